@@ -1343,7 +1343,6 @@ bool channel_guard::read_resource(const string &resource_name,
     printf("%s() error, line: %d: buffer size\n", __func__, __LINE__);
     return false;
   }
-  byte buf[n + 1];
   if (local_descriptor < 0 || local_descriptor >= descriptor_table_.num_) {
     printf("%s() error, line: %d: bad descriptor\n", __func__, __LINE__);
     return false;
@@ -1357,15 +1356,18 @@ bool channel_guard::read_resource(const string &resource_name,
            __LINE__);
     return false;
   }
+  // Read straight into out, n is caller controlled.
+  out->resize(n);
   int k = (int)::read(
       descriptor_table_.descriptor_entry_[local_descriptor].global_descriptor_,
-      buf,
+      (byte *)&(*out)[0],
       n);
   if (k < 0) {
     printf("%s() error, line: %d: read failed\n", __func__, __LINE__);
+    out->clear();
     return false;
   }
-  out->assign((char *)buf, k);
+  out->resize(k);
   return true;
 }
 
@@ -109,11 +109,8 @@ bool unix_tm_to_time_point(struct tm *the_time, time_point *tp);
 class random_source {
  public:
   bool initialized_;
-  bool have_rd_rand_;
-  int  fd_;
 
   random_source();
-  bool have_intel_rd_rand();
   bool start_random_source();
   int  get_random_bytes(int n, byte *b);
   bool close_random_source();
@@ -244,8 +244,12 @@ bool soft_Seal(spawned_children *kid, string in, string *out) {
   buffer_to_seal.assign(kid->measurement_.data(), kid->measurement_.size());
   buffer_to_seal.append(in.data(), in.size());
 
-  int  t_size = buffer_to_seal.size() + max_pad_size;
-  byte t_out[t_size];
+  // Payloads can be large now that they don't have to fit in a pipe.
+  int            t_size = buffer_to_seal.size() + max_pad_size;
+  scratch_buffer t_buf(t_size);
+  byte          *t_out = t_buf.data();
+  if (t_out == nullptr)
+    return false;
 
   byte iv[block_size];
   if (!get_random(8 * block_size, iv)) {
@@ -280,8 +284,11 @@ bool soft_Unseal(spawned_children *kid, string in, string *out) {
   printf("\n");
 #endif
 
-  int  t_size = in.size();
-  byte t_out[t_size];
+  int            t_size = in.size();
+  scratch_buffer t_buf(t_size);
+  byte          *t_out = t_buf.data();
+  if (t_out == nullptr)
+    return false;
 
   if (!authenticated_decrypt(trust_mgr->symmetric_key_algorithm_.c_str(),
                              (byte *)in.data(),
@@ -315,6 +322,104 @@ bool soft_Unseal(spawned_children *kid, string in, string *out) {
   return true;
 }
 
+// The batch versions look up the key once, draw every IV at once and
+// reuse one buffer, and put each result in rsp, in order.
+bool soft_Seal_batch(spawned_children   *kid,
+                     const app_request &req,
+                     app_response      *rsp) {
+  const char *alg = trust_mgr->symmetric_key_algorithm_.c_str();
+  byte       *key = trust_mgr->sealing_key_bytes_;
+  int         key_size = trust_mgr->max_symmetric_key_size_;
+  int         n = req.args_size();
+  if (n == 0)
+    return true;
+
+  int max_in = 0;
+  for (int i = 0; i < n; i++) {
+    if ((int)req.args(i).size() > max_in)
+      max_in = req.args(i).size();
+  }
+  scratch_buffer ivs(n * block_size);
+  scratch_buffer t_buf(kid->measurement_.size() + max_in + max_pad_size);
+  if (ivs.data() == nullptr || t_buf.data() == nullptr)
+    return false;
+  if (!get_random(8 * n * block_size, ivs.data()))
+    return false;
+
+  string buffer_to_seal;
+  buffer_to_seal.reserve(kid->measurement_.size() + max_in);
+  for (int i = 0; i < n; i++) {
+    buffer_to_seal.assign(kid->measurement_.data(), kid->measurement_.size());
+    buffer_to_seal.append(req.args(i));
+    int t_size = t_buf.size();
+    if (!authenticated_encrypt(alg,
+                               (byte *)buffer_to_seal.data(),
+                               buffer_to_seal.size(),
+                               key,
+                               key_size,
+                               ivs.data() + i * block_size,
+                               block_size,
+                               t_buf.data(),
+                               &t_size)) {
+      printf("%s() error, line %d, authenticated encrypt failed on item %d\n",
+             __func__,
+             __LINE__,
+             i);
+      return false;
+    }
+    rsp->add_args((char *)t_buf.data(), t_size);
+  }
+  return true;
+}
+
+bool soft_Unseal_batch(spawned_children   *kid,
+                       const app_request &req,
+                       app_response      *rsp) {
+  const char *alg = trust_mgr->symmetric_key_algorithm_.c_str();
+  byte       *key = trust_mgr->sealing_key_bytes_;
+  int         key_size = trust_mgr->max_symmetric_key_size_;
+  int         n = req.args_size();
+  int         m_size = kid->measurement_.size();
+  if (n == 0)
+    return true;
+
+  int max_in = 0;
+  for (int i = 0; i < n; i++) {
+    if ((int)req.args(i).size() > max_in)
+      max_in = req.args(i).size();
+  }
+  scratch_buffer t_buf(max_in);
+  if (t_buf.data() == nullptr)
+    return false;
+
+  for (int i = 0; i < n; i++) {
+    int t_size = t_buf.size();
+    if (!authenticated_decrypt(alg,
+                               (byte *)req.args(i).data(),
+                               req.args(i).size(),
+                               key,
+                               key_size,
+                               t_buf.data(),
+                               &t_size)) {
+      printf("%s() error, line %d, authenticated decrypt failed on item %d\n",
+             __func__,
+             __LINE__,
+             i);
+      return false;
+    }
+    if (t_size < m_size
+        || memcmp(t_buf.data(), kid->measurement_.data(), m_size) != 0) {
+      printf("%s() error, line %d, mis-matched measurements on item %d\n",
+             __func__,
+             __LINE__,
+             i);
+      return false;
+    }
+    rsp->add_args((char *)t_buf.data() + m_size, t_size - m_size);
+  }
+  return true;
+}
+
 bool soft_Attest(spawned_children *kid, string in, string *out) {
 #ifdef DEBUG
   printf("soft_Attest\n");
@@ -418,23 +523,27 @@ bool soft_Getmeasurement(spawned_children *kid, string *out) {
   return true;
 }
 
-void app_service_loop(spawned_children *kid, int read_fd, int write_fd) {
+// The loop owns transport and deletes it when the child goes away.
+void app_service_loop(spawned_children *kid, app_transport *transport) {
   bool continue_loop = true;
 
 #ifdef DEBUG
   printf("[%d] Application Service loop: read_fd=%d write_fd=%d\n",
          __LINE__,
-         read_fd,
-         write_fd);
+         transport->read_fd_,
+         transport->write_fd_);
 #endif
   while (continue_loop) {
-    bool   succeeded = false;
-    string in;
-    string out;
-    string str_app_req;
-    int    n = sized_pipe_read(read_fd, &str_app_req);
-    if (n <= 0) {
-      continue;
+    bool         succeeded = false;
+    bool         switch_to_rings = false;
+    bool         batch = false;
+    string       in;
+    string       out;
+    string       str_app_req;
+    app_response rsp;
+    int          n = transport->read_message(&str_app_req);
+    if (n < 0) {
+      break;
     }
     app_request req;
     if (!req.ParseFromString(str_app_req)) {
@@ -449,6 +558,12 @@ void app_service_loop(spawned_children *kid, int read_fd, int write_fd) {
     } else if (req.function() == "unseal") {
       in = req.args(0);
       succeeded = soft_Unseal(kid, in, &out);
+    } else if (req.function() == "seal_batch") {
+      batch = true;
+      succeeded = soft_Seal_batch(kid, req, &rsp);
+    } else if (req.function() == "unseal_batch") {
+      batch = true;
+      succeeded = soft_Unseal_batch(kid, req, &rsp);
     } else if (req.function() == "attest") {
       in = req.args(0);
       succeeded = soft_Attest(kid, in, &out);
@@ -458,6 +573,10 @@ void app_service_loop(spawned_children *kid, int read_fd, int write_fd) {
       succeeded = soft_GetPlatformStatement(kid, &out);
     } else if (req.function() == "getcerts") {
       succeeded = soft_GetParentEvidence(kid, &out);
+    } else if (req.function() == "gettransport") {
+      // The offer goes back on the pipes, then both ends switch.
+      switch_to_rings = transport->offer_rings(&rsp);
+      succeeded = switch_to_rings;
     }
 
 finishreq:
@@ -467,42 +586,52 @@ finishreq:
     else
       printf("Service response: failed\n");
 #endif
-    app_response rsp;
-    string       str_app_rsp;
+    string str_app_rsp;
     rsp.set_function(req.function());
+    if (req.has_request_id())
+      rsp.set_request_id(req.request_id());
 
     if (succeeded) {
       rsp.set_status("succeeded");
-      rsp.add_args(out);
+      if (!switch_to_rings && !batch)
+        rsp.add_args(out);
     } else {
       rsp.set_status("failed");
+      rsp.clear_args();
     }
     if (!rsp.SerializeToString(&str_app_rsp)) {
       printf("%s() error, line %d, Can't serialize response\n",
              __func__,
              __LINE__);
     }
-    if (write(write_fd, (byte *)str_app_rsp.data(), str_app_rsp.size())
-        < (int)str_app_rsp.size()) {
+    if (transport->write_message(str_app_rsp.size(), (byte *)str_app_rsp.data())
+        < 0) {
       printf("Response write failed\n");
     }
+    if (switch_to_rings && !transport->start_rings()) {
+      printf("%s() error, line %d, Can't switch to rings\n",
+             __func__,
+             __LINE__);
+      break;
+    }
 
 #ifdef DEBUG
     printf("Service loop: ended\n");
 #endif
   }
+  delete transport;
 }
 
-bool start_app_service_loop(spawned_children *kid, int read_fd, int write_fd) {
+bool start_app_service_loop(spawned_children *kid, app_transport *transport) {
 #ifdef DEBUG
   printf("\n[%d] %s\n", __LINE__, __func__);
 #endif
 #ifndef NOTHREAD
-  std::thread *t = new std::thread(app_service_loop, kid, read_fd, write_fd);
+  std::thread *t = new std::thread(app_service_loop, kid, transport);
   kid->thread_obj_ = t;
   t->detach();
 #else
-  app_service_loop(kid, read_fd, write_fd);
+  app_service_loop(kid, transport);
 #endif
   return true;
 }
@@ -565,14 +694,15 @@ bool process_run_request(run_request &req) {
   }
 #endif
 
+  // Plain byte-stream pipes, sized frames don't survive packet mode.
   int fd1[2];
-  if (pipe2(fd1, O_DIRECT) < 0) {
+  if (pipe(fd1) < 0) {
     printf("%s() error, line %d, Pipe 1 failed\n", __func__, __LINE__);
     return false;
   }
 
   int fd2[2];
-  if (pipe2(fd2, O_DIRECT) < 0) {
+  if (pipe(fd2) < 0) {
     printf("%s() error, line %d, Pipe 2 failed\n", __func__, __LINE__);
     return false;
   }
@@ -583,6 +713,15 @@ bool process_run_request(run_request &req) {
   int child_read_fd = fd1[0];
   int child_write_fd = fd2[1];
 
+  // Shared rings are optional, the child falls back to the pipes.
+  app_transport *transport = new app_transport();
+  transport->init_pipes(parent_read_fd, parent_write_fd);
+  if (!transport->create_rings(app_transport::default_ring_size)) {
+    printf("%s() error, line %d, No shared rings, using pipes\n",
+           __func__,
+           __LINE__);
+  }
+
 #ifdef DEBUG
   printf("pipes made: fds[]:"
          "  parent_read_fd = %d, parent_write_fd = %d,"
@@ -601,10 +740,12 @@ bool process_run_request(run_request &req) {
     close(fd1[1]);
     close(fd2[0]);
     close(fd2[1]);
+    delete transport;
     return false;
   } else if (pid == 0) {  // child
     close(parent_read_fd);
     close(parent_write_fd);
+    transport->inherit_rings();
 
     // Change process owner
     struct passwd *ent = getpwnam(FLAGS_guest_login_name.c_str());
@@ -683,6 +824,7 @@ bool process_run_request(run_request &req) {
     spawned_children *nk = new_kid();
     if (nk == nullptr) {
       printf("%s() error, line %d, Can't add kid\n", __func__, __LINE__);
+      delete transport;
       return false;
     }
     nk->location_ = req.location();
@@ -692,7 +834,7 @@ bool process_run_request(run_request &req) {
     nk->parent_read_fd_ = parent_read_fd;
     nk->parent_write_fd_ = parent_write_fd;
     nk->valid_ = true;
-    if (!start_app_service_loop(nk, parent_read_fd, parent_write_fd)) {
+    if (!start_app_service_loop(nk, transport)) {
       printf("%s() error, line %d, Couldn't start service loop\n",
              __func__,
              __LINE__);
@@ -20,6 +20,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -46,11 +47,124 @@ using std::string;
 #ifndef _APPLICATION_ENCLAVE_H__
 #  define _APPLICATION_ENCLAVE_H__
 
+// The shared memory transport needs memfd and eventfd; SDK enclave
+// builds only have the pipes.
+#  if !defined(OE_CERTIFIER) && !defined(KEYSTONE_CERTIFIER)
+#    define APPLICATION_SHARED_RING
+#    include <atomic>
+#  endif
+
+#  ifdef APPLICATION_SHARED_RING
+// Single producer, single consumer ring of sized frames (as in
+// sized_pipe_write) in memory shared by app_service and a child.  The
+// producer rings data_fd_ only when the consumer is waiting for bytes and
+// the consumer rings space_fd_ only when the producer is waiting for room,
+// so a busy ring makes no system calls.  Frames larger than the ring
+// stream through it.
+class shared_ring {
+ public:
+  class ring_header {
+   public:
+    std::atomic<uint64_t> head_;  // total bytes written
+    char                  pad1_[56];
+    std::atomic<uint64_t> tail_;  // total bytes read
+    char                  pad2_[56];
+    std::atomic<uint32_t> reader_waiting_;
+    std::atomic<uint32_t> writer_waiting_;
+    std::atomic<uint32_t> closed_;
+    uint32_t              size_;
+  };
+  static const int header_size = 4096;
+
+  ring_header *hdr_;
+  byte        *data_;
+  uint64_t     size_;
+  int          data_fd_;
+  int          space_fd_;
+  // Readable or hung up once the other process has gone away.
+  int peer_fd_;
+
+  shared_ring();
+
+  // base is header_size + ring_size bytes, ring_size a power of 2.
+  bool attach(byte *base,
+              int   ring_size,
+              int   data_fd,
+              int   space_fd,
+              int   peer_fd,
+              bool  init);
+  int  write_message(int size, byte *buf);
+  int  read_message(string *out);
+  void close();
+
+ private:
+  // Bytes to read (for_data) or room to write, from one load of each
+  // index.  False, after closing the ring, if the indices are corrupt.
+  bool available(bool for_data, uint64_t *head, uint64_t *tail, uint64_t *n);
+  bool wait_for(bool for_data, uint64_t need);
+  void     ring_bell(int fd, std::atomic<uint32_t> &waiting);
+  // Without bell the reader isn't woken for these bytes.
+  bool put(const byte *buf, int size, bool bell);
+  bool get(byte *buf, int size);
+};
+#  endif  // APPLICATION_SHARED_RING
+
+// Request/response transport between app_service and a child.  Starts on
+// the pipes; the parent prepares shared rings before fork and offers them
+// when the child asks (application_Init does), otherwise the pipes stay.
+class app_transport {
+ public:
+  enum { NUM_RING_FDS = 5 };
+  static const int default_ring_size = 1 << 20;
+
+  int  read_fd_;
+  int  write_fd_;
+  bool use_ring_;
+#  ifdef APPLICATION_SHARED_RING
+  // memfd, then the data and space doorbells of each direction.
+  int         ring_fds_[NUM_RING_FDS];
+  int         ring_size_;
+  byte       *map_;
+  size_t      map_size_;
+  shared_ring rx_;
+  shared_ring tx_;
+#  endif
+
+  app_transport();
+  ~app_transport();
+
+  bool init_pipes(int read_fd, int write_fd);
+
+  // Parent, before fork: make and map the rings.
+  bool create_rings(int ring_size);
+  // Child, between fork and exec: keep the ring fds across exec.
+  bool inherit_rings();
+  // Parent: describe the rings in the "gettransport" response; call
+  // start_rings once the response is on the pipe.
+  bool offer_rings(app_response *rsp);
+  bool start_rings();
+  // Child: ask for rings over the pipes and switch to them if offered.
+  bool request_rings();
+  bool accept_rings(const app_response &rsp);
+
+  int  write_message(int size, byte *buf);
+  int  read_message(string *out);
+  void close_rings();
+
+ private:
+  bool map_rings(bool init);
+};
+
 bool application_Init(const string &parent_enclave_type,
                       int           read_fd,
                       int           write_fd);
 bool application_Seal(int in_size, byte *in, int *size_out, byte *out);
 bool application_Unseal(int in_size, byte *in, int *size_out, byte *out);
+// One round trip, and one key lookup in app_service, for many items.
+bool application_Seal_batch(const std::vector<string> &in,
+                            std::vector<string>       *out);
+bool application_Unseal_batch(const std::vector<string> &in,
+                              std::vector<string>       *out);
 bool application_Attest(int   what_to_say_size,
                         byte *what_to_say,
                         int  *size_out,
@@ -0,0 +1,185 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _CC_METRICS_H__
+#define _CC_METRICS_H__
+
+// Metrics and tracing
+// -------------------------------------------------------------------
+//
+// A small registry of counters and latency histograms used to see where
+// time goes in attestation, certification, sealing, store I/O and the
+// secure channel.  Updates are lock-free (relaxed atomics); registration
+// happens once per call site and is the only place a lock is taken.
+//
+// Instrument code with the macros below, not the classes directly, so
+// the instrumentation disappears when the library is built with
+// -D NO_CERTIFIER_METRICS.  SDK enclave builds (OE, Keystone) get that
+// by default.
+
+#if defined(OE_CERTIFIER) || defined(KEYSTONE_CERTIFIER)
+#  ifndef NO_CERTIFIER_METRICS
+#    define NO_CERTIFIER_METRICS
+#  endif
+#endif
+
+#ifndef NO_CERTIFIER_METRICS
+
+#  include <stdint.h>
+#  include <atomic>
+#  include <chrono>
+#  include <string>
+
+using std::string;
+
+namespace certifier {
+namespace utilities {
+
+class metric_counter {
+ public:
+  string                name_;
+  string                help_;
+  std::atomic<uint64_t> value_;
+
+  metric_counter(const string &name, const string &help);
+
+  void     add(uint64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() { return value_.load(std::memory_order_relaxed); }
+};
+
+class metric_histogram {
+ public:
+  // Upper bounds of the buckets, in seconds; the last bucket is +Inf.
+  static const int    num_bounds_ = 14;
+  static const double bounds_[num_bounds_];
+
+  string                name_;
+  string                help_;
+  std::atomic<uint64_t> buckets_[num_bounds_ + 1];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_ns_;
+
+  metric_histogram(const string &name, const string &help);
+
+  void     observe_ns(uint64_t ns);
+  uint64_t count() { return count_.load(std::memory_order_relaxed); }
+  uint64_t sum_ns() { return sum_ns_.load(std::memory_order_relaxed); }
+};
+
+class metrics_registry {
+ public:
+  enum { MAX_NUM_METRICS = 128 };
+
+  std::atomic<int>  num_counters_;
+  metric_counter   *counters_[MAX_NUM_METRICS];
+  std::atomic<int>  num_histograms_;
+  metric_histogram *histograms_[MAX_NUM_METRICS];
+
+  metrics_registry();
+  ~metrics_registry();
+
+  static metrics_registry *get();
+
+  // Returns the existing metric if one with this name is registered.
+  metric_counter   *counter(const string &name, const string &help);
+  metric_histogram *histogram(const string &name, const string &help);
+
+  metric_counter   *find_counter(const string &name);
+  metric_histogram *find_histogram(const string &name);
+
+  // Zeroes all values, registrations are kept.
+  void reset();
+
+  // Prometheus text exposition format, version 0.0.4.
+  bool prometheus_text(string *out);
+};
+
+// Records the time from construction to end() (or destruction) into h.
+class metric_span {
+ public:
+  metric_histogram                     *h_;
+  std::chrono::steady_clock::time_point start_;
+  bool                                  ended_;
+
+  metric_span(metric_histogram *h);
+  ~metric_span();
+
+  void end();
+};
+
+// Exporters
+// -------------------------------------------------------------------
+
+class metrics_exporter {
+ public:
+  virtual ~metrics_exporter() {}
+  virtual bool export_text(const string &text) = 0;
+};
+
+// Writes to file_name atomically (via a temporary and rename), suitable
+// for the node_exporter textfile collector.
+class prometheus_file_exporter : public metrics_exporter {
+ public:
+  string file_name_;
+
+  prometheus_file_exporter(const string &file_name);
+  bool export_text(const string &text);
+};
+
+// Connects to host:port and writes the exposition text on each export.
+class prometheus_socket_exporter : public metrics_exporter {
+ public:
+  string host_name_;
+  int    port_;
+
+  prometheus_socket_exporter(const string &host_name, int port);
+  bool export_text(const string &text);
+};
+
+bool export_metrics(metrics_exporter *exporter);
+
+}  // namespace utilities
+}  // namespace certifier
+
+#  define CC_METRICS_CAT_(a, b) a##b
+#  define CC_METRICS_CAT(a, b)  CC_METRICS_CAT_(a, b)
+
+// Times the rest of the enclosing scope (or until CC_METRICS_SPAN_END).
+#  define CC_METRICS_SPAN(var, name, help)                                     \
+    static certifier::utilities::metric_histogram *CC_METRICS_CAT(var,        \
+                                                                  _hist) =    \
+        certifier::utilities::metrics_registry::get()->histogram(name, help); \
+    certifier::utilities::metric_span var(CC_METRICS_CAT(var, _hist))
+
+#  define CC_METRICS_SPAN_END(var) var.end()
+
+#  define CC_METRICS_COUNT(name, help, n)                                      \
+    do {                                                                       \
+      static certifier::utilities::metric_counter *cc_metrics_ctr =            \
+          certifier::utilities::metrics_registry::get()->counter(name, help);  \
+      cc_metrics_ctr->add(n);                                                  \
+    } while (0)
+
+#else  // NO_CERTIFIER_METRICS
+
+#  define CC_METRICS_SPAN(var, name, help)
+#  define CC_METRICS_SPAN_END(var)
+#  define CC_METRICS_COUNT(name, help, n)                                      \
+    do {                                                                       \
+    } while (0)
+
+#endif  // NO_CERTIFIER_METRICS
+
+#endif  // _CC_METRICS_H__
@@ -23,6 +23,9 @@
 
 #include <string>
 #include <memory>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -216,10 +219,82 @@ bool get_platform_from_sev_attest(const sev_attestation_message &sev_att,
                                   entity_message                *ent);
 bool get_measurement_from_sev_attest(const sev_attestation_message &sev_att,
                                      entity_message                *ent);
+
+// An index over a policy of "policy-key says ..." claims, parsed once.
+// Measurement claims are found by measurement.  Platform claims are
+// grouped by platform type and by the names and comparators of their
+// properties, then by the values of their "=" properties, so only claims
+// that could be satisfied are compared.
+class policy_index {
+ public:
+  policy_index();
+
+  bool build(const key_message &policy_pk, const signed_claim_sequence &policy);
+
+  // True if built from this key and a policy with the same claim
+  // signatures, so there's no need to rebuild.
+  bool built_from(const key_message           &policy_pk,
+                  const signed_claim_sequence &policy) const;
+
+  // Keeps, in policy order, every claim that is neither a measurement
+  // nor a platform claim, the first claim trusting measurement and the
+  // first platform claim plat satisfies.  False if either is missing.
+  bool filter(const string          &measurement,
+              const platform        &plat,
+              signed_claim_sequence *filtered_policy) const;
+
+  int num_claims() const { return policy_.claims_size(); }
+
+ private:
+  class platform_group {
+   public:
+    std::vector<string>                          names_;     // all properties
+    std::vector<string>                          eq_names_;  // "=" properties
+    std::unordered_map<string, std::vector<int>> by_values_;
+  };
+
+  bool                            built_;
+  key_message                     policy_pk_;
+  signed_claim_sequence           policy_;
+  std::vector<int>                other_claims_;
+  std::unordered_map<string, int> measurements_;
+  std::vector<platform>           platforms_;
+  std::vector<int>                platform_claims_;
+
+  // By platform type, then by property names and comparators.
+  std::map<string, std::map<string, platform_group>> platform_groups_;
+};
+
+// The claims of a trusted platform list ("policy-key says key
+// is-trusted[-for-attestation]") by the fingerprint of the trusted key,
+// each fingerprint computed once when the index is built.
+class trusted_key_index {
+ public:
+  trusted_key_index();
+
+  bool build(const signed_claim_sequence &trusted);
+
+  // True if built from a list with the same claim signatures.
+  bool built_from(const signed_claim_sequence &trusted) const;
+
+  // The claim in trusted for k, or -1.  The claim found when the index
+  // was built is returned only if it is still in trusted at the same
+  // place, so a stale index can miss but never gives a wrong claim.
+  int find(const signed_claim_sequence &trusted, const key_message &k) const;
+
+ private:
+  bool                            built_;
+  std::vector<string>             signatures_;
+  std::unordered_map<string, int> by_fingerprint_;
+};
+
 bool filter_sev_policy(const sev_attestation_message &sev_att,
                        const key_message             &policy_pk,
                        const signed_claim_sequence   &policy,
                        signed_claim_sequence         *filtered_policy);
+bool filter_sev_policy(const sev_attestation_message &sev_att,
+                       const policy_index            &index,
+                       signed_claim_sequence         *filtered_policy);
 bool init_policy(signed_claim_sequence &policy,
                  key_message           &policy_pk,
                  proved_statements     *already_proved);
@@ -17,6 +17,16 @@
 #define _CERTIFIER_FRAMEWORK_H__
 
 #include <string>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <atomic>
+#ifndef OE_CERTIFIER
+#  include <chrono>
+#  include <condition_variable>
+#  include <map>
+#  include <mutex>
+#endif
 #include <openssl/ssl.h>
 #include <openssl/rsa.h>
 #include <openssl/x509.h>
@@ -43,6 +53,10 @@ class store_entry {
   string tag_;
   string type_;
   string value_;
+  // After Deserialize the value stays in the store's serialized form
+  // until it is first read; value_offset_ is -1 once it is in value_.
+  int value_offset_;
+  int value_size_;
 
   store_entry();
   ~store_entry();
@@ -57,10 +71,16 @@ class store_entry {
 class policy_store {
  public:
   enum { MAX_NUM_ENTRIES = 500 };
+  // Deserialize rejects stores claiming more entries than this.
+  enum { MAX_NUM_ENTRIES_LIMIT = 100000 };
 
   unsigned      max_num_ents_;
   unsigned      num_ents_;
   store_entry **entry_;
+  // The plaintext Deserialize indexed, kept (and wiped when dropped)
+  // until every value in it has been read, replaced or deleted.
+  string   serialized_;
+  unsigned num_undecoded_;
 
  public:
   policy_store(unsigned max_ents);
@@ -68,13 +88,20 @@ class policy_store {
   ~policy_store();
 
  private:
-  bool add_entry(const string &tag, const string &type, const string &value);
+  bool         add_entry(const string &tag,
+                         const string &type,
+                         const string &value);
+  store_entry *decoded(unsigned ent);
+  void         drop_value(store_entry *se);
+  void         clear_entries();
+  bool         index_serialized();
 
  public:
   unsigned      get_num_entries();
   int           find_entry(const string &tag, const string &type);
   const string *tag(unsigned ent);
   const string *type(unsigned ent);
+  const string *value(unsigned ent);
   store_entry  *get_entry(unsigned ent);
   bool          delete_entry(unsigned ent);
   bool          get(unsigned ent, string *v);
@@ -85,6 +112,8 @@ class policy_store {
   void          print();
   bool          Serialize(string *psout);
   bool          Deserialize(string &in);
+  // Like Deserialize, but takes over the contents of *in.
+  bool          Deserialize_from(string *in);
 };
 
 // Trusted primitives
@@ -104,6 +133,17 @@ bool Unseal(const string &enclave_type,
             int          *size_out,
             byte         *out);
 
+// Seal or Unseal each item of in, results in order in out.
+bool Seal_batch(const string              &enclave_type,
+                const string              &enclave_id,
+                const std::vector<string> &in,
+                std::vector<string>       *out);
+
+bool Unseal_batch(const string              &enclave_type,
+                  const string              &enclave_id,
+                  const std::vector<string> &in,
+                  std::vector<string>       *out);
+
 bool Attest(const string &enclave_type,
             int           what_to_say_size,
             byte         *what_to_say,
@@ -134,6 +174,21 @@ bool reprotect_blob(const string &enclave_type,
                     int          *size_new_encrypted_blob,
                     byte         *data);
 
+// Key pregeneration
+// -------------------------------------------------------------------
+
+// A background thread keeps up to depth private keys of each started
+// public key algorithm ready, so cold_init and key rotation don't wait
+// for key generation.  Ready keys are held encrypted under a random key
+// that never leaves the process.  OE and Keystone builds (and
+// -D NO_KEY_POOL) have no pool and always generate.
+bool start_key_pregeneration(const string &public_key_alg, int depth);
+void stop_key_pregeneration();
+int  num_pregenerated_keys(const string &public_key_alg);
+
+// A ready key if there is one, otherwise a newly generated one.
+bool new_private_key(const string &public_key_alg, key_message *k);
+
 class domain_info {
  public:
   string domain_name_;
@@ -144,12 +199,14 @@ class domain_info {
   int    service_port_;
 };
 
-const int max_accerlerators = 4;
+// Initial size of the accelerator table; it grows as needed.
+const int initial_num_accelerators = 4;
 class accelerator {
  public:
   accelerator();
   ~accelerator();
   string  accelerator_type_;
+  string  accelerator_id_;
   bool    verified_;
   string  location_type_;  // in-memory, network, file
   string  file_name;
@@ -159,14 +216,29 @@ class accelerator {
   int     num_certs_;
   string *certs_;
   string  measurement_;
+
+  // Sent as an accelerator_group when certifying.
+  evidence_package support_;
 };
 
 class certifiers;
+class cc_trust_manager;
+class recertifier;
+class server_credentials;
+
+// Called after a domain's admissions cert has been renewed and the store
+// saved.
+typedef void (*recertified_callback)(cc_trust_manager &mgr,
+                                     const string     &domain_name,
+                                     const string     &admissions_cert,
+                                     void             *arg);
 
 class cc_trust_manager {
 
  private:
-  void cc_trust_manager_default_init();
+  void         cc_trust_manager_default_init();
+  accelerator *new_accelerator();
+  recertifier *recertifier_;
 
  public:
   // Python swig bindings need this to be public, to size other array decls
@@ -180,9 +252,15 @@ class cc_trust_manager {
   string public_key_algorithm_;
   string symmetric_key_algorithm_;
 
-  int         num_accelerators_;
-  accelerator accelerators_[max_accerlerators];
+  int           max_num_accelerators_;
+  int           num_accelerators_;
+  accelerator **accelerators_;
   bool add_accelerator(const string &acc_type, int num_certs, string *certs);
+  bool add_accelerator_evidence(const string           &acc_type,
+                                const string           &acc_id,
+                                const evidence_package &support,
+                                bool                    verified);
+  // True if there are accelerators of this type and all were verified.
   bool accelerator_verified(const string &acc_type);
 
   // For primary security domain only
@@ -337,6 +415,36 @@ class cc_trust_manager {
   bool get_certifiers_from_store();
   bool put_certifiers_in_store();
   bool write_private_key_to_file(const string &filename);
+
+  // Background re-certification.  A thread renews the admissions cert of
+  // each certified domain, with certify_domain, at a random point between
+  // renew_from and renew_to of the cert's lifetime, so a fleet certified
+  // together doesn't all come back at once.  A failed renewal is retried
+  // after retry_seconds.  While it runs, read admissions certs with
+  // get_admissions_cert.  OE and Keystone builds have no thread and
+  // can't start it.
+  bool start_recertification(double renew_from = 0.5,
+                             double renew_to = 0.75,
+                             int    retry_seconds = 60);
+  void stop_recertification();
+  // callback runs on the renewal thread; it may call get_admissions_cert.
+  bool add_recertified_callback(recertified_callback callback, void *arg);
+  int  num_recertifications();
+  bool get_admissions_cert(const string &domain_name, string *cert);
+
+  // The trust data lock.  The methods above that read or change the
+  // domains, keys or store take it, as does the renewal thread while it
+  // installs a renewed cert and saves the store.  It is recursive.  An
+  // application reading these members directly while renewal runs
+  // should hold it.  A no-op in OE and Keystone builds.
+  void lock_trust_data() const;
+  void unlock_trust_data() const;
+
+  // Loads creds from the policy cert, auth key and primary admissions
+  // cert, and reloads them whenever the primary domain is recertified.
+  // After rotating the auth key, call creds->update(*this) once it is
+  // certified.
+  bool keep_server_credentials(server_credentials *creds);
 };
 
 // Certification Anchors
@@ -370,9 +478,34 @@ class certifiers {
 
   bool get_certified_status();
   bool certify_domain(const string &purpose);
+
+  // certify_domain in two steps.  request_certification attests and
+  // asks the Certifier Service, holding the owner's trust data lock only
+  // while it reads the keys; accept_certification stores the result and
+  // saves the store under the lock.
+  bool request_certification(const string           &purpose,
+                             trust_response_message *response);
+  bool accept_certification(const string                 &purpose,
+                            const trust_response_message &response);
   void print_certifiers_entry();
 };
 
+class secure_authenticated_channel;
+class channel_reactor;
+
+// Completion callbacks for non-blocking channels.  ok is false if the
+// channel failed or was closed before the operation completed.
+typedef void (*channel_ready_callback)(secure_authenticated_channel &channel,
+                                       bool                          ok,
+                                       void                         *arg);
+typedef void (*message_read_callback)(secure_authenticated_channel &channel,
+                                      bool                          ok,
+                                      const string                 &msg,
+                                      void                         *arg);
+typedef void (*message_written_callback)(secure_authenticated_channel &channel,
+                                         bool                          ok,
+                                         void                         *arg);
+
 class secure_authenticated_channel {
  public:
   string          role_;
@@ -456,8 +589,193 @@ class secure_authenticated_channel {
   int  write(int size, byte *b);
   void close();
   bool get_peer_id(string *out_peer_id);
+
+#if !defined(OE_CERTIFIER) && !defined(SWIG)
+  // Non-blocking mode
+  // -----------------------------------------------------------------
+  //
+  // The socket is O_NONBLOCK and the channel is driven by a
+  // channel_reactor; SSL_ERROR_WANT_READ/WANT_WRITE just wait for the
+  // next epoll event.  Messages use the same 4-byte size prefix as
+  // read(string *)/write so either end may be blocking.  All callbacks
+  // run on the reactor thread and may issue further async calls,
+  // including close().  Not exposed to the Python bindings.
+  enum {
+    ASYNC_NONE = 0,
+    ASYNC_ACCEPTING = 1,
+    ASYNC_CONNECTING = 2,
+    ASYNC_OPEN = 3,
+    ASYNC_CLOSED = 4,
+  };
+
+  struct pending_write {
+    uint64_t                 end_;  // tx_queued_ after this message
+    message_written_callback cb_;
+    void                    *arg_;
+  };
+
+  channel_reactor          *reactor_;
+  int                       async_state_;
+  bool                      reactor_owned_;  // reactor deletes on close
+  bool                      want_write_;     // handshake wants EPOLLOUT
+  bool                      epoll_in_;       // EPOLLIN is registered
+  bool                      epoll_out_;      // EPOLLOUT is registered
+  bool                      scheduled_;      // on the reactor ready list
+  bool                      in_handler_;
+  bool                      failed_;
+  bool                      closing_;  // close() once tx_buf_ drains
+  channel_ready_callback    ready_cb_;
+  void                     *ready_arg_;
+  message_read_callback     read_cb_;
+  void                     *read_arg_;
+  // Unread bytes are capped at one maximum size frame; past that the
+  // channel stops reading until delivery makes room.
+  string                    rx_buf_;
+  size_t                    rx_off_;
+  string                    tx_buf_;
+  size_t                    tx_off_;
+  uint64_t                  tx_queued_;
+  uint64_t                  tx_written_;
+  std::deque<pending_write> pending_writes_;
+
+  // Server side: takes ownership of fd and runs SSL_accept on an SSL
+  // made from ctx.  cb runs once the handshake completes or fails.
+  bool async_accept(channel_reactor       *r,
+                    SSL_CTX               *ctx,
+                    int                    fd,
+                    channel_ready_callback cb,
+                    void                  *arg);
+
+  // Client side: fd must be a connected socket.
+  bool async_connect(channel_reactor       *r,
+                     SSL_CTX               *ctx,
+                     int                    fd,
+                     channel_ready_callback cb,
+                     void                  *arg);
+
+  // Moves a channel set up by init_client_ssl (or accepted by
+  // server_dispatch) into non-blocking mode.
+  bool set_non_blocking(channel_reactor *r);
+
+  // Delivers the next message to cb, once.  Call again from cb to keep
+  // reading.  Only one read may be outstanding.
+  bool async_read_message(message_read_callback cb, void *arg);
+
+  // Queues a framed message; cb (may be null) runs when it has been
+  // handed to TLS.
+  bool async_write_message(int                      size,
+                           byte                    *b,
+                           message_written_callback cb,
+                           void                    *arg);
+  bool async_write_message(const string            &msg,
+                           message_written_callback cb,
+                           void                    *arg);
+
+  // Internal, called by the reactor.
+  void handle_events(bool readable, bool writable);
+  void async_fail();
+  bool start_async(channel_reactor *r, int fd);
+  bool continue_handshake();
+  bool fill_rx();
+  bool flush_tx();
+  void deliver_messages();
+  void complete_writes();
+  void update_interest();
+#endif  // !OE_CERTIFIER && !SWIG
 };
 
+#if !defined(OE_CERTIFIER) && !defined(SWIG)
+// Channel reactor
+// -------------------------------------------------------------------
+//
+// A level-triggered epoll loop over non-blocking channels and listening
+// sockets.  One thread calls run() (or run_once()); other threads may
+// only call stop().
+class channel_reactor {
+ public:
+  struct listener {
+    int                    sock_;
+    SSL_CTX               *ctx_;
+    channel_ready_callback cb_;
+    void                  *arg_;
+  };
+
+  int                                         epoll_fd_;
+  int                                         wake_fd_;
+  std::atomic<bool>                           stop_;
+  int                                         num_channels_;
+  std::vector<secure_authenticated_channel *> channels_;  // indexed by fd
+  std::vector<listener>                       listeners_;
+  std::vector<secure_authenticated_channel *> ready_;
+  std::vector<secure_authenticated_channel *> to_delete_;
+
+  channel_reactor();
+  ~channel_reactor();
+
+  bool init();
+
+  // Accepted connections get a reactor owned channel which is deleted
+  // after it closes; cb runs when its handshake completes.  The reactor
+  // frees ctx.
+  bool add_listener(int                    sock,
+                    SSL_CTX               *ctx,
+                    channel_ready_callback cb,
+                    void                  *arg);
+
+  bool add_channel(secure_authenticated_channel *c);
+  bool modify_channel(secure_authenticated_channel *c,
+                      bool                          want_read,
+                      bool                          want_write);
+  void remove_channel(secure_authenticated_channel *c);
+
+  // Runs c->handle_events() on the next loop iteration, so callbacks
+  // never run inside the async call that triggered them.
+  void schedule(secure_authenticated_channel *c);
+
+  // Returns the number of events handled, -1 on error.
+  int  run_once(int timeout_ms);
+  bool run();
+  void stop();
+
+  void accept_connections(listener &l);
+};
+
+// Non-blocking counterpart of server_dispatch: listens on host_name:port
+// and hands each authenticated channel to func from the reactor thread.
+// async_server_listen returns after the listener is registered;
+// async_server_dispatch also runs r until r->stop().
+bool async_server_listen(const string          &host_name,
+                         int                    port,
+                         const string          &asn1_root_cert,
+                         const string          &asn1_peer_root_cert,
+                         int                    num_certs,
+                         string                *cert_chain,
+                         key_message           &private_key,
+                         const string          &private_key_cert,
+                         channel_reactor       *r,
+                         channel_ready_callback func,
+                         void                  *arg);
+
+bool async_server_dispatch(const string          &host_name,
+                           int                    port,
+                           const string          &asn1_root_cert,
+                           const string          &asn1_peer_root_cert,
+                           int                    num_certs,
+                           string                *cert_chain,
+                           key_message           &private_key,
+                           const string          &private_key_cert,
+                           channel_reactor       *r,
+                           channel_ready_callback func,
+                           void                  *arg);
+
+bool async_server_dispatch(const string           &host_name,
+                           int                     port,
+                           const cc_trust_manager &mgr,
+                           channel_reactor        *r,
+                           channel_ready_callback  func,
+                           void                   *arg);
+#endif  // !OE_CERTIFIER && !SWIG
+
 bool server_dispatch(const string &host_name,
                      int           port,
                      const string &asn1_root_cert,
@@ -480,6 +798,127 @@ bool server_dispatch(const string           &host_name,
                      const cc_trust_manager &mgr,
                      void (*)(secure_authenticated_channel &));
 
+#ifndef SWIG
+// The keys and certs a server presents, with the SSL_CTX made from them.
+// Never changed once made; server_credentials replaces it whole.
+class server_credential_set {
+ public:
+  SSL_CTX            *ctx_;
+  bool                has_chain_;
+  string              asn1_root_cert_;
+  string              asn1_peer_root_cert_;
+  std::vector<string> cert_chain_;
+  key_message         private_key_;
+  string              private_key_cert_;
+
+  server_credential_set();
+  ~server_credential_set();
+
+  // Makes ctx_ from the rest, as server_dispatch always has.
+  bool init_ctx();
+};
+
+// Credentials a running server can swap.  Each handshake takes the set
+// current when it starts; an SSL holds a reference to its SSL_CTX, so
+// channels already open finish on the set they started with.  A failed
+// update leaves the current set in place.  Thread safe.
+class server_credentials {
+ public:
+  bool update(const string &asn1_root_cert,
+              const string &asn1_peer_root_cert,
+              int           num_certs,
+              string       *cert_chain,
+              key_message  &private_key,
+              const string &private_key_cert);
+  bool update(const string &asn1_root_cert,
+              key_message  &private_key,
+              const string &private_key_cert);
+  bool update(cc_trust_manager &mgr);
+
+  std::shared_ptr<const server_credential_set> current() const;
+
+ private:
+  std::shared_ptr<const server_credential_set> current_;
+
+  bool install(server_credential_set *set);
+};
+
+// As server_dispatch above, but new connections use whatever creds are
+// current.
+bool server_dispatch(const string       &host_name,
+                     int                 port,
+                     server_credentials &creds,
+                     void (*)(secure_authenticated_channel &));
+#endif  // !SWIG
+
+#if !defined(OE_CERTIFIER) && !defined(SWIG)
+// Client channel pool
+// -------------------------------------------------------------------
+//
+// Keeps authenticated client channels open between requests.  Channels
+// are kept per (host, port, peer root, client cert); borrow hands out an
+// idle one if it is still healthy and opens a new one otherwise, and
+// give_back makes it idle again.  No more than max_per_host channels to
+// one key are open at once; a borrow past that waits up to wait_ms for
+// one to come back.  Channels idle longer than idle_timeout_secs, or with
+// anything unread, are closed rather than reused.  Give every channel
+// back before the pool is destroyed.  Thread safe.
+class channel_pool {
+ public:
+  channel_pool(int max_per_host = 8,
+               int idle_timeout_secs = 60,
+               int wait_ms = 5000);
+  ~channel_pool();
+
+  // Returns nullptr on failure.
+  secure_authenticated_channel *borrow(const string &host_name,
+                                       int           port,
+                                       const string &asn1_root_cert,
+                                       key_message  &private_key,
+                                       const string &private_key_cert);
+  secure_authenticated_channel *borrow(const string           &host_name,
+                                       int                     port,
+                                       const cc_trust_manager &mgr);
+
+  // Pass reusable = false after an error; c is then closed.
+  void give_back(secure_authenticated_channel *c, bool reusable = true);
+
+  // Closes every idle channel.
+  void close_idle();
+
+  int num_open();
+  int num_idle();
+  int num_connects();
+
+ private:
+  typedef std::chrono::steady_clock clock;
+
+  struct idle_channel {
+    secure_authenticated_channel *channel_;
+    clock::time_point             since_;
+  };
+  struct host_channels {
+    int                       num_open_;
+    std::vector<idle_channel> idle_;  // most recently returned last
+  };
+
+  int                                              max_per_host_;
+  int                                              idle_timeout_secs_;
+  int                                              wait_ms_;
+  int                                              num_connects_;
+  std::mutex                                       lock_;
+  std::condition_variable                          returned_;
+  std::map<string, host_channels>                  hosts_;
+  std::map<secure_authenticated_channel *, string> borrowed_;
+
+  static bool healthy(secure_authenticated_channel *c);
+  static void discard(secure_authenticated_channel *c);
+
+  channel_pool(const channel_pool &);
+  channel_pool &operator=(const channel_pool &);
+};
+#endif  // !OE_CERTIFIER && !SWIG
+
 }  // namespace framework
 }  // namespace certifier
 
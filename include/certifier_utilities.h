@@ -16,7 +16,13 @@
 #ifndef _CERTIFIER_UTILITIES_H__
 #define _CERTIFIER_UTILITIES_H__
 
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <openssl/ssl.h>
 #include <openssl/rsa.h>
 #include <openssl/x509.h>
@@ -87,6 +93,51 @@ bool add_interval_to_time_point(time_point &t_in,
                                 time_point *out);
 int  compare_time(time_point &t1, time_point &t2);
 void print_time_point(time_point &t);
+
+// Nanoseconds since 1970-01-01T00:00:00Z.  Parsing accepts RFC 3339
+// (with or without fractional seconds, Z or an offset) and the strings
+// time_to_string writes.  It rejects the YYYY:MM:DDTHH:MM:SSZ form of
+// the Go certifier's TimePointToString, which string_to_time misread.
+typedef int64_t time_ns;
+const time_ns   ns_per_second = 1000000000;
+time_ns         time_ns_now();
+bool            string_to_time_ns(const string &s, time_ns *t);
+bool            time_ns_to_string(time_ns t, string *s);
+bool            time_point_to_time_ns(const time_point &tp, time_ns *t);
+
+// One request's view of the clock.  While one is in scope, validity
+// checks on its thread (check_date_range, verify_signed_claim) compare
+// against the time it was made, and parse each not_before/not_after
+// string once.  OE and Keystone enclaves have no thread_local, so there
+// (and with -D NO_REQUEST_CLOCK) current() is always nullptr and checks
+// read the clock themselves.
+#if defined(OE_CERTIFIER) || defined(KEYSTONE_CERTIFIER)
+#  ifndef NO_REQUEST_CLOCK
+#    define NO_REQUEST_CLOCK
+#  endif
+#endif
+
+class request_clock {
+ public:
+  request_clock();
+  ~request_clock();
+
+  time_ns now() const { return now_; }
+  bool    in_range(const string &nb, const string &na);
+
+  // The innermost request_clock on this thread, or nullptr.
+  static request_clock *current();
+
+ private:
+  time_ns                             now_;
+  request_clock                      *outer_;
+  std::unordered_map<string, time_ns> parsed_;
+
+  bool parse(const string &s, time_ns *t);
+
+  request_clock(const request_clock &);
+  request_clock &operator=(const request_clock &);
+};
 void print_entity(const entity_message &em);
 void print_key(const key_message &k);
 void print_rsa_key(const rsa_message &rsa);
@@ -117,6 +168,98 @@ bool verify_artifact(X509        &cert,
                      string      *subject_description_str,
                      uint64_t    *sn);
 
+// Certificate verification with long-lived OpenSSL state, shared by
+// every caller: DER is decoded once per SHA-256 digest, each trust root
+// gets one X509_STORE, verification keys are converted once per
+// fingerprint, and a signature, once verified, isn't checked again.
+// Each cache is cleared rather than allowed to grow past max_cached.
+// Thread safe.
+class cert_verifier {
+ public:
+  static const int max_cached = 1024;
+
+  static cert_verifier &instance();
+
+  // A new reference to the decoded certificate (X509_free it), or
+  // nullptr.
+  X509 *decode(const string &der);
+
+  // A new reference to root's store (X509_STORE_free it), or nullptr.
+  X509_STORE *store(X509 *root);
+
+  // X509_verify_cert of leaf against root, with untrusted as the
+  // intermediates it may chain through.
+  bool verify_chain(X509                      *root,
+                    X509                      *leaf,
+                    const std::vector<X509 *> &untrusted);
+
+  // X509_verify of cert with key.
+  bool verify_signature(X509 *cert, const key_message &key);
+
+  void clear();
+  int  num_decodes() const { return num_decodes_.load(); }
+  int  num_signature_checks() const { return num_signature_checks_.load(); }
+
+ private:
+  std::mutex                               lock_;
+  std::unordered_map<string, X509 *>       certs_;   // by DER digest
+  std::unordered_map<string, X509_STORE *> stores_;  // by root digest
+  std::unordered_map<string, EVP_PKEY *>   keys_;    // by fingerprint
+  std::unordered_set<string>               verified_;
+  std::atomic<int>                         num_decodes_;
+  std::atomic<int>                         num_signature_checks_;
+
+  cert_verifier();
+  ~cert_verifier();
+  EVP_PKEY *public_key(const key_message &key, const string &fp);
+};
+
+// A key to certify, named as produce_artifact names a subject.
+class admission_request {
+ public:
+  key_message subject_key;
+  string      subject_name;
+  string      subject_organization;
+  uint64_t    sn;
+};
+
+// Issues the certificates produce_artifact makes for a non-root subject,
+// signed by one policy key.  init converts the key and builds the issuer
+// name and extensions once; issue_admission_certs then signs a batch on
+// num_threads threads (0 means one per core), each of which sets up its
+// digest context once and copies it for every certificate.
+class admission_cert_issuer {
+ public:
+  admission_cert_issuer();
+  ~admission_cert_issuer();
+
+  bool init(const key_message &policy_key,
+            const string      &issuer_name,
+            const string      &issuer_organization,
+            double             secs_duration,
+            int                num_threads = 0);
+
+  // certs[i] is the DER certificate for batch[i].  The whole batch has
+  // the same validity period.
+  bool issue_admission_certs(const std::vector<admission_request> &batch,
+                             std::vector<string>                  *certs);
+
+ private:
+  EVP_PKEY                     *signing_pkey_;
+  const EVP_MD                 *digest_;
+  X509_NAME                    *issuer_name_;
+  std::vector<X509_EXTENSION *> extensions_;
+  double                        secs_duration_;
+  int                           num_threads_;
+
+  bool issue(const admission_request &req,
+             const ASN1_TIME         *not_before,
+             const ASN1_TIME         *not_after,
+             EVP_MD_CTX              *sign_ctx,
+             EVP_MD_CTX              *ctx,
+             string                  *der);
+};
+
 int cipher_block_byte_size(const char *alg_name);
 int cipher_key_byte_size(const char *alg_name);
 int digest_output_byte_size(const char *alg_name);
@@ -26,4 +26,8 @@ bool test_certify_steps(bool print_all);
 
 bool test_full_certification(bool print_all);
 
+bool test_policy_index(bool print_all);
+
+bool test_key_fingerprint(bool print_all);
+
 #endif  // __CLAIMS_TESTS_H__
@@ -0,0 +1,74 @@
+//  Copyright (c) 2023, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <openssl/x509.h>
+
+#include <nvidia.h>
+#include "certifier_framework.h"
+
+const int nvidia_gpu_nonce_size = 32;
+
+// Attestation evidence from one GPU.
+class NvidiaGPUEvidence {
+ public:
+  int                  index = -1;
+  std::string          uuid;
+  std::vector<uint8_t> nonce;
+  std::vector<uint8_t> report;
+  std::vector<uint8_t> cert_chain;  // PEM, leaf first
+  bool                 verified = false;
+};
+
+// Collects attestation reports from every GPU on a platform, each with
+// its own nonce, verifies them and hands them to a cc_trust_manager as
+// accelerators.  Collection and verification use a thread per GPU.
+// Certificates are remembered once verified, so the root and
+// intermediates every GPU shares are only checked for the first chain.
+class NvidiaAttestationPipeline {
+ public:
+  // trusted_root is the DER certificate every chain must lead to.
+  NvidiaAttestationPipeline(const std::string &trusted_root);
+  ~NvidiaAttestationPipeline();
+
+  bool collect(NvidiaPlatform *platform, std::vector<NvidiaGPUEvidence> *out);
+
+  // Returns the number of GPUs that verified.
+  int  verify(std::vector<NvidiaGPUEvidence> *evidence);
+  bool verify_gpu(NvidiaGPUEvidence *ev);
+
+  // Adds each GPU as an "nvidia-gpu" accelerator.
+  bool attach(const std::vector<NvidiaGPUEvidence>  &evidence,
+              certifier::framework::cc_trust_manager *tm);
+
+  int num_cached_certs();
+  int num_signature_checks() { return signature_checks.load(); }
+
+ private:
+  X509                 *root;
+  std::mutex            cache_lock;
+  std::set<std::string> verified_certs;  // SHA-256 of the DER
+  std::atomic<int>      signature_checks;
+
+  EVP_PKEY *verify_chain(const std::vector<uint8_t> &pem);
+  bool      cert_known(const std::string &hash);
+  void      remember_cert(const std::string &hash);
+};
@@ -16,15 +16,24 @@
 
 #include <nvidia.h>
 
+#include <openssl/evp.h>
+
+// Mock GPU.  The first form replays the certificate chain and report
+// recorded in dir.  The second signs a fresh report for every nonce with
+// signing_key, like a real GPU, so many distinct devices can be mocked.
 class NvidiaGPUMock : public NvidiaGPU {
  public:
-  NvidiaGPUMock(const std::string &dir) : base_dir(dir) {}
+  NvidiaGPUMock(const std::string &dir, int index = 0)
+      : base_dir(dir), index(index), signing_key(nullptr) {}
+  NvidiaGPUMock(int                index,
+                const std::string &cert_chain_pem,
+                EVP_PKEY          *signing_key)
+      : index(index), cert_chain(cert_chain_pem), signing_key(signing_key) {}
+  ~NvidiaGPUMock();
 
   GPUArch get_architecture() override { return GPUArch::Hopper; }
 
-  std::string get_uuid() override {
-    return "GPU-11111111-2222-3333-4444-555555555555";
-  }
+  std::string get_uuid() override;
 
   std::string get_vbios_version() override { return "96.00.5e.00.01"; }
 
@@ -35,20 +44,38 @@ class NvidiaGPUMock : public NvidiaGPU {
 
  private:
   std::string base_dir;
+  int         index;
+  std::string cert_chain;
+  EVP_PKEY   *signing_key;
 };
 
 class NvidiaPlatformMock : public NvidiaPlatform {
  public:
-  NvidiaPlatformMock(const std::string &dir) : base_dir(dir) {}
+  NvidiaPlatformMock() {}
+  NvidiaPlatformMock(const std::string &dir) {
+    gpus.emplace_back(new NvidiaGPUMock(dir));
+  }
+
+  // num_gpus signing GPUs whose certificate chains share a mock root and
+  // intermediate, as NVIDIA's do.  The root, in DER, is returned in
+  // root_cert.
+  static std::unique_ptr<NvidiaPlatformMock> create(
+      int          num_gpus,
+      std::string *root_cert,
+      long         leaf_lifetime = 365L * 86400L);
 
   std::string get_driver_version() override { return "545.00"; }
 
   bool is_cc_enabled() override { return true; }
 
-  int get_num_gpus() override { return 1; }
+  int get_num_gpus() override { return (int)gpus.size(); }
 
-  NvidiaGPU *get_gpu(int index) override { return new NvidiaGPUMock(base_dir); }
+  NvidiaGPU *get_gpu(int index) override {
+    if (index < 0 || index >= (int)gpus.size())
+      return nullptr;
+    return gpus[index].get();
+  }
 
  private:
-  std::string base_dir;
+  std::vector<std::unique_ptr<NvidiaGPU>> gpus;
 };
@@ -22,4 +22,6 @@ bool test_policy_store(bool print_all);
 
 bool test_init_and_recover_containers(bool print_all);
 
+bool test_lazy_store(bool print_all);
+
 #endif  // __STORE_TESTS_H__
@@ -46,6 +46,7 @@ typedef unsigned char byte;
 
 #include "certifier_utilities.h"
 #include "certifier_algorithms.h"
+#include "cc_metrics.h"
 
 using std::string;
 
@@ -145,10 +146,15 @@ bool ecc_verify(const char *alg,
                 byte       *sig);
 
 bool same_key(const key_message &k1, const key_message &k2);
+// SHA-256 of the key's type and public values (the key bits of a
+// symmetric key), ignoring leading zeros.  Equal just when same_key is
+// true.
+bool key_fingerprint(const key_message &k, string *fp);
 bool same_measurement(const string &m1, const string &m2);
 bool same_entity(const entity_message &e1, const entity_message &e2);
 bool same_property(const property &p1, const property &p2);
 bool same_properties(const properties &p1, const properties &p2);
+const property *find_property(const string &name, const properties &p);
 bool satisfying_property(const property &p1, const property &p2);
 bool satisfying_properties(const properties &p1, const properties &p2);
 bool same_platform(const platform &p1, const platform &p2);
@@ -216,12 +222,100 @@ bool verify_signed_claim(const signed_claim_message &claim,
 bool get_vse_clause_from_signed_claim(const signed_claim_message &scm,
                                       vse_clause                 *c);
 
+// Compact evidence packages: keys and certs that occur more than once in
+// a package are kept once, in interned, and each assertion refers to
+// them by index.  Expansion gives back the original serialized evidence
+// byte for byte, so signatures over it still check.  The encoding only
+// saves space: parsing and expanding a compact package costs about three
+// times as much as parsing the full one, and the Go service can't read
+// it, so nothing here produces it.  Use it to store or ship packages
+// where size matters; validate_evidence accepts it but doesn't need it.
+bool is_compact_evidence_package(const evidence_package &evp);
+bool compact_evidence_package(const evidence_package &in,
+                              evidence_package       *out);
+bool expand_evidence_package(const evidence_package &in,
+                             evidence_package       *out);
+
+// Sized frames: a 4 byte little-endian size, then the body.  Frames
+// larger than the max frame size are refused on both ends.
+const int frame_header_size = 4;
+const int default_max_frame_size = 64 * 1024 * 1024;
+void      set_max_frame_size(int size);
+int       get_max_frame_size();
+void      encode_frame_size(int size, byte *hdr);
+int       decode_frame_size(const byte *hdr);
+
 int sized_pipe_read(int fd, string *out);
 int sized_pipe_write(int fd, int size, byte *buf);
 
 int sized_ssl_read(SSL *ssl, string *out);
 int sized_ssl_write(SSL *ssl, int size, byte *buf);
 
+// Scratch buffers
+// -------------------------------------------------------------------
+//
+// Input-sized scratch space for Attest, Seal, signing and store I/O.
+// Blocks come from a small per-thread pool rather than the stack, so
+// enclave threads with small stacks don't overflow and steady state
+// does no allocation.  Contents are cleared when the buffer goes out of
+// scope, since they are often keys or plaintext.  OE and Keystone
+// builds (and -D NO_SCRATCH_POOL) allocate on every use instead.
+
+#if defined(OE_CERTIFIER) || defined(KEYSTONE_CERTIFIER)
+#  ifndef NO_SCRATCH_POOL
+#    define NO_SCRATCH_POOL
+#  endif
+#endif
+
+// Blocks bigger than this are freed rather than kept.
+const int max_pooled_scratch_size = 1024 * 1024;
+const int max_pooled_scratch_blocks = 8;
+
+class scratch_buffer {
+ public:
+  scratch_buffer(int size);
+  ~scratch_buffer();
+
+  // nullptr if the allocation failed.
+  byte *data() { return buf_; }
+  int   size() { return size_; }
+
+ private:
+  byte *buf_;
+  int   size_;
+  int   capacity_;
+
+  scratch_buffer(const scratch_buffer &);
+  scratch_buffer &operator=(const scratch_buffer &);
+};
+
+// Number of blocks the calling thread's pool is holding.
+int num_pooled_scratch_blocks();
+
+// Random bytes
+// -------------------------------------------------------------------
+//
+// get_random draws from a per-thread AES-256-CTR generator seeded from
+// getrandom().  Each refill of its buffer rekeys it from its own output,
+// and it mixes in a fresh seed every random_reseed_interval bytes and in
+// a forked child.  OE and Keystone builds (and -D NO_RANDOM_POOL) read
+// the kernel on every call instead.
+
+#if defined(OE_CERTIFIER) || defined(KEYSTONE_CERTIFIER)
+#  ifndef NO_RANDOM_POOL
+#    define NO_RANDOM_POOL
+#  endif
+#endif
+
+const int random_pool_size = 4096;
+const int random_reseed_interval = 1024 * 1024;
+
+// Reads n bytes from the kernel's generator.
+bool get_seed_bytes(int n, byte *out);
+
+// Number of times the calling thread's generator has been seeded.
+int num_random_seedings();
+
 class cert_keys_seen {
  public:
   string       issuer_name_;
@@ -17,6 +17,7 @@
 #define __SUPPORT_TESTS_H__
 
 bool test_random(bool print_all);
+bool test_random_fork(bool print_all);
 
 bool test_encrypt(bool print_all);
 
@@ -31,6 +32,7 @@ bool test_digest_multiple(bool print_all);
 bool test_sign_and_verify(bool print_all);
 
 bool test_time(bool print_all);
+bool test_time_ns(bool print_all);
 
 bool test_key_translation(bool print_all);
 
@@ -42,4 +44,21 @@ bool test_new_local_certify(bool print_all);
 
 bool test_partial_local_certify(bool print_all);
 
+bool test_metrics(bool print_all);
+
+bool test_async_channel(bool print_all);
+
+bool test_sized_frames(bool print_all);
+
+bool test_small_stacks(bool print_all);
+
+bool test_app_transport(bool print_all);
+
+bool test_app_batch(bool print_all);
+
+bool test_key_pregeneration(bool print_all);
+bool test_recertification(bool print_all);
+bool test_server_credential_rotation(bool print_all);
+bool test_channel_pool(bool print_all);
+
 #endif  // __SUPPORT_TESTS_H__
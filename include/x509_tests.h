@@ -22,6 +22,9 @@ bool test_x_509_chain(bool print_all);
 
 bool test_x_509_sign(bool print_all);
 
+bool test_cert_verifier(bool print_all);
+bool test_admission_cert_issuer(bool print_all);
+
 #ifdef RUN_SEV_TESTS
 
 bool test_sev_certs(bool print_all);
@@ -18,6 +18,9 @@
 #include <DataFrame/DataFrameStatsVisitors.h>
 #include <DataFrame/RandGen.h>
 
+#include "column_stream.h"
+#include "dataset_stream.h"
+
 using namespace hmdf;
 
 using ULDataFrame = StdDataFrame<long>;
@@ -26,35 +29,25 @@ std::string proc_data(const char *sales_df_str) {
   std::cout << "=========" << std::endl;
   std::cout << "Starting Analytics Applicaton: " << std::endl;
   std::cout << "=========" << std::endl;
-  std::string ret;
 
   // MyDataFrame df;
   ULDataFrame sales_df;
   sales_df.from_string(sales_df_str);
 
-  // basic statistics
-  MeanVisitor<double> n_mv;
-  auto mean = sales_df.visit<double>("total_price", n_mv).get_result();
-  ret.append("mean sale price is " + std::to_string(mean) + "\n");
-
-
-  // calculate correlation
-  CorrVisitor<double, double> corr_v;
-  std::string                 sel_column_names[] = {"order_id",
-                                                    "product_id",
-                                                    "price_per_unit",
-                                                    "quantity",
-                                                    "total_price"};
-  for (auto col_1 : sel_column_names) {
-    ret.append(col_1 + " ");
-    for (auto col_2 : sel_column_names) {
-      auto corr =
-          sales_df.visit<double, double>(col_1.c_str(), col_2.c_str(), corr_v)
-              .get_result();
-      ret.append(" " + std::to_string(corr) + " ");
-    }
-    ret.append("\n");
+  // One pass over the selected columns gives the means and the whole
+  // correlation matrix, rather than a CorrVisitor pass for each pair.
+  std::vector<const double *> columns;
+  int64_t                     num_rows = -1;
+  for (const std::string &name : sel_column_names) {
+    const auto &col = sales_df.get_column<double>(name.c_str());
+    columns.push_back(col.data());
+    if (num_rows < 0 || (int64_t)col.size() < num_rows)
+      num_rows = (int64_t)col.size();
   }
+  moment_accumulator acc((int)columns.size());
+  if (!column_moments(columns, num_rows, 0, &acc))
+    return "can't compute statistics\n";
+  std::string ret = stats_report(sel_column_names, acc);
 
   std::cout << "=========" << std::endl;
   std::cout << "Finished Data Analytics Application" << std::endl;
@@ -63,3 +56,17 @@ std::string proc_data(const char *sales_df_str) {
 
   return ret;
 }
+
+// The same report as proc_data, from a dataset that was streamed in.
+std::string proc_stream_stats(const std::vector<std::string> &names,
+                              const moment_accumulator       &acc) {
+  std::string ret = stats_report(names, acc);
+
+  std::cout << "=========" << std::endl;
+  std::cout << "Finished streaming analytics on " << acc.count() << " rows"
+            << std::endl;
+  std::cout << ret << std::endl;
+  std::cout << "=========" << std::endl;
+
+  return ret;
+}
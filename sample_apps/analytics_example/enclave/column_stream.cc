@@ -0,0 +1,336 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef OE_CERTIFIER
+#include <thread>
+#endif
+
+#include "column_stream.h"
+
+const char analytics_stream_magic[] = "analytics-columns-v1";
+
+static const int magic_size = sizeof(analytics_stream_magic) - 1;
+
+static void append_u32(uint32_t n, std::string *out) {
+  char b[4];
+  b[0] = (char)(n & 0xff);
+  b[1] = (char)((n >> 8) & 0xff);
+  b[2] = (char)((n >> 16) & 0xff);
+  b[3] = (char)((n >> 24) & 0xff);
+  out->append(b, 4);
+}
+
+static bool read_u32(const std::string &in, size_t *pos, uint32_t *n) {
+  if (in.size() < 4 || *pos > in.size() - 4)
+    return false;
+  const unsigned char *b = (const unsigned char *)in.data() + *pos;
+  *n = ((uint32_t)b[0]) | (((uint32_t)b[1]) << 8) | (((uint32_t)b[2]) << 16)
+       | (((uint32_t)b[3]) << 24);
+  *pos += 4;
+  return true;
+}
+
+bool is_column_schema(const std::string &msg) {
+  return msg.size() >= (size_t)magic_size
+         && memcmp(msg.data(), analytics_stream_magic, magic_size) == 0;
+}
+
+bool encode_column_schema(const std::vector<std::string> &names,
+                          std::string                    *msg) {
+  if (names.empty() || (int)names.size() > analytics_max_columns) {
+    printf("%s() error, line %d, bad number of columns\n", __func__, __LINE__);
+    return false;
+  }
+  msg->assign(analytics_stream_magic, magic_size);
+  append_u32((uint32_t)names.size(), msg);
+  for (const std::string &name : names) {
+    append_u32((uint32_t)name.size(), msg);
+    msg->append(name);
+  }
+  return true;
+}
+
+bool decode_column_schema(const std::string        &msg,
+                          std::vector<std::string> *names) {
+  if (!is_column_schema(msg)) {
+    printf("%s() error, line %d, not a column schema\n", __func__, __LINE__);
+    return false;
+  }
+  size_t   pos = magic_size;
+  uint32_t num_columns = 0;
+  if (!read_u32(msg, &pos, &num_columns) || num_columns == 0
+      || num_columns > (uint32_t)analytics_max_columns) {
+    printf("%s() error, line %d, bad number of columns\n", __func__, __LINE__);
+    return false;
+  }
+  names->clear();
+  for (uint32_t i = 0; i < num_columns; i++) {
+    uint32_t len = 0;
+    if (!read_u32(msg, &pos, &len) || len > msg.size() - pos) {
+      printf("%s() error, line %d, truncated schema\n", __func__, __LINE__);
+      return false;
+    }
+    names->push_back(msg.substr(pos, len));
+    pos += len;
+  }
+  return pos == msg.size();
+}
+
+bool parse_csv_row(const std::string &line, int num_columns, double *row) {
+  const char *p = line.c_str();
+  char       *next = nullptr;
+  strtol(p, &next, 10);  // index
+  if (next == p)
+    return false;
+  for (int c = 0; c < num_columns; c++) {
+    if (*next != ',')
+      return false;
+    p = next + 1;
+    row[c] = strtod(p, &next);
+    if (next == p || !isfinite(row[c]))
+      return false;
+  }
+  if (*next == '\r')
+    next++;
+  return *next == '\0';
+}
+
+column_chunk::column_chunk(int num_columns, int capacity)
+    : num_columns_(num_columns),
+      capacity_(capacity),
+      num_rows_(0),
+      values_((size_t)num_columns * capacity) {}
+
+bool column_chunk::append_row(const double *row) {
+  if (full())
+    return false;
+  for (int c = 0; c < num_columns_; c++)
+    values_[c * capacity_ + num_rows_] = row[c];
+  num_rows_++;
+  return true;
+}
+
+bool column_chunk::encode(std::string *msg) const {
+  size_t column_bytes = (size_t)num_rows_ * sizeof(double);
+  msg->clear();
+  msg->reserve(4 + num_columns_ * column_bytes);
+  append_u32((uint32_t)num_rows_, msg);
+  for (int c = 0; c < num_columns_; c++)
+    msg->append((const char *)column(c), column_bytes);
+  return true;
+}
+
+bool column_chunk::decode(const std::string &msg) {
+  size_t   pos = 0;
+  uint32_t n = 0;
+  if (!read_u32(msg, &pos, &n) || n > (uint32_t)capacity_
+      || msg.size() - pos != (size_t)num_columns_ * n * sizeof(double)) {
+    printf("%s() error, line %d, bad chunk\n", __func__, __LINE__);
+    return false;
+  }
+  num_rows_ = (int)n;
+  size_t column_bytes = (size_t)num_rows_ * sizeof(double);
+  for (int c = 0; c < num_columns_; c++) {
+    memcpy(&values_[c * capacity_], msg.data() + pos, column_bytes);
+    pos += column_bytes;
+  }
+  return true;
+}
+
+moment_accumulator::moment_accumulator(int num_columns)
+    : num_columns_(num_columns),
+      count_(0),
+      mean_(num_columns, 0.0),
+      comoment_((size_t)num_columns * num_columns, 0.0) {}
+
+void moment_accumulator::add(const column_chunk &chunk) {
+  if (chunk.num_columns() != num_columns_)
+    return;
+  std::vector<const double *> columns(num_columns_);
+  for (int i = 0; i < num_columns_; i++)
+    columns[i] = chunk.column(i);
+  add_columns(columns.data(), chunk.num_rows());
+}
+
+// Rows are taken a block at a time: each block is read once, shifted,
+// and every sum and product over it is then taken from cache.  Sums are
+// kept in four lanes so the loops vectorize without reassociating.
+const int moment_block_rows = 512;
+const int moment_lanes = 4;
+
+static double lane_sum(const double *x, int n) {
+  double s[moment_lanes] = {0.0, 0.0, 0.0, 0.0};
+  int    r = 0;
+  for (; r + moment_lanes <= n; r += moment_lanes) {
+    for (int l = 0; l < moment_lanes; l++)
+      s[l] += x[r + l];
+  }
+  for (; r < n; r++)
+    s[0] += x[r];
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+static double lane_dot(const double *x, const double *y, int n) {
+  double s[moment_lanes] = {0.0, 0.0, 0.0, 0.0};
+  int    r = 0;
+  for (; r + moment_lanes <= n; r += moment_lanes) {
+    for (int l = 0; l < moment_lanes; l++)
+      s[l] += x[r + l] * y[r + l];
+  }
+  for (; r < n; r++)
+    s[0] += x[r] * y[r];
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+// The rows are summarized on their own, then merged in.  Values are
+// taken relative to the first row, which keeps the single pass sums
+// from cancelling.
+void moment_accumulator::add_columns(const double *const *columns,
+                                     int64_t              num_rows) {
+  if (num_rows <= 0)
+    return;
+
+  int                 k = num_columns_;
+  std::vector<double> shift(k), sum(k, 0.0), cross((size_t)k * k, 0.0);
+  std::vector<double> block((size_t)k * moment_block_rows);
+  for (int i = 0; i < k; i++)
+    shift[i] = columns[i][0];
+
+  for (int64_t start = 0; start < num_rows; start += moment_block_rows) {
+    int m = (int)(num_rows - start < moment_block_rows ? num_rows - start
+                                                       : moment_block_rows);
+    for (int i = 0; i < k; i++) {
+      const double *x = columns[i] + start;
+      double       *d = &block[(size_t)i * moment_block_rows];
+      for (int r = 0; r < m; r++)
+        d[r] = x[r] - shift[i];
+      sum[i] += lane_sum(d, m);
+    }
+    for (int i = 0; i < k; i++) {
+      const double *di = &block[(size_t)i * moment_block_rows];
+      for (int j = i; j < k; j++) {
+        const double *dj = &block[(size_t)j * moment_block_rows];
+        cross[i * k + j] += lane_dot(di, dj, m);
+      }
+    }
+  }
+
+  moment_accumulator b(k);
+  double             n = (double)num_rows;
+  b.count_ = num_rows;
+  for (int i = 0; i < k; i++)
+    b.mean_[i] = shift[i] + sum[i] / n;
+  for (int i = 0; i < k; i++) {
+    for (int j = i; j < k; j++) {
+      double c = cross[i * k + j] - sum[i] * sum[j] / n;
+      b.comoment_[i * k + j] = c;
+      b.comoment_[j * k + i] = c;
+    }
+  }
+  merge(b);
+}
+
+// Chan et al.: for row sets A and B with n = n_A + n_B and d the
+// difference of their means, C_ij = C_A,ij + C_B,ij + d_i d_j n_A n_B / n.
+bool moment_accumulator::merge(const moment_accumulator &other) {
+  if (other.num_columns_ != num_columns_)
+    return false;
+  if (other.count_ == 0)
+    return true;
+  if (count_ == 0) {
+    *this = other;
+    return true;
+  }
+
+  double na = (double)count_, nb = (double)other.count_, n = na + nb;
+  std::vector<double> d(num_columns_);
+  for (int i = 0; i < num_columns_; i++)
+    d[i] = other.mean_[i] - mean_[i];
+  for (int i = 0; i < num_columns_; i++) {
+    for (int j = 0; j < num_columns_; j++) {
+      int k = i * num_columns_ + j;
+      comoment_[k] += other.comoment_[k] + d[i] * d[j] * na * nb / n;
+    }
+  }
+  for (int i = 0; i < num_columns_; i++)
+    mean_[i] += d[i] * nb / n;
+  count_ += other.count_;
+  return true;
+}
+
+double moment_accumulator::covariance(int i, int j) const {
+  if (count_ < 2)
+    return 0.0;
+  return comoment_[i * num_columns_ + j] / (double)(count_ - 1);
+}
+
+double moment_accumulator::correlation(int i, int j) const {
+  double cii = comoment_[i * num_columns_ + i];
+  double cjj = comoment_[j * num_columns_ + j];
+  if (cii <= 0.0 || cjj <= 0.0)
+    return 0.0;
+  return comoment_[i * num_columns_ + j] / sqrt(cii * cjj);
+}
+
+bool column_moments(const std::vector<const double *> &columns,
+                    int64_t                            num_rows,
+                    int                                num_threads,
+                    moment_accumulator                *acc) {
+  if ((int)columns.size() != acc->num_columns()) {
+    printf("%s() error, line %d, wrong number of columns\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+#ifdef OE_CERTIFIER
+  num_threads = 1;
+#else
+  if (num_threads <= 0)
+    num_threads = (int)std::thread::hardware_concurrency();
+#endif
+  // Threads get at least a block each.
+  if (num_threads > num_rows / moment_block_rows)
+    num_threads = (int)(num_rows / moment_block_rows);
+  if (num_threads <= 1) {
+    acc->add_columns(columns.data(), num_rows);
+    return true;
+  }
+
+#ifndef OE_CERTIFIER
+  int                             k = (int)columns.size();
+  std::vector<moment_accumulator> parts(num_threads, moment_accumulator(k));
+  std::vector<std::thread>        threads;
+  for (int t = 0; t < num_threads; t++) {
+    int64_t first = num_rows * t / num_threads;
+    int64_t last = num_rows * (t + 1) / num_threads;
+    threads.push_back(std::thread([&columns, &parts, k, t, first, last]() {
+      std::vector<const double *> range(k);
+      for (int i = 0; i < k; i++)
+        range[i] = columns[i] + first;
+      parts[t].add_columns(range.data(), last - first);
+    }));
+  }
+  for (std::thread &t : threads)
+    t.join();
+  for (const moment_accumulator &part : parts)
+    acc->merge(part);
+#endif
+  return true;
+}
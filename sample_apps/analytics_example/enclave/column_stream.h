@@ -0,0 +1,113 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _COLUMN_STREAM_H__
+#define _COLUMN_STREAM_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * Streaming transport for the analytics example.  Rather than one
+ * DataFrame::to_string blob, the client sends a schema message and then
+ * the rows in chunks of at most analytics_chunk_rows, one channel message
+ * each, so neither side ever holds more than a chunk.
+ *
+ *   schema: analytics_stream_magic, num_columns, then each column name
+ *   chunk:  num_rows, then each column's num_rows doubles in turn
+ *
+ * Counts and name lengths are 4 byte little-endian.  Doubles are sent as
+ * the sender's IEEE doubles; the client and the enclave are both x86.  A
+ * chunk of zero rows ends the stream.
+ */
+
+extern const char analytics_stream_magic[];
+const int         analytics_chunk_rows = 8192;
+const int         analytics_max_columns = 64;
+
+bool is_column_schema(const std::string &msg);
+bool encode_column_schema(const std::vector<std::string> &names,
+                          std::string                    *msg);
+bool decode_column_schema(const std::string        &msg,
+                          std::vector<std::string> *names);
+
+// Parses a csv2 data row, an integer index and then num_columns numbers,
+// into row.  Fails on a missing, empty or non-numeric field or anything
+// after the last one.
+bool parse_csv_row(const std::string &line, int num_columns, double *row);
+
+// Rows are appended one at a time and kept by column.
+class column_chunk {
+ public:
+  column_chunk(int num_columns, int capacity = analytics_chunk_rows);
+
+  int  num_columns() const { return num_columns_; }
+  int  num_rows() const { return num_rows_; }
+  bool full() const { return num_rows_ >= capacity_; }
+  void clear() { num_rows_ = 0; }
+
+  // row has num_columns() values.
+  bool          append_row(const double *row);
+  const double *column(int c) const { return &values_[c * capacity_]; }
+
+  bool encode(std::string *msg) const;
+  bool decode(const std::string &msg);
+
+ private:
+  int                 num_columns_;
+  int                 capacity_;
+  int                 num_rows_;
+  std::vector<double> values_;  // column c starts at c * capacity_
+};
+
+// Count, means and co-moments (sums of products of deviations from the
+// mean) of each pair of columns.  Accumulators over disjoint rows merge
+// exactly, so a stream is summarized a chunk at a time.
+class moment_accumulator {
+ public:
+  moment_accumulator(int num_columns);
+
+  int     num_columns() const { return num_columns_; }
+  int64_t count() const { return count_; }
+
+  void add(const column_chunk &chunk);
+  bool merge(const moment_accumulator &other);
+
+  // Adds num_rows rows held as one buffer per column, reading each row
+  // once.
+  void add_columns(const double *const *columns, int64_t num_rows);
+
+  double mean(int i) const { return mean_[i]; }
+  double covariance(int i, int j) const;  // sample covariance
+  double correlation(int i, int j) const;
+
+ private:
+  int                 num_columns_;
+  int64_t             count_;
+  std::vector<double> mean_;
+  std::vector<double> comoment_;  // num_columns_ x num_columns_
+};
+
+// The moments of num_rows rows of columns, split between num_threads
+// threads (0 means one per core) and merged.  OpenEnclave can't start
+// threads, so the enclave always uses one.
+bool column_moments(const std::vector<const double *> &columns,
+                    int64_t                            num_rows,
+                    int                                num_threads,
+                    moment_accumulator                *acc);
+
+#endif
@@ -0,0 +1,144 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+
+#include <fstream>
+
+#include "dataset_stream.h"
+
+using namespace certifier::framework;
+using std::string;
+
+const std::vector<std::string> sel_column_names = {"order_id",
+                                                   "product_id",
+                                                   "price_per_unit",
+                                                   "quantity",
+                                                   "total_price"};
+
+std::string stats_report(const std::vector<std::string> &names,
+                         const moment_accumulator       &acc) {
+  int              num_sel = (int)sel_column_names.size();
+  std::vector<int> sel(num_sel, -1);
+  for (int i = 0; i < num_sel; i++) {
+    for (int c = 0; c < (int)names.size(); c++) {
+      if (names[c] == sel_column_names[i])
+        sel[i] = c;
+    }
+    if (sel[i] < 0)
+      return "no column " + sel_column_names[i] + "\n";
+  }
+
+  std::string ret;
+  ret.append("mean sale price is " + std::to_string(acc.mean(sel[num_sel - 1]))
+             + "\n");
+  for (int i = 0; i < num_sel; i++) {
+    ret.append(sel_column_names[i] + " ");
+    for (int j = 0; j < num_sel; j++) {
+      double corr = acc.correlation(sel[i], sel[j]);
+      ret.append(" " + std::to_string(corr) + " ");
+    }
+    ret.append("\n");
+  }
+  return ret;
+}
+
+bool stream_dataset(secure_authenticated_channel &channel,
+                    const string                 &csv_file) {
+  std::ifstream in(csv_file);
+  string        line;
+  if (!in || !std::getline(in, line)) {
+    printf("%s() error, line %d, can't read %s\n",
+           __func__,
+           __LINE__,
+           csv_file.c_str());
+    return false;
+  }
+
+  std::vector<std::string> names;
+  size_t                   start = 0;
+  for (;;) {
+    size_t end = line.find(',', start);
+    string field = line.substr(start, end - start);
+    names.push_back(field.substr(0, field.find(':')));
+    if (end == string::npos)
+      break;
+    start = end + 1;
+  }
+  names.erase(names.begin());
+
+  string msg;
+  if (!encode_column_schema(names, &msg)
+      || channel.write(msg.size(), (byte *)msg.data()) <= 0)
+    return false;
+
+  int                 num_columns = (int)names.size();
+  column_chunk        chunk(num_columns);
+  std::vector<double> row(num_columns);
+  long                num_rows = 0;
+  long                num_malformed = 0;
+  bool                more = true;
+  while (more) {
+    more = (bool)std::getline(in, line);
+    if (more && !line.empty()) {
+      if (parse_csv_row(line, num_columns, row.data())) {
+        chunk.append_row(row.data());
+        num_rows++;
+      } else {
+        num_malformed++;
+      }
+    }
+    // The final, short chunk is followed by an empty one.
+    if (chunk.full() || (!more && chunk.num_rows() > 0)) {
+      if (!chunk.encode(&msg)
+          || channel.write(msg.size(), (byte *)msg.data()) <= 0)
+        return false;
+      chunk.clear();
+    }
+  }
+  if (!chunk.encode(&msg) || channel.write(msg.size(), (byte *)msg.data()) <= 0)
+    return false;
+  printf("streamed %ld rows\n", num_rows);
+  if (num_malformed > 0) {
+    printf("%s() error, line %d, skipped %ld malformed rows in %s\n",
+           __func__,
+           __LINE__,
+           num_malformed,
+           csv_file.c_str());
+  }
+  return true;
+}
+
+bool receive_dataset(secure_authenticated_channel &channel,
+                     const string                 &schema,
+                     std::vector<std::string>     *names,
+                     moment_accumulator           *acc) {
+  if (!decode_column_schema(schema, names))
+    return false;
+
+  column_chunk chunk((int)names->size());
+  *acc = moment_accumulator((int)names->size());
+  string msg;
+  for (;;) {
+    if (channel.read(&msg) <= 0 || !chunk.decode(msg)) {
+      printf("%s() error, line %d, can't read chunk\n", __func__, __LINE__);
+      return false;
+    }
+    if (chunk.num_rows() == 0)
+      break;
+    acc->add(chunk);
+  }
+  return true;
+}
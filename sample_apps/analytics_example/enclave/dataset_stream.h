@@ -0,0 +1,54 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _DATASET_STREAM_H__
+#define _DATASET_STREAM_H__
+
+#include <string>
+#include <vector>
+
+#include "certifier_framework.h"
+#include "column_stream.h"
+
+/*
+ * The streaming client and server of the analytics example, over an
+ * authenticated channel.  Neither needs OpenEnclave or DataFrame, so
+ * stream_test runs both outside the enclave.
+ */
+
+// The columns the report covers; the sale price is the last.
+extern const std::vector<std::string> sel_column_names;
+
+// The mean sale price and the correlation matrix of the selected columns,
+// from their moments.
+std::string stats_report(const std::vector<std::string> &names,
+                         const moment_accumulator       &acc);
+
+// Sends the dataset a chunk at a time, as read from the csv2 file: a
+// header of name:count:<type> columns, the first of them the index, which
+// isn't sent.  Malformed rows are skipped, counted and reported.
+bool stream_dataset(
+    certifier::framework::secure_authenticated_channel &channel,
+    const std::string                                  &csv_file);
+
+// Reads a streamed dataset after its schema, giving its column names and
+// moments.
+bool receive_dataset(
+    certifier::framework::secure_authenticated_channel &channel,
+    const std::string                                  &schema,
+    std::vector<std::string>                           *names,
+    moment_accumulator                                 *acc);
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/mount.h>
 #include <openssl/rand.h>
 #include <openenclave/enclave.h>
@@ -22,9 +23,11 @@
 
 #include "certifier_framework.h"
 #include "certifier_utilities.h"
+#include "support.h"
 #include "../policy_key.cc"
 
 #include "analytics_app.cc"
+#include "dataset_stream.h"
 
 using namespace certifier::framework;
 using namespace certifier::utilities;
@@ -50,7 +53,7 @@ static string data_dir = "../app1_data/";
 #define FLAGS_measurement_file            "example_app.measurement"
 
 static std::string enclave_type;
-cc_trust_data     *app_trust_data = nullptr;
+cc_trust_manager  *app_trust_data = nullptr;
 
 static bool simulator_initialized = false;
 static bool openenclave_initialized = false;
@@ -103,6 +106,7 @@ bool cold_init(void);
 bool certify_me(void);
 bool warm_restart(void);
 bool run_me_as_client(void);
+bool run_me_as_streaming_client(void);
 bool run_me_as_server(void);
 bool temp_test(void);
 }
@@ -182,7 +186,7 @@ bool certifier_init(char *usr_data_dir, size_t usr_data_dir_size) {
 
     string store_file(data_dir);
     store_file.append(FLAGS_policy_store_file);
-    app_trust_data = new cc_trust_data(enclave_type, purpose, store_file);
+    app_trust_data = new cc_trust_manager(enclave_type, purpose, store_file);
     if (app_trust_data == nullptr) {
       printf("couldn't initialize trust object\n");
       return false;
@@ -196,19 +200,20 @@ bool certifier_init(char *usr_data_dir, size_t usr_data_dir_size) {
     }
 
     // Init simulated enclave
-    string attest_key_file_name(data_dir);
-    attest_key_file_name.append(FLAGS_attest_key_file);
-    string platform_attest_file_name(data_dir);
-    platform_attest_file_name.append(FLAGS_platform_attest_endorsement);
-    string measurement_file_name(data_dir);
-    measurement_file_name.append(FLAGS_measurement_file);
-    string attest_endorsement_file_name(data_dir);
-    attest_endorsement_file_name.append(FLAGS_platform_attest_endorsement);
-
-    if (!app_trust_data->initialize_simulated_enclave_data(
-            attest_key_file_name,
-            measurement_file_name,
-            attest_endorsement_file_name)) {
+    string attest_key;
+    string measurement;
+    string attest_endorsement;
+    if (!read_file_into_string(data_dir + FLAGS_attest_key_file, &attest_key)
+        || !read_file_into_string(data_dir + FLAGS_measurement_file,
+                                  &measurement)
+        || !read_file_into_string(data_dir + FLAGS_platform_attest_endorsement,
+                                  &attest_endorsement)) {
+      printf("Can't read simulated enclave data\n");
+      return false;
+    }
+    if (!app_trust_data->initialize_simulated_enclave(attest_key,
+                                                      measurement,
+                                                      attest_endorsement)) {
       printf("Can't init simulated enclave\n");
       return false;
     }
@@ -225,28 +230,46 @@ void clear_sensitive_data() {
 }
 
 bool cold_init() {
-  return app_trust_data->cold_init(public_key_alg, symmetric_key_alg);
+  return app_trust_data->cold_init(public_key_alg,
+                                   symmetric_key_alg,
+                                   "analytics-home_domain",
+                                   FLAGS_policy_host,
+                                   FLAGS_policy_port,
+                                   FLAGS_server_app_host,
+                                   FLAGS_server_app_port);
 }
 
 bool warm_restart() {
   return app_trust_data->warm_restart();
 }
 
-// Todo: replace with new cc_trust_data interface
 bool certify_me() {
-  return app_trust_data->certify_me(FLAGS_policy_host, FLAGS_policy_port);
+  return app_trust_data->certify_me();
 }
 
 void server_application(secure_authenticated_channel &channel) {
 
   printf("Server peer id is %s\n", channel.peer_id_.c_str());
 
-  // Read message from client over authenticated, encrypted channel
+  // Read message from client over authenticated, encrypted channel.  A
+  // streaming client starts with a column schema rather than the whole
+  // dataset.
   string out;
   int    n = channel.read(&out);
-  printf("SSL server read: %s\n", (const char *)out.data());
 
-  std::string ret = proc_data((const char *)out.c_str());
+  std::string ret;
+  if (n > 0 && is_column_schema(out)) {
+    printf("SSL server reading streamed dataset\n");
+    std::vector<std::string> names;
+    moment_accumulator       acc(0);
+    if (receive_dataset(channel, out, &names, &acc))
+      ret = proc_stream_stats(names, acc);
+    else
+      ret = "can't read dataset\n";
+  } else {
+    printf("SSL server read: %s\n", (const char *)out.data());
+    ret = proc_data((const char *)out.c_str());
+  }
 
   // Reply over authenticated, encrypted channel
   channel.write(ret.size(), (byte *)ret.c_str());
@@ -262,7 +285,7 @@ bool run_me_as_server() {
                   FLAGS_server_app_port,
                   app_trust_data->serialized_policy_cert_,
                   app_trust_data->private_auth_key_,
-                  app_trust_data->private_auth_key_.certificate(),
+                  app_trust_data->serialized_primary_admissions_cert_,
                   server_application);
   return true;
 }
@@ -283,7 +306,16 @@ void client_application(secure_authenticated_channel &channel) {
   printf("SSL client read: %s\n", (const char *)buf.c_str());
 }
 
-bool run_me_as_client() {
+void streaming_client_application(secure_authenticated_channel &channel) {
+  if (!stream_dataset(channel, data_dir + "../third_party/dataset/sales.csv"))
+    return;
+
+  string buf;
+  if (channel.read(&buf) > 0)
+    printf("SSL client read: %s\n", (const char *)buf.c_str());
+}
+
+static bool run_client(void (*app)(secure_authenticated_channel &)) {
   if (!app_trust_data->warm_restart()) {
     printf("warm-restart failed\n");
     return false;
@@ -301,16 +333,24 @@ bool run_me_as_client() {
           FLAGS_server_app_port,
           app_trust_data->serialized_policy_cert_,
           app_trust_data->private_auth_key_,
-          app_trust_data->private_auth_key_.certificate())) {
+          app_trust_data->serialized_primary_admissions_cert_)) {
     printf("Can't init client app\n");
     return false;
   }
 
   // This is the actual application code.
-  client_application(channel);
+  app(channel);
   return true;
 }
 
+bool run_me_as_client() {
+  return run_client(client_application);
+}
+
+bool run_me_as_streaming_client() {
+  return run_client(streaming_client_application);
+}
+
 // not used
 bool temp_test() {
   RSA *r = RSA_new();
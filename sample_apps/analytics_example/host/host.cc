@@ -116,6 +116,21 @@ int main(int argc, const char *argv[]) {
               result,
               oe_result_str(result));
     }
+  } else if (strcmp(argv[2], "run-app-as-streaming-client") == 0) {
+    result = warm_restart(enclave, &ret);
+    if (result != OE_OK) {
+      fprintf(stderr,
+              "certifier_init failed: result=%u (%s)\n",
+              result,
+              oe_result_str(result));
+    }
+    result = run_me_as_streaming_client(enclave, &ret);
+    if (result != OE_OK) {
+      fprintf(stderr,
+              "certifier_init failed: result=%u (%s)\n",
+              result,
+              oe_result_str(result));
+    }
   } else if (strcmp(argv[2], "run-app-as-server") == 0) {
     result = warm_restart(enclave, &ret);
     if (result != OE_OK) {
@@ -0,0 +1,395 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Streaming analytics benchmark, run outside the enclave on synthetic
+ * sales rows like those dataset_generation.py makes.  "text" builds the
+ * whole dataset as one text blob and parses it back into columns, as
+ * to_string/from_string do, then computes the statistics; "stream" sends
+ * each chunk through encode/decode and a moment_accumulator.  "held" is
+ * the most the receiving side keeps at once.
+ *
+ * The correlation matrix is then timed on dataset/sales.csv repeated to
+ * 1M and 10M rows: "visitor" is the 25 CorrVisitor calls proc_data used
+ * to make, "moments" the single pass column_moments on one thread and
+ * on every core.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "column_stream.h"
+
+const int num_columns = 5;  // order_id, product_id, price, quantity, total
+
+class sales_rows {
+ public:
+  sales_rows() : state_(0x9e3779b97f4a7c15ULL), order_id_(0) {}
+
+  void next(double *row) {
+    double price = 1 + (int)(rand() % 299);
+    double quantity = 1 + (int)(rand() % 20);
+    row[0] = (double)order_id_;
+    row[1] = (double)(rand() % 2001);
+    row[2] = price;
+    row[3] = quantity;
+    row[4] = price * quantity;
+    if (rand() % 4 == 0)
+      order_id_++;
+  }
+
+ private:
+  uint64_t state_;
+  long     order_id_;
+
+  uint64_t rand() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_ >> 11;
+  }
+};
+
+static void two_pass(const std::vector<std::vector<double>> &cols,
+                     double                                 *mean,
+                     double                                 *corr) {
+  long n = (long)cols[0].size();
+  for (int i = 0; i < num_columns; i++) {
+    double sum = 0.0;
+    for (long r = 0; r < n; r++)
+      sum += cols[i][r];
+    mean[i] = sum / n;
+  }
+  double c[num_columns][num_columns];
+  for (int i = 0; i < num_columns; i++) {
+    for (int j = 0; j < num_columns; j++) {
+      double sum = 0.0;
+      for (long r = 0; r < n; r++)
+        sum += (cols[i][r] - mean[i]) * (cols[j][r] - mean[j]);
+      c[i][j] = sum;
+    }
+  }
+  for (int i = 0; i < num_columns; i++) {
+    for (int j = 0; j < num_columns; j++)
+      corr[i * num_columns + j] = c[i][j] / sqrt(c[i][i] * c[j][j]);
+  }
+}
+
+static bool close_to(double a, double b) {
+  return fabs(a - b) <= 1.0e-9 * (1.0 + fabs(a) + fabs(b));
+}
+
+bool test_column_stream() {
+  std::vector<std::string> names = {"order_id",
+                                    "product_id",
+                                    "price_per_unit",
+                                    "quantity",
+                                    "total_price"};
+  std::vector<std::string> names_out;
+  std::string              msg;
+  if (!encode_column_schema(names, &msg) || !is_column_schema(msg)
+      || !decode_column_schema(msg, &names_out) || names_out != names) {
+    printf("schema round trip failed\n");
+    return false;
+  }
+  msg.pop_back();
+  if (decode_column_schema(msg, &names_out)) {
+    printf("truncated schema decoded\n");
+    return false;
+  }
+
+  double row[num_columns];
+  if (!parse_csv_row("7,1,2,3.5,4,14\r", num_columns, row) || row[2] != 3.5
+      || row[4] != 14) {
+    printf("csv row not parsed\n");
+    return false;
+  }
+  const char *malformed[] = {"",
+                             "7,1,2,3,4",
+                             "7,1,2,3,4,14,15",
+                             "7,1,,3,4,14",
+                             "7,1,2,x,4,14",
+                             "7,1,2,3,4,nan",
+                             "x,1,2,3,4,14",
+                             "7;1;2;3;4;14"};
+  for (const char *line : malformed) {
+    if (parse_csv_row(line, num_columns, row)) {
+      printf("malformed csv row \"%s\" parsed\n", line);
+      return false;
+    }
+  }
+
+  // Uneven chunks, some merged from separate accumulators, against two
+  // passes over the whole dataset.
+  const int                        num_rows = 50000;
+  std::vector<std::vector<double>> cols(num_columns);
+  sales_rows                       rows;
+  column_chunk                     chunk(num_columns, 3000);
+  column_chunk                     in(num_columns, 3000);
+  moment_accumulator               acc(num_columns), part(num_columns);
+  for (int r = 0; r < num_rows; r++) {
+    rows.next(row);
+    for (int c = 0; c < num_columns; c++)
+      cols[c].push_back(row[c]);
+    chunk.append_row(row);
+    if (chunk.full() || r == num_rows - 1) {
+      if (!chunk.encode(&msg) || !in.decode(msg)) {
+        printf("chunk round trip failed\n");
+        return false;
+      }
+      if (r < num_rows / 2)
+        part.add(in);
+      else
+        acc.add(in);
+      chunk.clear();
+    }
+  }
+  if (!acc.merge(part) || acc.count() != num_rows) {
+    printf("merge failed\n");
+    return false;
+  }
+
+  double mean[num_columns], corr[num_columns * num_columns];
+  two_pass(cols, mean, corr);
+  for (int i = 0; i < num_columns; i++) {
+    if (!close_to(mean[i], acc.mean(i))) {
+      printf("mean %d wrong\n", i);
+      return false;
+    }
+    for (int j = 0; j < num_columns; j++) {
+      if (!close_to(corr[i * num_columns + j], acc.correlation(i, j))) {
+        printf("correlation %d, %d wrong\n", i, j);
+        return false;
+      }
+    }
+  }
+
+  msg.resize(msg.size() - 1);
+  if (in.decode(msg)) {
+    printf("short chunk decoded\n");
+    return false;
+  }
+  return true;
+}
+
+void bench_text(long num_rows) {
+  auto start = std::chrono::steady_clock::now();
+
+  std::string blob;
+  sales_rows  rows;
+  double      row[num_columns];
+  char        field[32];
+  for (long r = 0; r < num_rows; r++) {
+    rows.next(row);
+    for (int c = 0; c < num_columns; c++) {
+      snprintf(field, sizeof(field), c == 0 ? "%g" : ",%g", row[c]);
+      blob.append(field);
+    }
+    blob.append("\n");
+  }
+
+  std::vector<std::vector<double>> cols(num_columns);
+  const char                      *p = blob.c_str();
+  char                            *next = nullptr;
+  for (long r = 0; r < num_rows; r++) {
+    for (int c = 0; c < num_columns; c++) {
+      cols[c].push_back(strtod(p, &next));
+      p = next + 1;
+    }
+  }
+  double mean[num_columns], corr[num_columns * num_columns];
+  two_pass(cols, mean, corr);
+
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  double held = (double)blob.size() + (double)num_rows * num_columns * 8;
+  printf("%-8s %10ld rows %8.1f ns/row %10.1f MB held  mean total %.3f\n",
+         "text",
+         num_rows,
+         secs.count() * 1.0e9 / num_rows,
+         held / 1.0e6,
+         mean[4]);
+}
+
+void bench_stream(long num_rows) {
+  auto start = std::chrono::steady_clock::now();
+
+  sales_rows         rows;
+  column_chunk       out(num_columns), in(num_columns);
+  moment_accumulator acc(num_columns);
+  std::string        msg;
+  double             row[num_columns];
+  for (long r = 0; r < num_rows; r++) {
+    rows.next(row);
+    out.append_row(row);
+    if (out.full() || r == num_rows - 1) {
+      out.encode(&msg);
+      in.decode(msg);
+      acc.add(in);
+      out.clear();
+    }
+  }
+
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  double held = (double)msg.capacity() + analytics_chunk_rows * num_columns * 8;
+  printf("%-8s %10ld rows %8.1f ns/row %10.1f MB held  mean total %.3f\n",
+         "stream",
+         num_rows,
+         secs.count() * 1.0e9 / num_rows,
+         held / 1.0e6,
+         acc.mean(4));
+}
+
+// As DataFrame's CovVisitor, which CorrVisitor calls for (x, y), (x, x)
+// and (y, y): a pass summing x, y and x * y.
+static double visitor_cov(const double *x, const double *y, long n) {
+  double sum_x = 0.0, sum_y = 0.0, dot = 0.0;
+  for (long r = 0; r < n; r++) {
+    sum_x += x[r];
+    sum_y += y[r];
+    dot += x[r] * y[r];
+  }
+  return (dot - sum_x * sum_y / n) / (n - 1);
+}
+
+static void visitor_corr(const std::vector<std::vector<double>> &cols,
+                         double                                 *corr) {
+  long n = (long)cols[0].size();
+  for (int i = 0; i < num_columns; i++) {
+    for (int j = 0; j < num_columns; j++) {
+      const double *x = cols[i].data(), *y = cols[j].data();
+      corr[i * num_columns + j] =
+          visitor_cov(x, y, n)
+          / sqrt(visitor_cov(x, x, n) * visitor_cov(y, y, n));
+    }
+  }
+}
+
+// The five value columns of a csv2 file, after the header and index.
+static bool load_sales(const char                       *file,
+                       std::vector<std::vector<double>> *cols) {
+  std::ifstream in(file);
+  std::string   line;
+  if (!in || !std::getline(in, line)) {
+    printf("can't read %s\n", file);
+    return false;
+  }
+  cols->assign(num_columns, std::vector<double>());
+  long   num_malformed = 0;
+  double row[num_columns];
+  while (std::getline(in, line)) {
+    if (line.empty())
+      continue;
+    if (!parse_csv_row(line, num_columns, row)) {
+      num_malformed++;
+      continue;
+    }
+    for (int c = 0; c < num_columns; c++)
+      (*cols)[c].push_back(row[c]);
+  }
+  if (num_malformed > 0)
+    printf("skipped %ld malformed rows in %s\n", num_malformed, file);
+  return !(*cols)[0].empty();
+}
+
+static double time_corr(const std::vector<std::vector<double>> &cols,
+                        int                                     num_threads,
+                        double                                 *corr) {
+  auto start = std::chrono::steady_clock::now();
+  if (num_threads < 0) {
+    visitor_corr(cols, corr);
+  } else {
+    std::vector<const double *> columns;
+    for (const std::vector<double> &col : cols)
+      columns.push_back(col.data());
+    moment_accumulator acc(num_columns);
+    column_moments(columns, (int64_t)cols[0].size(), num_threads, &acc);
+    for (int i = 0; i < num_columns; i++) {
+      for (int j = 0; j < num_columns; j++)
+        corr[i * num_columns + j] = acc.correlation(i, j);
+    }
+  }
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  return secs.count();
+}
+
+bool bench_corr(const std::vector<std::vector<double>> &sales, long num_rows) {
+  std::vector<std::vector<double>> cols(num_columns);
+  long                             m = (long)sales[0].size();
+  for (int c = 0; c < num_columns; c++) {
+    cols[c].resize(num_rows);
+    for (long r = 0; r < num_rows; r++)
+      cols[c][r] = sales[c][r % m];
+  }
+
+  std::vector<int> threads = {-1, 1};
+  int              cores = (int)std::thread::hardware_concurrency();
+  if (cores > 1)
+    threads.push_back(cores);
+  double expected[num_columns * num_columns];
+  for (int t : threads) {
+    double corr[num_columns * num_columns];
+    double secs = time_corr(cols, t, corr);
+    if (t < 0)
+      memcpy(expected, corr, sizeof(corr));
+    for (int k = 0; k < num_columns * num_columns; k++) {
+      if (fabs(corr[k] - expected[k]) > 1.0e-9) {
+        printf("correlation %d differs from CorrVisitor's\n", k);
+        return false;
+      }
+    }
+    char label[32];
+    snprintf(label, sizeof(label), t < 0 ? "visitor" : "moments/%d", t);
+    printf("%-10s %10ld rows %8.2f ns/row\n",
+           label,
+           num_rows,
+           secs * 1.0e9 / num_rows);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (!test_column_stream()) {
+    printf("Column stream tests failed\n");
+    return 1;
+  }
+  printf("Column stream tests successful\n");
+
+  // The text blob for 100M rows is several GB, so only the stream runs.
+  long sizes[] = {1000000L, 10000000L, 100000000L};
+  for (long num_rows : sizes) {
+    if (num_rows <= 10000000L)
+      bench_text(num_rows);
+    bench_stream(num_rows);
+  }
+
+  std::vector<std::vector<double>> sales;
+  const char *file = argc > 1 ? argv[1] : "third_party/dataset/sales.csv";
+  if (!load_sales(file, &sales))
+    return 1;
+  long corr_sizes[] = {1000000L, 10000000L};
+  for (long num_rows : corr_sizes) {
+    if (!bench_corr(sales, num_rows))
+      return 1;
+  }
+  return 0;
+}
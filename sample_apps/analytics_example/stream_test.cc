@@ -0,0 +1,266 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Runs the analytics streaming client and server, stream_dataset and
+ * receive_dataset, over an authenticated channel on localhost, outside
+ * the enclave.  The keys are made here, as the certifier would have made
+ * them, so this checks the transport and the report, not attestation.
+ *
+ * Each dataset is streamed to the server, whose reply must match the
+ * report computed here from the same file: sales.csv (or the file
+ * named), that file repeated to span several chunks, and a copy with a
+ * malformed row, which must be skipped.
+ *
+ *   make stream_test && ./stream_test [third_party/dataset/sales.csv]
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "certifier_framework.h"
+#include "certifier_utilities.h"
+#include "support.h"
+#include "dataset_stream.h"
+
+using namespace certifier::framework;
+using namespace certifier::utilities;
+using std::string;
+
+static const char *test_host = "localhost";
+static const int   test_port = 8125;
+
+static bool make_admissions_cert(key_message &policy_key,
+                                 key_message &auth_key,
+                                 const char  *role,
+                                 string      *out) {
+  string issuer_name("policyAuthority");
+  string issuer_organization("root");
+  string subject_name(role);
+  string subject_organization("1234567890");
+
+  X509 *x509_cert = X509_new();
+  bool  ret = produce_artifact(policy_key,
+                              issuer_name,
+                              issuer_organization,
+                              auth_key,
+                              subject_name,
+                              subject_organization,
+                              23,
+                              86400.0,
+                              x509_cert,
+                              false)
+             && x509_to_asn1(x509_cert, out);
+  X509_free(x509_cert);
+  if (ret)
+    auth_key.set_certificate(*out);
+  return ret;
+}
+
+static void stream_server(secure_authenticated_channel &channel) {
+  string schema;
+  string ret;
+  if (channel.read(&schema) <= 0 || !is_column_schema(schema)) {
+    ret = "not a streamed dataset\n";
+  } else {
+    std::vector<std::string> names;
+    moment_accumulator       acc(0);
+    if (receive_dataset(channel, schema, &names, &acc))
+      ret = stats_report(names, acc);
+    else
+      ret = "can't read dataset\n";
+  }
+  channel.write(ret.size(), (byte *)ret.data());
+}
+
+// The report for csv_file, chunked as stream_dataset chunks it.
+static bool local_report(const string &csv_file, string *report) {
+  std::ifstream in(csv_file);
+  string        line;
+  if (!in || !std::getline(in, line))
+    return false;
+
+  std::vector<std::string> names;
+  size_t                   start = 0;
+  for (;;) {
+    size_t end = line.find(',', start);
+    string field = line.substr(start, end - start);
+    names.push_back(field.substr(0, field.find(':')));
+    if (end == string::npos)
+      break;
+    start = end + 1;
+  }
+  names.erase(names.begin());
+
+  int                 num_columns = (int)names.size();
+  column_chunk        chunk(num_columns);
+  moment_accumulator  acc(num_columns);
+  std::vector<double> row(num_columns);
+  while (std::getline(in, line)) {
+    if (line.empty() || !parse_csv_row(line, num_columns, row.data()))
+      continue;
+    chunk.append_row(row.data());
+    if (chunk.full()) {
+      acc.add(chunk);
+      chunk.clear();
+    }
+  }
+  if (chunk.num_rows() > 0)
+    acc.add(chunk);
+  *report = stats_report(names, acc);
+  return true;
+}
+
+static bool run_client(key_message  &client_key,
+                       const string &client_cert,
+                       const string &policy_cert,
+                       const string &csv_file,
+                       string       *reply) {
+  string                       my_role("client");
+  secure_authenticated_channel channel(my_role);
+  bool                         connected = false;
+  for (int i = 0; i < 50 && !connected; i++) {
+    connected = channel.init_client_ssl(test_host,
+                                        test_port,
+                                        policy_cert,
+                                        client_key,
+                                        client_cert);
+    if (!connected)
+      usleep(100000);
+  }
+  if (!connected) {
+    printf("%s() error, line %d, can't connect\n", __func__, __LINE__);
+    return false;
+  }
+  bool ret = stream_dataset(channel, csv_file) && channel.read(reply) > 0;
+  channel.close();
+  return ret;
+}
+
+static bool check(key_message  &client_key,
+                  const string &client_cert,
+                  const string &policy_cert,
+                  const string &csv_file,
+                  const string &reference_file) {
+  string reply;
+  string expected;
+  if (!run_client(client_key, client_cert, policy_cert, csv_file, &reply)
+      || !local_report(reference_file, &expected)) {
+    printf("%s: FAILED, can't stream\n", csv_file.c_str());
+    return false;
+  }
+  if (reply != expected) {
+    printf("%s: FAILED, server sent\n%s\nexpected\n%s\n",
+           csv_file.c_str(),
+           reply.c_str(),
+           expected.c_str());
+    return false;
+  }
+  printf("%s: passed\n%s\n", csv_file.c_str(), reply.c_str());
+  return true;
+}
+
+int main(int an, char **av) {
+  string csv_file(an > 1 ? av[1] : "third_party/dataset/sales.csv");
+
+  key_message policy_key;
+  key_message server_key;
+  key_message client_key;
+  string      policy_cert;
+  string      server_cert;
+  string      client_cert;
+  string      type(Enc_method_rsa_2048_private);
+  string      name("policyKey");
+  string      issuer("policyAuthority");
+  if (!make_root_key_with_cert(type, name, issuer, &policy_key)
+      || !make_certifier_rsa_key(2048, &server_key)
+      || !make_certifier_rsa_key(2048, &client_key)) {
+    printf("Can't make keys\n");
+    return 1;
+  }
+  policy_cert.assign(policy_key.certificate().data(),
+                     policy_key.certificate().size());
+  if (!make_admissions_cert(policy_key, server_key, "server", &server_cert)
+      || !make_admissions_cert(policy_key,
+                               client_key,
+                               "client",
+                               &client_cert)) {
+    printf("Can't make certificates\n");
+    return 1;
+  }
+
+  // server_dispatch never returns; it goes when the process does.
+  std::thread server([&]() {
+    server_dispatch(test_host,
+                    test_port,
+                    policy_cert,
+                    server_key,
+                    server_cert,
+                    stream_server);
+  });
+  server.detach();
+
+  // The file repeated to span several chunks, and a copy with a malformed
+  // row, which must give the same report as the file.
+  std::ifstream       in(csv_file);
+  string              header;
+  string              line;
+  std::vector<string> rows;
+  if (!in || !std::getline(in, header)) {
+    printf("Can't read %s\n", csv_file.c_str());
+    return 1;
+  }
+  while (std::getline(in, line))
+    rows.push_back(line);
+
+  string        repeated_file("/tmp/stream_test_repeated.csv");
+  std::ofstream repeated(repeated_file);
+  repeated << header << "\n";
+  for (int n = 0; n < 3 * analytics_chunk_rows;) {
+    for (size_t i = 0; i < rows.size(); i++, n++)
+      repeated << rows[i] << "\n";
+  }
+  repeated.close();
+
+  string        malformed_file("/tmp/stream_test_malformed.csv");
+  std::ofstream malformed(malformed_file);
+  malformed << header << "\n";
+  for (size_t i = 0; i < rows.size(); i++) {
+    if (i == rows.size() / 2)
+      malformed << "17,1,2,not-a-number,4,5\n";
+    malformed << rows[i] << "\n";
+  }
+  malformed.close();
+
+  bool ok = check(client_key, client_cert, policy_cert, csv_file, csv_file)
+            && check(client_key,
+                     client_cert,
+                     policy_cert,
+                     repeated_file,
+                     repeated_file)
+            && check(client_key,
+                     client_cert,
+                     policy_cert,
+                     malformed_file,
+                     csv_file);
+  unlink(repeated_file.c_str());
+  unlink(malformed_file.c_str());
+  return ok ? 0 : 1;
+}
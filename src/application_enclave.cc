@@ -26,259 +26,584 @@
 #include "application_enclave.h"
 #include "certifier.pb.h"
 
+#include <mutex>
 #include <string>
 using std::string;
 
 // #define DEBUG
 
-bool initialized = false;
-int  reader = 0;
-int  writer = 0;
+#ifdef APPLICATION_SHARED_RING
+#  include <errno.h>
+#  include <poll.h>
+#  include <sys/eventfd.h>
+#  include <sys/mman.h>
+
+// Shared rings
+// -------------------------------------------------------------------
+
+shared_ring::shared_ring()
+    : hdr_(nullptr),
+      data_(nullptr),
+      size_(0),
+      data_fd_(-1),
+      space_fd_(-1),
+      peer_fd_(-1) {}
+
+bool shared_ring::attach(byte *base,
+                         int   ring_size,
+                         int   data_fd,
+                         int   space_fd,
+                         int   peer_fd,
+                         bool  init) {
+  if (base == nullptr || ring_size <= 0 || (ring_size & (ring_size - 1)) != 0)
+    return false;
+  hdr_ = (ring_header *)base;
+  data_ = base + header_size;
+  size_ = (uint64_t)ring_size;
+  data_fd_ = data_fd;
+  space_fd_ = space_fd;
+  peer_fd_ = peer_fd;
+  if (init) {
+    hdr_->head_.store(0);
+    hdr_->tail_.store(0);
+    hdr_->reader_waiting_.store(0);
+    hdr_->writer_waiting_.store(0);
+    hdr_->closed_.store(0);
+    hdr_->size_ = (uint32_t)ring_size;
+  } else if (hdr_->size_ != (uint32_t)ring_size) {
+    printf("%s() error, line %d, ring size mismatch\n", __func__, __LINE__);
+    return false;
+  }
+  return true;
+}
 
-bool application_Init(const string &parent_enclave_type,
-                      int           read_fd,
-                      int           write_fd) {
-  reader = read_fd;
-  writer = write_fd;
-  certifier_parent_enclave_type = parent_enclave_type;
-  certifier_parent_enclave_type_intitalized = true;
-  initialized = true;
+// head_ and tail_ live in memory the other process can write, so each is
+// loaded once and every copy works from that one snapshot.  A ring that
+// claims to hold more than size_ bytes is corrupt and is closed.
+bool shared_ring::available(bool      for_data,
+                            uint64_t *head,
+                            uint64_t *tail,
+                            uint64_t *n) {
+  *head = hdr_->head_.load();
+  *tail = hdr_->tail_.load();
+  uint64_t used = *head - *tail;
+  if (used > size_) {
+    printf("%s() error, line %d, corrupt ring indices\n", __func__, __LINE__);
+    close();
+    return false;
+  }
+  *n = for_data ? used : size_ - used;
   return true;
 }
 
-bool application_GetParentEvidence(string *out) {
-  app_request  req;
-  app_response rsp;
+void shared_ring::ring_bell(int fd, std::atomic<uint32_t> &waiting) {
+  if (waiting.load() == 0)
+    return;
+  uint64_t one = 1;
+  if (write(fd, &one, sizeof(one)) != sizeof(one))
+    printf("%s() error, line %d, doorbell failed\n", __func__, __LINE__);
+}
 
-  // request
-  req.set_function("getparentevidence");
-  string req_str;
-  req.SerializeToString(&req_str);
-  if (sized_pipe_write(writer, req_str.size(), (byte *)req_str.data()) < 0) {
-    printf("%s() error, line %d, application_Init, sized_pipe_write failed\n",
-           __func__,
-           __LINE__);
-    return false;
+// Replies to small requests usually land within a few microseconds, so
+// spin briefly before paying for the doorbell.  Only worth it with a
+// second CPU to make progress on.
+static const int ring_spin_count = 20000;
+static int       ring_spins = -1;
+
+static inline void cpu_relax() {
+#  if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#  elif defined(__aarch64__)
+  asm volatile("yield");
+#  endif
+}
+
+// The waiting flag is set before the final check and the other side
+// publishes before testing it, so a wakeup can't be lost.
+bool shared_ring::wait_for(bool for_data, uint64_t need) {
+  std::atomic<uint32_t> &waiting =
+      for_data ? hdr_->reader_waiting_ : hdr_->writer_waiting_;
+  int fd = for_data ? data_fd_ : space_fd_;
+
+  if (ring_spins < 0)
+    ring_spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? ring_spin_count : 0;
+  uint64_t head, tail, avail;
+  for (int i = 0; i < ring_spins; i++) {
+    if (!available(for_data, &head, &tail, &avail))
+      return false;
+    if (avail >= need)
+      return true;
+    cpu_relax();
   }
 
-  // response
-  string rsp_str;
-  int    n = sized_pipe_read(reader, &rsp_str);
-  if (n < 0) {
-    printf("%s() error, line %d, application_Init, sized_pipe_read failed\n",
-           __func__,
-           __LINE__);
-    return false;
+  for (;;) {
+    if (!available(for_data, &head, &tail, &avail))
+      return false;
+    if (avail >= need)
+      break;
+    if (hdr_->closed_.load() != 0)
+      return false;
+    waiting.store(1);
+    if (!available(for_data, &head, &tail, &avail))
+      return false;
+    if (avail >= need) {
+      waiting.store(0);
+      break;
+    }
+
+    struct pollfd pfd[2];
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = peer_fd_;
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    int n = poll(pfd, peer_fd_ >= 0 ? 2 : 1, -1);
+    waiting.store(0);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (pfd[0].revents & POLLIN) {
+      uint64_t v;
+      if (read(fd, &v, sizeof(v)) < 0 && errno != EAGAIN && errno != EINTR)
+        return false;
+    } else if (peer_fd_ >= 0 && pfd[1].revents != 0) {
+      // Nothing is sent on the pipes once the rings are in use.
+      printf("%s() error, line %d, peer went away\n", __func__, __LINE__);
+      return false;
+    }
   }
-  if (!rsp.ParseFromString(rsp_str)) {
-    printf("%s() error, line %d, application_Init: Can't parse response\n",
-           __func__,
-           __LINE__);
-    return false;
+  return true;
+}
+
+bool shared_ring::put(const byte *buf, int size, bool bell) {
+  int done = 0;
+  while (done < size) {
+    uint64_t head, tail, room;
+    if (!available(false, &head, &tail, &room))
+      return false;
+    if (room == 0) {
+      // Whatever was published unrung is all the reader can work on.
+      ring_bell(data_fd_, hdr_->reader_waiting_);
+      if (!wait_for(false, 1))
+        return false;
+      continue;
+    }
+    uint64_t off = head & (size_ - 1);
+    int      n = size - done;
+    if ((uint64_t)n > room)
+      n = (int)room;
+    int first = n;
+    if ((uint64_t)first > size_ - off)
+      first = (int)(size_ - off);
+    memcpy(data_ + off, buf + done, first);
+    memcpy(data_, buf + done + first, n - first);
+    hdr_->head_.store(head + n);
+    if (bell)
+      ring_bell(data_fd_, hdr_->reader_waiting_);
+    done += n;
   }
-  if (rsp.function() != "getparentevidence" || rsp.status() != "succeeded") {
-    printf(
-        "%s() error, line %d, application_Init: Not GetParentEvidence call\n",
-        __func__,
-        __LINE__);
-    return false;
+  return true;
+}
+
+bool shared_ring::get(byte *buf, int size) {
+  int done = 0;
+  while (done < size) {
+    uint64_t head, tail, avail;
+    if (!available(true, &head, &tail, &avail))
+      return false;
+    if (avail == 0) {
+      if (!wait_for(true, 1))
+        return false;
+      continue;
+    }
+    uint64_t off = tail & (size_ - 1);
+    int      n = size - done;
+    if ((uint64_t)n > avail)
+      n = (int)avail;
+    int first = n;
+    if ((uint64_t)first > size_ - off)
+      first = (int)(size_ - off);
+    memcpy(buf + done, data_ + off, first);
+    memcpy(buf + done + first, data_, n - first);
+    hdr_->tail_.store(tail + n);
+    ring_bell(space_fd_, hdr_->writer_waiting_);
+    done += n;
   }
-  out->assign((char *)rsp.args(0).data(), (int)rsp.args(0).size());
   return true;
 }
 
-const int buffer_pad = 2048;
-const int platform_statement_size = 4096;
+int shared_ring::write_message(int size, byte *buf) {
+  if (hdr_ == nullptr || size < 0 || size > get_max_frame_size()
+      || (size > 0 && buf == nullptr))
+    return -1;
+  // The body's bell covers the header, so the reader wakes once.
+  byte hdr[frame_header_size];
+  encode_frame_size(size, hdr);
+  if (!put(hdr, frame_header_size, size == 0) || !put(buf, size, true))
+    return -1;
+  return size;
+}
 
-bool application_Seal(int in_size, byte *in, int *size_out, byte *out) {
-  app_request  req;
-  app_response rsp;
+int shared_ring::read_message(string *out) {
+  out->clear();
+  if (hdr_ == nullptr)
+    return -1;
+  byte hdr[frame_header_size];
+  if (!get(hdr, frame_header_size))
+    return -1;
+  int size = decode_frame_size(hdr);
+  if (size < 0 || size > get_max_frame_size()) {
+    printf("%s() error, line %d, bad frame size %d\n", __func__, __LINE__, size);
+    return -1;
+  }
+  out->resize(size);
+  if (size > 0 && !get((byte *)&(*out)[0], size)) {
+    out->clear();
+    return -1;
+  }
+  return size;
+}
 
-  req.set_function("seal");
+void shared_ring::close() {
+  if (hdr_ == nullptr)
+    return;
+  hdr_->closed_.store(1);
+  uint64_t one = 1;
+  if (write(data_fd_, &one, sizeof(one)) < 0
+      || write(space_fd_, &one, sizeof(one)) < 0)
+    printf("%s() error, line %d, doorbell failed\n", __func__, __LINE__);
+  hdr_ = nullptr;
+  data_ = nullptr;
+}
+#endif  // APPLICATION_SHARED_RING
+
+// Transport
+// -------------------------------------------------------------------
+
+app_transport::app_transport() : read_fd_(-1), write_fd_(-1), use_ring_(false) {
+#ifdef APPLICATION_SHARED_RING
+  for (int i = 0; i < NUM_RING_FDS; i++)
+    ring_fds_[i] = -1;
+  ring_size_ = 0;
+  map_ = nullptr;
+  map_size_ = 0;
+#endif
+}
 
-  // send request
-  string req_arg_str;
-  req_arg_str.assign((char *)in, in_size);
-  req.add_args(req_arg_str);
-  string req_str;
-  if (!req.SerializeToString(&req_str)) {
-    printf("%s() error, line %d, application_Seal: Can't serialize request\n",
+app_transport::~app_transport() {
+  close_rings();
+}
+
+bool app_transport::init_pipes(int read_fd, int write_fd) {
+  read_fd_ = read_fd;
+  write_fd_ = write_fd;
+  return true;
+}
+
+bool app_transport::create_rings(int ring_size) {
+#ifdef APPLICATION_SHARED_RING
+  if (ring_size <= 0 || (ring_size & (ring_size - 1)) != 0) {
+    printf("%s() error, line %d, ring size must be a power of 2\n",
            __func__,
            __LINE__);
     return false;
   }
-  if (sized_pipe_write(writer, req_str.size(), (byte *)req_str.data()) < 0) {
-    printf("%s() error, line %d, application_Seal: sized_pipe_write failed\n",
-           __func__,
-           __LINE__);
+  ring_size_ = ring_size;
+  ring_fds_[0] = memfd_create("app_service_rings", MFD_CLOEXEC);
+  if (ring_fds_[0] < 0) {
+    printf("%s() error, line %d, memfd_create failed\n", __func__, __LINE__);
+    return false;
+  }
+  for (int i = 1; i < NUM_RING_FDS; i++) {
+    ring_fds_[i] = eventfd(0, EFD_CLOEXEC);
+    if (ring_fds_[i] < 0) {
+      printf("%s() error, line %d, eventfd failed\n", __func__, __LINE__);
+      close_rings();
+      return false;
+    }
+  }
+  map_size_ = 2 * (shared_ring::header_size + (size_t)ring_size_);
+  if (ftruncate(ring_fds_[0], map_size_) != 0 || !map_rings(true)) {
+    printf("%s() error, line %d, can't map rings\n", __func__, __LINE__);
+    close_rings();
     return false;
   }
+  return true;
+#else
+  return false;
+#endif
+}
 
-  // response
-  int  t_size = in_size + buffer_pad;
-  byte t_out[t_size];
-  int  n = read(reader, t_out, t_size);
-  if (n < 0) {
-    printf("%s() error, line %d, application_Seal: read failed\n",
-           __func__,
-           __LINE__);
+bool app_transport::inherit_rings() {
+#ifdef APPLICATION_SHARED_RING
+  for (int i = 0; i < NUM_RING_FDS; i++) {
+    if (ring_fds_[i] >= 0 && fcntl(ring_fds_[i], F_SETFD, 0) != 0)
+      return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Ring 0 carries parent to child, ring 1 child to parent.
+bool app_transport::map_rings(bool parent) {
+#ifdef APPLICATION_SHARED_RING
+  void *m = mmap(nullptr,
+                 map_size_,
+                 PROT_READ | PROT_WRITE,
+                 MAP_SHARED,
+                 ring_fds_[0],
+                 0);
+  if (m == MAP_FAILED)
     return false;
+  map_ = (byte *)m;
+  byte *ring0 = map_;
+  byte *ring1 = map_ + shared_ring::header_size + ring_size_;
+  if (parent) {
+    return tx_.attach(ring0,
+                      ring_size_,
+                      ring_fds_[1],
+                      ring_fds_[2],
+                      read_fd_,
+                      true)
+           && rx_.attach(ring1,
+                         ring_size_,
+                         ring_fds_[3],
+                         ring_fds_[4],
+                         read_fd_,
+                         true);
   }
-  string rsp_str;
-  rsp_str.assign((char *)t_out, n);
-  if (!rsp.ParseFromString(rsp_str)) {
-    printf("%s() error, line %d, application_Seal: Can't parse response\n",
+  return rx_.attach(ring0,
+                    ring_size_,
+                    ring_fds_[1],
+                    ring_fds_[2],
+                    read_fd_,
+                    false)
+         && tx_.attach(ring1,
+                       ring_size_,
+                       ring_fds_[3],
+                       ring_fds_[4],
+                       read_fd_,
+                       false);
+#else
+  return false;
+#endif
+}
+
+bool app_transport::offer_rings(app_response *rsp) {
+#ifdef APPLICATION_SHARED_RING
+  if (map_ == nullptr)
+    return false;
+  rsp->add_args("shared-ring");
+  rsp->add_args(std::to_string(ring_size_));
+  for (int i = 0; i < NUM_RING_FDS; i++)
+    rsp->add_args(std::to_string(ring_fds_[i]));
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool app_transport::start_rings() {
+#ifdef APPLICATION_SHARED_RING
+  if (map_ == nullptr)
+    return false;
+  use_ring_ = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool app_transport::accept_rings(const app_response &rsp) {
+#ifdef APPLICATION_SHARED_RING
+  if (rsp.args_size() != NUM_RING_FDS + 2 || rsp.args(0) != "shared-ring")
+    return false;
+  ring_size_ = atoi(rsp.args(1).c_str());
+  for (int i = 0; i < NUM_RING_FDS; i++)
+    ring_fds_[i] = atoi(rsp.args(i + 2).c_str());
+  map_size_ = 2 * (shared_ring::header_size + (size_t)ring_size_);
+  if (ring_size_ <= 0 || !map_rings(false)) {
+    printf("%s() error, line %d, can't map offered rings\n",
            __func__,
            __LINE__);
     return false;
   }
-  if (rsp.function() != "seal" || rsp.status() != "succeeded") {
-    printf("%s() error, line %d, application_Seal: function: %s, status: %s is "
-           "wrong\n",
-           __func__,
-           __LINE__,
-           rsp.function().c_str(),
-           rsp.status().c_str());
+  use_ring_ = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+// The parent answers "gettransport" with the rings, or fails it if it
+// has none, in which case the pipes stay in use.
+bool app_transport::request_rings() {
+#ifdef APPLICATION_SHARED_RING
+  app_request req;
+  req.set_function("gettransport");
+  req.add_args("shared-ring");
+  string req_str;
+  if (!req.SerializeToString(&req_str)
+      || write_message(req_str.size(), (byte *)req_str.data()) < 0)
     return false;
-  }
 
-  if (out == nullptr) {
-    *size_out = (int)rsp.args(0).size();
+  string       rsp_str;
+  app_response rsp;
+  if (read_message(&rsp_str) < 0 || !rsp.ParseFromString(rsp_str))
+    return false;
+  if (rsp.function() != "gettransport" || rsp.status() != "succeeded")
     return true;
+  return accept_rings(rsp);
+#else
+  return true;
+#endif
+}
+
+int app_transport::write_message(int size, byte *buf) {
+#ifdef APPLICATION_SHARED_RING
+  if (use_ring_)
+    return tx_.write_message(size, buf);
+#endif
+  return sized_pipe_write(write_fd_, size, buf);
+}
+
+int app_transport::read_message(string *out) {
+#ifdef APPLICATION_SHARED_RING
+  if (use_ring_)
+    return rx_.read_message(out);
+#endif
+  return sized_pipe_read(read_fd_, out);
+}
+
+void app_transport::close_rings() {
+#ifdef APPLICATION_SHARED_RING
+  tx_.close();
+  rx_.close();
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
   }
+  for (int i = 0; i < NUM_RING_FDS; i++) {
+    if (ring_fds_[i] >= 0)
+      close(ring_fds_[i]);
+    ring_fds_[i] = -1;
+  }
+#endif
+  use_ring_ = false;
+}
 
-  if (*size_out < (int)rsp.args(0).size()) {
-    printf("%s() error, line %d, application_Seal: output too big\n",
+// Child side
+// -------------------------------------------------------------------
+
+bool          initialized = false;
+app_transport parent_transport;
+static uint64_t next_request_id = 0;
+// One request and its response at a time on parent_transport; the
+// parent answers requests in order, so there is nothing to pipeline.
+static std::mutex call_lock;
+
+bool application_Init(const string &parent_enclave_type,
+                      int           read_fd,
+                      int           write_fd) {
+  parent_transport.init_pipes(read_fd, write_fd);
+  if (!parent_transport.request_rings()) {
+    printf("%s() error, line %d, transport negotiation failed\n",
            __func__,
            __LINE__);
     return false;
   }
-  *size_out = (int)rsp.args(0).size();
-  memcpy(out, rsp.args(0).data(), *size_out);
+  certifier_parent_enclave_type = parent_enclave_type;
+  certifier_parent_enclave_type_intitalized = true;
+  initialized = true;
   return true;
 }
 
-bool application_Unseal(int in_size, byte *in, int *size_out, byte *out) {
-  app_request  req;
-  app_response rsp;
-
-  // request
-  req.set_function("unseal");
-  string req_arg_str;
-  req_arg_str.assign((char *)in, in_size);
-  req.add_args(req_arg_str);
+// Sends req and waits for its response.
+static bool application_call(app_request &req, app_response *rsp) {
+  std::lock_guard<std::mutex> l(call_lock);
+  req.set_request_id(++next_request_id);
   string req_str;
-  req.SerializeToString(&req_str);
-  if (sized_pipe_write(writer, req_str.size(), (byte *)req_str.data()) < 0) {
-    printf("%s() error, line %d, application_Unseal: sized_pipe_write failed\n",
+  if (!req.SerializeToString(&req_str)) {
+    printf("%s() error, line %d, Can't serialize request\n",
            __func__,
            __LINE__);
     return false;
   }
-
-  // response
-  int  t_size = in_size + buffer_pad;
-  byte t_out[t_size];
-  int  n = read(reader, t_out, t_size);
-  if (n < 0) {
-    printf("%s() error, line %d, application_Unseal: read failed\n",
+  if (parent_transport.write_message(req_str.size(), (byte *)req_str.data())
+      < 0) {
+    printf("%s() error, line %d, %s: write failed\n",
            __func__,
-           __LINE__);
+           __LINE__,
+           req.function().c_str());
     return false;
   }
 
   string rsp_str;
-  rsp_str.assign((char *)t_out, n);
-  if (!rsp.ParseFromString(rsp_str)) {
-    printf("%s() error, line %d, application_Unseal: Can't parse response\n",
+  if (parent_transport.read_message(&rsp_str) < 0) {
+    printf("%s() error, line %d, %s: read failed\n",
            __func__,
-           __LINE__);
+           __LINE__,
+           req.function().c_str());
     return false;
   }
-  if (rsp.function() != "unseal" || rsp.status() != "succeeded") {
-    printf("%s() error, line %d, application_Unseal: function: %s, status: %s "
-           "is wrong\n",
+  if (!rsp->ParseFromString(rsp_str)) {
+    printf("%s() error, line %d, %s: Can't parse response\n",
            __func__,
            __LINE__,
-           rsp.function().c_str(),
-           rsp.status().c_str());
+           req.function().c_str());
     return false;
   }
-
-  if (out == nullptr) {
-    *size_out = (int)rsp.args(0).size();
-    return true;
+  if (rsp->request_id() != req.request_id()) {
+    printf("%s() error, line %d, %s: response %lu to request %lu\n",
+           __func__,
+           __LINE__,
+           req.function().c_str(),
+           (unsigned long)rsp->request_id(),
+           (unsigned long)req.request_id());
+    return false;
   }
-  if (*size_out < (int)rsp.args(0).size()) {
-    printf("%s() error, line %d, application_Unseal: output too big\n",
+  if (rsp->function() != req.function() || rsp->status() != "succeeded") {
+    printf("%s() error, line %d, function: %s, status: %s is wrong\n",
            __func__,
-           __LINE__);
+           __LINE__,
+           rsp->function().c_str(),
+           rsp->status().c_str());
     return false;
   }
-  *size_out = (int)rsp.args(0).size();
-  memcpy(out, rsp.args(0).data(), *size_out);
   return true;
 }
 
-// Attestation is a signed_claim_message
-// with a vse_claim_message claim
-bool application_Attest(int in_size, byte *in, int *size_out, byte *out) {
+bool application_GetParentEvidence(string *out) {
   app_request  req;
   app_response rsp;
 
-  // request
-  req.set_function("attest");
-  string req_arg_str;
-  req_arg_str.assign((char *)in, in_size);
-  req.add_args(req_arg_str);
-  string req_str;
-  req.SerializeToString(&req_str);
-  if (sized_pipe_write(writer, req_str.size(), (byte *)req_str.data()) < 0) {
-    printf("%s() error, line %d, application_Attest: sized_pipe_write failed\n",
-           __func__,
-           __LINE__);
-    return false;
-  }
-
-  // response
-  int  t_size = in_size + buffer_pad;
-  byte t_out[t_size];
-  int  n = read(reader, t_out, t_size);
-  if (n < 0) {
-    printf("%s() error, line %d, application_Attest: read failed\n",
-           __func__,
-           __LINE__);
-    return false;
-  }
-
-  string rsp_str;
-  rsp_str.assign((char *)t_out, n);
-  if (!rsp.ParseFromString(rsp_str)) {
-    printf("%s() error, line %d, application_Attest, can't parse response %d\n",
-           __func__,
-           __LINE__,
-           n);
+  req.set_function("getparentevidence");
+  if (!application_call(req, &rsp) || rsp.args_size() < 1)
     return false;
-  }
+  out->assign((char *)rsp.args(0).data(), (int)rsp.args(0).size());
+  return true;
+}
 
-  if (rsp.function() != "attest" || rsp.status() != "succeeded") {
-    printf("%s() error, line %d, application_Attest, function: %s, status: %s "
-           "is wrong\n",
-           __func__,
-           __LINE__,
-           rsp.function().c_str(),
-           rsp.status().c_str());
+// Copies the first response argument to out, or just sizes it.
+static bool application_result(const char         *fn,
+                               const app_response &rsp,
+                               int                *size_out,
+                               byte               *out) {
+  if (rsp.args_size() < 1) {
+    printf("%s() error, line %d, %s: no result\n", __func__, __LINE__, fn);
     return false;
   }
-
   if (out == nullptr) {
     *size_out = (int)rsp.args(0).size();
     return true;
   }
   if (*size_out < (int)rsp.args(0).size()) {
-    printf("%s() error, line %d, application_Attest: output too big\n",
-           __func__,
-           __LINE__);
+    printf("%s() error, line %d, %s: output too big\n", __func__, __LINE__, fn);
     return false;
   }
   *size_out = (int)rsp.args(0).size();
@@ -286,69 +611,111 @@ bool application_Attest(int in_size, byte *in, int *size_out, byte *out) {
   return true;
 }
 
-bool application_GetPlatformStatement(int *size_out, byte *out) {
+bool application_Seal(int in_size, byte *in, int *size_out, byte *out) {
   app_request  req;
   app_response rsp;
 
-#ifdef DEBUG
-  printf("application_GetPlatformStatement\n");
-#endif
-  // request
-  req.set_function("getplatformstatement");
-  string req_str;
-  req.SerializeToString(&req_str);
-  if (sized_pipe_write(writer, req_str.size(), (byte *)req_str.data()) < 0) {
-    printf("%s() error, line %d, application_GetPlatformStatement: "
-           "sized_pipe_write failed\n",
-           __func__,
-           __LINE__);
+  req.set_function("seal");
+  req.add_args((char *)in, in_size);
+  if (!application_call(req, &rsp))
     return false;
-  }
+  return application_result(__func__, rsp, size_out, out);
+}
 
-  // response
-  int  t_size = platform_statement_size;
-  byte t_out[t_size];
-  int  n = read(reader, t_out, t_size);
-  if (n < 0) {
-    printf("%s() error, line %d, application_GetPlatformStatement: bad read\n",
-           __func__,
-           __LINE__);
-    return false;
-  }
+bool application_Unseal(int in_size, byte *in, int *size_out, byte *out) {
+  app_request  req;
+  app_response rsp;
 
-  string rsp_str;
-  rsp_str.assign((char *)t_out, n);
-  if (!rsp.ParseFromString(rsp_str)) {
-    printf("%s() error, line %d, application_GetPlatformStatement: bad "
-           "ParseFromString\n",
-           __func__,
-           __LINE__);
+  req.set_function("unseal");
+  req.add_args((char *)in, in_size);
+  if (!application_call(req, &rsp))
     return false;
+  return application_result(__func__, rsp, size_out, out);
+}
+
+// Sends in as seal_batch or unseal_batch requests, as many items per
+// request as fit well inside a frame, and appends the results to out.
+static bool application_batch(const char                *fn,
+                              const std::vector<string> &in,
+                              std::vector<string>       *out) {
+  // Room for the sealing overhead and encoding of each item.
+  const int item_overhead = 256;
+  const int max_request_size = get_max_frame_size() / 2;
+
+  out->clear();
+  out->reserve(in.size());
+  size_t next = 0;
+  while (next < in.size()) {
+    app_request  req;
+    app_response rsp;
+    int          request_size = 0;
+    size_t       first = next;
+
+    req.set_function(fn);
+    while (next < in.size()) {
+      int item_size = (int)in[next].size() + item_overhead;
+      if (next > first && request_size + item_size > max_request_size)
+        break;
+      req.add_args(in[next]);
+      request_size += item_size;
+      next++;
+    }
+    if (!application_call(req, &rsp))
+      return false;
+    if (rsp.args_size() != req.args_size()) {
+      printf("%s() error, line %d, %s: %d results for %d items\n",
+             __func__,
+             __LINE__,
+             fn,
+             rsp.args_size(),
+             req.args_size());
+      return false;
+    }
+    for (int i = 0; i < rsp.args_size(); i++)
+      out->push_back(rsp.args(i));
   }
+  return true;
+}
 
-  if (rsp.function() != "getplatformstatement" || rsp.status() != "succeeded") {
-    printf("%s() error, line %d, application_GetPlatformStatement: function: "
-           "%s, status: %s is wrong\n",
-           __func__,
-           __LINE__,
-           rsp.function().c_str(),
-           rsp.status().c_str());
+bool application_Seal_batch(const std::vector<string> &in,
+                            std::vector<string>       *out) {
+  return application_batch("seal_batch", in, out);
+}
+
+bool application_Unseal_batch(const std::vector<string> &in,
+                              std::vector<string>       *out) {
+  return application_batch("unseal_batch", in, out);
+}
+
+// Attestation is a signed_claim_message
+// with a vse_claim_message claim
+bool application_Attest(int in_size, byte *in, int *size_out, byte *out) {
+  app_request  req;
+  app_response rsp;
+
+  req.set_function("attest");
+  req.add_args((char *)in, in_size);
+  if (!application_call(req, &rsp))
     return false;
-  }
+  return application_result(__func__, rsp, size_out, out);
+}
 
+bool application_GetPlatformStatement(int *size_out, byte *out) {
+  app_request  req;
+  app_response rsp;
+
+#ifdef DEBUG
+  printf("application_GetPlatformStatement\n");
+#endif
+  req.set_function("getplatformstatement");
+  if (!application_call(req, &rsp))
+    return false;
   if (out == nullptr) {
     *size_out = 0;
     return true;
   }
-  if (*size_out < (int)rsp.args(0).size()) {
-    printf("%s() error, line %d, application_GetPlatformStatement: output too "
-           "big\n",
-           __func__,
-           __LINE__);
+  if (!application_result(__func__, rsp, size_out, out))
     return false;
-  }
-  *size_out = (int)rsp.args(0).size();
-  memcpy(out, rsp.args(0).data(), *size_out);
 
 #ifdef DEBUG
   printf("application_GetPlatformStatement returns true\n");
@@ -47,6 +47,32 @@
 #  include "sev_support.h"
 #endif  // SEV_SNP
 
+#if defined(OE_CERTIFIER) || defined(KEYSTONE_CERTIFIER)
+#  ifndef NO_KEY_POOL
+#    define NO_KEY_POOL
+#  endif
+#  ifndef NO_RECERTIFIER
+#    define NO_RECERTIFIER
+#  endif
+#endif
+
+#if !defined(NO_KEY_POOL) || !defined(NO_RECERTIFIER)
+#  include <chrono>
+#  include <condition_variable>
+#  include <map>
+#  include <mutex>
+#  include <thread>
+#endif
+
+#ifndef OE_CERTIFIER
+#  include <algorithm>
+#  include <fcntl.h>
+#  include <netinet/tcp.h>
+#  include <poll.h>
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#endif  // OE_CERTIFIER
+
 using namespace certifier::framework;
 using namespace certifier::utilities;
 
@@ -86,10 +112,79 @@ extern string gramine_platform_cert;
 
 // #define DEBUG
 
+// Renews admissions certs in the background; see start_recertification.
+#ifndef NO_RECERTIFIER
+// lock_ covers the renewal schedule and data_lock_ the trust manager's
+// data.  Neither is held while a domain is attested and certified, and
+// lock_ is never taken with data_lock_ held.
+class certifier::framework::recertifier {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  class domain_state {
+   public:
+    string            cert_;
+    clock::time_point due_;
+  };
+
+  std::recursive_mutex                                 data_lock_;
+  std::mutex                                           lock_;
+  std::condition_variable                              wake_;
+  std::thread                                         *worker_;
+  bool                                                 stopping_;
+  double                                               renew_from_;
+  double                                               renew_to_;
+  int                                                  retry_seconds_;
+  int                                                  num_renewals_;
+  std::vector<std::pair<recertified_callback, void *>> callbacks_;
+  std::map<string, domain_state>                       domains_;
+
+  recertifier();
+
+  void schedule(const string &cert, domain_state *d);
+  void run(cc_trust_manager *mgr);
+};
+#else
+class certifier::framework::recertifier {};
+#endif  // NO_RECERTIFIER
+
+// Holds mgr's trust data lock until unlock or the end of the scope.
+class trust_data_lock {
+ public:
+  trust_data_lock(const cc_trust_manager &mgr) : mgr_(mgr), held_(true) {
+    mgr_.lock_trust_data();
+  }
+  ~trust_data_lock() { unlock(); }
+
+  void unlock() {
+    if (held_)
+      mgr_.unlock_trust_data();
+    held_ = false;
+  }
+
+ private:
+  const cc_trust_manager &mgr_;
+  bool                    held_;
+};
+
+// The policy cert, auth key and primary admissions cert, copied together
+// so a renewal can't change them part way.
+static void copy_credentials(const cc_trust_manager &mgr,
+                             string                 *policy_cert,
+                             key_message            *auth_key,
+                             string                 *admissions_cert) {
+  trust_data_lock l(mgr);
+  *policy_cert = mgr.serialized_policy_cert_;
+  auth_key->CopyFrom(mgr.private_auth_key_);
+  *admissions_cert = mgr.serialized_primary_admissions_cert_;
+}
+
 certifier::framework::accelerator::accelerator() {
   num_certs_ = 0;
   certs_ = nullptr;
   verified_ = false;
+  address_ = nullptr;
+  size_ = 0;
 }
 
 certifier::framework::accelerator::~accelerator() {
@@ -130,7 +225,10 @@ void certifier::framework::cc_trust_manager::cc_trust_manager_default_init() {
   x509_policy_cert_ = nullptr;
   cc_is_certified_ = false;
   peer_data_initialized_ = false;
+  recertifier_ = new recertifier();
+  max_num_accelerators_ = initial_num_accelerators;
   num_accelerators_ = 0;
+  accelerators_ = new accelerator *[max_num_accelerators_];
   max_num_certified_domains_ = MAX_NUM_CERTIFIERS;
   num_certified_domains_ = 0;
   certified_domains_ = new certifiers *[max_num_certified_domains_];
@@ -140,15 +238,25 @@ void certifier::framework::cc_trust_manager::cc_trust_manager_default_init() {
 }
 
 certifier::framework::cc_trust_manager::~cc_trust_manager() {
+  stop_recertification();
+  delete recertifier_;
+  recertifier_ = nullptr;
+
   for (int i = 0; i < num_certified_domains_; i++) {
     if (certified_domains_[i] != nullptr) {
       delete certified_domains_[i];
       certified_domains_[i] = nullptr;
     }
   }
-  delete certified_domains_;
+  delete[] certified_domains_;
   certified_domains_ = nullptr;
   num_certified_domains_ = 0;
+
+  for (int i = 0; i < num_accelerators_; i++)
+    delete accelerators_[i];
+  delete[] accelerators_;
+  accelerators_ = nullptr;
+  num_accelerators_ = 0;
 }
 
 bool certifier::framework::cc_trust_manager::initialize_enclave(
@@ -366,18 +474,72 @@ bool certifier::framework::cc_trust_manager::initialize_oe_enclave(
 
 bool certifier::framework::cc_trust_manager::accelerator_verified(
     const string &acc_type) {
+  bool found = false;
   for (int i = 0; i < num_accelerators_; i++) {
-    if (acc_type == accelerators_[i].accelerator_type_)
-      return accelerators_[i].verified_;
+    if (acc_type != accelerators_[i]->accelerator_type_)
+      continue;
+    if (!accelerators_[i]->verified_)
+      return false;
+    found = true;
   }
-  return false;
+  return found;
+}
+
+// The accelerator table has no fixed size; a node may have any number
+// of GPUs.
+certifier::framework::accelerator *
+certifier::framework::cc_trust_manager::new_accelerator() {
+  if (num_accelerators_ >= max_num_accelerators_) {
+    int           new_max = 2 * max_num_accelerators_;
+    accelerator **t = new accelerator *[new_max];
+    for (int i = 0; i < num_accelerators_; i++)
+      t[i] = accelerators_[i];
+    delete[] accelerators_;
+    accelerators_ = t;
+    max_num_accelerators_ = new_max;
+  }
+  accelerator *acc = new accelerator();
+  accelerators_[num_accelerators_++] = acc;
+  return acc;
 }
 
 bool certifier::framework::cc_trust_manager::add_accelerator(
     const string &acc_type,
     int           num_certs,
     string       *certs) {
-  return false;
+  trust_data_lock l(*this);
+  if (num_certs < 0 || (num_certs > 0 && certs == nullptr))
+    return false;
+
+  accelerator *acc = new_accelerator();
+  acc->accelerator_type_ = acc_type;
+  acc->location_type_ = "in-memory";
+  if (num_certs > 0) {
+    acc->certs_ = new string[num_certs];
+    acc->num_certs_ = num_certs;
+  }
+  for (int i = 0; i < num_certs; i++) {
+    acc->certs_[i] = certs[i];
+    evidence *ev = acc->support_.add_fact_assertion();
+    ev->set_evidence_type("cert");
+    ev->set_serialized_evidence(certs[i]);
+  }
+  return true;
+}
+
+bool certifier::framework::cc_trust_manager::add_accelerator_evidence(
+    const string           &acc_type,
+    const string           &acc_id,
+    const evidence_package &support,
+    bool                    verified) {
+  trust_data_lock l(*this);
+  accelerator *acc = new_accelerator();
+  acc->accelerator_type_ = acc_type;
+  acc->accelerator_id_ = acc_id;
+  acc->location_type_ = "in-memory";
+  acc->support_.CopyFrom(support);
+  acc->verified_ = verified;
+  return true;
 }
 
 bool certifier::framework::cc_trust_manager::init_policy_key(
@@ -591,6 +753,11 @@ void certifier::framework::cc_trust_manager::print_trust_data() {
 const int max_pad_size_for_store = 1024;
 
 bool certifier::framework::cc_trust_manager::save_store() {
+  trust_data_lock l(*this);
+
+  CC_METRICS_SPAN(span,
+                  "certifier_store_save_seconds",
+                  "Time to protect and write the store");
 
 #if 0
   printf("Saved trust data:\n");
@@ -607,8 +774,11 @@ bool certifier::framework::cc_trust_manager::save_store() {
     return false;
   }
 
-  int  size_protected_blob = serialized_store.size() + max_pad_size_for_store;
-  byte protected_blob[size_protected_blob];
+  int size_protected_blob = serialized_store.size() + max_pad_size_for_store;
+  scratch_buffer protected_blob_buf(size_protected_blob);
+  byte          *protected_blob = protected_blob_buf.data();
+  if (protected_blob == nullptr)
+    return false;
 
   byte pkb[max_symmetric_key_size_];
   memset(pkb, 0, max_symmetric_key_size_);
@@ -649,46 +819,43 @@ bool certifier::framework::cc_trust_manager::save_store() {
 }
 
 bool certifier::framework::cc_trust_manager::fetch_store() {
+  trust_data_lock l(*this);
 
-  int size_protected_blob = file_size(store_file_name_);
-  if (size_protected_blob < 0) {
-    printf("%s(): Invalid size_protected_blob=%d for store file name='%s'\n",
-           __func__,
-           size_protected_blob,
-           store_file_name_.c_str());
-    return false;
-  }
-  byte protected_blob[size_protected_blob];
-  int  size_unprotected_blob = size_protected_blob;
-  byte unprotected_blob[size_unprotected_blob];
-
-  memset(protected_blob, 0, size_protected_blob);
-  memset(unprotected_blob, 0, size_unprotected_blob);
+  CC_METRICS_SPAN(span,
+                  "certifier_store_fetch_seconds",
+                  "Time to read and unprotect the store");
 
-  if (!read_file(store_file_name_, &size_protected_blob, protected_blob)) {
+  // The file is ciphertext, so it needn't be wiped.
+  string protected_blob;
+  if (!read_file_into_string(store_file_name_, &protected_blob)) {
     printf("%s(): Can't read %s\n", __func__, store_file_name_.c_str());
     return false;
   }
+  int size_protected_blob = protected_blob.size();
 
   key_message pk;
   pk.set_key_name("protect-key");
   pk.set_key_type(Enc_method_aes_256_cbc_hmac_sha256);
   pk.set_key_format("vse-key");
 
+  // Decrypted once, straight into the buffer the store parses and then
+  // wipes.
+  int    size_unprotected_blob = size_protected_blob;
+  string serialized_store(size_unprotected_blob, 0);
   if (!unprotect_blob(enclave_type_,
                       size_protected_blob,
-                      protected_blob,
+                      (byte *)protected_blob.data(),
                       &pk,
                       &size_unprotected_blob,
-                      unprotected_blob)) {
+                      (byte *)&serialized_store[0])) {
     printf("%s(): Can't Unprotect\n", __func__);
+    OPENSSL_cleanse(&serialized_store[0], serialized_store.size());
     return false;
   }
+  serialized_store.resize(size_unprotected_blob);
 
   // read policy store
-  string serialized_store;
-  serialized_store.assign((char *)unprotected_blob, size_unprotected_blob);
-  if (!store_.Deserialize(serialized_store)) {
+  if (!store_.Deserialize_from(&serialized_store)) {
     printf("%s(): Can't deserialize store\n", __func__);
     return false;
   }
@@ -716,6 +883,7 @@ void certifier::framework::cc_trust_manager::clear_sensitive_data() {
 //  initialized cert is in the array initialized_cert with size
 //  initialized_cert_size These are set in embed+policy_key.cc.
 bool certifier::framework::cc_trust_manager::put_trust_data_in_store() {
+  trust_data_lock l(*this);
 
 #if 0
   store_.policy_key_.CopyFrom(public_policy_key_);
@@ -860,6 +1028,7 @@ bool certifier::framework::cc_trust_manager::put_trust_data_in_store() {
 }
 
 bool certifier::framework::cc_trust_manager::get_trust_data_from_store() {
+  trust_data_lock l(*this);
 
   const string string_type("string");
   const string key_type("key");
@@ -1070,19 +1239,280 @@ bool certifier::framework::cc_trust_manager::get_trust_data_from_store() {
   return false;
 }
 
+// Key pregeneration
+// -------------------------------------------------------------------
+
+static bool generate_private_key(const string &public_key_alg,
+                                 key_message  *k) {
+  if (public_key_alg == Enc_method_rsa_2048)
+    return make_certifier_rsa_key(2048, k);
+  if (public_key_alg == Enc_method_rsa_3072)
+    return make_certifier_rsa_key(3072, k);
+  if (public_key_alg == Enc_method_rsa_4096)
+    return make_certifier_rsa_key(4096, k);
+  if (public_key_alg == Enc_method_ecc_384)
+    return make_certifier_ecc_key(384, k);
+  printf("%s() error, line %d, Unsupported public key algorithm: '%s'\n",
+         __func__,
+         __LINE__,
+         public_key_alg.c_str());
+  return false;
+}
+
+#ifndef NO_KEY_POOL
+class key_pregenerator {
+ public:
+  class ready_keys {
+   public:
+    string             alg_;
+    int                depth_;
+    std::deque<string> sealed_;
+  };
+
+  std::mutex              lock_;
+  std::condition_variable wanted_;
+  std::thread            *worker_;
+  bool                    stopping_;
+  std::vector<ready_keys> algs_;
+  byte                    wrap_key_[cc_trust_manager::max_symmetric_key_size_];
+
+  key_pregenerator();
+
+  ready_keys *find(const string &alg);
+  bool        seal(const key_message &k, string *out);
+  bool        unseal(const string &in, key_message *k);
+  void        run();
+};
+
+static const char *key_wrap_alg = Enc_method_aes_256_gcm;
+static const int   key_wrap_pad = 128;
+
+key_pregenerator::key_pregenerator() : worker_(nullptr), stopping_(false) {
+  memset(wrap_key_, 0, sizeof(wrap_key_));
+}
+
+key_pregenerator::ready_keys *key_pregenerator::find(const string &alg) {
+  for (size_t i = 0; i < algs_.size(); i++) {
+    if (algs_[i].alg_ == alg)
+      return &algs_[i];
+  }
+  return nullptr;
+}
+
+bool key_pregenerator::seal(const key_message &k, string *out) {
+  string serialized;
+  byte   iv[block_size];
+  if (!k.SerializeToString(&serialized) || !get_random(8 * block_size, iv))
+    return false;
+  int size_out = serialized.size() + key_wrap_pad;
+  out->resize(size_out);
+  bool ret = authenticated_encrypt(key_wrap_alg,
+                                   (byte *)serialized.data(),
+                                   serialized.size(),
+                                   wrap_key_,
+                                   sizeof(wrap_key_),
+                                   iv,
+                                   block_size,
+                                   (byte *)&(*out)[0],
+                                   &size_out);
+  OPENSSL_cleanse(&serialized[0], serialized.size());
+  out->resize(ret ? size_out : 0);
+  return ret;
+}
+
+bool key_pregenerator::unseal(const string &in, key_message *k) {
+  int            size_out = in.size();
+  scratch_buffer buf(size_out);
+  if (buf.data() == nullptr
+      || !authenticated_decrypt(key_wrap_alg,
+                                (byte *)in.data(),
+                                in.size(),
+                                wrap_key_,
+                                sizeof(wrap_key_),
+                                buf.data(),
+                                &size_out))
+    return false;
+  return k->ParseFromArray(buf.data(), size_out);
+}
+
+// Generation happens outside the lock, so takers never wait on it.
+void key_pregenerator::run() {
+  std::unique_lock<std::mutex> l(lock_);
+  size_t                       next = 0;
+  while (!stopping_) {
+    string alg;
+    for (size_t i = 0; i < algs_.size() && alg.empty(); i++) {
+      ready_keys &r = algs_[(next + i) % algs_.size()];
+      if ((int)r.sealed_.size() < r.depth_) {
+        alg = r.alg_;
+        next = (next + i + 1) % algs_.size();
+      }
+    }
+    if (alg.empty()) {
+      wanted_.wait(l);
+      continue;
+    }
+    l.unlock();
+
+    key_message k;
+    string      sealed;
+    bool        ok = generate_private_key(alg, &k) && seal(k, &sealed);
+    k.Clear();
+
+    l.lock();
+    ready_keys *r = find(alg);
+    if (!ok) {
+      printf("%s() error, line %d, can't pregenerate %s keys\n",
+             __func__,
+             __LINE__,
+             alg.c_str());
+      if (r != nullptr)
+        r->depth_ = 0;
+    } else if (r != nullptr && (int)r->sealed_.size() < r->depth_) {
+      r->sealed_.push_back(sealed);
+    }
+  }
+}
+
+// Never destroyed; stop_key_pregeneration runs at exit so the worker is
+// gone before OpenSSL cleans up.
+static key_pregenerator *the_key_pregenerator = nullptr;
+static std::mutex        key_pregenerator_lock;
+
+static key_pregenerator *get_key_pregenerator() {
+  std::lock_guard<std::mutex> l(key_pregenerator_lock);
+  return the_key_pregenerator;
+}
+
+bool certifier::framework::start_key_pregeneration(const string &public_key_alg,
+                                                   int           depth) {
+  if (depth <= 0) {
+    printf("%s() error, line %d, bad depth %d\n", __func__, __LINE__, depth);
+    return false;
+  }
+  if (public_key_alg != Enc_method_rsa_2048
+      && public_key_alg != Enc_method_rsa_3072
+      && public_key_alg != Enc_method_rsa_4096
+      && public_key_alg != Enc_method_ecc_384) {
+    printf("%s() error, line %d, Unsupported public key algorithm: '%s'\n",
+           __func__,
+           __LINE__,
+           public_key_alg.c_str());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> g(key_pregenerator_lock);
+  if (the_key_pregenerator == nullptr) {
+    the_key_pregenerator = new key_pregenerator();
+    atexit(stop_key_pregeneration);
+  }
+  key_pregenerator           *p = the_key_pregenerator;
+  std::lock_guard<std::mutex> l(p->lock_);
+  if (p->worker_ == nullptr) {
+    if (!get_random(8 * (int)sizeof(p->wrap_key_), p->wrap_key_))
+      return false;
+    p->stopping_ = false;
+    p->worker_ = new std::thread(&key_pregenerator::run, p);
+  }
+  key_pregenerator::ready_keys *r = p->find(public_key_alg);
+  if (r == nullptr) {
+    p->algs_.push_back(key_pregenerator::ready_keys());
+    r = &p->algs_.back();
+    r->alg_ = public_key_alg;
+  }
+  r->depth_ = depth;
+  p->wanted_.notify_one();
+  return true;
+}
+
+void certifier::framework::stop_key_pregeneration() {
+  std::lock_guard<std::mutex> g(key_pregenerator_lock);
+  key_pregenerator           *p = the_key_pregenerator;
+  if (p == nullptr)
+    return;
+  {
+    std::lock_guard<std::mutex> l(p->lock_);
+    if (p->worker_ == nullptr)
+      return;
+    p->stopping_ = true;
+    p->wanted_.notify_one();
+  }
+  p->worker_->join();
+  delete p->worker_;
+
+  std::lock_guard<std::mutex> l(p->lock_);
+  p->worker_ = nullptr;
+  for (size_t i = 0; i < p->algs_.size(); i++) {
+    for (size_t j = 0; j < p->algs_[i].sealed_.size(); j++) {
+      string &sealed = p->algs_[i].sealed_[j];
+      OPENSSL_cleanse(&sealed[0], sealed.size());
+    }
+  }
+  p->algs_.clear();
+  OPENSSL_cleanse(p->wrap_key_, sizeof(p->wrap_key_));
+}
+
+int certifier::framework::num_pregenerated_keys(const string &public_key_alg) {
+  key_pregenerator *p = get_key_pregenerator();
+  if (p == nullptr)
+    return 0;
+  std::lock_guard<std::mutex>   l(p->lock_);
+  key_pregenerator::ready_keys *r = p->find(public_key_alg);
+  return r == nullptr ? 0 : (int)r->sealed_.size();
+}
+
+bool certifier::framework::new_private_key(const string &public_key_alg,
+                                           key_message  *k) {
+  key_pregenerator *p = get_key_pregenerator();
+  if (p != nullptr) {
+    std::lock_guard<std::mutex>   l(p->lock_);
+    key_pregenerator::ready_keys *r = p->find(public_key_alg);
+    if (r != nullptr && !r->sealed_.empty()) {
+      string sealed;
+      sealed.swap(r->sealed_.front());
+      r->sealed_.pop_front();
+      p->wanted_.notify_one();
+      if (p->unseal(sealed, k))
+        return true;
+    }
+  }
+  return generate_private_key(public_key_alg, k);
+}
+#else
+bool certifier::framework::start_key_pregeneration(const string &public_key_alg,
+                                                   int           depth) {
+  return false;
+}
+
+void certifier::framework::stop_key_pregeneration() {}
+
+int certifier::framework::num_pregenerated_keys(const string &public_key_alg) {
+  return 0;
+}
+
+bool certifier::framework::new_private_key(const string &public_key_alg,
+                                           key_message  *k) {
+  return generate_private_key(public_key_alg, k);
+}
+#endif  // NO_KEY_POOL
+
 // If regen is true, replace them even if they are valid
+// The generators below hold the trust data lock only to read the
+// settings and to install the result, never while a key is being made.
 bool certifier::framework::cc_trust_manager::generate_symmetric_key(
     bool regen) {
-
+  trust_data_lock l(*this);
   if (cc_symmetric_key_initialized_ && !regen)
     return true;
+  string alg = symmetric_key_algorithm_;
+  l.unlock();
 
   // Make up symmetric keys (e.g.-for sealing) for app
   int num_key_bytes;
-  if (symmetric_key_algorithm_ == Enc_method_aes_256_cbc_hmac_sha256
-      || symmetric_key_algorithm_ == Enc_method_aes_256_cbc_hmac_sha384
-      || symmetric_key_algorithm_ == Enc_method_aes_256_gcm) {
-    num_key_bytes = cipher_key_byte_size(symmetric_key_algorithm_.c_str());
+  if (alg == Enc_method_aes_256_cbc_hmac_sha256
+      || alg == Enc_method_aes_256_cbc_hmac_sha384
+      || alg == Enc_method_aes_256_gcm) {
+    num_key_bytes = cipher_key_byte_size(alg.c_str());
     if (num_key_bytes <= 0) {
       printf("%s() error, line %d, Can't recover symmetric alg key size\n",
              __func__,
@@ -1093,18 +1523,23 @@ bool certifier::framework::cc_trust_manager::generate_symmetric_key(
     printf("%s() error, line %d, unsupported encryption algorithm: '%s'\n",
            __func__,
            __LINE__,
-           symmetric_key_algorithm_.c_str());
+           alg.c_str());
     return false;
   }
-  memset(symmetric_key_bytes_, 0, max_symmetric_key_size_);
-  if (!get_random(8 * num_key_bytes, symmetric_key_bytes_)) {
+  byte key_bytes[max_symmetric_key_size_];
+  memset(key_bytes, 0, max_symmetric_key_size_);
+  if (!get_random(8 * num_key_bytes, key_bytes)) {
     printf("%s() error, line %d, Can't get random bytes for app key\n",
            __func__,
            __LINE__);
     return false;
   }
+
+  trust_data_lock l2(*this);
+  memcpy(symmetric_key_bytes_, key_bytes, max_symmetric_key_size_);
+  memset(key_bytes, 0, max_symmetric_key_size_);
   symmetric_key_.set_key_name("app-symmetric-key");
-  symmetric_key_.set_key_type(symmetric_key_algorithm_);
+  symmetric_key_.set_key_type(alg);
   symmetric_key_.set_key_format("vse-key");
   symmetric_key_.set_secret_key_bits(symmetric_key_bytes_, 8 * num_key_bytes);
 
@@ -1112,16 +1547,18 @@ bool certifier::framework::cc_trust_manager::generate_symmetric_key(
 }
 
 bool certifier::framework::cc_trust_manager::generate_sealing_key(bool regen) {
-
+  trust_data_lock l(*this);
   if (cc_sealing_key_initialized_ && !regen)
     return true;
+  string alg = symmetric_key_algorithm_;
+  l.unlock();
 
   // Make up symmetric keys (e.g.-for sealing)for app
   int num_key_bytes;
-  if (symmetric_key_algorithm_ == Enc_method_aes_256_cbc_hmac_sha256
-      || symmetric_key_algorithm_ == Enc_method_aes_256_cbc_hmac_sha384
-      || symmetric_key_algorithm_ == Enc_method_aes_256_gcm) {
-    num_key_bytes = cipher_key_byte_size(symmetric_key_algorithm_.c_str());
+  if (alg == Enc_method_aes_256_cbc_hmac_sha256
+      || alg == Enc_method_aes_256_cbc_hmac_sha384
+      || alg == Enc_method_aes_256_gcm) {
+    num_key_bytes = cipher_key_byte_size(alg.c_str());
     if (num_key_bytes <= 0) {
       printf("%s() error, line %d, Can't get symmetric alg key size\n",
              __func__,
@@ -1132,18 +1569,23 @@ bool certifier::framework::cc_trust_manager::generate_sealing_key(bool regen) {
     printf("%s() error, line %d, unsupported encryption algorithm: '%s'\n",
            __func__,
            __LINE__,
-           symmetric_key_algorithm_.c_str());
+           alg.c_str());
     return false;
   }
-  memset(sealing_key_bytes_, 0, max_symmetric_key_size_);
-  if (!get_random(8 * num_key_bytes, sealing_key_bytes_)) {
+  byte key_bytes[max_symmetric_key_size_];
+  memset(key_bytes, 0, max_symmetric_key_size_);
+  if (!get_random(8 * num_key_bytes, key_bytes)) {
     printf("%s() error, line %d, Can't get random bytes for app key\n",
            __func__,
            __LINE__);
     return false;
   }
+
+  trust_data_lock l2(*this);
+  memcpy(sealing_key_bytes_, key_bytes, max_symmetric_key_size_);
+  memset(key_bytes, 0, max_symmetric_key_size_);
   service_sealing_key_.set_key_name("sealing-key");
-  service_sealing_key_.set_key_type(symmetric_key_algorithm_);
+  service_sealing_key_.set_key_type(alg);
   service_sealing_key_.set_key_format("vse-key");
   service_sealing_key_.set_secret_key_bits(sealing_key_bytes_,
                                            8 * num_key_bytes);
@@ -1152,107 +1594,64 @@ bool certifier::framework::cc_trust_manager::generate_sealing_key(bool regen) {
 }
 
 bool certifier::framework::cc_trust_manager::generate_auth_key(bool regen) {
-
+  trust_data_lock l(*this);
   if (cc_auth_key_initialized_ && !regen)
     return true;
+  string alg = public_key_algorithm_;
+  l.unlock();
 
   // make app auth private and public key
-  if (public_key_algorithm_ == Enc_method_rsa_2048) {
-    if (!make_certifier_rsa_key(2048, &private_auth_key_)) {
-      printf("%s() error, line %d, Can't generate App private key\n",
-             __func__,
-             __LINE__);
-      return false;
-    }
-  } else if (public_key_algorithm_ == Enc_method_rsa_3072) {
-    if (!make_certifier_rsa_key(3072, &private_auth_key_)) {
-      printf("%s() error, line %d, Can't generate App private key\n",
-             __func__,
-             __LINE__);
-      return false;
-    }
-  } else if (public_key_algorithm_ == Enc_method_rsa_4096) {
-    if (!make_certifier_rsa_key(4096, &private_auth_key_)) {
-      printf("%s() error, line %d, Can't generate App private key\n",
-             __func__,
-             __LINE__);
-      return false;
-    }
-  } else if (public_key_algorithm_ == Enc_method_ecc_384) {
-    if (!make_certifier_ecc_key(384, &private_auth_key_)) {
-      printf("%s() error, line %d, Can't generate App private key\n",
-             __func__,
-             __LINE__);
-      return false;
-    }
-  } else {
-    printf("%s() error, line %d, Unsupported public key algorithm: '%s'\n",
+  key_message priv;
+  key_message pub;
+  if (!new_private_key(alg, &priv)) {
+    printf("%s() error, line %d, Can't generate App private key\n",
            __func__,
-           __LINE__,
-           public_key_algorithm_.c_str());
+           __LINE__);
     return false;
   }
 
-  private_auth_key_.set_key_name("auth-key");
-  if (!private_key_to_public_key(private_auth_key_, &public_auth_key_)) {
+  priv.set_key_name("auth-key");
+  if (!private_key_to_public_key(priv, &pub)) {
     printf("%s() error, line %d, Can't make public Auth key\n",
            __func__,
            __LINE__);
     return false;
   }
 
+  trust_data_lock l2(*this);
+  private_auth_key_.Swap(&priv);
+  public_auth_key_.Swap(&pub);
   return true;
 }
 
 bool certifier::framework::cc_trust_manager::generate_service_key(bool regen) {
-
+  trust_data_lock l(*this);
   if (cc_service_key_initialized_ && !regen)
     return true;
+  string alg = public_key_algorithm_;
+  l.unlock();
 
   // make app service private and public key
-  if (public_key_algorithm_ == Enc_method_rsa_2048) {
-    if (!make_certifier_rsa_key(2048, &private_service_key_)) {
-      printf("%s() error, line %d, Can't generate App private key\n",
-             __func__,
-             __LINE__);
-      return false;
-    }
-  } else if (public_key_algorithm_ == Enc_method_rsa_3072) {
-    if (!make_certifier_rsa_key(3072, &private_service_key_)) {
-      printf("%s() error, line %d, Can't generate App private key\n",
-             __func__,
-             __LINE__);
-      return false;
-    }
-  } else if (public_key_algorithm_ == Enc_method_rsa_4096) {
-    if (!make_certifier_rsa_key(4096, &private_service_key_)) {
-      printf("%s() error, line %d, Can't generate App private key\n",
-             __func__,
-             __LINE__);
-      return false;
-    }
-  } else if (public_key_algorithm_ == Enc_method_ecc_384) {
-    if (!make_certifier_ecc_key(384, &private_service_key_)) {
-      printf("%s() error, line %d, Can't generate App private key\n",
-             __func__,
-             __LINE__);
-      return false;
-    }
-  } else {
-    printf("%s() error, line %d, Unsupported public key algorithm\n",
+  key_message priv;
+  key_message pub;
+  if (!new_private_key(alg, &priv)) {
+    printf("%s() error, line %d, Can't generate App private key\n",
            __func__,
            __LINE__);
     return false;
   }
 
-  private_service_key_.set_key_name("service-attest-key");
-  if (!private_key_to_public_key(private_service_key_, &public_service_key_)) {
+  priv.set_key_name("service-attest-key");
+  if (!private_key_to_public_key(priv, &pub)) {
     printf("%s() error, line %d, Can't make public service key\n",
            __func__,
            __LINE__);
     return false;
   }
 
+  trust_data_lock l2(*this);
+  private_service_key_.Swap(&priv);
+  public_service_key_.Swap(&pub);
   return true;
 }
 
@@ -1392,9 +1791,10 @@ bool certifier::framework::cc_trust_manager::GetPlatformSaysAttestClaim(
     return simulated_GetAttestClaim(scm);
   }
   if (enclave_type_ == "application-enclave") {
-    int  size_out = 8192;
-    byte out[size_out];
-    if (!application_GetPlatformStatement(&size_out, out)) {
+    int            size_out = 8192;
+    scratch_buffer out_buf(size_out);
+    byte          *out = out_buf.data();
+    if (out == nullptr || !application_GetPlatformStatement(&size_out, out)) {
       printf("%s() error, line %d, Can't get Platform Statement from parent\n",
              __func__,
              __LINE__);
@@ -1420,6 +1820,7 @@ bool certifier::framework::cc_trust_manager::add_or_update_new_domain(
     int           port,
     const string &service_host,
     int           service_port) {
+  trust_data_lock l(*this);
 
   // don't duplicate
   certifiers *found = nullptr;
@@ -1453,6 +1854,7 @@ bool certifier::framework::cc_trust_manager::add_or_update_new_domain(
 }
 
 bool certifier::framework::cc_trust_manager::certify_primary_domain() {
+  trust_data_lock l(*this);
 
   // already certified
   if (cc_is_certified_)
@@ -1464,29 +1866,32 @@ bool certifier::framework::cc_trust_manager::certify_primary_domain() {
     printf("%s() error, line %d, primary domain\n", __func__, __LINE__);
     return false;
   }
+  certifiers *primary = certified_domains_[0];
 
 #ifdef DEBUG
   // Debug: print primary certifier data
   printf("Certifying primary domain\n");
-  certified_domains_[0]->print_certifiers_entry();
+  primary->print_certifiers_entry();
 #endif
 
-  if (!certified_domains_[0]->certify_domain(purpose_)) {
+  // Not held while attesting and waiting for the Certifier Service.
+  l.unlock();
+  if (!primary->certify_domain(purpose_)) {
     printf("%s() error, line %d, can't certify primary domain\n",
            __func__,
            __LINE__);
     return false;
   }
 
+  trust_data_lock l2(*this);
   if (purpose_ == "authentication") {
     cc_auth_key_initialized_ = true;
     primary_admissions_cert_valid_ = true;
-    serialized_primary_admissions_cert_ =
-        certified_domains_[0]->admissions_cert_;
+    serialized_primary_admissions_cert_ = primary->admissions_cert_;
     cc_is_certified_ = true;
   } else if (purpose_ == "attestation") {
     cc_service_platform_rule_initialized_ = true;
-    if (!platform_rule_.ParseFromString(certified_domains_[0]->signed_rule_)) {
+    if (!platform_rule_.ParseFromString(primary->signed_rule_)) {
       printf("%s():%d error, Can't parse platform rule\n", __func__, __LINE__);
     }
     cc_is_certified_ = true;
@@ -1499,6 +1904,7 @@ bool certifier::framework::cc_trust_manager::certify_primary_domain() {
 
 bool certifier::framework::cc_trust_manager::certify_secondary_domain(
     const string &domain_name) {
+  trust_data_lock l(*this);
 
   // find it
   certifiers *found = nullptr;
@@ -1509,6 +1915,7 @@ bool certifier::framework::cc_trust_manager::certify_secondary_domain(
       break;
     }
   }
+  l.unlock();
   return (found ? found->certify_domain(purpose_) : false);
 }
 
@@ -1537,6 +1944,7 @@ bool certifier::framework::cc_trust_manager::run_peer_certification_service(
 }
 
 bool certifier::framework::cc_trust_manager::get_certifiers_from_store() {
+  trust_data_lock l(*this);
 
   int ent = store_.find_entry("all-certifiers", "certifiers_message");
   if (ent < 0) {
@@ -1587,6 +1995,7 @@ bool certifier::framework::cc_trust_manager::get_certifiers_from_store() {
 }
 
 bool certifier::framework::cc_trust_manager::put_certifiers_in_store() {
+  trust_data_lock l(*this);
   certifiers_message cert_messages;
   string             serialized_cert_messages;
 
@@ -1719,7 +2128,21 @@ bool certifier::framework::certifiers::get_certified_status() {
 // add auth-key and symmetric key
 bool certifier::framework::certifiers::certify_domain(const string &purpose) {
 
-  purpose_ = purpose;
+  CC_METRICS_SPAN(span,
+                  "certifier_certify_domain_seconds",
+                  "Time to certify a domain, end to end");
+  trust_response_message response;
+  return request_certification(purpose, &response)
+         && accept_certification(purpose, response);
+}
+
+bool certifier::framework::certifiers::request_certification(
+    const string           &purpose,
+    trust_response_message *response) {
+
+  CC_METRICS_COUNT("certifier_certify_requests_total",
+                   "Certification requests",
+                   1);
 
   // owner has enclave_type, keys, and store.
   if (owner_ == nullptr) {
@@ -1853,6 +2276,8 @@ bool certifier::framework::certifiers::certify_domain(const string &purpose) {
     return false;
   }
 
+  // The keys may be rotated by another thread.
+  trust_data_lock       keys(*owner_);
   attestation_user_data ud;
   if (purpose == "authentication") {
 #ifdef DEBUG
@@ -1906,9 +2331,13 @@ bool certifier::framework::certifiers::certify_domain(const string &purpose) {
            __LINE__);
     return false;
   }
+  keys.unlock();
 
-  int  size_out = 16000;
-  byte out[size_out];
+  int            size_out = 16000;
+  scratch_buffer out_buf(size_out);
+  byte          *out = out_buf.data();
+  if (out == nullptr)
+    return false;
   if (!Attest(owner_->enclave_type_,
               serialized_ud.size(),
               (byte *)serialized_ud.data(),
@@ -1920,11 +2349,8 @@ bool certifier::framework::certifiers::certify_domain(const string &purpose) {
   string the_attestation_str;
   the_attestation_str.assign((char *)out, size_out);
 
-  // Now, if there are accelerators, verify them.
-
   // Get certified
-  trust_request_message  request;
-  trust_response_message response;
+  trust_request_message request;
 
   // Should trust_request_message should be signed by auth key
   //   to prevent MITM attacks?  Probably not.
@@ -1964,6 +2390,19 @@ bool certifier::framework::certifiers::certify_domain(const string &purpose) {
   }
   request.set_allocated_support(ep);
 
+  // Evidence for any accelerators goes along with the request.
+  trust_data_lock accels(*owner_);
+  for (int i = 0; i < owner_->num_accelerators_; i++) {
+    accelerator *acc = owner_->accelerators_[i];
+    if (acc->support_.fact_assertion_size() == 0)
+      continue;
+    accelerator_group *ag = request.add_accels();
+    ag->set_type(acc->accelerator_type_);
+    ag->set_id(acc->accelerator_id_);
+    ag->mutable_support()->CopyFrom(acc->support_);
+  }
+  accels.unlock();
+
   // Serialize request
   string serialized_request;
   if (!request.SerializeToString(&serialized_request)) {
@@ -1979,6 +2418,9 @@ bool certifier::framework::certifiers::certify_domain(const string &purpose) {
 #endif
 
   // Open socket and send request.
+  CC_METRICS_SPAN(rt_span,
+                  "certifier_certify_round_trip_seconds",
+                  "Certifier Service request round trip");
   int sock = -1;
   if (!open_client_socket(host_, port_, &sock)) {
     printf("%s() error, line: %d, Can't open request socket\n",
@@ -2007,28 +2449,40 @@ bool certifier::framework::certifiers::certify_domain(const string &purpose) {
     printf("%s() error, line: %d, Can't read response\n", __func__, __LINE__);
     return false;
   }
-  if (!response.ParseFromString(serialized_response)) {
+  if (!response->ParseFromString(serialized_response)) {
     printf("%s() error, line: %d, Can't parse response\n", __func__, __LINE__);
     return false;
   }
   close(sock);
+  CC_METRICS_SPAN_END(rt_span);
 
 #ifdef DEBUG
   printf("\nResponse:\n");
-  print_trust_response_message(response);
+  print_trust_response_message(*response);
 #endif
 
-  if (response.status() != "succeeded") {
+  if (response->status() != "succeeded") {
     printf("%s() error, line: %d, Certification failed, status='%s'\n",
            __func__,
            __LINE__,
-           response.status().c_str());
+           response->status().c_str());
     printf("\nResponse:\n");
-    print_trust_response_message(response);
+    print_trust_response_message(*response);
     return false;
   }
+  return true;
+}
+
+bool certifier::framework::certifiers::accept_certification(
+    const string                 &purpose,
+    const trust_response_message &response) {
+  trust_data_lock l(*owner_);
 
+  purpose_ = purpose;
   is_certified_ = true;
+  CC_METRICS_COUNT("certifier_certify_succeeded_total",
+                   "Successful certifications",
+                   1);
 
   // Store the admissions certificate cert or platform rule
   if (owner_->purpose_ == "authentication") {
@@ -2064,6 +2518,238 @@ bool certifier::framework::certifiers::certify_domain(const string &purpose) {
   return owner_->save_store();
 }
 
+// Re-certification
+// -------------------------------------------------------------------
+
+#ifndef NO_RECERTIFIER
+certifier::framework::recertifier::recertifier()
+    : worker_(nullptr),
+      stopping_(false),
+      renew_from_(0.5),
+      renew_to_(0.75),
+      retry_seconds_(60),
+      num_renewals_(0) {}
+
+// Seconds from now until the fraction frac of cert's lifetime is gone.
+static bool renewal_delay(const string &cert, double frac, double *secs) {
+  X509 *x = cert_verifier::instance().decode(cert);
+  if (x == nullptr)
+    return false;
+  int  age_days = 0, age_secs = 0, life_days = 0, life_secs = 0;
+  bool ret =
+      ASN1_TIME_diff(&age_days, &age_secs, X509_get0_notBefore(x), nullptr)
+      && ASN1_TIME_diff(&life_days,
+                        &life_secs,
+                        X509_get0_notBefore(x),
+                        X509_get0_notAfter(x));
+  X509_free(x);
+  if (!ret)
+    return false;
+  double age = age_days * 86400.0 + age_secs;
+  double life = life_days * 86400.0 + life_secs;
+  *secs = life * frac - age;
+  return true;
+}
+
+void certifier::framework::recertifier::schedule(const string &cert,
+                                                 domain_state *d) {
+  uint32_t r = 0;
+  double   frac = renew_from_;
+  if (get_random(8 * sizeof(r), (byte *)&r))
+    frac += (renew_to_ - renew_from_) * (r / 4294967296.0);
+  double secs = 0.0;
+  if (!renewal_delay(cert, frac, &secs)) {
+    printf("%s() error, line %d, can't read admissions cert validity\n",
+           __func__,
+           __LINE__);
+    secs = retry_seconds_;
+  }
+  d->cert_ = cert;
+  d->due_ = clock::now()
+            + std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(secs > 0.0 ? secs : 0.0));
+}
+
+// Domains are rescanned each time round, so certs renewed by the
+// application, and domains it adds, are picked up.  A due domain is
+// certified from a copy with no lock held; the renewed cert is then
+// installed in the domain, if it is still there, and the store saved
+// under the trust data lock.  Callbacks run without either lock.
+void certifier::framework::recertifier::run(cc_trust_manager *mgr) {
+  std::unique_lock<std::mutex> l(lock_);
+  while (!stopping_) {
+    std::vector<certifiers> domains;
+    l.unlock();
+    {
+      trust_data_lock t(*mgr);
+      for (int i = 0; i < mgr->num_certified_domains_; i++) {
+        certifiers *c = mgr->certified_domains_[i];
+        if (c != nullptr && c->is_certified_ && !c->admissions_cert_.empty())
+          domains.push_back(*c);
+      }
+    }
+    l.lock();
+    if (stopping_)
+      break;
+
+    clock::time_point now = clock::now();
+    clock::time_point next = now + std::chrono::hours(24);
+    certifiers       *due = nullptr;
+    for (size_t i = 0; i < domains.size() && due == nullptr; i++) {
+      certifiers   &c = domains[i];
+      domain_state &d = domains_[c.domain_name_];
+      if (d.cert_ != c.admissions_cert_)
+        schedule(c.admissions_cert_, &d);
+      if (d.due_ <= now)
+        due = &c;
+      else if (d.due_ < next)
+        next = d.due_;
+    }
+    if (due == nullptr) {
+      wake_.wait_until(l, next);
+      continue;
+    }
+
+    string name = due->domain_name_;
+    string cert;
+    bool   ok = false;
+    l.unlock();
+    trust_response_message response;
+    if (due->request_certification(mgr->purpose_, &response)) {
+      trust_data_lock t(*mgr);
+      for (int i = 0; i < mgr->num_certified_domains_ && !ok; i++) {
+        certifiers *c = mgr->certified_domains_[i];
+        if (c == nullptr || c->domain_name_ != name)
+          continue;
+        ok = c->accept_certification(mgr->purpose_, response);
+        cert = c->admissions_cert_;
+      }
+    }
+    l.lock();
+
+    // start_recertification may have cleared domains_ meanwhile.
+    domain_state &d = domains_[name];
+    if (!ok) {
+      printf("%s() error, line %d, can't recertify %s, retrying in %d s\n",
+             __func__,
+             __LINE__,
+             name.c_str(),
+             retry_seconds_);
+      d.due_ = clock::now() + std::chrono::seconds(retry_seconds_);
+      continue;
+    }
+    num_renewals_++;
+    schedule(cert, &d);
+
+    std::vector<std::pair<recertified_callback, void *>> callbacks = callbacks_;
+    l.unlock();
+    for (size_t i = 0; i < callbacks.size(); i++)
+      callbacks[i].first(*mgr, name, cert, callbacks[i].second);
+    l.lock();
+  }
+}
+
+bool certifier::framework::cc_trust_manager::start_recertification(
+    double renew_from,
+    double renew_to,
+    int    retry_seconds) {
+  if (renew_from <= 0.0 || renew_to < renew_from || renew_to >= 1.0
+      || retry_seconds <= 0) {
+    printf("%s() error, line %d, bad renewal window\n", __func__, __LINE__);
+    return false;
+  }
+  std::lock_guard<std::mutex> l(recertifier_->lock_);
+  recertifier_->renew_from_ = renew_from;
+  recertifier_->renew_to_ = renew_to;
+  recertifier_->retry_seconds_ = retry_seconds;
+  recertifier_->domains_.clear();
+  if (recertifier_->worker_ == nullptr) {
+    recertifier_->stopping_ = false;
+    recertifier_->worker_ =
+        new std::thread(&recertifier::run, recertifier_, this);
+  }
+  recertifier_->wake_.notify_one();
+  return true;
+}
+
+void certifier::framework::cc_trust_manager::stop_recertification() {
+  std::thread *worker = nullptr;
+  {
+    std::lock_guard<std::mutex> l(recertifier_->lock_);
+    worker = recertifier_->worker_;
+    recertifier_->stopping_ = true;
+    recertifier_->wake_.notify_one();
+  }
+  if (worker == nullptr)
+    return;
+  worker->join();
+  delete worker;
+  std::lock_guard<std::mutex> l(recertifier_->lock_);
+  recertifier_->worker_ = nullptr;
+}
+
+bool certifier::framework::cc_trust_manager::add_recertified_callback(
+    recertified_callback callback,
+    void                *arg) {
+  if (callback == nullptr)
+    return false;
+  std::lock_guard<std::mutex> l(recertifier_->lock_);
+  recertifier_->callbacks_.push_back(std::make_pair(callback, arg));
+  return true;
+}
+
+int certifier::framework::cc_trust_manager::num_recertifications() {
+  std::lock_guard<std::mutex> l(recertifier_->lock_);
+  return recertifier_->num_renewals_;
+}
+
+void certifier::framework::cc_trust_manager::lock_trust_data() const {
+  recertifier_->data_lock_.lock();
+}
+
+void certifier::framework::cc_trust_manager::unlock_trust_data() const {
+  recertifier_->data_lock_.unlock();
+}
+#else
+bool certifier::framework::cc_trust_manager::start_recertification(
+    double renew_from,
+    double renew_to,
+    int    retry_seconds) {
+  return false;
+}
+
+void certifier::framework::cc_trust_manager::stop_recertification() {}
+
+bool certifier::framework::cc_trust_manager::add_recertified_callback(
+    recertified_callback callback,
+    void                *arg) {
+  return false;
+}
+
+int certifier::framework::cc_trust_manager::num_recertifications() {
+  return 0;
+}
+
+void certifier::framework::cc_trust_manager::lock_trust_data() const {}
+
+void certifier::framework::cc_trust_manager::unlock_trust_data() const {}
+#endif  // NO_RECERTIFIER
+
+bool certifier::framework::cc_trust_manager::get_admissions_cert(
+    const string &domain_name,
+    string       *cert) {
+  trust_data_lock l(*this);
+  for (int i = 0; i < num_certified_domains_; i++) {
+    certifiers *c = certified_domains_[i];
+    if (c != nullptr && c->domain_name_ == domain_name && c->is_certified_
+        && !c->admissions_cert_.empty()) {
+      cert->assign(c->admissions_cert_);
+      return true;
+    }
+  }
+  return false;
+}
+
 // --------------------------------------------------------------------------------------
 // helpers for proofs
 
@@ -2385,6 +3071,18 @@ bool extract_id_from_cert(X509 *in, string *out) {
   return true;
 }
 
+// Trusts root through cert_verifier's store for it, shared by every
+// SSL_CTX with that root, rather than a store built for this one.
+static bool use_trust_root(SSL_CTX *ctx, X509 *root) {
+  X509_STORE *st = cert_verifier::instance().store(root);
+  if (st == nullptr) {
+    printf("%s() error, line %d, no store for root\n", __func__, __LINE__);
+    return false;
+  }
+  SSL_CTX_set_cert_store(ctx, st);  // takes the reference
+  return true;
+}
+
 // Loads server side certs and keys.
 bool load_server_certs_and_key(X509         *root_cert,
                                key_message  &private_key,
@@ -2401,8 +3099,8 @@ bool load_server_certs_and_key(X509         *root_cert,
   EVP_PKEY *auth_private_key = EVP_PKEY_new();
   EVP_PKEY_set1_RSA(auth_private_key, r);
 
-  X509 *x509_auth_key_cert = X509_new();
-  if (!asn1_to_x509(private_key_cert, x509_auth_key_cert)) {
+  X509 *x509_auth_key_cert = cert_verifier::instance().decode(private_key_cert);
+  if (x509_auth_key_cert == nullptr) {
     printf("%s() error, line %d, asn1_to_x509 failed %d\n",
            __func__,
            __LINE__,
@@ -2512,8 +3210,8 @@ bool load_server_certs_and_key(X509         *root_cert,
   auth_private_key = EVP_PKEY_new();
   EVP_PKEY_set1_RSA(auth_private_key, r);
 
-  x509_auth_key_cert = X509_new();
-  if (!asn1_to_x509(private_key_cert, x509_auth_key_cert)) {
+  x509_auth_key_cert = cert_verifier::instance().decode(private_key_cert);
+  if (x509_auth_key_cert == nullptr) {
     printf("%s() error, line %d, asn1_to_x509 failed %d\n",
            __func__,
            __LINE__,
@@ -2624,47 +3322,178 @@ done:
     EVP_PKEY_free(auth_private_key);
     auth_private_key = nullptr;
   }
+  if (x509_auth_key_cert != nullptr) {
+    X509_free(x509_auth_key_cert);
+    x509_auth_key_cert = nullptr;
+  }
   return ret;
 }
 
-bool certifier::framework::server_dispatch(
-    const string &host_name,
-    int           port,
-    const string &asn1_root_cert,
-    const string &asn1_peer_root_cert,
-    int           num_certs,
-    string       *cert_chain,
-    key_message  &private_key,
-    const string &private_key_cert,
-    void (*func)(secure_authenticated_channel &)) {
+certifier::framework::server_credential_set::server_credential_set()
+    : ctx_(nullptr),
+      has_chain_(false) {}
 
-#ifdef DEBUG
-  printf("\nserver_dispatch\n");
-  printf("asn1_root_cert: ");
-  print_bytes(asn1_root_cert.size(), (byte *)asn1_root_cert.data());
-  printf("\n");
-  printf("asn1_peer_root_cert: ");
-  print_bytes(asn1_peer_root_cert.size(), (byte *)asn1_peer_root_cert.data());
-  printf("\n");
-  printf("private_key_cert: ");
-  print_bytes(private_key_cert.size(), (byte *)private_key_cert.data());
-  printf("\n");
-  printf("private_key: ");
-  print_key(private_key);
-  printf("\n");
-#endif
+certifier::framework::server_credential_set::~server_credential_set() {
+  if (ctx_ != nullptr)
+    SSL_CTX_free(ctx_);
+}
 
+bool certifier::framework::server_credential_set::init_ctx() {
   OPENSSL_init_ssl(0, NULL);
   SSL_load_error_strings();
 
-  X509 *root_cert = X509_new();
-  if (!asn1_to_x509(asn1_root_cert, root_cert)) {
+  bool  ret = false;
+  X509 *root_cert = cert_verifier::instance().decode(asn1_root_cert_);
+  X509 *peer_root_cert = cert_verifier::instance().decode(asn1_peer_root_cert_);
+  if (root_cert == nullptr || peer_root_cert == nullptr) {
     printf("%s() error, line %d, Can't convert cert\n", __func__, __LINE__);
+    goto done;
+  }
+
+  ctx_ = SSL_CTX_new(TLS_server_method());
+  if (ctx_ == nullptr) {
+    printf("%s() error, line %d, SSL_CTX_new failed (1)\n", __func__, __LINE__);
+    goto done;
+  }
+  if (!use_trust_root(ctx_, peer_root_cert))
+    goto done;
+  if (has_chain_ ? !load_server_certs_and_key(root_cert,
+                                              peer_root_cert,
+                                              (int)cert_chain_.size(),
+                                              cert_chain_.data(),
+                                              private_key_,
+                                              private_key_cert_,
+                                              ctx_)
+                 : !load_server_certs_and_key(root_cert,
+                                              private_key_,
+                                              private_key_cert_,
+                                              ctx_)) {
+    printf("%s() error, line %d, SSL_CTX_new failed (2)\n", __func__, __LINE__);
+    goto done;
+  }
+  SSL_CTX_set_options(ctx_,
+                      SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3
+                          | SSL_OP_NO_COMPRESSION);
+
+  // Verify peer
+  SSL_CTX_set_verify(ctx_,
+                     SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
+                     nullptr);
+#ifdef DEBUG
+  SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER, nullptr);
+#endif
+  ret = true;
+
+done:
+  if (root_cert != nullptr)
+    X509_free(root_cert);
+  if (peer_root_cert != nullptr)
+    X509_free(peer_root_cert);
+  if (!ret && ctx_ != nullptr) {
+    SSL_CTX_free(ctx_);
+    ctx_ = nullptr;
+  }
+  return ret;
+}
+
+// Publishes set once its SSL_CTX is made.  Takes ownership of set.
+bool certifier::framework::server_credentials::install(
+    server_credential_set *set) {
+  if (!set->init_ctx()) {
+    delete set;
     return false;
   }
-  X509 *peer_root_cert = X509_new();
-  if (!asn1_to_x509(asn1_peer_root_cert, peer_root_cert)) {
-    printf("%s() error, line %d, Can't convert cert\n", __func__, __LINE__);
+  std::shared_ptr<const server_credential_set> p(set);
+  std::atomic_store(&current_, p);
+  return true;
+}
+
+bool certifier::framework::server_credentials::update(
+    const string &asn1_root_cert,
+    const string &asn1_peer_root_cert,
+    int           num_certs,
+    string       *cert_chain,
+    key_message  &private_key,
+    const string &private_key_cert) {
+  server_credential_set *set = new server_credential_set();
+  set->has_chain_ = true;
+  set->asn1_root_cert_ = asn1_root_cert;
+  set->asn1_peer_root_cert_ = asn1_peer_root_cert;
+  for (int i = 0; i < num_certs; i++)
+    set->cert_chain_.push_back(cert_chain[i]);
+  set->private_key_.CopyFrom(private_key);
+  set->private_key_cert_ = private_key_cert;
+  return install(set);
+}
+
+bool certifier::framework::server_credentials::update(
+    const string &asn1_root_cert,
+    key_message  &private_key,
+    const string &private_key_cert) {
+  server_credential_set *set = new server_credential_set();
+  set->asn1_root_cert_ = asn1_root_cert;
+  set->asn1_peer_root_cert_ = asn1_root_cert;
+  set->private_key_.CopyFrom(private_key);
+  set->private_key_cert_ = private_key_cert;
+  return install(set);
+}
+
+bool certifier::framework::server_credentials::update(cc_trust_manager &mgr) {
+  string          policy_cert;
+  key_message     auth_key;
+  string          cert;
+  trust_data_lock l(mgr);
+  copy_credentials(mgr, &policy_cert, &auth_key, &cert);
+  if (mgr.num_certified_domains_ > 0 && mgr.certified_domains_[0] != nullptr)
+    mgr.get_admissions_cert(mgr.certified_domains_[0]->domain_name_, &cert);
+  l.unlock();
+  return update(policy_cert, auth_key, cert);
+}
+
+std::shared_ptr<const certifier::framework::server_credential_set>
+certifier::framework::server_credentials::current() const {
+  return std::atomic_load(&current_);
+}
+
+static void reload_server_credentials(cc_trust_manager &mgr,
+                                      const string     &domain_name,
+                                      const string     &admissions_cert,
+                                      void             *arg) {
+  trust_data_lock l(mgr);
+  bool primary = mgr.num_certified_domains_ > 0
+                 && mgr.certified_domains_[0] != nullptr
+                 && mgr.certified_domains_[0]->domain_name_ == domain_name;
+  l.unlock();
+  if (primary)
+    ((server_credentials *)arg)->update(mgr);
+}
+
+bool certifier::framework::cc_trust_manager::keep_server_credentials(
+    server_credentials *creds) {
+  if (!creds->update(*this)) {
+    printf("%s() error, line %d, Can't load credentials\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+#ifndef NO_RECERTIFIER
+  return add_recertified_callback(reload_server_credentials, creds);
+#else
+  return true;
+#endif
+}
+
+bool certifier::framework::server_dispatch(
+    const string       &host_name,
+    int                 port,
+    server_credentials &creds,
+    void (*func)(secure_authenticated_channel &)) {
+
+  OPENSSL_init_ssl(0, NULL);
+  SSL_load_error_strings();
+
+  if (creds.current() == nullptr) {
+    printf("%s() error, line %d, No credentials\n", __func__, __LINE__);
     return false;
   }
 
@@ -2679,37 +3508,6 @@ bool certifier::framework::server_dispatch(
     return false;
   }
 
-  // Set up TLS handshake data.
-  SSL_METHOD *method = (SSL_METHOD *)TLS_server_method();
-  SSL_CTX    *ctx = SSL_CTX_new(method);
-  if (ctx == NULL) {
-    printf("%s() error, line %d, SSL_CTX_new failed (1)\n", __func__, __LINE__);
-    return false;
-  }
-  X509_STORE *cs = SSL_CTX_get_cert_store(ctx);
-  X509_STORE_add_cert(cs, peer_root_cert);
-
-  X509 *x509_auth_cert = X509_new();
-  if (asn1_to_x509(private_key_cert, x509_auth_cert)) {
-    X509_STORE_add_cert(cs, x509_auth_cert);
-  } else {
-    printf("DIDNT ADD AUTH CERT\n");
-  }
-
-  if (!load_server_certs_and_key(root_cert,
-                                 peer_root_cert,
-                                 num_certs,
-                                 cert_chain,
-                                 private_key,
-                                 private_key_cert,
-                                 ctx)) {
-    printf("%s() error, line %d, SSL_CTX_new failed (2)\n", __func__, __LINE__);
-    return false;
-  }
-
-  const long flags = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION;
-  SSL_CTX_set_options(ctx, flags);
-
 #if 0
   // This is unnecessary usually.
   if(!isRoot()) {
@@ -2718,14 +3516,6 @@ bool certifier::framework::server_dispatch(
   }
 #endif
 
-  // Verify peer
-  SSL_CTX_set_verify(ctx,
-                     SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
-                     nullptr);
-#ifdef DEBUG
-  SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
-#endif
-
   // Testing hook: Allow pytests to invoke with NULL 'func' hdlr.
   // Close socket before exiting, so we don't have unpredictable
   // behaviour when tests are run on CI machines.
@@ -2743,17 +3533,31 @@ bool certifier::framework::server_dispatch(
     int                client = accept(sock, (struct sockaddr *)&addr, &len);
     string             my_role("server");
     secure_authenticated_channel nc(my_role);
-    if (!nc.init_server_ssl(host_name,
-                            port,
-                            asn1_root_cert,
-                            asn1_peer_root_cert,
-                            num_certs,
-                            cert_chain,
-                            private_key,
-                            private_key_cert)) {
+    CC_METRICS_COUNT("certifier_server_connections_total",
+                     "Accepted connections",
+                     1);
+
+    std::shared_ptr<const server_credential_set> c = creds.current();
+    key_message &private_key = (key_message &)c->private_key_;
+    bool         ok = c->has_chain_
+                  ? nc.init_server_ssl(host_name,
+                                       port,
+                                       c->asn1_root_cert_,
+                                       c->asn1_peer_root_cert_,
+                                       (int)c->cert_chain_.size(),
+                                       (string *)c->cert_chain_.data(),
+                                       private_key,
+                                       c->private_key_cert_)
+                  : nc.init_server_ssl(host_name,
+                                       port,
+                                       c->asn1_root_cert_,
+                                       private_key,
+                                       c->private_key_cert_);
+    if (!ok) {
+      close(client);
       continue;
     }
-    nc.ssl_ = SSL_new(ctx);
+    nc.ssl_ = SSL_new(c->ctx_);
     SSL_set_fd(nc.ssl_, client);
     nc.sock_ = client;
     nc.server_channel_accept_and_auth(func);
@@ -2765,15 +3569,21 @@ bool certifier::framework::server_dispatch(
     const string &host_name,
     int           port,
     const string &asn1_root_cert,
+    const string &asn1_peer_root_cert,
+    int           num_certs,
+    string       *cert_chain,
     key_message  &private_key,
     const string &private_key_cert,
     void (*func)(secure_authenticated_channel &)) {
 
 #ifdef DEBUG
   printf("\nserver_dispatch\n");
-  printf("ans1_root_cert: ");
+  printf("asn1_root_cert: ");
   print_bytes(asn1_root_cert.size(), (byte *)asn1_root_cert.data());
   printf("\n");
+  printf("asn1_peer_root_cert: ");
+  print_bytes(asn1_peer_root_cert.size(), (byte *)asn1_peer_root_cert.data());
+  printf("\n");
   printf("private_key_cert: ");
   print_bytes(private_key_cert.size(), (byte *)private_key_cert.data());
   printf("\n");
@@ -2782,98 +3592,50 @@ bool certifier::framework::server_dispatch(
   printf("\n");
 #endif
 
-  OPENSSL_init_ssl(0, NULL);
-  SSL_load_error_strings();
-
-  X509 *root_cert = X509_new();
-  if (!asn1_to_x509(asn1_root_cert, root_cert)) {
-    printf("%s() error, line %d, Can't convert cert\n", __func__, __LINE__);
-    return false;
-  }
-
-  // Get a socket.
-  int sock = -1;
-  if (!open_server_socket(host_name, port, &sock)) {
-    printf("%s() error, line %d, Can't open server socket to %s:%d\n",
+  server_credentials creds;
+  if (!creds.update(asn1_root_cert,
+                    asn1_peer_root_cert,
+                    num_certs,
+                    cert_chain,
+                    private_key,
+                    private_key_cert)) {
+    printf("%s() error, line %d, Can't load credentials\n",
            __func__,
-           __LINE__,
-           host_name.c_str(),
-           port);
-    return false;
-  }
-
-  // Set up TLS handshake data.
-  SSL_METHOD *method = (SSL_METHOD *)TLS_server_method();
-  SSL_CTX    *ctx = SSL_CTX_new(method);
-  if (ctx == NULL) {
-    printf("%s() error, line %d, SSL_CTX_new failed (1)\n", __func__, __LINE__);
-    return false;
-  }
-  X509_STORE *cs = SSL_CTX_get_cert_store(ctx);
-  X509_STORE_add_cert(cs, root_cert);
-
-  X509 *x509_auth_cert = X509_new();
-  if (asn1_to_x509(private_key_cert, x509_auth_cert)) {
-    X509_STORE_add_cert(cs, x509_auth_cert);
-  }
-
-  if (!load_server_certs_and_key(root_cert,
-                                 private_key,
-                                 private_key_cert,
-                                 ctx)) {
-    printf("%s() error, line %d, SSL_CTX_new failed (2)\n", __func__, __LINE__);
+           __LINE__);
     return false;
   }
+  return server_dispatch(host_name, port, creds, func);
+}
 
-  const long flags = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION;
-  SSL_CTX_set_options(ctx, flags);
-
-#if 0
-  // This is unnecessary usually.
-  if(!isRoot()) {
-    printf("server_dispatch: This program must be run as root/sudo user!!");
-    return false;
-  }
-#endif
+bool certifier::framework::server_dispatch(
+    const string &host_name,
+    int           port,
+    const string &asn1_root_cert,
+    key_message  &private_key,
+    const string &private_key_cert,
+    void (*func)(secure_authenticated_channel &)) {
 
-  // Verify peer
-  SSL_CTX_set_verify(ctx,
-                     SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
-                     nullptr);
 #ifdef DEBUG
-  SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+  printf("\nserver_dispatch\n");
+  printf("ans1_root_cert: ");
+  print_bytes(asn1_root_cert.size(), (byte *)asn1_root_cert.data());
+  printf("\n");
+  printf("private_key_cert: ");
+  print_bytes(private_key_cert.size(), (byte *)private_key_cert.data());
+  printf("\n");
+  printf("private_key: ");
+  print_key(private_key);
+  printf("\n");
 #endif
 
-  // Testing hook: Allow pytests to invoke with NULL 'func' hdlr.
-  // Close socket before exiting, so we don't have unpredictable
-  // behaviour when tests are run on CI machines.
-  if (!func) {
-    close(sock);
-    return true;
-  }
-
-  while (1) {
-#ifdef DEBUG
-    printf("at accept\n");
-#endif
-    struct sockaddr_in addr;
-    unsigned int       len = sizeof(sockaddr_in);
-    int                client = accept(sock, (struct sockaddr *)&addr, &len);
-    string             my_role("server");
-    secure_authenticated_channel nc(my_role);
-    if (!nc.init_server_ssl(host_name,
-                            port,
-                            asn1_root_cert,
-                            private_key,
-                            private_key_cert)) {
-      continue;
-    }
-    nc.ssl_ = SSL_new(ctx);
-    SSL_set_fd(nc.ssl_, client);
-    nc.sock_ = client;
-    nc.server_channel_accept_and_auth(func);
+  server_credentials creds;
+  if (!creds.update(asn1_root_cert, private_key, private_key_cert)) {
+    printf("%s() error, line %d, Can't load credentials\n",
+           __func__,
+           __LINE__);
+    return false;
   }
-  return true;
+  return server_dispatch(host_name, port, creds, func);
 }
 
 bool certifier::framework::server_dispatch(
@@ -2882,15 +3644,19 @@ bool certifier::framework::server_dispatch(
     const cc_trust_manager &mgr,
     void (*func)(secure_authenticated_channel &)) {
 
+  string      policy_cert;
+  key_message auth_key;
+  string      admissions_cert;
+  copy_credentials(mgr, &policy_cert, &auth_key, &admissions_cert);
   return server_dispatch(
       host_name,
       port,
-      (string &)mgr.serialized_policy_cert_,  // Policy-certificate / Root cert
-      (key_message &)mgr.private_auth_key_,  // Private key (whose public key is
-                                             // named in the admission cert)
+      policy_cert,  // Policy-certificate / Root cert
+      auth_key,     // Private key (whose public key is
+                    // named in the admission cert)
 
       // Admission cert
-      (const string &)mgr.serialized_primary_admissions_cert_,
+      admissions_cert,
       func);
 }
 
@@ -2909,10 +3675,40 @@ certifier::framework::secure_authenticated_channel::
   num_cert_chain_ = 0;
   cert_chain_ = nullptr;
   peer_id_.clear();
+#ifndef OE_CERTIFIER
+  reactor_ = nullptr;
+  async_state_ = ASYNC_NONE;
+  reactor_owned_ = false;
+  want_write_ = false;
+  epoll_in_ = false;
+  epoll_out_ = false;
+  scheduled_ = false;
+  in_handler_ = false;
+  failed_ = false;
+  closing_ = false;
+  ready_cb_ = nullptr;
+  ready_arg_ = nullptr;
+  read_cb_ = nullptr;
+  read_arg_ = nullptr;
+  rx_off_ = 0;
+  tx_off_ = 0;
+  tx_queued_ = 0;
+  tx_written_ = 0;
+#endif  // OE_CERTIFIER
 }
 
 certifier::framework::secure_authenticated_channel::
     ~secure_authenticated_channel() {
+#ifndef OE_CERTIFIER
+  if (async_state_ != ASYNC_NONE) {
+    // No callbacks from a destructor.
+    ready_cb_ = nullptr;
+    read_cb_ = nullptr;
+    pending_writes_.clear();
+    reactor_owned_ = false;
+    async_fail();
+  }
+#endif  // OE_CERTIFIER
   role_.clear();
   channel_initialized_ = false;
 
@@ -2975,8 +3771,8 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
   asn1_peer_root_cert_.assign((char *)peer_asn1_root_cert.data(),
                               peer_asn1_root_cert.size());
 
-  root_cert_ = X509_new();
-  if (!asn1_to_x509(asn1_root_cert_, root_cert_)) {
+  root_cert_ = cert_verifier::instance().decode(asn1_root_cert_);
+  if (root_cert_ == nullptr) {
     printf("%s() error, line %d, init_client_ssl: root invalid\n",
            __func__,
            __LINE__);
@@ -2989,8 +3785,8 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
     return false;
   }
 
-  peer_root_cert_ = X509_new();
-  if (!asn1_to_x509(asn1_peer_root_cert_, peer_root_cert_)) {
+  peer_root_cert_ = cert_verifier::instance().decode(asn1_peer_root_cert_);
+  if (peer_root_cert_ == nullptr) {
     printf("%s() error, line %d, init_client_ssl: peer root cert invalid\n",
            __func__,
            __LINE__);
@@ -3023,8 +3819,8 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
   }
 
   asn1_my_cert_.assign(auth_cert.data(), auth_cert.size());
-  X509_STORE *cs = SSL_CTX_get_cert_store(ssl_ctx_);
-  X509_STORE_add_cert(cs, peer_root_cert_);
+  if (!use_trust_root(ssl_ctx_, peer_root_cert_))
+    return false;
 
 // When intermediate certs exist
 #if 0
@@ -3039,18 +3835,9 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
   }
 #endif
 
-  X509 *x509_auth_cert = X509_new();
-  if (asn1_to_x509(auth_cert, x509_auth_cert)) {
-    X509_STORE_add_cert(cs, x509_auth_cert);
-  } else {
-    printf("COULDNT ADD\n");
-  }
-
 #ifdef DEBUG
   printf("init_client_ssl, peer root cert:\n");
   X509_print_fp(stdout, peer_root_cert_);
-  printf("init_client_ssl, auth cert:\n");
-  X509_print_fp(stdout, x509_auth_cert);
   printf("\n");
 #endif
 
@@ -3083,8 +3870,15 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
   int res = SSL_set_cipher_list(ssl_, "TLS_AES_256_GCM_SHA384");  // Change?
 
   // SSL_connect - initiate the TLS/SSL handshake with an TLS/SSL server
+  CC_METRICS_SPAN(hs_span,
+                  "certifier_channel_connect_seconds",
+                  "Client TLS handshake time");
   int ret = SSL_connect(ssl_);
+  CC_METRICS_SPAN_END(hs_span);
   if (ret <= 0) {
+    CC_METRICS_COUNT("certifier_channel_handshake_failures_total",
+                     "Failed TLS handshakes",
+                     1);
     int err = SSL_get_error(ssl_, ret);
     printf("%s() error, line %d, ssl_connect failed, ret=%d, err=%d: %s\n",
            __func__,
@@ -3136,16 +3930,16 @@ bool certifier::framework::secure_authenticated_channel::init_server_ssl(
   asn1_peer_root_cert_.assign((char *)peer_asn1_root_cert.data(),
                               peer_asn1_root_cert.size());
 
-  root_cert_ = X509_new();
-  if (!asn1_to_x509(asn1_root_cert, root_cert_)) {
+  root_cert_ = cert_verifier::instance().decode(asn1_root_cert);
+  if (root_cert_ == nullptr) {
     printf("%s() error, line %d, Can't translate der to X509\n",
            __func__,
            __LINE__);
     return false;
   }
 
-  peer_root_cert_ = X509_new();
-  if (!asn1_to_x509(peer_asn1_root_cert, peer_root_cert_)) {
+  peer_root_cert_ = cert_verifier::instance().decode(peer_asn1_root_cert);
+  if (peer_root_cert_ == nullptr) {
     printf("%s() error, line %d, Can't translate der to X509\n",
            __func__,
            __LINE__);
@@ -3174,8 +3968,8 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
 
   asn1_root_cert_.assign((char *)asn1_root_cert.data(), asn1_root_cert.size());
 
-  root_cert_ = X509_new();
-  if (!asn1_to_x509(asn1_root_cert_, root_cert_)) {
+  root_cert_ = cert_verifier::instance().decode(asn1_root_cert_);
+  if (root_cert_ == nullptr) {
     printf("%s() error, line %d, init_client_ssl: root cert invalid\n",
            __func__,
            __LINE__);
@@ -3192,8 +3986,8 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
   asn1_peer_root_cert_.assign((char *)asn1_root_cert.data(),
                               asn1_root_cert.size());
 
-  peer_root_cert_ = X509_new();
-  if (!asn1_to_x509(asn1_peer_root_cert_, peer_root_cert_)) {
+  peer_root_cert_ = cert_verifier::instance().decode(asn1_peer_root_cert_);
+  if (peer_root_cert_ == nullptr) {
     printf("%s() error, line %d, init_client_ssl: peer root cert invalid\n",
            __func__,
            __LINE__);
@@ -3219,15 +4013,9 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
     return false;
   }
 
-  X509_STORE *cs = SSL_CTX_get_cert_store(ssl_ctx_);
   asn1_my_cert_ = auth_cert;
-
-  X509_STORE_add_cert(cs, peer_root_cert_);
-
-  X509 *x509_auth_cert = X509_new();
-  if (asn1_to_x509(auth_cert, x509_auth_cert)) {
-    X509_STORE_add_cert(cs, x509_auth_cert);
-  }
+  if (!use_trust_root(ssl_ctx_, peer_root_cert_))
+    return false;
 
   // For debugging: SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, verify_callback);
   SSL_CTX_set_verify(ssl_ctx_, SSL_VERIFY_PEER, nullptr);
@@ -3258,8 +4046,15 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
   int res = SSL_set_cipher_list(ssl_, "TLS_AES_256_GCM_SHA384");  // Change?
 
   // SSL_connect - initiate the TLS/SSL handshake with an TLS/SSL server
+  CC_METRICS_SPAN(hs_span,
+                  "certifier_channel_connect_seconds",
+                  "Client TLS handshake time");
   int ret = SSL_connect(ssl_);
+  CC_METRICS_SPAN_END(hs_span);
   if (ret <= 0) {
+    CC_METRICS_COUNT("certifier_channel_handshake_failures_total",
+                     "Failed TLS handshakes",
+                     1);
     int err = SSL_get_error(ssl_, ret);
     printf("%s() error, line %d, ssl_connect failed, ret=%d, err=%d: %s\n",
            __func__,
@@ -3295,12 +4090,15 @@ bool certifier::framework::secure_authenticated_channel::init_client_ssl(
     int                     port,
     const cc_trust_manager &mgr) {
 
-  return secure_authenticated_channel::init_client_ssl(
-      host_name,
-      port,
-      (string &)mgr.serialized_policy_cert_,
-      (key_message &)mgr.private_auth_key_,
-      (const string &)mgr.serialized_primary_admissions_cert_);
+  string      policy_cert;
+  key_message auth_key;
+  string      admissions_cert;
+  copy_credentials(mgr, &policy_cert, &auth_key, &admissions_cert);
+  return secure_authenticated_channel::init_client_ssl(host_name,
+                                                       port,
+                                                       policy_cert,
+                                                       auth_key,
+                                                       admissions_cert);
 }
 
 // Loads client side certs and keys.  Note: key for private_key is in
@@ -3318,8 +4116,8 @@ bool certifier::framework::secure_authenticated_channel::
   EVP_PKEY *auth_private_key = EVP_PKEY_new();
   EVP_PKEY_set1_RSA(auth_private_key, r);
 
-  X509 *x509_auth_key_cert = X509_new();
-  if (!asn1_to_x509(asn1_my_cert_, x509_auth_key_cert)) {
+  X509 *x509_auth_key_cert = cert_verifier::instance().decode(asn1_my_cert_);
+  if (x509_auth_key_cert == nullptr) {
     printf("%s() error, line %d, can't translate der to X509 %d\n",
            __func__,
            __LINE__,
@@ -3387,8 +4185,15 @@ void certifier::framework::secure_authenticated_channel::
         void (*func)(secure_authenticated_channel &)) {
 
   // accept and carry out auth
+  CC_METRICS_SPAN(hs_span,
+                  "certifier_channel_accept_seconds",
+                  "Server TLS handshake time");
   int res = SSL_accept(ssl_);
+  CC_METRICS_SPAN_END(hs_span);
   if (res != 1) {
+    CC_METRICS_COUNT("certifier_channel_handshake_failures_total",
+                     "Failed TLS handshakes",
+                     1);
     printf("%s() error, line %d, Can't SSL_accept connection"
            ", res=%d\n",
            __func__,
@@ -3449,15 +4254,15 @@ bool certifier::framework::secure_authenticated_channel::init_server_ssl(
   asn1_peer_root_cert_.assign((char *)asn1_root_cert.data(),
                               asn1_root_cert.size());
 
-  root_cert_ = X509_new();
-  if (!asn1_to_x509(asn1_root_cert, root_cert_)) {
+  root_cert_ = cert_verifier::instance().decode(asn1_root_cert);
+  if (root_cert_ == nullptr) {
     printf("%s() error, line %d, Can't translate der to X509\n",
            __func__,
            __LINE__);
     return false;
   }
-  peer_root_cert_ = X509_new();
-  if (!asn1_to_x509(asn1_peer_root_cert_, peer_root_cert_)) {
+  peer_root_cert_ = cert_verifier::instance().decode(asn1_peer_root_cert_);
+  if (peer_root_cert_ == nullptr) {
     printf("%s() error, line %d, Can't translate der to X509\n",
            __func__,
            __LINE__);
@@ -3470,30 +4275,65 @@ bool certifier::framework::secure_authenticated_channel::init_server_ssl(
     const string           &host_name,
     int                     port,
     const cc_trust_manager &mgr) {
-  return secure_authenticated_channel::init_server_ssl(
-      host_name,
-      port,
-      (string &)mgr.serialized_policy_cert_,
-      (key_message &)mgr.private_auth_key_,
-      mgr.serialized_primary_admissions_cert_);
+  string      policy_cert;
+  key_message auth_key;
+  string      admissions_cert;
+  copy_credentials(mgr, &policy_cert, &auth_key, &admissions_cert);
+  return secure_authenticated_channel::init_server_ssl(host_name,
+                                                       port,
+                                                       policy_cert,
+                                                       auth_key,
+                                                       admissions_cert);
 }
 
 int certifier::framework::secure_authenticated_channel::read(int   size,
                                                              byte *b) {
-  return SSL_read(ssl_, b, size);
+  CC_METRICS_SPAN(span, "certifier_channel_read_seconds", "Channel read time");
+  int n = SSL_read(ssl_, b, size);
+  if (n > 0)
+    CC_METRICS_COUNT("certifier_channel_read_bytes_total",
+                     "Bytes read from channels",
+                     n);
+  return n;
 }
 
 int certifier::framework::secure_authenticated_channel::read(string *out) {
-  return sized_ssl_read(ssl_, out);
+  CC_METRICS_SPAN(span, "certifier_channel_read_seconds", "Channel read time");
+  int n = sized_ssl_read(ssl_, out);
+  if (n > 0)
+    CC_METRICS_COUNT("certifier_channel_read_bytes_total",
+                     "Bytes read from channels",
+                     n);
+  return n;
 }
 
 int certifier::framework::secure_authenticated_channel::write(int   size,
                                                               byte *b) {
-  return sized_ssl_write(ssl_, size, b);
+  CC_METRICS_SPAN(span,
+                  "certifier_channel_write_seconds",
+                  "Channel write time");
+  int n = sized_ssl_write(ssl_, size, b);
+  if (n > 0)
+    CC_METRICS_COUNT("certifier_channel_write_bytes_total",
+                     "Bytes written to channels",
+                     n);
+  return n;
 }
 
 void certifier::framework::secure_authenticated_channel::close() {
+#ifndef OE_CERTIFIER
+  if (async_state_ != ASYNC_NONE) {
+    // Let queued messages go out first.
+    if (async_state_ == ASYNC_OPEN && tx_off_ < tx_buf_.size()) {
+      closing_ = true;
+      return;
+    }
+    async_fail();
+    return;
+  }
+#endif  // OE_CERTIFIER
   ::close(sock_);
+  sock_ = -1;
   if (ssl_ != nullptr) {
     SSL_free(ssl_);
     ssl_ = nullptr;
@@ -3505,3 +4345,968 @@ bool certifier::framework::secure_authenticated_channel::get_peer_id(
   out_peer_id->assign((char *)peer_id_.data(), peer_id_.size());
   return true;
 }
+
+#ifndef OE_CERTIFIER
+// Non-blocking channels
+// --------------------------------------------------------------------------------------
+
+// Largest plaintext handed to a single SSL_read/SSL_write.
+const int async_io_stride = 16384;
+
+bool certifier::framework::secure_authenticated_channel::start_async(
+    channel_reactor *r,
+    int              fd) {
+  if (r == nullptr || fd < 0 || ssl_ == nullptr) {
+    printf("%s() error, line %d, bad arguments\n", __func__, __LINE__);
+    return false;
+  }
+
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    printf("%s() error, line %d, Can't set O_NONBLOCK\n", __func__, __LINE__);
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  // Partial writes let a large message go out as the socket drains;
+  // tx_buf_ may be reallocated between retries.
+  SSL_set_mode(ssl_,
+               SSL_MODE_ENABLE_PARTIAL_WRITE
+                   | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+  reactor_ = r;
+  sock_ = fd;
+  failed_ = false;
+  closing_ = false;
+  if (!r->add_channel(this)) {
+    reactor_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool certifier::framework::secure_authenticated_channel::async_accept(
+    channel_reactor       *r,
+    SSL_CTX               *ctx,
+    int                    fd,
+    channel_ready_callback cb,
+    void                  *arg) {
+  ssl_ = SSL_new(ctx);
+  if (ssl_ == nullptr) {
+    printf("%s() error, line %d, SSL_new failed\n", __func__, __LINE__);
+    ::close(fd);
+    return false;
+  }
+  SSL_set_fd(ssl_, fd);
+  sock_ = fd;
+  SSL_set_accept_state(ssl_);
+  async_state_ = ASYNC_ACCEPTING;
+  ready_cb_ = cb;
+  ready_arg_ = arg;
+  if (!start_async(r, fd)) {
+    ready_cb_ = nullptr;
+    async_fail();
+    return false;
+  }
+  return true;
+}
+
+bool certifier::framework::secure_authenticated_channel::async_connect(
+    channel_reactor       *r,
+    SSL_CTX               *ctx,
+    int                    fd,
+    channel_ready_callback cb,
+    void                  *arg) {
+  ssl_ = SSL_new(ctx);
+  if (ssl_ == nullptr) {
+    printf("%s() error, line %d, SSL_new failed\n", __func__, __LINE__);
+    ::close(fd);
+    return false;
+  }
+  SSL_set_fd(ssl_, fd);
+  sock_ = fd;
+  SSL_set_cipher_list(ssl_, "TLS_AES_256_GCM_SHA384");
+  SSL_set_connect_state(ssl_);
+  async_state_ = ASYNC_CONNECTING;
+  ready_cb_ = cb;
+  ready_arg_ = arg;
+  if (!start_async(r, fd)) {
+    ready_cb_ = nullptr;
+    async_fail();
+    return false;
+  }
+  // The client speaks first.
+  r->schedule(this);
+  return true;
+}
+
+bool certifier::framework::secure_authenticated_channel::set_non_blocking(
+    channel_reactor *r) {
+  if (!channel_initialized_ || async_state_ != ASYNC_NONE) {
+    printf("%s() error, line %d, channel not open or already non-blocking\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  async_state_ = ASYNC_OPEN;
+  if (!start_async(r, sock_)) {
+    async_state_ = ASYNC_NONE;
+    return false;
+  }
+  // Records may already be buffered inside SSL.
+  r->schedule(this);
+  return true;
+}
+
+bool certifier::framework::secure_authenticated_channel::async_read_message(
+    message_read_callback cb,
+    void                 *arg) {
+  if (async_state_ != ASYNC_OPEN || cb == nullptr || read_cb_ != nullptr)
+    return false;
+  read_cb_ = cb;
+  read_arg_ = arg;
+  if (!in_handler_ && rx_buf_.size() - rx_off_ >= (size_t)frame_header_size)
+    reactor_->schedule(this);
+  return true;
+}
+
+bool certifier::framework::secure_authenticated_channel::async_write_message(
+    int                      size,
+    byte                    *b,
+    message_written_callback cb,
+    void                    *arg) {
+  if (async_state_ != ASYNC_OPEN || closing_ || size < 0
+      || size > get_max_frame_size())
+    return false;
+
+  // Same framing as sized_ssl_write.
+  byte hdr[frame_header_size];
+  encode_frame_size(size, hdr);
+  tx_buf_.append((const char *)hdr, frame_header_size);
+  tx_buf_.append((const char *)b, size);
+  tx_queued_ += frame_header_size + size;
+  if (cb != nullptr) {
+    pending_write pw;
+    pw.end_ = tx_queued_;
+    pw.cb_ = cb;
+    pw.arg_ = arg;
+    pending_writes_.push_back(pw);
+  }
+
+  // Inside a callback the handler flushes everything queued at once.
+  if (in_handler_)
+    return true;
+  if (!flush_tx())
+    failed_ = true;
+  if (failed_
+      || (!pending_writes_.empty()
+          && pending_writes_.front().end_ <= tx_written_)) {
+    reactor_->schedule(this);
+  } else {
+    update_interest();
+  }
+  return true;
+}
+
+bool certifier::framework::secure_authenticated_channel::async_write_message(
+    const string            &msg,
+    message_written_callback cb,
+    void                    *arg) {
+  return async_write_message((int)msg.size(), (byte *)msg.data(), cb, arg);
+}
+
+bool certifier::framework::secure_authenticated_channel::continue_handshake() {
+  ERR_clear_error();
+  int ret = (async_state_ == ASYNC_ACCEPTING) ? SSL_accept(ssl_)
+                                              : SSL_connect(ssl_);
+  if (ret == 1) {
+    async_state_ = ASYNC_OPEN;
+    want_write_ = false;
+
+    peer_cert_ = SSL_get_peer_certificate(ssl_);
+    if (peer_cert_ != nullptr) {
+      peer_id_.clear();
+      if (!extract_id_from_cert(peer_cert_, &peer_id_)) {
+        printf("%s() error, line %d, Can't extract id\n", __func__, __LINE__);
+      }
+    }
+    channel_initialized_ = true;
+
+    channel_ready_callback cb = ready_cb_;
+    ready_cb_ = nullptr;
+    if (cb != nullptr)
+      cb(*this, true, ready_arg_);
+    return true;
+  }
+
+  int err = SSL_get_error(ssl_, ret);
+  if (err == SSL_ERROR_WANT_READ) {
+    want_write_ = false;
+    return true;
+  }
+  if (err == SSL_ERROR_WANT_WRITE) {
+    want_write_ = true;
+    return true;
+  }
+  CC_METRICS_COUNT("certifier_channel_handshake_failures_total",
+                   "Failed TLS handshakes",
+                   1);
+#ifdef DEBUG
+  printf("%s() error, line %d, handshake failed, err=%d: %s\n",
+         __func__,
+         __LINE__,
+         err,
+         ssl_strerror(err));
+#endif
+  return false;
+}
+
+// Room left in rx_buf_, which holds at most one maximum size frame.
+static size_t rx_room(const string &rx_buf, size_t rx_off) {
+  size_t limit = (size_t)frame_header_size + (size_t)get_max_frame_size();
+  size_t held = rx_buf.size() - rx_off;
+  return held < limit ? limit - held : 0;
+}
+
+// Reads until SSL would block or rx_buf_ is full.  Returns false on EOF
+// or error; what was read before that is still delivered.
+bool certifier::framework::secure_authenticated_channel::fill_rx() {
+  byte buf[async_io_stride];
+
+  if (rx_off_ == rx_buf_.size()) {
+    rx_buf_.clear();
+    rx_off_ = 0;
+  } else if (rx_off_ > (size_t)async_io_stride * 4) {
+    rx_buf_.erase(0, rx_off_);
+    rx_off_ = 0;
+  }
+
+  for (;;) {
+    size_t room = rx_room(rx_buf_, rx_off_);
+    if (room == 0)
+      return true;
+    ERR_clear_error();
+    int n = SSL_read(ssl_,
+                     buf,
+                     (int)(room < sizeof(buf) ? room : sizeof(buf)));
+    if (n > 0) {
+      rx_buf_.append((const char *)buf, n);
+      continue;
+    }
+    int err = SSL_get_error(ssl_, n);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+      return true;
+    return false;
+  }
+}
+
+void certifier::framework::secure_authenticated_channel::deliver_messages() {
+  while (read_cb_ != nullptr && async_state_ == ASYNC_OPEN) {
+    size_t avail = rx_buf_.size() - rx_off_;
+    if (avail < (size_t)frame_header_size)
+      return;
+    int size = decode_frame_size((const byte *)rx_buf_.data() + rx_off_);
+    if (size < 0 || size > get_max_frame_size()) {
+      printf("%s() error, line %d, bad message size %d\n",
+             __func__,
+             __LINE__,
+             size);
+      failed_ = true;
+      return;
+    }
+    if (avail < (size_t)frame_header_size + (size_t)size)
+      return;
+
+    string msg(rx_buf_, rx_off_ + frame_header_size, size);
+    rx_off_ += frame_header_size + size;
+    CC_METRICS_COUNT("certifier_channel_read_bytes_total",
+                     "Bytes read from channels",
+                     size);
+
+    message_read_callback cb = read_cb_;
+    read_cb_ = nullptr;
+    cb(*this, true, msg, read_arg_);
+  }
+}
+
+bool certifier::framework::secure_authenticated_channel::flush_tx() {
+  while (tx_off_ < tx_buf_.size()) {
+    size_t left = tx_buf_.size() - tx_off_;
+    int    len = left > (size_t)async_io_stride * 64 ? async_io_stride * 64
+                                                     : (int)left;
+    ERR_clear_error();
+    int n = SSL_write(ssl_, tx_buf_.data() + tx_off_, len);
+    if (n > 0) {
+      tx_off_ += n;
+      tx_written_ += n;
+      CC_METRICS_COUNT("certifier_channel_write_bytes_total",
+                       "Bytes written to channels",
+                       n);
+      continue;
+    }
+    int err = SSL_get_error(ssl_, n);
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+      if (tx_off_ > (size_t)async_io_stride * 64) {
+        tx_buf_.erase(0, tx_off_);
+        tx_off_ = 0;
+      }
+      return true;
+    }
+    return false;
+  }
+  tx_buf_.clear();
+  tx_off_ = 0;
+  return true;
+}
+
+void certifier::framework::secure_authenticated_channel::complete_writes() {
+  while (async_state_ == ASYNC_OPEN && !pending_writes_.empty()
+         && pending_writes_.front().end_ <= tx_written_) {
+    pending_write pw = pending_writes_.front();
+    pending_writes_.pop_front();
+    pw.cb_(*this, true, pw.arg_);
+  }
+}
+
+void certifier::framework::secure_authenticated_channel::update_interest() {
+  if (reactor_ == nullptr || async_state_ == ASYNC_CLOSED)
+    return;
+  bool want_read = rx_room(rx_buf_, rx_off_) > 0;
+  bool want_write = want_write_ || tx_off_ < tx_buf_.size();
+  if (want_read != epoll_in_ || want_write != epoll_out_)
+    reactor_->modify_channel(this, want_read, want_write);
+}
+
+void certifier::framework::secure_authenticated_channel::handle_events(
+    bool readable,
+    bool writable) {
+  if (async_state_ == ASYNC_NONE || async_state_ == ASYNC_CLOSED)
+    return;
+  if (failed_) {
+    async_fail();
+    return;
+  }
+
+  in_handler_ = true;
+  if (async_state_ == ASYNC_ACCEPTING || async_state_ == ASYNC_CONNECTING) {
+    bool ok = continue_handshake();
+    if (!ok || async_state_ != ASYNC_OPEN) {
+      in_handler_ = false;
+      if (!ok)
+        async_fail();
+      else
+        update_interest();
+      return;
+    }
+    // Application data can arrive with the last handshake flight.
+    readable = true;
+  }
+
+  bool ok = true;
+  if (readable || SSL_pending(ssl_) > 0)
+    ok = fill_rx();
+  deliver_messages();
+  if (ok && !failed_ && async_state_ == ASYNC_OPEN)
+    ok = flush_tx();
+  in_handler_ = false;
+  if (!ok || failed_) {
+    async_fail();
+    return;
+  }
+
+  complete_writes();
+  if (async_state_ != ASYNC_OPEN)
+    return;
+  if (closing_ && tx_off_ == tx_buf_.size()) {
+    async_fail();
+    return;
+  }
+  // Reads stopped at a full rx_buf_ can leave records decrypted in SSL,
+  // which epoll won't report once there is room again.
+  if (SSL_pending(ssl_) > 0 && rx_room(rx_buf_, rx_off_) > 0)
+    reactor_->schedule(this);
+  update_interest();
+}
+
+// Closes the channel now and fails outstanding operations.
+void certifier::framework::secure_authenticated_channel::async_fail() {
+  if (async_state_ == ASYNC_NONE || async_state_ == ASYNC_CLOSED)
+    return;
+  int old_state = async_state_;
+  async_state_ = ASYNC_CLOSED;
+
+  if (reactor_ != nullptr) {
+    reactor_->remove_channel(this);
+    if (scheduled_) {
+      std::vector<secure_authenticated_channel *> &r = reactor_->ready_;
+      r.erase(std::remove(r.begin(), r.end(), this), r.end());
+      scheduled_ = false;
+    }
+  }
+  if (ssl_ != nullptr) {
+    if (old_state == ASYNC_OPEN && !failed_)
+      SSL_shutdown(ssl_);
+    SSL_free(ssl_);
+    ssl_ = nullptr;
+  }
+  if (sock_ >= 0)
+    ::close(sock_);
+  sock_ = -1;
+  channel_initialized_ = false;
+  tx_buf_.clear();
+  tx_off_ = 0;
+
+  channel_ready_callback ready_cb = ready_cb_;
+  ready_cb_ = nullptr;
+  if (ready_cb != nullptr)
+    ready_cb(*this, false, ready_arg_);
+
+  message_read_callback read_cb = read_cb_;
+  read_cb_ = nullptr;
+  if (read_cb != nullptr) {
+    string empty;
+    read_cb(*this, false, empty, read_arg_);
+  }
+
+  std::deque<pending_write> writes;
+  writes.swap(pending_writes_);
+  for (size_t i = 0; i < writes.size(); i++)
+    writes[i].cb_(*this, false, writes[i].arg_);
+
+  if (reactor_owned_ && reactor_ != nullptr)
+    reactor_->to_delete_.push_back(this);
+}
+
+// Reactor
+// --------------------------------------------------------------------------------------
+
+certifier::framework::channel_reactor::channel_reactor() {
+  epoll_fd_ = -1;
+  wake_fd_ = -1;
+  stop_ = false;
+  num_channels_ = 0;
+}
+
+certifier::framework::channel_reactor::~channel_reactor() {
+  for (size_t i = 0; i < channels_.size(); i++) {
+    if (channels_[i] != nullptr)
+      channels_[i]->async_fail();
+  }
+  for (size_t i = 0; i < to_delete_.size(); i++)
+    delete to_delete_[i];
+  to_delete_.clear();
+  ready_.clear();
+
+  for (size_t i = 0; i < listeners_.size(); i++) {
+    ::close(listeners_[i].sock_);
+    SSL_CTX_free(listeners_[i].ctx_);
+  }
+  listeners_.clear();
+  if (wake_fd_ >= 0)
+    ::close(wake_fd_);
+  if (epoll_fd_ >= 0)
+    ::close(epoll_fd_);
+}
+
+bool certifier::framework::channel_reactor::init() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    printf("%s() error, line %d, epoll_create1 failed\n", __func__, __LINE__);
+    return false;
+  }
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ < 0) {
+    printf("%s() error, line %d, eventfd failed\n", __func__, __LINE__);
+    return false;
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = wake_fd_;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) < 0) {
+    printf("%s() error, line %d, epoll_ctl failed\n", __func__, __LINE__);
+    return false;
+  }
+  return true;
+}
+
+bool certifier::framework::channel_reactor::add_listener(
+    int                    sock,
+    SSL_CTX               *ctx,
+    channel_ready_callback cb,
+    void                  *arg) {
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+    printf("%s() error, line %d, Can't set O_NONBLOCK\n", __func__, __LINE__);
+    return false;
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = sock;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sock, &ev) < 0) {
+    printf("%s() error, line %d, epoll_ctl failed\n", __func__, __LINE__);
+    return false;
+  }
+  listener l;
+  l.sock_ = sock;
+  l.ctx_ = ctx;
+  l.cb_ = cb;
+  l.arg_ = arg;
+  listeners_.push_back(l);
+  return true;
+}
+
+bool certifier::framework::channel_reactor::add_channel(
+    secure_authenticated_channel *c) {
+  int fd = c->sock_;
+  if ((size_t)fd >= channels_.size())
+    channels_.resize(fd + 1024, nullptr);
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    printf("%s() error, line %d, epoll_ctl failed\n", __func__, __LINE__);
+    return false;
+  }
+  c->epoll_in_ = true;
+  c->epoll_out_ = false;
+  channels_[fd] = c;
+  num_channels_++;
+  return true;
+}
+
+bool certifier::framework::channel_reactor::modify_channel(
+    secure_authenticated_channel *c,
+    bool                          want_read,
+    bool                          want_write) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = (want_read ? EPOLLIN : 0) | (want_write ? EPOLLOUT : 0);
+  ev.data.fd = c->sock_;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c->sock_, &ev) < 0)
+    return false;
+  c->epoll_in_ = want_read;
+  c->epoll_out_ = want_write;
+  return true;
+}
+
+void certifier::framework::channel_reactor::remove_channel(
+    secure_authenticated_channel *c) {
+  int fd = c->sock_;
+  if (fd < 0 || (size_t)fd >= channels_.size() || channels_[fd] != c)
+    return;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  channels_[fd] = nullptr;
+  num_channels_--;
+}
+
+void certifier::framework::channel_reactor::schedule(
+    secure_authenticated_channel *c) {
+  if (c->scheduled_
+      || c->async_state_ == secure_authenticated_channel::ASYNC_CLOSED)
+    return;
+  c->scheduled_ = true;
+  ready_.push_back(c);
+}
+
+void certifier::framework::channel_reactor::accept_connections(listener &l) {
+  for (;;) {
+    int fd = accept4(l.sock_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+    CC_METRICS_COUNT("certifier_server_connections_total",
+                     "Accepted connections",
+                     1);
+    string                        role("server");
+    secure_authenticated_channel *c = new secure_authenticated_channel(role);
+    c->reactor_owned_ = true;
+    // On failure the channel never reached the reactor.
+    if (!c->async_accept(this, l.ctx_, fd, l.cb_, l.arg_))
+      delete c;
+  }
+}
+
+int certifier::framework::channel_reactor::run_once(int timeout_ms) {
+  const int          max_events = 256;
+  struct epoll_event events[max_events];
+
+  int n = epoll_wait(epoll_fd_,
+                     events,
+                     max_events,
+                     ready_.empty() ? timeout_ms : 0);
+  if (n < 0) {
+    if (errno != EINTR) {
+      printf("%s() error, line %d, epoll_wait failed\n", __func__, __LINE__);
+      return -1;
+    }
+    n = 0;
+  }
+
+  for (int i = 0; i < n; i++) {
+    int      fd = events[i].data.fd;
+    uint32_t ev = events[i].events;
+    if (fd == wake_fd_) {
+      uint64_t v;
+      if (::read(wake_fd_, &v, sizeof(v)) < 0) {
+        // Nothing to drain.
+      }
+      continue;
+    }
+    if ((size_t)fd < channels_.size() && channels_[fd] != nullptr) {
+      bool err = (ev & (EPOLLERR | EPOLLHUP)) != 0;
+      channels_[fd]->handle_events((ev & EPOLLIN) || err,
+                                   (ev & EPOLLOUT) || err);
+      continue;
+    }
+    for (size_t j = 0; j < listeners_.size(); j++) {
+      if (listeners_[j].sock_ == fd) {
+        accept_connections(listeners_[j]);
+        break;
+      }
+    }
+  }
+
+  // Channels scheduled while these run wait for the next iteration.
+  std::vector<secure_authenticated_channel *> ready;
+  ready.swap(ready_);
+  for (size_t i = 0; i < ready.size(); i++) {
+    ready[i]->scheduled_ = false;
+    ready[i]->handle_events(false, false);
+  }
+
+  for (size_t i = 0; i < to_delete_.size(); i++)
+    delete to_delete_[i];
+  to_delete_.clear();
+  return n + (int)ready.size();
+}
+
+bool certifier::framework::channel_reactor::run() {
+  while (!stop_) {
+    if (run_once(-1) < 0)
+      return false;
+  }
+  stop_ = false;
+  return true;
+}
+
+void certifier::framework::channel_reactor::stop() {
+  stop_ = true;
+  uint64_t one = 1;
+  if (::write(wake_fd_, &one, sizeof(one)) < 0) {
+    // Already signalled.
+  }
+}
+
+bool certifier::framework::async_server_listen(
+    const string          &host_name,
+    int                    port,
+    const string          &asn1_root_cert,
+    const string          &asn1_peer_root_cert,
+    int                    num_certs,
+    string                *cert_chain,
+    key_message           &private_key,
+    const string          &private_key_cert,
+    channel_reactor       *r,
+    channel_ready_callback func,
+    void                  *arg) {
+
+  server_credential_set creds;
+  creds.has_chain_ = true;
+  creds.asn1_root_cert_ = asn1_root_cert;
+  creds.asn1_peer_root_cert_ = asn1_peer_root_cert;
+  for (int i = 0; i < num_certs; i++)
+    creds.cert_chain_.push_back(cert_chain[i]);
+  creds.private_key_.CopyFrom(private_key);
+  creds.private_key_cert_ = private_key_cert;
+  if (!creds.init_ctx()) {
+    printf("%s() error, line %d, Can't make SSL_CTX\n", __func__, __LINE__);
+    return false;
+  }
+
+  int sock = -1;
+  if (!open_server_socket(host_name, port, &sock)) {
+    printf("%s() error, line %d, Can't open server socket to %s:%d\n",
+           __func__,
+           __LINE__,
+           host_name.c_str(),
+           port);
+    return false;
+  }
+  // open_server_socket's backlog is sized for one blocking accept loop.
+  listen(sock, SOMAXCONN);
+
+  // The listener owns the SSL_CTX from here on.
+  SSL_CTX *ctx = creds.ctx_;
+  creds.ctx_ = nullptr;
+  if (!r->add_listener(sock, ctx, func, arg)) {
+    SSL_CTX_free(ctx);
+    ::close(sock);
+    return false;
+  }
+  return true;
+}
+
+bool certifier::framework::async_server_dispatch(
+    const string          &host_name,
+    int                    port,
+    const string          &asn1_root_cert,
+    const string          &asn1_peer_root_cert,
+    int                    num_certs,
+    string                *cert_chain,
+    key_message           &private_key,
+    const string          &private_key_cert,
+    channel_reactor       *r,
+    channel_ready_callback func,
+    void                  *arg) {
+  if (!async_server_listen(host_name,
+                           port,
+                           asn1_root_cert,
+                           asn1_peer_root_cert,
+                           num_certs,
+                           cert_chain,
+                           private_key,
+                           private_key_cert,
+                           r,
+                           func,
+                           arg)) {
+    return false;
+  }
+  return r->run();
+}
+
+bool certifier::framework::async_server_dispatch(
+    const string           &host_name,
+    int                     port,
+    const cc_trust_manager &mgr,
+    channel_reactor        *r,
+    channel_ready_callback  func,
+    void                   *arg) {
+  string      policy_cert;
+  key_message auth_key;
+  string      admissions_cert;
+  copy_credentials(mgr, &policy_cert, &auth_key, &admissions_cert);
+  return async_server_dispatch(host_name,
+                               port,
+                               policy_cert,
+                               policy_cert,
+                               0,
+                               nullptr,
+                               auth_key,
+                               admissions_cert,
+                               r,
+                               func,
+                               arg);
+}
+
+// Client channel pool
+// --------------------------------------------------------------------------------------
+
+static string pool_key(const string &host_name,
+                       int           port,
+                       const string &asn1_root_cert,
+                       const string &private_key_cert) {
+  string key(host_name);
+  key.append(1, '\0');
+  key.append(std::to_string(port));
+  key.append(1, '\0');
+  key.append(std::to_string(asn1_root_cert.size()));
+  key.append(1, '\0');
+  key.append(asn1_root_cert);
+  key.append(private_key_cert);
+  return key;
+}
+
+certifier::framework::channel_pool::channel_pool(int max_per_host,
+                                                 int idle_timeout_secs,
+                                                 int wait_ms)
+    : max_per_host_(max_per_host),
+      idle_timeout_secs_(idle_timeout_secs),
+      wait_ms_(wait_ms),
+      num_connects_(0) {}
+
+certifier::framework::channel_pool::~channel_pool() {
+  close_idle();
+}
+
+// Open with nothing waiting to be read.  A peer that closed, or sent
+// something nobody asked for, leaves the socket readable; records that
+// only carry handshake messages, like TLS 1.3 session tickets, are
+// consumed by a non-blocking peek and don't count.
+bool certifier::framework::channel_pool::healthy(
+    secure_authenticated_channel *c) {
+  if (c->ssl_ == nullptr || c->sock_ < 0 || SSL_pending(c->ssl_) > 0)
+    return false;
+  struct pollfd p;
+  p.fd = c->sock_;
+  p.events = POLLIN;
+  p.revents = 0;
+  int n = poll(&p, 1, 0);
+  if (n == 0)
+    return true;
+  if (n < 0 || (p.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+    return false;
+
+  int  flags = fcntl(c->sock_, F_GETFL, 0);
+  byte b;
+  fcntl(c->sock_, F_SETFL, flags | O_NONBLOCK);
+  int r = SSL_peek(c->ssl_, &b, 1);
+  int err = SSL_get_error(c->ssl_, r);
+  fcntl(c->sock_, F_SETFL, flags);
+  return r <= 0 && err == SSL_ERROR_WANT_READ;
+}
+
+void certifier::framework::channel_pool::discard(
+    secure_authenticated_channel *c) {
+  c->close();
+  delete c;
+}
+
+secure_authenticated_channel *certifier::framework::channel_pool::borrow(
+    const string &host_name,
+    int           port,
+    const string &asn1_root_cert,
+    key_message  &private_key,
+    const string &private_key_cert) {
+  string key = pool_key(host_name, port, asn1_root_cert, private_key_cert);
+  std::unique_lock<std::mutex> l(lock_);
+  host_channels               &h = hosts_[key];
+  clock::time_point            deadline =
+      clock::now() + std::chrono::milliseconds(wait_ms_);
+  for (;;) {
+    clock::time_point oldest =
+        clock::now() - std::chrono::seconds(idle_timeout_secs_);
+    while (!h.idle_.empty() && h.idle_.front().since_ <= oldest) {
+      discard(h.idle_.front().channel_);
+      h.idle_.erase(h.idle_.begin());
+      h.num_open_--;
+    }
+    while (!h.idle_.empty()) {
+      idle_channel ic = h.idle_.back();
+      h.idle_.pop_back();
+      if (healthy(ic.channel_)) {
+        borrowed_[ic.channel_] = key;
+        return ic.channel_;
+      }
+      h.num_open_--;
+      discard(ic.channel_);
+    }
+    if (h.num_open_ < max_per_host_)
+      break;
+    if (returned_.wait_until(l, deadline) == std::cv_status::timeout
+        && h.idle_.empty() && h.num_open_ >= max_per_host_) {
+      printf("%s() error, line %d, %d channels to %s:%d in use\n",
+             __func__,
+             __LINE__,
+             h.num_open_,
+             host_name.c_str(),
+             port);
+      return nullptr;
+    }
+  }
+  h.num_open_++;
+  num_connects_++;
+  l.unlock();
+
+  // Connect outside the lock; the slot is already counted.
+  string                        role("client");
+  secure_authenticated_channel *c = new secure_authenticated_channel(role);
+  if (!c->init_client_ssl(host_name,
+                          port,
+                          asn1_root_cert,
+                          private_key,
+                          private_key_cert)) {
+    printf("%s() error, line %d, Can't connect to %s:%d\n",
+           __func__,
+           __LINE__,
+           host_name.c_str(),
+           port);
+    discard(c);
+    l.lock();
+    h.num_open_--;
+    returned_.notify_one();
+    return nullptr;
+  }
+  l.lock();
+  borrowed_[c] = key;
+  return c;
+}
+
+secure_authenticated_channel *certifier::framework::channel_pool::borrow(
+    const string           &host_name,
+    int                     port,
+    const cc_trust_manager &mgr) {
+  string      policy_cert;
+  key_message auth_key;
+  string      admissions_cert;
+  copy_credentials(mgr, &policy_cert, &auth_key, &admissions_cert);
+  return borrow(host_name, port, policy_cert, auth_key, admissions_cert);
+}
+
+void certifier::framework::channel_pool::give_back(
+    secure_authenticated_channel *c,
+    bool                          reusable) {
+  if (c == nullptr)
+    return;
+  std::lock_guard<std::mutex> l(lock_);
+  std::map<secure_authenticated_channel *, string>::iterator it =
+      borrowed_.find(c);
+  if (it == borrowed_.end()) {
+    printf("%s() error, line %d, channel not borrowed\n", __func__, __LINE__);
+    return;
+  }
+  host_channels &h = hosts_[it->second];
+  borrowed_.erase(it);
+  if (reusable && healthy(c)) {
+    idle_channel ic;
+    ic.channel_ = c;
+    ic.since_ = clock::now();
+    h.idle_.push_back(ic);
+  } else {
+    h.num_open_--;
+    discard(c);
+  }
+  returned_.notify_all();
+}
+
+void certifier::framework::channel_pool::close_idle() {
+  std::lock_guard<std::mutex> l(lock_);
+  for (std::map<string, host_channels>::iterator it = hosts_.begin();
+       it != hosts_.end();
+       ++it) {
+    for (size_t i = 0; i < it->second.idle_.size(); i++)
+      discard(it->second.idle_[i].channel_);
+    it->second.num_open_ -= (int)it->second.idle_.size();
+    it->second.idle_.clear();
+  }
+  returned_.notify_all();
+}
+
+int certifier::framework::channel_pool::num_open() {
+  std::lock_guard<std::mutex> l(lock_);
+  int                         n = 0;
+  for (std::map<string, host_channels>::iterator it = hosts_.begin();
+       it != hosts_.end();
+       ++it)
+    n += it->second.num_open_;
+  return n;
+}
+
+int certifier::framework::channel_pool::num_idle() {
+  std::lock_guard<std::mutex> l(lock_);
+  int                         n = 0;
+  for (std::map<string, host_channels>::iterator it = hosts_.begin();
+       it != hosts_.end();
+       ++it)
+    n += (int)it->second.idle_.size();
+  return n;
+}
+
+int certifier::framework::channel_pool::num_connects() {
+  std::lock_guard<std::mutex> l(lock_);
+  return num_connects_;
+}
+#endif  // OE_CERTIFIER
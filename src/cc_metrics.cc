@@ -0,0 +1,320 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is included in support.cc so every build that links the
+// certifier picks it up without makefile changes.
+
+#include "cc_metrics.h"
+
+#ifndef NO_CERTIFIER_METRICS
+
+#  include <mutex>
+#  include <netdb.h>
+#  include <sys/socket.h>
+
+// clang-format off
+const double certifier::utilities::metric_histogram::bounds_[] = {
+    0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.005, 0.01,
+    0.05,    0.1,     0.25,   0.5,    1.0,   5.0,   10.0,
+};
+// clang-format on
+
+certifier::utilities::metric_counter::metric_counter(const string &name,
+                                                     const string &help)
+    : name_(name), help_(help), value_(0) {}
+
+certifier::utilities::metric_histogram::metric_histogram(const string &name,
+                                                         const string &help)
+    : name_(name), help_(help), count_(0), sum_ns_(0) {
+  for (int i = 0; i <= num_bounds_; i++)
+    buckets_[i].store(0, std::memory_order_relaxed);
+}
+
+void certifier::utilities::metric_histogram::observe_ns(uint64_t ns) {
+  double secs = ((double)ns) / 1.0e9;
+  int    i = 0;
+  while (i < num_bounds_ && secs > bounds_[i])
+    i++;
+  buckets_[i].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+}
+
+// Registry
+// -------------------------------------------------------------------
+
+static std::mutex metrics_registration_lock;
+
+certifier::utilities::metrics_registry::metrics_registry()
+    : num_counters_(0), num_histograms_(0) {}
+
+certifier::utilities::metrics_registry::~metrics_registry() {
+  for (int i = 0; i < num_counters_.load(); i++)
+    delete counters_[i];
+  for (int i = 0; i < num_histograms_.load(); i++)
+    delete histograms_[i];
+}
+
+certifier::utilities::metrics_registry *
+certifier::utilities::metrics_registry::get() {
+  // Never destroyed: spans may still fire from static destructors.
+  static metrics_registry *the_registry = new metrics_registry();
+  return the_registry;
+}
+
+certifier::utilities::metric_counter *
+certifier::utilities::metrics_registry::find_counter(const string &name) {
+  int n = num_counters_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    if (counters_[i]->name_ == name)
+      return counters_[i];
+  }
+  return nullptr;
+}
+
+certifier::utilities::metric_histogram *
+certifier::utilities::metrics_registry::find_histogram(const string &name) {
+  int n = num_histograms_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    if (histograms_[i]->name_ == name)
+      return histograms_[i];
+  }
+  return nullptr;
+}
+
+// Registration only happens the first time a call site runs, so a lock
+// here is cheap; the acquire/release pair lets readers skip it.
+certifier::utilities::metric_counter *
+certifier::utilities::metrics_registry::counter(const string &name,
+                                                const string &help) {
+  std::lock_guard<std::mutex> l(metrics_registration_lock);
+  metric_counter             *c = find_counter(name);
+  if (c != nullptr)
+    return c;
+  int n = num_counters_.load(std::memory_order_relaxed);
+  if (n >= MAX_NUM_METRICS) {
+    printf("%s() error, line %d, too many counters\n", __func__, __LINE__);
+    static metric_counter overflow("overflow", "");
+    return &overflow;
+  }
+  counters_[n] = new metric_counter(name, help);
+  num_counters_.store(n + 1, std::memory_order_release);
+  return counters_[n];
+}
+
+certifier::utilities::metric_histogram *
+certifier::utilities::metrics_registry::histogram(const string &name,
+                                                  const string &help) {
+  std::lock_guard<std::mutex> l(metrics_registration_lock);
+  metric_histogram           *h = find_histogram(name);
+  if (h != nullptr)
+    return h;
+  int n = num_histograms_.load(std::memory_order_relaxed);
+  if (n >= MAX_NUM_METRICS) {
+    printf("%s() error, line %d, too many histograms\n", __func__, __LINE__);
+    static metric_histogram overflow("overflow", "");
+    return &overflow;
+  }
+  histograms_[n] = new metric_histogram(name, help);
+  num_histograms_.store(n + 1, std::memory_order_release);
+  return histograms_[n];
+}
+
+void certifier::utilities::metrics_registry::reset() {
+  int n = num_counters_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++)
+    counters_[i]->value_.store(0, std::memory_order_relaxed);
+  n = num_histograms_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    metric_histogram *h = histograms_[i];
+    for (int j = 0; j <= metric_histogram::num_bounds_; j++)
+      h->buckets_[j].store(0, std::memory_order_relaxed);
+    h->count_.store(0, std::memory_order_relaxed);
+    h->sum_ns_.store(0, std::memory_order_relaxed);
+  }
+}
+
+bool certifier::utilities::metrics_registry::prometheus_text(string *out) {
+  char buf[512];
+
+  out->clear();
+  int n = num_counters_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    metric_counter *c = counters_[i];
+    snprintf(buf,
+             sizeof(buf),
+             "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+             c->name_.c_str(),
+             c->help_.c_str(),
+             c->name_.c_str(),
+             c->name_.c_str(),
+             (unsigned long)c->value());
+    out->append(buf);
+  }
+
+  n = num_histograms_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    metric_histogram *h = histograms_[i];
+    snprintf(buf,
+             sizeof(buf),
+             "# HELP %s %s\n# TYPE %s histogram\n",
+             h->name_.c_str(),
+             h->help_.c_str(),
+             h->name_.c_str());
+    out->append(buf);
+
+    // Buckets are cumulative in the exposition format.
+    uint64_t cumulative = 0;
+    for (int j = 0; j < metric_histogram::num_bounds_; j++) {
+      cumulative += h->buckets_[j].load(std::memory_order_relaxed);
+      snprintf(buf,
+               sizeof(buf),
+               "%s_bucket{le=\"%g\"} %lu\n",
+               h->name_.c_str(),
+               metric_histogram::bounds_[j],
+               (unsigned long)cumulative);
+      out->append(buf);
+    }
+    cumulative +=
+        h->buckets_[metric_histogram::num_bounds_].load(
+            std::memory_order_relaxed);
+    snprintf(buf,
+             sizeof(buf),
+             "%s_bucket{le=\"+Inf\"} %lu\n%s_sum %.9f\n%s_count %lu\n",
+             h->name_.c_str(),
+             (unsigned long)cumulative,
+             h->name_.c_str(),
+             ((double)h->sum_ns()) / 1.0e9,
+             h->name_.c_str(),
+             (unsigned long)cumulative);
+    out->append(buf);
+  }
+  return true;
+}
+
+// Spans
+// -------------------------------------------------------------------
+
+certifier::utilities::metric_span::metric_span(metric_histogram *h)
+    : h_(h), start_(std::chrono::steady_clock::now()), ended_(false) {}
+
+certifier::utilities::metric_span::~metric_span() {
+  end();
+}
+
+void certifier::utilities::metric_span::end() {
+  if (ended_ || h_ == nullptr)
+    return;
+  ended_ = true;
+  std::chrono::nanoseconds ns = std::chrono::duration_cast<
+      std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+  h_->observe_ns((uint64_t)ns.count());
+}
+
+// Exporters
+// -------------------------------------------------------------------
+
+certifier::utilities::prometheus_file_exporter::prometheus_file_exporter(
+    const string &file_name)
+    : file_name_(file_name) {}
+
+bool certifier::utilities::prometheus_file_exporter::export_text(
+    const string &text) {
+  string tmp_name(file_name_);
+  tmp_name.append(".tmp");
+  if (!write_file(tmp_name, (int)text.size(), (byte *)text.data())) {
+    printf("%s() error, line %d, can't write %s\n",
+           __func__,
+           __LINE__,
+           tmp_name.c_str());
+    return false;
+  }
+  if (rename(tmp_name.c_str(), file_name_.c_str()) != 0) {
+    printf("%s() error, line %d, can't rename %s\n",
+           __func__,
+           __LINE__,
+           tmp_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+certifier::utilities::prometheus_socket_exporter::prometheus_socket_exporter(
+    const string &host_name,
+    int           port)
+    : host_name_(host_name), port_(port) {}
+
+bool certifier::utilities::prometheus_socket_exporter::export_text(
+    const string &text) {
+  struct addrinfo  hints;
+  struct addrinfo *result = nullptr;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  string port_str = std::to_string(port_);
+  if (getaddrinfo(host_name_.c_str(), port_str.c_str(), &hints, &result) != 0) {
+    printf("%s() error, line %d, getaddrinfo failed for %s\n",
+           __func__,
+           __LINE__,
+           host_name_.c_str());
+    return false;
+  }
+
+  int sock = -1;
+  for (struct addrinfo *rp = result; rp != nullptr; rp = rp->ai_next) {
+    sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+    if (sock < 0)
+      continue;
+    if (connect(sock, rp->ai_addr, rp->ai_addrlen) == 0)
+      break;
+    ::close(sock);
+    sock = -1;
+  }
+  freeaddrinfo(result);
+  if (sock < 0) {
+    printf("%s() error, line %d, can't connect to %s:%d\n",
+           __func__,
+           __LINE__,
+           host_name_.c_str(),
+           port_);
+    return false;
+  }
+
+  const char *p = text.data();
+  size_t      left = text.size();
+  while (left > 0) {
+    ssize_t n = ::write(sock, p, left);
+    if (n <= 0) {
+      ::close(sock);
+      return false;
+    }
+    p += n;
+    left -= n;
+  }
+  ::close(sock);
+  return true;
+}
+
+bool certifier::utilities::export_metrics(metrics_exporter *exporter) {
+  if (exporter == nullptr)
+    return false;
+  string text;
+  if (!metrics_registry::get()->prometheus_text(&text))
+    return false;
+  return exporter->export_text(text);
+}
+
+#endif  // NO_CERTIFIER_METRICS
@@ -30,7 +30,9 @@ using namespace certifier::utilities;
 // Policy store
 // -------------------------------------------------------------------
 
-certifier::framework::store_entry::store_entry() {}
+certifier::framework::store_entry::store_entry()
+    : value_offset_(-1),
+      value_size_(0) {}
 
 certifier::framework::store_entry::~store_entry() {}
 
@@ -46,22 +48,32 @@ void certifier::framework::store_entry::print() {
 certifier::framework::policy_store::policy_store(unsigned max_ents) {
   max_num_ents_ = max_ents;
   num_ents_ = 0;
+  num_undecoded_ = 0;
   entry_ = new store_entry *[max_ents];
 }
 
 certifier::framework::policy_store::policy_store() {
   max_num_ents_ = MAX_NUM_ENTRIES;
   num_ents_ = 0;
+  num_undecoded_ = 0;
   entry_ = new store_entry *[MAX_NUM_ENTRIES];
 }
 
 certifier::framework::policy_store::~policy_store() {
+  clear_entries();
+  delete[] entry_;
+}
+
+void certifier::framework::policy_store::clear_entries() {
   for (unsigned i = 0; i < num_ents_; i++) {
     delete entry_[i];
     entry_[i] = nullptr;
   }
-  delete[] entry_;
   num_ents_ = 0;
+  num_undecoded_ = 0;
+  if (!serialized_.empty())
+    OPENSSL_cleanse(&serialized_[0], serialized_.size());
+  serialized_.clear();
 }
 
 unsigned certifier::framework::policy_store::get_num_entries() {
@@ -90,16 +102,45 @@ int certifier::framework::policy_store::find_entry(const string &tag,
   return -1;
 }
 
-bool certifier::framework::policy_store::get(unsigned ent, string *v) {
+// se's value no longer needs the serialized store; once no value does,
+// the plaintext is wiped.
+void certifier::framework::policy_store::drop_value(store_entry *se) {
+  if (se->value_offset_ < 0)
+    return;
+  se->value_offset_ = -1;
+  se->value_size_ = 0;
+  if (--num_undecoded_ == 0 && !serialized_.empty()) {
+    OPENSSL_cleanse(&serialized_[0], serialized_.size());
+    serialized_.clear();
+  }
+}
+
+// Copies ent's value out of the serialized store the first time it is
+// read.
+store_entry *certifier::framework::policy_store::decoded(unsigned ent) {
   if (ent >= num_ents_)
+    return nullptr;
+  store_entry *se = entry_[ent];
+  if (se->value_offset_ >= 0) {
+    se->value_.assign(serialized_.data() + se->value_offset_,
+                      se->value_size_);
+    drop_value(se);
+  }
+  return se;
+}
+
+bool certifier::framework::policy_store::get(unsigned ent, string *v) {
+  store_entry *se = decoded(ent);
+  if (se == nullptr)
     return false;
-  *v = entry_[ent]->value_;
+  *v = se->value_;
   return true;
 }
 
 bool certifier::framework::policy_store::put(unsigned ent, const string v) {
   if (ent >= num_ents_)
     return false;
+  drop_value(entry_[ent]);
   entry_[ent]->value_ = v;
   return true;
 }
@@ -116,10 +157,15 @@ const string *certifier::framework::policy_store::type(unsigned ent) {
   return &entry_[ent]->type_;
 }
 
-store_entry *certifier::framework::policy_store::get_entry(unsigned ent) {
-  if (ent >= num_ents_)
+const string *certifier::framework::policy_store::value(unsigned ent) {
+  store_entry *se = decoded(ent);
+  if (se == nullptr)
     return nullptr;
-  return entry_[ent];
+  return &se->value_;
+}
+
+store_entry *certifier::framework::policy_store::get_entry(unsigned ent) {
+  return decoded(ent);
 }
 
 bool certifier::framework::policy_store::update_or_insert(const string &tag,
@@ -138,8 +184,9 @@ bool certifier::framework::policy_store::delete_entry(unsigned ent) {
   if (ent >= num_ents_)
     return false;
 
+  drop_value(entry_[ent]);
   delete entry_[ent];
-  for (unsigned i = ent; i < num_ents_; i++) {
+  for (unsigned i = ent; i + 1 < num_ents_; i++) {
     entry_[i] = entry_[i + 1];
   }
   entry_[num_ents_ - 1] = nullptr;
@@ -154,11 +201,12 @@ void certifier::framework::policy_store::print() {
 
   for (unsigned i = 0; i < num_ents_; i++) {
     printf("  Entry %3d: ", i);
-    entry_[i]->print();
+    decoded(i)->print();
     printf("\n");
   }
 }
 
+// Values never read are written straight from the serialized store.
 bool certifier::framework::policy_store::Serialize(string *psout) {
   policy_store_message psm;
 
@@ -169,35 +217,176 @@ bool certifier::framework::policy_store::Serialize(string *psout) {
     store_entry        *se = entry_[i];
     pe->set_tag(se->tag_);
     pe->set_type(se->type_);
-    pe->set_value(se->value_);
+    if (se->value_offset_ >= 0)
+      pe->set_value(serialized_.data() + se->value_offset_, se->value_size_);
+    else
+      pe->set_value(se->value_);
   }
 
   return (psm.SerializeToString(psout));
 }
 
-bool certifier::framework::policy_store::Deserialize(string &in) {
-
-  policy_store_message psm;
+// Protobuf wire format, as far as policy_store_message needs it.
+static bool read_varint(const string &s, size_t *pos, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64 && *pos < s.size(); shift += 7) {
+    byte b = (byte)s[(*pos)++];
+    *v |= (uint64_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
 
-  if (!psm.ParseFromString(in))
+// Reads the field at *pos.  Length delimited fields report where their
+// bytes are in *off and *len; varints report their value in *v.
+static bool read_field(const string &s,
+                       size_t       *pos,
+                       int          *field,
+                       int          *wire_type,
+                       uint64_t     *v,
+                       size_t       *off,
+                       size_t       *len) {
+  uint64_t key;
+  if (!read_varint(s, pos, &key) || (key >> 3) == 0)
     return false;
+  *field = (int)(key >> 3);
+  *wire_type = (int)(key & 7);
+  switch (*wire_type) {
+    case 0:
+      return read_varint(s, pos, v);
+    case 1:
+    case 5: {
+      size_t n = *wire_type == 1 ? 8 : 4;
+      if (s.size() - *pos < n)
+        return false;
+      *pos += n;
+      return true;
+    }
+    case 2:
+      if (!read_varint(s, pos, v) || *v > s.size() - *pos)
+        return false;
+      *off = *pos;
+      *len = (size_t)*v;
+      *pos += *len;
+      return true;
+    default:
+      return false;
+  }
+}
 
-  if (psm.has_max_ents()) {
-    max_num_ents_ = psm.max_ents();
+// One pass over serialized_ recording each entry's tag and type and
+// where its value is.  Nothing else is copied.
+bool certifier::framework::policy_store::index_serialized() {
+  std::vector<store_entry *> ents;
+  int                        max_ents = MAX_NUM_ENTRIES;
+  bool                       ok = true;
+  size_t                     pos = 0;
+  while (ok && pos < serialized_.size()) {
+    int      field, wire_type;
+    uint64_t v = 0;
+    size_t   off = 0, len = 0;
+    if (!read_field(serialized_, &pos, &field, &wire_type, &v, &off, &len)) {
+      ok = false;
+      break;
+    }
+    if (field == 1 && wire_type == 0) {
+      max_ents = (int)(int32_t)v;
+      continue;
+    }
+    if (field != 2 || wire_type != 2)
+      continue;
+
+    store_entry *se = new store_entry();
+    ents.push_back(se);
+    size_t epos = off;
+    while (epos < off + len) {
+      int      efield, ewire_type;
+      uint64_t ev = 0;
+      size_t   eoff = 0, elen = 0;
+      // Bound the entry's fields by the entry, not the whole store.
+      if (!read_field(serialized_,
+                      &epos,
+                      &efield,
+                      &ewire_type,
+                      &ev,
+                      &eoff,
+                      &elen)
+          || epos > off + len) {
+        ok = false;
+        break;
+      }
+      if (ewire_type != 2)
+        continue;
+      if (efield == 1) {
+        se->tag_.assign(serialized_.data() + eoff, elen);
+      } else if (efield == 2) {
+        se->type_.assign(serialized_.data() + eoff, elen);
+      } else if (efield == 3) {
+        if (elen > (size_t)INT_MAX) {
+          ok = false;
+          break;
+        }
+        se->value_offset_ = (int)eoff;
+        se->value_size_ = (int)elen;
+      }
+    }
+  }
+
+  if (ok) {
+    if (max_ents < (int)ents.size())
+      max_ents = (int)ents.size();
+    if (max_ents <= 0)
+      max_ents = MAX_NUM_ENTRIES;
+    if (max_ents > MAX_NUM_ENTRIES_LIMIT
+        || ents.size() > (size_t)MAX_NUM_ENTRIES_LIMIT) {
+      printf("%s() error, line %d, store claims %d entries\n",
+             __func__,
+             __LINE__,
+             max_ents);
+      ok = false;
+    }
   } else {
-    max_num_ents_ = MAX_NUM_ENTRIES;
+    printf("%s() error, line %d, Can't parse store\n", __func__, __LINE__);
+  }
+  if (!ok) {
+    for (size_t i = 0; i < ents.size(); i++)
+      delete ents[i];
+    return false;
   }
 
-  for (int i = 0; i < psm.entries_size(); i++) {
-    const policy_store_entry &pe = psm.entries(i);
-    store_entry              *se = new store_entry();
-    entry_[i] = se;
-    se->tag_ = pe.tag();
-    se->type_ = pe.type();
-    se->value_ = pe.value();
+  if ((unsigned)max_ents > max_num_ents_) {
+    delete[] entry_;
+    entry_ = new store_entry *[max_ents];
+  }
+  max_num_ents_ = max_ents;
+  for (size_t i = 0; i < ents.size(); i++) {
+    if (ents[i]->value_offset_ >= 0)
+      num_undecoded_++;
+    entry_[num_ents_++] = ents[i];
   }
-  num_ents_ = psm.entries_size();
+  return true;
+}
 
+bool certifier::framework::policy_store::Deserialize(string &in) {
+  string copy(in);
+  return Deserialize_from(&copy);
+}
+
+// Takes over *in and indexes it; values are copied out of it only when
+// first read.
+bool certifier::framework::policy_store::Deserialize_from(string *in) {
+  clear_entries();
+  serialized_.swap(*in);
+  in->clear();
+  if (!index_serialized()) {
+    clear_entries();
+    return false;
+  }
+  if (num_undecoded_ == 0) {
+    OPENSSL_cleanse(&serialized_[0], serialized_.size());
+    serialized_.clear();
+  }
   return true;
 }
 
@@ -500,12 +689,16 @@ extern bool keystone_Verify(const int what_to_say_size,
 
 // Buffer overflow check: Seal returns true and the buffer size in size_out.
 // Check on Gramine.
+// the padding size includes an IV and possibly 3 additional blocks
+const int max_key_seal_pad = 1024;
+
 bool certifier::framework::Seal(const string &enclave_type,
                                 const string &enclave_id,
                                 int           in_size,
                                 byte         *in,
                                 int          *size_out,
                                 byte         *out) {
+  CC_METRICS_SPAN(span, "certifier_seal_seconds", "Time spent in Seal");
 
   if (enclave_type == "simulated-enclave") {
     return simulated_Seal(enclave_type, enclave_id, in_size, in, size_out, out);
@@ -555,6 +748,7 @@ bool certifier::framework::Unseal(const string &enclave_type,
                                   byte         *in,
                                   int          *size_out,
                                   byte         *out) {
+  CC_METRICS_SPAN(span, "certifier_unseal_seconds", "Time spent in Unseal");
 
   if (enclave_type == "simulated-enclave") {
     return simulated_Unseal(enclave_type,
@@ -600,6 +794,68 @@ bool certifier::framework::Unseal(const string &enclave_type,
   return false;
 }
 
+// Application enclaves send the whole batch to app_service at once,
+// other enclaves seal item by item.
+bool certifier::framework::Seal_batch(const string              &enclave_type,
+                                      const string              &enclave_id,
+                                      const std::vector<string> &in,
+                                      std::vector<string>       *out) {
+  if (enclave_type == "application-enclave")
+    return application_Seal_batch(in, out);
+
+  out->clear();
+  out->resize(in.size());
+  for (size_t i = 0; i < in.size(); i++) {
+    int size_out = in[i].size() + max_key_seal_pad;
+    (*out)[i].resize(size_out);
+    if (!Seal(enclave_type,
+              enclave_id,
+              in[i].size(),
+              (byte *)in[i].data(),
+              &size_out,
+              (byte *)&(*out)[i][0])) {
+      printf("%s() error, line %d, can't seal item %d\n",
+             __func__,
+             __LINE__,
+             (int)i);
+      out->clear();
+      return false;
+    }
+    (*out)[i].resize(size_out);
+  }
+  return true;
+}
+
+bool certifier::framework::Unseal_batch(const string              &enclave_type,
+                                        const string              &enclave_id,
+                                        const std::vector<string> &in,
+                                        std::vector<string>       *out) {
+  if (enclave_type == "application-enclave")
+    return application_Unseal_batch(in, out);
+
+  out->clear();
+  out->resize(in.size());
+  for (size_t i = 0; i < in.size(); i++) {
+    int size_out = in[i].size();
+    (*out)[i].resize(size_out);
+    if (!Unseal(enclave_type,
+                enclave_id,
+                in[i].size(),
+                (byte *)in[i].data(),
+                &size_out,
+                (byte *)&(*out)[i][0])) {
+      printf("%s() error, line %d, can't unseal item %d\n",
+             __func__,
+             __LINE__,
+             (int)i);
+      out->clear();
+      return false;
+    }
+    (*out)[i].resize(size_out);
+  }
+  return true;
+}
+
 //  Buffer overflow check: Attest returns true and the buffer size in size_out.
 //  Check on Gramine.
 bool certifier::framework::Attest(const string &enclave_type,
@@ -607,6 +863,7 @@ bool certifier::framework::Attest(const string &enclave_type,
                                   byte         *what_to_say,
                                   int          *size_out,
                                   byte         *out) {
+  CC_METRICS_SPAN(span, "certifier_attest_seconds", "Time spent in Attest");
 
   if (enclave_type == "simulated-enclave") {
     return simulated_Attest(enclave_type,
@@ -806,8 +1063,6 @@ bool   GetParentEnclaveType(string *type) {
 // Protect Support
 // -------------------------------------------------------------------
 
-// the padding size includes an IV and possibly 3 additional blocks
-const int max_key_seal_pad = 1024;
 const int protect_key_size = 64;
 
 bool certifier::framework::protect_blob(const string &enclave_type,
@@ -863,8 +1118,11 @@ bool certifier::framework::protect_blob(const string &enclave_type,
     return false;
   }
 
-  int  size_encrypted = size_unencrypted_data + max_key_seal_pad;
-  byte encrypted_data[size_encrypted];
+  int            size_encrypted = size_unencrypted_data + max_key_seal_pad;
+  scratch_buffer encrypted_buf(size_encrypted);
+  byte          *encrypted_data = encrypted_buf.data();
+  if (encrypted_data == nullptr)
+    return false;
   if (!authenticated_encrypt(key.key_type().c_str(),
                              unencrypted_data,
                              size_unencrypted_data,
@@ -905,10 +1163,8 @@ bool certifier::framework::unprotect_blob(const string &enclave_type,
                                           int  *size_of_unencrypted_data,
                                           byte *unencrypted_data) {
 
-  string protected_blob_string;
-  protected_blob_string.assign((char *)protected_blob, size_protected_blob);
   protected_blob_message pb;
-  if (!pb.ParseFromString(protected_blob_string)) {
+  if (!pb.ParseFromArray(protected_blob, size_protected_blob)) {
     printf("%s() error, line %d, unprotect_blob: can't parse protected blob "
            "message\n",
            __func__,
@@ -1002,9 +1258,12 @@ bool certifier::framework::reprotect_blob(const string &enclave_type,
                                           int          *size_new_encrypted_blob,
                                           byte         *data) {
 
-  key_message new_key;
-  int         size_unencrypted_data = size_protected_blob;
-  byte        unencrypted_data[size_unencrypted_data];
+  key_message    new_key;
+  int            size_unencrypted_data = size_protected_blob;
+  scratch_buffer unencrypted_buf(size_unencrypted_data);
+  byte          *unencrypted_data = unencrypted_buf.data();
+  if (unencrypted_data == nullptr)
+    return false;
 
   if (!unprotect_blob(enclave_type,
                       size_protected_blob,
@@ -1058,18 +1317,24 @@ bool certifier::framework::reprotect_blob(const string &enclave_type,
 
 bool certifier::utilities::check_date_range(const string &nb,
                                             const string &na) {
-  time_point t_now;
-  time_point t_nb;
-  time_point t_na;
+  request_clock *clock = request_clock::current();
+  if (clock != nullptr) {
+    if (!clock->in_range(nb, na)) {
+      printf("No longer valid\n");
+      return false;
+    }
+    return true;
+  }
 
-  if (!time_now(&t_now))
-    return false;
-  if (!string_to_time(nb, &t_nb))
+  time_ns t_now = time_ns_now();
+  time_ns t_nb;
+  time_ns t_na;
+  if (!string_to_time_ns(nb, &t_nb))
     return false;
-  if (!string_to_time(na, &t_na))
+  if (!string_to_time_ns(na, &t_na))
     return false;
 
-  if (compare_time(t_now, t_nb) < 0 || compare_time(t_na, t_now) < 0) {
+  if (t_now < t_nb || t_na < t_now) {
     printf("No longer valid\n");
     return false;
   }
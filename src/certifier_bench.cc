@@ -0,0 +1,2177 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// certifier_bench.cc: Microbenchmarks for the Certifier primitives.
+//
+// Built with Google Benchmark, so the usual flags apply.  To record
+// results for regression tracking across releases, use:
+//
+//   ./certifier_bench.exe --benchmark_out=bench.json
+//
+// which writes JSON, the default --benchmark_out_format.
+//
+// To run a subset, use --benchmark_filter=<regex>.
+
+#include <benchmark/benchmark.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+
+#include "certifier.h"
+#include "support.h"
+#include "simulated_enclave.h"
+#include "cc_helpers.h"
+#include "application_enclave.h"
+
+#ifdef SEV_SNP
+#  include "attestation.h"
+#endif
+
+// test_support.cc constructs the standard simulated-enclave evidence packages
+#include "test_support.cc"
+
+using namespace certifier::framework;
+using namespace certifier::utilities;
+
+// -----------------------------------------------------------------------
+
+static const char *bench_digest_algs[] = {
+    Digest_method_sha_256,
+    Digest_method_sha_384,
+    Digest_method_sha_512,
+};
+
+// authenticated_encrypt dispatches on these.
+static const char *bench_auth_enc_algs[] = {
+    Enc_method_aes_256_cbc_hmac_sha256,
+    Enc_method_aes_256_cbc_hmac_sha384,
+    Enc_method_aes_256_gcm,
+};
+
+class bench_sign_alg {
+ public:
+  const char *sign_alg_;
+  const char *key_type_;
+  int         key_bits_;
+};
+
+// clang-format off
+static bench_sign_alg bench_sign_algs[] = {
+    { Enc_method_rsa_2048_sha256_pkcs_sign, "rsa", 2048 },
+    { Enc_method_rsa_3072_sha384_pkcs_sign, "rsa", 3072 },
+    { Enc_method_rsa_4096_sha384_pkcs_sign, "rsa", 4096 },
+    { Enc_method_ecc_256_sha256_pkcs_sign,  "ecc", 256 },
+    { Enc_method_ecc_384_sha384_pkcs_sign,  "ecc", 384 },
+};
+// clang-format on
+
+static bool bench_make_key(const bench_sign_alg &a, key_message *k) {
+  if (strcmp(a.key_type_, "rsa") == 0)
+    return make_certifier_rsa_key(a.key_bits_, k);
+  return make_certifier_ecc_key(a.key_bits_, k);
+}
+
+static bool bench_validity(string *nb, string *na) {
+  time_point t_nb;
+  time_point t_na;
+  if (!time_now(&t_nb))
+    return false;
+  if (!add_interval_to_time_point(t_nb, 24.0 * 365.0, &t_na))
+    return false;
+  if (!time_to_string(t_nb, nb))
+    return false;
+  if (!time_to_string(t_na, na))
+    return false;
+  return true;
+}
+
+// policy-key says measurement is-trusted, signed by signing_key
+static bool bench_measurement_claim(const key_message &signing_key,
+                                    claim_message     *claim) {
+  key_message pk;
+  if (!private_key_to_public_key(signing_key, &pk))
+    return false;
+  entity_message key_ent;
+  if (!make_key_entity(pk, &key_ent))
+    return false;
+
+  byte m[32];
+  for (int i = 0; i < 32; i++)
+    m[i] = i;
+  string measurement;
+  measurement.assign((char *)m, sizeof(m));
+  entity_message meas_ent;
+  if (!make_measurement_entity(measurement, &meas_ent))
+    return false;
+
+  string     is_trusted("is-trusted");
+  string     says("says");
+  vse_clause c1;
+  vse_clause c2;
+  if (!make_unary_vse_clause(meas_ent, is_trusted, &c1))
+    return false;
+  if (!make_indirect_vse_clause(key_ent, says, c1, &c2))
+    return false;
+
+  string serialized_cl;
+  if (!c2.SerializeToString(&serialized_cl))
+    return false;
+
+  string nb;
+  string na;
+  if (!bench_validity(&nb, &na))
+    return false;
+  string format("vse-clause");
+  string desc("bench claim");
+  return make_claim(serialized_cl.size(),
+                    (byte *)serialized_cl.data(),
+                    format,
+                    desc,
+                    nb,
+                    na,
+                    claim);
+}
+
+// Digest and symmetric primitives
+// -----------------------------------------------------------------------
+
+static void BM_digest_message(benchmark::State &state, const char *alg) {
+  int    size = state.range(0);
+  string msg(size, 'a');
+  byte   digest[64];
+
+  for (auto _ : state) {
+    if (!digest_message(alg,
+                        (const byte *)msg.data(),
+                        size,
+                        digest,
+                        sizeof(digest))) {
+      state.SkipWithError("digest_message failed");
+      break;
+    }
+    benchmark::DoNotOptimize(digest);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+// get_random against reading the kernel generator on every call, which
+// is what get_random used to do.
+static void BM_get_random(benchmark::State &state, bool from_kernel) {
+  int   size = state.range(0);
+  byte *out = new byte[size];
+
+  for (auto _ : state) {
+    bool ok = from_kernel ? get_seed_bytes(size, out)
+                          : get_random(8 * size, out);
+    if (!ok) {
+      state.SkipWithError("get_random failed");
+      break;
+    }
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  delete[] out;
+}
+
+static void BM_authenticated_encrypt(benchmark::State &state,
+                                     const char       *alg) {
+  int  size = state.range(0);
+  int  key_size = cipher_key_byte_size(alg);
+  byte key[key_size];
+  byte iv[block_size];
+  for (int i = 0; i < key_size; i++)
+    key[i] = (byte)i;
+  memset(iv, 0, sizeof(iv));
+
+  string plain(size, 'p');
+  int    cipher_max = size + 256;
+  byte  *cipher = new byte[cipher_max];
+
+  for (auto _ : state) {
+    int size_out = cipher_max;
+    if (!authenticated_encrypt(alg,
+                               (byte *)plain.data(),
+                               size,
+                               key,
+                               key_size,
+                               iv,
+                               block_size,
+                               cipher,
+                               &size_out)) {
+      state.SkipWithError("authenticated_encrypt failed");
+      break;
+    }
+    benchmark::DoNotOptimize(cipher);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  delete[] cipher;
+}
+
+static void BM_authenticated_decrypt(benchmark::State &state,
+                                     const char       *alg) {
+  int  size = state.range(0);
+  int  key_size = cipher_key_byte_size(alg);
+  byte key[key_size];
+  byte iv[block_size];
+  for (int i = 0; i < key_size; i++)
+    key[i] = (byte)i;
+  memset(iv, 0, sizeof(iv));
+
+  string plain(size, 'p');
+  int    cipher_max = size + 256;
+  byte  *cipher = new byte[cipher_max];
+  byte  *recovered = new byte[cipher_max];
+  int    cipher_size = cipher_max;
+  if (!authenticated_encrypt(alg,
+                             (byte *)plain.data(),
+                             size,
+                             key,
+                             key_size,
+                             iv,
+                             block_size,
+                             cipher,
+                             &cipher_size)) {
+    state.SkipWithError("authenticated_encrypt failed");
+  }
+
+  for (auto _ : state) {
+    int size_out = cipher_max;
+    if (!authenticated_decrypt(alg,
+                               cipher,
+                               cipher_size,
+                               key,
+                               key_size,
+                               recovered,
+                               &size_out)) {
+      state.SkipWithError("authenticated_decrypt failed");
+      break;
+    }
+    benchmark::DoNotOptimize(recovered);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  delete[] cipher;
+  delete[] recovered;
+}
+
+// Claims
+// -----------------------------------------------------------------------
+
+static void BM_make_signed_claim(benchmark::State &state, bench_sign_alg a) {
+  key_message   key;
+  claim_message claim;
+  if (!bench_make_key(a, &key) || !bench_measurement_claim(key, &claim)) {
+    state.SkipWithError("can't construct claim");
+    return;
+  }
+
+  for (auto _ : state) {
+    signed_claim_message sc;
+    if (!make_signed_claim(a.sign_alg_, claim, key, &sc)) {
+      state.SkipWithError("make_signed_claim failed");
+      break;
+    }
+    benchmark::DoNotOptimize(sc);
+  }
+}
+
+static void BM_verify_signed_claim(benchmark::State &state, bench_sign_alg a) {
+  key_message          key;
+  key_message          pk;
+  claim_message        claim;
+  signed_claim_message sc;
+  if (!bench_make_key(a, &key) || !bench_measurement_claim(key, &claim)
+      || !make_signed_claim(a.sign_alg_, claim, key, &sc)
+      || !private_key_to_public_key(key, &pk)) {
+    state.SkipWithError("can't construct signed claim");
+    return;
+  }
+
+  for (auto _ : state) {
+    if (!verify_signed_claim(sc, pk)) {
+      state.SkipWithError("verify_signed_claim failed");
+      break;
+    }
+  }
+}
+
+// X509 artifacts
+// -----------------------------------------------------------------------
+
+// verify_artifact expects the subject key to be of the same family as the
+// issuer key, so both are made the same way.
+
+static void BM_produce_artifact(benchmark::State &state, bench_sign_alg a) {
+  string      issuer_name("bench-issuer");
+  string      issuer_desc("bench");
+  string      subject_name("bench-subject");
+  string      subject_desc("bench");
+  key_message signing_key;
+  key_message subject_key;
+  key_message subject_pk;
+  if (!bench_make_key(a, &signing_key)
+      || !bench_make_key(a, &subject_key)
+      || !private_key_to_public_key(subject_key, &subject_pk)) {
+    state.SkipWithError("can't make keys");
+    return;
+  }
+  signing_key.set_key_name(issuer_name);
+  subject_pk.set_key_name(subject_name);
+
+  for (auto _ : state) {
+    X509 *x = X509_new();
+    if (!produce_artifact(signing_key,
+                          issuer_name,
+                          issuer_desc,
+                          subject_pk,
+                          subject_name,
+                          subject_desc,
+                          1L,
+                          86400.0,
+                          x,
+                          false)) {
+      X509_free(x);
+      state.SkipWithError("produce_artifact failed");
+      break;
+    }
+    X509_free(x);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// A batch of state.range(0) admission certificates for 2048 bit RSA auth
+// keys, on one thread per core.
+static void BM_issue_admission_certs(benchmark::State &state,
+                                     bench_sign_alg    a) {
+  string                         issuer_name("policyAuthority");
+  string                         issuer_organization("root");
+  key_message                    policy_key;
+  key_message                    auth_key;
+  std::vector<admission_request> batch(state.range(0));
+  admission_cert_issuer          issuer;
+  if (!bench_make_key(a, &policy_key)
+      || !make_certifier_rsa_key(2048, &auth_key)
+      || !issuer.init(policy_key, issuer_name, issuer_organization, 86400.0)) {
+    state.SkipWithError("can't make issuer");
+    return;
+  }
+  for (int i = 0; i < (int)batch.size(); i++) {
+    if (!private_key_to_public_key(auth_key, &batch[i].subject_key)) {
+      state.SkipWithError("can't make auth key");
+      return;
+    }
+    batch[i].subject_name = "bench-subject";
+    batch[i].subject_organization = "bench";
+    batch[i].sn = i;
+  }
+
+  std::vector<string> certs;
+  for (auto _ : state) {
+    if (!issuer.issue_admission_certs(batch, &certs)) {
+      state.SkipWithError("issue_admission_certs failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batch.size());
+}
+
+static void BM_verify_artifact(benchmark::State &state, bench_sign_alg a) {
+  string      issuer_name("bench-issuer");
+  string      issuer_desc("bench");
+  string      subject_name("bench-subject");
+  string      subject_desc("bench");
+  key_message signing_key;
+  key_message verify_key;
+  key_message subject_key;
+  key_message subject_pk;
+  if (!bench_make_key(a, &signing_key)
+      || !private_key_to_public_key(signing_key, &verify_key)
+      || !bench_make_key(a, &subject_key)
+      || !private_key_to_public_key(subject_key, &subject_pk)) {
+    state.SkipWithError("can't make keys");
+    return;
+  }
+  signing_key.set_key_name(issuer_name);
+  subject_pk.set_key_name(subject_name);
+
+  X509 *x = X509_new();
+  if (!produce_artifact(signing_key,
+                        issuer_name,
+                        issuer_desc,
+                        subject_pk,
+                        subject_name,
+                        subject_desc,
+                        1L,
+                        86400.0,
+                        x,
+                        false)) {
+    X509_free(x);
+    state.SkipWithError("produce_artifact failed");
+    return;
+  }
+
+  for (auto _ : state) {
+    string      issuer_name_out;
+    string      issuer_desc_out;
+    key_message subject_key_out;
+    string      subject_name_out;
+    string      subject_desc_out;
+    uint64_t    sn;
+    if (!verify_artifact(*x,
+                         verify_key,
+                         &issuer_name_out,
+                         &issuer_desc_out,
+                         &subject_key_out,
+                         &subject_name_out,
+                         &subject_desc_out,
+                         &sn)) {
+      state.SkipWithError("verify_artifact failed");
+      break;
+    }
+  }
+  X509_free(x);
+}
+
+// A root and a leaf it signs, checked as the TLS and SEV paths do: "fresh"
+// decodes both and builds a store for every check, as they used to;
+// "cached" goes through cert_verifier.
+
+static bool bench_make_chain(const bench_sign_alg &a,
+                             string               *root_der,
+                             string               *leaf_der) {
+  string      root_name("bench-root"), root_desc("bench");
+  string      leaf_name("bench-leaf"), leaf_desc("bench");
+  key_message root_key, root_pk, leaf_key, leaf_pk;
+  if (!bench_make_key(a, &root_key)
+      || !private_key_to_public_key(root_key, &root_pk)
+      || !bench_make_key(a, &leaf_key)
+      || !private_key_to_public_key(leaf_key, &leaf_pk))
+    return false;
+  root_key.set_key_name(root_name);
+  root_pk.set_key_name(root_name);
+  leaf_pk.set_key_name(leaf_name);
+
+  X509 *root = X509_new();
+  X509 *leaf = X509_new();
+  bool  ret = produce_artifact(root_key,
+                              root_name,
+                              root_desc,
+                              root_pk,
+                              root_name,
+                              root_desc,
+                              1L,
+                              86400.0,
+                              root,
+                              true)
+             && produce_artifact(root_key,
+                                 root_name,
+                                 root_desc,
+                                 leaf_pk,
+                                 leaf_name,
+                                 leaf_desc,
+                                 2L,
+                                 86400.0,
+                                 leaf,
+                                 false)
+             && x509_to_asn1(root, root_der) && x509_to_asn1(leaf, leaf_der);
+  X509_free(root);
+  X509_free(leaf);
+  return ret;
+}
+
+static void BM_verify_cert_chain(benchmark::State &state,
+                                 bench_sign_alg    a,
+                                 bool              cached) {
+  string root_der, leaf_der;
+  if (!bench_make_chain(a, &root_der, &leaf_der)) {
+    state.SkipWithError("can't make chain");
+    return;
+  }
+
+  for (auto _ : state) {
+    bool ok = false;
+    if (cached) {
+      cert_verifier &v = cert_verifier::instance();
+      X509          *root = v.decode(root_der);
+      X509          *leaf = v.decode(leaf_der);
+      ok = root != nullptr && leaf != nullptr
+           && v.verify_chain(root, leaf, std::vector<X509 *>());
+      X509_free(root);
+      X509_free(leaf);
+    } else {
+      X509           *root = X509_new();
+      X509           *leaf = X509_new();
+      X509_STORE     *store = X509_STORE_new();
+      X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+      ok = asn1_to_x509(root_der, root) && asn1_to_x509(leaf_der, leaf)
+           && X509_STORE_add_cert(store, root) == 1
+           && X509_STORE_CTX_init(ctx, store, leaf, nullptr) == 1
+           && X509_verify_cert(ctx) == 1;
+      X509_STORE_CTX_free(ctx);
+      X509_STORE_free(store);
+      X509_free(root);
+      X509_free(leaf);
+    }
+    if (!ok) {
+      state.SkipWithError("chain check failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Store
+// -----------------------------------------------------------------------
+
+static void BM_protect_blob(benchmark::State &state) {
+  string enclave_type("simulated-enclave");
+  int    size = state.range(0);
+
+  key_message key;
+  byte        key_bits[64];
+  for (int i = 0; i < (int)sizeof(key_bits); i++)
+    key_bits[i] = (byte)i;
+  key.set_key_name("bench-key");
+  key.set_key_type(Enc_method_aes_256_cbc_hmac_sha256);
+  key.set_key_format("vse-key");
+  key.set_secret_key_bits((void *)key_bits, sizeof(key_bits));
+
+  string data(size, 'd');
+  int    blob_max = size + 2048;
+  byte  *blob = new byte[blob_max];
+
+  for (auto _ : state) {
+    int blob_size = blob_max;
+    if (!protect_blob(enclave_type,
+                      key,
+                      size,
+                      (byte *)data.data(),
+                      &blob_size,
+                      blob)) {
+      state.SkipWithError("protect_blob failed");
+      break;
+    }
+    benchmark::DoNotOptimize(blob);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  delete[] blob;
+}
+
+static void BM_unprotect_blob(benchmark::State &state) {
+  string enclave_type("simulated-enclave");
+  int    size = state.range(0);
+
+  key_message key;
+  byte        key_bits[64];
+  for (int i = 0; i < (int)sizeof(key_bits); i++)
+    key_bits[i] = (byte)i;
+  key.set_key_name("bench-key");
+  key.set_key_type(Enc_method_aes_256_cbc_hmac_sha256);
+  key.set_key_format("vse-key");
+  key.set_secret_key_bits((void *)key_bits, sizeof(key_bits));
+
+  string data(size, 'd');
+  int    blob_max = size + 2048;
+  byte  *blob = new byte[blob_max];
+  byte  *recovered = new byte[blob_max];
+  int    blob_size = blob_max;
+  if (!protect_blob(enclave_type,
+                    key,
+                    size,
+                    (byte *)data.data(),
+                    &blob_size,
+                    blob)) {
+    state.SkipWithError("protect_blob failed");
+  }
+
+  for (auto _ : state) {
+    key_message key_out;
+    int         size_out = blob_max;
+    if (!unprotect_blob(enclave_type,
+                        blob_size,
+                        blob,
+                        &key_out,
+                        &size_out,
+                        recovered)) {
+      state.SkipWithError("unprotect_blob failed");
+      break;
+    }
+    benchmark::DoNotOptimize(recovered);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  delete[] blob;
+  delete[] recovered;
+}
+
+static void bench_fill_store(policy_store &ps, int n) {
+  string type("binary");
+  string value(64, 'v');
+  for (int i = 0; i < n; i++) {
+    string tag("bench-entry-");
+    tag.append(std::to_string(i));
+    ps.update_or_insert(tag, type, value);
+  }
+}
+
+static void BM_policy_store_update_or_insert(benchmark::State &state) {
+  int          n = state.range(0);
+  policy_store ps(policy_store::MAX_NUM_ENTRIES);
+  bench_fill_store(ps, n);
+  string tag("bench-entry-0");
+  string type("binary");
+  string value(64, 'w');
+
+  for (auto _ : state) {
+    if (!ps.update_or_insert(tag, type, value)) {
+      state.SkipWithError("update_or_insert failed");
+      break;
+    }
+  }
+}
+
+static void BM_policy_store_find_entry(benchmark::State &state) {
+  int          n = state.range(0);
+  policy_store ps(policy_store::MAX_NUM_ENTRIES);
+  bench_fill_store(ps, n);
+  string tag("bench-entry-");
+  tag.append(std::to_string(n - 1));
+  string type("binary");
+
+  for (auto _ : state) {
+    int ent = ps.find_entry(tag, type);
+    if (ent < 0) {
+      state.SkipWithError("find_entry failed");
+      break;
+    }
+    benchmark::DoNotOptimize(ent);
+  }
+}
+
+static void BM_policy_store_serialize(benchmark::State &state) {
+  int          n = state.range(0);
+  policy_store ps(policy_store::MAX_NUM_ENTRIES);
+  bench_fill_store(ps, n);
+
+  for (auto _ : state) {
+    string out;
+    if (!ps.Serialize(&out)) {
+      state.SkipWithError("Serialize failed");
+      break;
+    }
+    benchmark::DoNotOptimize(out);
+  }
+}
+
+static void BM_policy_store_deserialize(benchmark::State &state) {
+  int          n = state.range(0);
+  policy_store ps(policy_store::MAX_NUM_ENTRIES);
+  bench_fill_store(ps, n);
+  string serialized;
+  if (!ps.Serialize(&serialized)) {
+    state.SkipWithError("Serialize failed");
+    return;
+  }
+
+  for (auto _ : state) {
+    policy_store new_ps(policy_store::MAX_NUM_ENTRIES);
+    if (!new_ps.Deserialize(serialized)) {
+      state.SkipWithError("Deserialize failed");
+      break;
+    }
+  }
+}
+
+// Policy filtering
+// -----------------------------------------------------------------------
+
+// A policy of n claims: a key trusted for attestation, 16 platforms and
+// the rest measurements.  Filtering doesn't check signatures, so the
+// claims carry unique placeholders instead.
+static bool bench_policy(int                    n,
+                         key_message           *policy_pk,
+                         signed_claim_sequence *policy) {
+  key_message policy_key;
+  if (!make_certifier_rsa_key(2048, &policy_key)
+      || !private_key_to_public_key(policy_key, policy_pk))
+    return false;
+  entity_message key_ent;
+  if (!make_key_entity(*policy_pk, &key_ent))
+    return false;
+
+  string nb, na;
+  if (!bench_validity(&nb, &na))
+    return false;
+
+  const int num_platforms = 16;
+  for (int i = 0; i < n; i++) {
+    entity_message subject;
+    string         verb;
+    if (i == 0) {
+      verb = "is-trusted-for-attestation";
+      if (!make_key_entity(*policy_pk, &subject))
+        return false;
+    } else if (i <= num_platforms) {
+      verb = "has-trusted-platform-property";
+      string   debug_name("debug"), api_name("api-major");
+      string   str_type("string"), int_type("int");
+      string   eq("="), ge(">="), debug(i % 2 ? "yes" : "no"), unused;
+      platform plat;
+      plat.set_platform_type("amd-sev-snp");
+      plat.set_has_key(false);
+      if (!make_property(debug_name,
+                         str_type,
+                         eq,
+                         0,
+                         debug,
+                         plat.mutable_props()->add_props())
+          || !make_property(api_name,
+                            int_type,
+                            ge,
+                            i,
+                            unused,
+                            plat.mutable_props()->add_props())
+          || !make_platform_entity(plat, &subject))
+        return false;
+    } else {
+      verb = "is-trusted";
+      string m(48, 0);
+      memcpy((byte *)m.data(), &i, sizeof(i));
+      if (!make_measurement_entity(m, &subject))
+        return false;
+    }
+
+    string     says("says");
+    vse_clause said, cl;
+    string     serialized_cl;
+    if (!make_unary_vse_clause(subject, verb, &said)
+        || !make_indirect_vse_clause(key_ent, says, said, &cl)
+        || !cl.SerializeToString(&serialized_cl))
+      return false;
+    string        format("vse-clause");
+    string        desc;
+    claim_message cm;
+    if (!make_claim(serialized_cl.size(),
+                    (byte *)serialized_cl.data(),
+                    format,
+                    desc,
+                    nb,
+                    na,
+                    &cm))
+      return false;
+    signed_claim_message *sc = policy->add_claims();
+    cm.SerializeToString(sc->mutable_serialized_claim_message());
+    sc->set_signing_algorithm(Enc_method_rsa_2048_sha256_pkcs_sign);
+    sc->mutable_signing_key()->CopyFrom(*policy_pk);
+    string sig(256, 0);
+    memcpy((byte *)sig.data(), &i, sizeof(i));
+    sc->set_signature(sig);
+  }
+  return true;
+}
+
+static void BM_policy_index_build(benchmark::State &state) {
+  key_message           policy_pk;
+  signed_claim_sequence policy;
+  if (!bench_policy(state.range(0), &policy_pk, &policy)) {
+    state.SkipWithError("can't make policy");
+    return;
+  }
+
+  for (auto _ : state) {
+    policy_index index;
+    if (!index.build(policy_pk, policy)) {
+      state.SkipWithError("build failed");
+      break;
+    }
+  }
+}
+
+static void BM_policy_index_built_from(benchmark::State &state) {
+  key_message           policy_pk;
+  signed_claim_sequence policy;
+  policy_index          index;
+  if (!bench_policy(state.range(0), &policy_pk, &policy)
+      || !index.build(policy_pk, policy)) {
+    state.SkipWithError("can't make policy");
+    return;
+  }
+
+  for (auto _ : state) {
+    if (!index.built_from(policy_pk, policy)) {
+      state.SkipWithError("built_from failed");
+      break;
+    }
+  }
+}
+
+// The last measurement, on a platform only the last platform claim
+// with its debug setting allows.
+static void BM_policy_index_filter(benchmark::State &state) {
+  int                   n = state.range(0);
+  key_message           policy_pk;
+  signed_claim_sequence policy;
+  policy_index          index;
+  if (!bench_policy(n, &policy_pk, &policy)
+      || !index.build(policy_pk, policy)) {
+    state.SkipWithError("can't make policy");
+    return;
+  }
+  string m(48, 0);
+  int    last = n - 1;
+  memcpy((byte *)m.data(), &last, sizeof(last));
+  platform plat;
+  string   debug_name("debug"), api_name("api-major");
+  string   str_type("string"), int_type("int");
+  string   eq("="), no("no"), unused;
+  plat.set_platform_type("amd-sev-snp");
+  make_property(debug_name,
+                str_type,
+                eq,
+                0,
+                no,
+                plat.mutable_props()->add_props());
+  make_property(api_name,
+                int_type,
+                eq,
+                16,
+                unused,
+                plat.mutable_props()->add_props());
+
+  for (auto _ : state) {
+    signed_claim_sequence filtered;
+    if (!index.filter(m, plat, &filtered)) {
+      state.SkipWithError("filter failed");
+      break;
+    }
+    benchmark::DoNotOptimize(filtered);
+  }
+}
+
+// Key identity
+// -----------------------------------------------------------------------
+
+// A trusted list of n "policy-key says key-i is-trusted-for-attestation"
+// claims.  Only lookups are measured, so the keys are placeholders with
+// distinct moduli and the claims aren't signed.
+static bool bench_trusted_keys(int                       n,
+                               std::vector<key_message> *keys,
+                               signed_claim_sequence    *trusted) {
+  key_message policy_pk;
+  policy_pk.set_key_type(Enc_method_rsa_2048_public);
+  policy_pk.mutable_rsa_key()->set_public_modulus(string(256, 'p'));
+  policy_pk.mutable_rsa_key()->set_public_exponent(string("\x01\x00\x01"));
+  entity_message policy_ent;
+  if (!make_key_entity(policy_pk, &policy_ent))
+    return false;
+  string nb, na;
+  if (!bench_validity(&nb, &na))
+    return false;
+
+  for (int i = 0; i < n; i++) {
+    key_message k;
+    k.set_key_type(Enc_method_rsa_2048_public);
+    string modulus(256, 'k');
+    memcpy((byte *)modulus.data() + 200, &i, sizeof(i));
+    k.mutable_rsa_key()->set_public_modulus(modulus);
+    k.mutable_rsa_key()->set_public_exponent(string("\x01\x00\x01"));
+    keys->push_back(k);
+
+    entity_message key_ent;
+    vse_clause     said, cl;
+    string         verb("is-trusted-for-attestation"), says("says");
+    string         serialized_cl;
+    if (!make_key_entity(k, &key_ent)
+        || !make_unary_vse_clause(key_ent, verb, &said)
+        || !make_indirect_vse_clause(policy_ent, says, said, &cl)
+        || !cl.SerializeToString(&serialized_cl))
+      return false;
+    string        format("vse-clause"), desc;
+    claim_message cm;
+    if (!make_claim(serialized_cl.size(),
+                    (byte *)serialized_cl.data(),
+                    format,
+                    desc,
+                    nb,
+                    na,
+                    &cm))
+      return false;
+    signed_claim_message *sc = trusted->add_claims();
+    cm.SerializeToString(sc->mutable_serialized_claim_message());
+    sc->set_signing_algorithm(Enc_method_rsa_2048_sha256_pkcs_sign);
+    sc->mutable_signing_key()->CopyFrom(policy_pk);
+    string sig(256, 0);
+    memcpy((byte *)sig.data(), &i, sizeof(i));
+    sc->set_signature(sig);
+  }
+  return true;
+}
+
+extern bool get_signed_platform_claim_from_trusted_list(
+    const key_message     &expected_key,
+    signed_claim_sequence &trusted_platforms,
+    signed_claim_message  *claim);
+
+// Finds the claim for the last key in the list, as validate_evidence
+// does for the platform key.  The first lookup, which builds the index,
+// isn't timed.
+static void BM_trusted_key_lookup(benchmark::State &state) {
+  std::vector<key_message> keys;
+  signed_claim_sequence    trusted;
+  signed_claim_message     first;
+  if (!bench_trusted_keys(state.range(0), &keys, &trusted)
+      || !get_signed_platform_claim_from_trusted_list(keys.back(),
+                                                      trusted,
+                                                      &first)) {
+    state.SkipWithError("can't make trusted list");
+    return;
+  }
+
+  for (auto _ : state) {
+    signed_claim_message sc;
+    if (!get_signed_platform_claim_from_trusted_list(keys.back(),
+                                                     trusted,
+                                                     &sc)) {
+      state.SkipWithError("lookup failed");
+      break;
+    }
+  }
+}
+
+static void BM_same_key(benchmark::State &state) {
+  key_message k1, k2;
+  if (!make_certifier_rsa_key(2048, &k1)) {
+    state.SkipWithError("can't make key");
+    return;
+  }
+  k2.CopyFrom(k1);
+
+  for (auto _ : state) {
+    if (!same_key(k1, k2)) {
+      state.SkipWithError("same_key failed");
+      break;
+    }
+  }
+}
+
+static void BM_key_fingerprint(benchmark::State &state) {
+  key_message k;
+  if (!make_certifier_rsa_key(2048, &k)) {
+    state.SkipWithError("can't make key");
+    return;
+  }
+
+  for (auto _ : state) {
+    string fp;
+    if (!key_fingerprint(k, &fp)) {
+      state.SkipWithError("key_fingerprint failed");
+      break;
+    }
+    benchmark::DoNotOptimize(fp);
+  }
+}
+
+// Evidence validation
+// -----------------------------------------------------------------------
+
+static void BM_validate_evidence(benchmark::State &state,
+                                 const char       *descriptor) {
+  string enclave_type("simulated-enclave");
+  string evidence_descriptor(descriptor);
+  string unused("unused-file-name");
+  string purpose("authentication");
+
+  evidence_package      evp;
+  signed_claim_sequence trusted_platforms;
+  signed_claim_sequence trusted_measurements;
+  key_message           policy_key;
+  key_message           policy_pk;
+  if (!construct_standard_evidence_package(enclave_type,
+                                           false,
+                                           unused,
+                                           evidence_descriptor,
+                                           &trusted_platforms,
+                                           &trusted_measurements,
+                                           &policy_key,
+                                           &policy_pk,
+                                           &evp)) {
+    state.SkipWithError("can't construct evidence package");
+    return;
+  }
+
+  for (auto _ : state) {
+    if (!validate_evidence(evidence_descriptor,
+                           trusted_platforms,
+                           trusted_measurements,
+                           purpose,
+                           evp,
+                           policy_pk)) {
+      state.SkipWithError("validate_evidence failed");
+      break;
+    }
+  }
+}
+
+// One claim's validity check: "time_point" is how check_date_range used
+// to do it (time_now, sscanf and a field by field compare), "time_ns"
+// parses to epoch nanoseconds and "request_clock" is the same check
+// inside validate_evidence, with one clock read per request.
+static void BM_check_date_range(benchmark::State &state, const char *how) {
+  string mode(how);
+  string nb("2023-10-18T09:05: 7.00000Z");
+  string na("2099-10-18T09:05: 7.00000Z");
+
+  if (mode == "time_point") {
+    for (auto _ : state) {
+      time_point t_now, t_nb, t_na;
+      time_now(&t_now);
+      string_to_time(nb, &t_nb);
+      string_to_time(na, &t_na);
+      bool ok = compare_time(t_now, t_nb) >= 0 && compare_time(t_na, t_now) >= 0;
+      if (!ok) {
+        state.SkipWithError("out of range");
+        break;
+      }
+    }
+  } else if (mode == "time_ns") {
+    for (auto _ : state) {
+      if (!check_date_range(nb, na)) {
+        state.SkipWithError("out of range");
+        break;
+      }
+    }
+  } else {
+    request_clock clock;
+    for (auto _ : state) {
+      if (!check_date_range(nb, na)) {
+        state.SkipWithError("out of range");
+        break;
+      }
+    }
+  }
+}
+
+// Serialized size and parse time of a full or compact package; parsing
+// a compact package includes expanding it.
+static void BM_evidence_package(benchmark::State &state,
+                                const char       *descriptor) {
+  string enclave_type("simulated-enclave");
+  string evidence_descriptor(descriptor);
+  string unused("unused-file-name");
+  bool   compact = state.range(0) != 0;
+
+  evidence_package      evp;
+  signed_claim_sequence trusted_platforms;
+  signed_claim_sequence trusted_measurements;
+  key_message           policy_key;
+  key_message           policy_pk;
+  if (!construct_standard_evidence_package(enclave_type,
+                                           false,
+                                           unused,
+                                           evidence_descriptor,
+                                           &trusted_platforms,
+                                           &trusted_measurements,
+                                           &policy_key,
+                                           &policy_pk,
+                                           &evp)) {
+    state.SkipWithError("can't construct evidence package");
+    return;
+  }
+  evidence_package compact_evp;
+  string           serialized;
+  if (compact) {
+    if (!compact_evidence_package(evp, &compact_evp)
+        || !compact_evp.SerializeToString(&serialized)) {
+      state.SkipWithError("can't compact evidence package");
+      return;
+    }
+  } else if (!evp.SerializeToString(&serialized)) {
+    state.SkipWithError("can't serialize evidence package");
+    return;
+  }
+
+  for (auto _ : state) {
+    evidence_package parsed;
+    if (!parsed.ParseFromString(serialized)) {
+      state.SkipWithError("can't parse");
+      break;
+    }
+    if (compact) {
+      evidence_package expanded;
+      if (!expand_evidence_package(parsed, &expanded)) {
+        state.SkipWithError("can't expand");
+        break;
+      }
+      benchmark::DoNotOptimize(expanded);
+    }
+    benchmark::DoNotOptimize(parsed);
+  }
+  state.counters["bytes"] = serialized.size();
+}
+
+// Simulated enclave primitives
+// -----------------------------------------------------------------------
+
+static void BM_Seal(benchmark::State &state, const char *enclave) {
+  string enclave_type(enclave);
+  string enclave_id("bench-enclave");
+  int    size = state.range(0);
+  string data(size, 's');
+  int    sealed_max = size + 512;
+  byte  *sealed = new byte[sealed_max];
+
+  for (auto _ : state) {
+    int size_out = sealed_max;
+    if (!Seal(enclave_type,
+              enclave_id,
+              size,
+              (byte *)data.data(),
+              &size_out,
+              sealed)) {
+      state.SkipWithError("Seal failed");
+      break;
+    }
+    benchmark::DoNotOptimize(sealed);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  delete[] sealed;
+}
+
+static void BM_Attest(benchmark::State &state, const char *enclave) {
+  string      enclave_type(enclave);
+  key_message enclave_key;
+  key_message enclave_pk;
+  if (!make_certifier_rsa_key(2048, &enclave_key)
+      || !private_key_to_public_key(enclave_key, &enclave_pk)) {
+    state.SkipWithError("can't make enclave key");
+    return;
+  }
+  attestation_user_data ud;
+  string                serialized_ud;
+  if (!make_attestation_user_data(enclave_type, enclave_pk, &ud)
+      || !ud.SerializeToString(&serialized_ud)) {
+    state.SkipWithError("can't make user data");
+    return;
+  }
+
+  byte out[16000];
+  for (auto _ : state) {
+    int size_out = sizeof(out);
+    if (!Attest(enclave_type,
+                serialized_ud.size(),
+                (byte *)serialized_ud.data(),
+                &size_out,
+                out)) {
+      state.SkipWithError("Attest failed");
+      break;
+    }
+    benchmark::DoNotOptimize(out);
+  }
+}
+
+#ifdef SEV_SNP
+// These require the sev-snp-simulator device, see sev-snp-simulator.
+extern bool      verify_sev_Attest(EVP_PKEY *key,
+                                   int       size_sev_attestation,
+                                   byte     *the_attestation,
+                                   int      *size_measurement,
+                                   byte     *measurement);
+extern EVP_PKEY *get_simulated_vcek_key();
+
+static void BM_verify_sev_Attest(benchmark::State &state) {
+  string      enclave_type("sev-enclave");
+  key_message enclave_key;
+  key_message enclave_pk;
+  if (!make_certifier_rsa_key(2048, &enclave_key)
+      || !private_key_to_public_key(enclave_key, &enclave_pk)) {
+    state.SkipWithError("can't make enclave key");
+    return;
+  }
+  attestation_user_data ud;
+  string                serialized_ud;
+  if (!make_attestation_user_data(enclave_type, enclave_pk, &ud)
+      || !ud.SerializeToString(&serialized_ud)) {
+    state.SkipWithError("can't make user data");
+    return;
+  }
+
+  byte out[16000];
+  int  size_out = sizeof(out);
+  if (!Attest(enclave_type,
+              serialized_ud.size(),
+              (byte *)serialized_ud.data(),
+              &size_out,
+              out)) {
+    state.SkipWithError("Attest failed, is the sev simulator loaded?");
+    return;
+  }
+
+#  ifdef SEV_DUMMY_GUEST
+  EVP_PKEY *verify_pkey = get_simulated_vcek_key();
+#  else
+  extern int sev_read_pem_into_x509(const char *file_name, X509 **x509_cert);
+  extern EVP_PKEY *sev_get_vcek_pubkey(X509 * x509_vcek);
+  X509            *x509_vcek = nullptr;
+  EVP_PKEY        *verify_pkey = nullptr;
+  if (sev_read_pem_into_x509("test_data/vcek.pem", &x509_vcek)
+      == EXIT_SUCCESS) {
+    verify_pkey = sev_get_vcek_pubkey(x509_vcek);
+  }
+#  endif
+  if (verify_pkey == nullptr) {
+    state.SkipWithError("can't get vcek key");
+    return;
+  }
+
+  for (auto _ : state) {
+    byte measurement[64];
+    int  size_measurement = sizeof(measurement);
+    if (!verify_sev_Attest(verify_pkey,
+                           size_out,
+                           out,
+                           &size_measurement,
+                           measurement)) {
+      state.SkipWithError("verify_sev_Attest failed");
+      break;
+    }
+  }
+  EVP_PKEY_free(verify_pkey);
+}
+#endif  // SEV_SNP
+
+// Channels
+// -----------------------------------------------------------------------
+
+// One policy key certifies the client and server auth keys, as in
+// test_channel.exe.
+class bench_channel_keys {
+ public:
+  key_message policy_key_;
+  string      policy_cert_;
+  key_message server_key_;
+  string      server_cert_;
+  key_message client_key_;
+  string      client_cert_;
+
+  bool init();
+};
+
+static bool bench_admissions_cert(key_message &policy_key,
+                                  key_message &auth_key,
+                                  const char  *role,
+                                  string      *out) {
+  string issuer_name("policyAuthority");
+  string issuer_organization("root");
+  string subject_name(role);
+  string subject_organization("1234567890");
+
+  X509 *x509_cert = X509_new();
+  bool  ret = produce_artifact(policy_key,
+                              issuer_name,
+                              issuer_organization,
+                              auth_key,
+                              subject_name,
+                              subject_organization,
+                              23,
+                              86400.0,
+                              x509_cert,
+                              false)
+             && x509_to_asn1(x509_cert, out);
+  X509_free(x509_cert);
+  if (ret)
+    auth_key.set_certificate(*out);
+  return ret;
+}
+
+bool bench_channel_keys::init() {
+  string type(Enc_method_rsa_2048_private);
+  string name("policyKey");
+  string issuer("policyAuthority");
+  if (!make_root_key_with_cert(type, name, issuer, &policy_key_))
+    return false;
+  policy_cert_.assign(policy_key_.certificate().data(),
+                      policy_key_.certificate().size());
+  if (!make_certifier_rsa_key(2048, &server_key_)
+      || !make_certifier_rsa_key(2048, &client_key_))
+    return false;
+  return bench_admissions_cert(policy_key_,
+                               server_key_,
+                               "server",
+                               &server_cert_)
+         && bench_admissions_cert(policy_key_,
+                                  client_key_,
+                                  "client",
+                                  &client_cert_);
+}
+
+static void bench_echo_read(secure_authenticated_channel &channel,
+                            bool                          ok,
+                            const string                 &msg,
+                            void                         *arg) {
+  if (!ok)
+    return;
+  channel.async_write_message(msg, nullptr, nullptr);
+  channel.async_read_message(bench_echo_read, arg);
+}
+
+static void bench_echo_ready(secure_authenticated_channel &channel,
+                             bool                          ok,
+                             void                         *arg) {
+  if (ok)
+    channel.async_read_message(bench_echo_read, arg);
+}
+
+class bench_echo_client {
+ public:
+  int  ready_;
+  int  outstanding_;
+  bool failed_;
+};
+
+static void bench_client_ready(secure_authenticated_channel &channel,
+                               bool                          ok,
+                               void                         *arg) {
+  bench_echo_client *c = (bench_echo_client *)arg;
+  if (ok)
+    c->ready_++;
+  else
+    c->failed_ = true;
+}
+
+static void bench_client_read(secure_authenticated_channel &channel,
+                              bool                          ok,
+                              const string                 &msg,
+                              void                         *arg) {
+  bench_echo_client *c = (bench_echo_client *)arg;
+  c->outstanding_--;
+  if (!ok)
+    c->failed_ = true;
+}
+
+// Every iteration sends one 64 byte message on each of range(0)
+// authenticated channels and waits for all the echoes; the echo server
+// runs on its own reactor thread.  items_per_second is messages/sec.
+static void BM_channel_echo(benchmark::State &state) {
+  int num_channels = state.range(0);
+
+  struct rlimit rl;
+  getrlimit(RLIMIT_NOFILE, &rl);
+  rl.rlim_cur = rl.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &rl);
+  if (rl.rlim_cur < (rlim_t)(2 * num_channels + 64)) {
+    state.SkipWithError("RLIMIT_NOFILE too small");
+    return;
+  }
+
+  static bench_channel_keys keys;
+  static bool               keys_ok = keys.init();
+  if (!keys_ok) {
+    state.SkipWithError("Can't make channel keys");
+    return;
+  }
+
+  string          host("localhost");
+  int             port = 8131;
+  channel_reactor server;
+  if (!server.init()
+      || !async_server_listen(host,
+                              port,
+                              keys.policy_cert_,
+                              keys.policy_cert_,
+                              0,
+                              nullptr,
+                              keys.server_key_,
+                              keys.server_cert_,
+                              &server,
+                              bench_echo_ready,
+                              nullptr)) {
+    state.SkipWithError("Can't start echo server");
+    return;
+  }
+  std::thread server_thread([&server]() { server.run(); });
+
+  // The first, blocking, channel provides the client SSL_CTX.
+  string                       role("client");
+  secure_authenticated_channel first(role);
+  channel_reactor              client;
+  bench_echo_client            c;
+  c.ready_ = 0;
+  c.outstanding_ = 0;
+  c.failed_ = false;
+
+  std::vector<secure_authenticated_channel *> channels;
+  if (!client.init()
+      || !first.init_client_ssl(host,
+                                port,
+                                keys.policy_cert_,
+                                keys.client_key_,
+                                keys.client_cert_)) {
+    c.failed_ = true;
+  }
+  for (int i = 0; i < num_channels && !c.failed_; i++) {
+    int sock = -1;
+    if (!open_client_socket(host, port, &sock)) {
+      c.failed_ = true;
+      break;
+    }
+    secure_authenticated_channel *ch = new secure_authenticated_channel(role);
+    channels.push_back(ch);
+    if (!ch->async_connect(&client,
+                           first.ssl_ctx_,
+                           sock,
+                           bench_client_ready,
+                           &c)) {
+      c.failed_ = true;
+    }
+    // Bound the handshakes in flight.
+    while (!c.failed_ && (i + 1) - c.ready_ > 256)
+      client.run_once(1000);
+  }
+  while (!c.failed_ && c.ready_ < num_channels)
+    client.run_once(1000);
+
+  string msg(64, 'x');
+  if (c.failed_)
+    state.SkipWithError("Can't set up channels");
+  for (auto _ : state) {
+    if (c.failed_)
+      break;
+    c.outstanding_ = num_channels;
+    for (int i = 0; i < num_channels; i++) {
+      channels[i]->async_write_message(msg, nullptr, nullptr);
+      channels[i]->async_read_message(bench_client_read, &c);
+    }
+    while (c.outstanding_ > 0 && !c.failed_)
+      client.run_once(1000);
+    if (c.failed_) {
+      state.SkipWithError("Echo failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_channels);
+
+  for (size_t i = 0; i < channels.size(); i++)
+    delete channels[i];
+  server.stop();
+  server_thread.join();
+}
+
+// Every iteration is one 64 byte request and its echo.  With range(0)
+// 0 each request connects and handshakes, as the sample clients do; with
+// 1 the channel comes from a channel_pool.  items_per_second is
+// requests/sec.
+static void BM_channel_requests(benchmark::State &state) {
+  bool pooled = state.range(0) != 0;
+
+  static bench_channel_keys keys;
+  static bool               keys_ok = keys.init();
+  if (!keys_ok) {
+    state.SkipWithError("Can't make channel keys");
+    return;
+  }
+
+  string          host("localhost");
+  int             port = 8132;
+  channel_reactor server;
+  if (!server.init()
+      || !async_server_listen(host,
+                              port,
+                              keys.policy_cert_,
+                              keys.policy_cert_,
+                              0,
+                              nullptr,
+                              keys.server_key_,
+                              keys.server_cert_,
+                              &server,
+                              bench_echo_ready,
+                              nullptr)) {
+    state.SkipWithError("Can't start echo server");
+    return;
+  }
+  std::thread server_thread([&server]() { server.run(); });
+
+  string       role("client");
+  string       msg(64, 'x');
+  string       out;
+  channel_pool pool;
+  for (auto _ : state) {
+    secure_authenticated_channel *c = nullptr;
+    if (pooled) {
+      c = pool.borrow(host,
+                      port,
+                      keys.policy_cert_,
+                      keys.client_key_,
+                      keys.client_cert_);
+    } else {
+      c = new secure_authenticated_channel(role);
+      if (!c->init_client_ssl(host,
+                              port,
+                              keys.policy_cert_,
+                              keys.client_key_,
+                              keys.client_cert_)) {
+        delete c;
+        c = nullptr;
+      }
+    }
+    if (c == nullptr) {
+      state.SkipWithError("Can't connect");
+      break;
+    }
+    bool ok = c->write(msg.size(), (byte *)msg.data()) > 0
+              && c->read(&out) > 0 && out == msg;
+    if (pooled) {
+      pool.give_back(c, ok);
+    } else {
+      c->close();
+      delete c;
+    }
+    if (!ok) {
+      state.SkipWithError("Echo failed");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["connects"] =
+      pooled ? pool.num_connects() : (double)state.iterations();
+
+  pool.close_idle();
+  server.stop();
+  server_thread.join();
+}
+
+// -----------------------------------------------------------------------
+
+// Framing
+// -----------------------------------------------------------------------
+
+static const char *bench_frame_transports[] = {
+    "pipe",
+    "tcp",
+    "tls",
+};
+
+// Both ends of a transport carrying sized frames.  For "tls" the frames
+// run over TLS on a loopback TCP connection, with the channel keys.
+class bench_frame_link {
+ public:
+  int      read_fd_;
+  int      write_fd_;
+  int      listen_fd_;
+  SSL_CTX *server_ctx_;
+  SSL_CTX *client_ctx_;
+  SSL     *server_ssl_;
+  SSL     *client_ssl_;
+
+  bench_frame_link();
+  ~bench_frame_link();
+
+  bool open_tcp();
+  bool open_tls(bench_channel_keys &keys);
+
+  int write_frame(int size, byte *buf);
+  int read_frame(string *out);
+};
+
+bench_frame_link::bench_frame_link()
+    : read_fd_(-1),
+      write_fd_(-1),
+      listen_fd_(-1),
+      server_ctx_(nullptr),
+      client_ctx_(nullptr),
+      server_ssl_(nullptr),
+      client_ssl_(nullptr) {}
+
+bench_frame_link::~bench_frame_link() {
+  if (server_ssl_ != nullptr)
+    SSL_free(server_ssl_);
+  if (client_ssl_ != nullptr)
+    SSL_free(client_ssl_);
+  if (server_ctx_ != nullptr)
+    SSL_CTX_free(server_ctx_);
+  if (client_ctx_ != nullptr)
+    SSL_CTX_free(client_ctx_);
+  if (read_fd_ >= 0)
+    close(read_fd_);
+  if (write_fd_ >= 0)
+    close(write_fd_);
+  if (listen_fd_ >= 0)
+    close(listen_fd_);
+}
+
+bool bench_frame_link::open_tcp() {
+  struct sockaddr_in addr;
+  socklen_t          len = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0 || bind(listen_fd_, (struct sockaddr *)&addr, len) != 0
+      || listen(listen_fd_, 1) != 0
+      || getsockname(listen_fd_, (struct sockaddr *)&addr, &len) != 0)
+    return false;
+  write_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (write_fd_ < 0
+      || connect(write_fd_, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    return false;
+  read_fd_ = accept(listen_fd_, nullptr, nullptr);
+  if (read_fd_ < 0)
+    return false;
+  int one = 1;
+  setsockopt(write_fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  setsockopt(read_fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return true;
+}
+
+bool bench_frame_link::open_tls(bench_channel_keys &keys) {
+  if (!open_tcp())
+    return false;
+
+  X509 *x = X509_new();
+  if (!asn1_to_x509(keys.server_cert_, x)) {
+    X509_free(x);
+    return false;
+  }
+  EVP_PKEY *pkey = pkey_from_key(keys.server_key_);
+  server_ctx_ = SSL_CTX_new(TLS_server_method());
+  client_ctx_ = SSL_CTX_new(TLS_client_method());
+  bool ret = pkey != nullptr && server_ctx_ != nullptr
+             && client_ctx_ != nullptr
+             && SSL_CTX_use_certificate(server_ctx_, x) == 1
+             && SSL_CTX_use_PrivateKey(server_ctx_, pkey) == 1;
+  X509_free(x);
+  if (pkey != nullptr)
+    EVP_PKEY_free(pkey);
+  if (!ret)
+    return false;
+
+  // The frames, not the handshake, are what is measured here.
+  SSL_CTX_set_verify(client_ctx_, SSL_VERIFY_NONE, nullptr);
+  server_ssl_ = SSL_new(server_ctx_);
+  client_ssl_ = SSL_new(client_ctx_);
+  if (server_ssl_ == nullptr || client_ssl_ == nullptr)
+    return false;
+  SSL_set_fd(server_ssl_, read_fd_);
+  SSL_set_fd(client_ssl_, write_fd_);
+
+  int         accepted = 0;
+  std::thread server([this, &accepted]() {
+    accepted = SSL_accept(server_ssl_);
+  });
+  int connected = SSL_connect(client_ssl_);
+  server.join();
+  return accepted == 1 && connected == 1;
+}
+
+int bench_frame_link::write_frame(int size, byte *buf) {
+  if (client_ssl_ != nullptr)
+    return sized_ssl_write(client_ssl_, size, buf);
+  return sized_socket_write(write_fd_, size, buf);
+}
+
+int bench_frame_link::read_frame(string *out) {
+  if (server_ssl_ != nullptr)
+    return sized_ssl_read(server_ssl_, out);
+  return sized_socket_read(read_fd_, out);
+}
+
+// Every iteration writes one frame of range(0) bytes; a reader thread
+// drains them until it sees an empty frame.  bytes_per_second is the
+// body throughput.
+static void BM_sized_frames(benchmark::State &state, const char *transport) {
+  int              size = state.range(0);
+  bench_frame_link link;
+  bool             ok = false;
+
+  if (strcmp(transport, "pipe") == 0) {
+    int fd[2];
+    ok = pipe(fd) == 0;
+    if (ok) {
+      link.read_fd_ = fd[0];
+      link.write_fd_ = fd[1];
+    }
+  } else if (strcmp(transport, "tcp") == 0) {
+    ok = link.open_tcp();
+  } else if (strcmp(transport, "tls") == 0) {
+    static bench_channel_keys keys;
+    static bool               keys_ok = keys.init();
+    ok = keys_ok && link.open_tls(keys);
+  }
+  if (!ok) {
+    state.SkipWithError("Can't open transport");
+    return;
+  }
+
+  std::thread reader([&link]() {
+    string out;
+    while (link.read_frame(&out) > 0)
+      ;
+  });
+
+  string msg(size, 'f');
+  bool   failed = false;
+  for (auto _ : state) {
+    if (link.write_frame(size, (byte *)msg.data()) != size) {
+      state.SkipWithError("Write failed");
+      failed = true;
+      break;
+    }
+  }
+  // Closing the write side also stops a reader stuck mid-frame.
+  if (failed || link.write_frame(0, nullptr) != 0) {
+    close(link.write_fd_);
+    link.write_fd_ = -1;
+  }
+  reader.join();
+  state.SetBytesProcessed(state.iterations() * (int64_t)size);
+}
+
+// App service transport
+// -----------------------------------------------------------------------
+
+static const char *bench_app_transports[] = {
+    "pipe",
+#ifdef APPLICATION_SHARED_RING
+    "ring",
+#endif
+};
+
+// The app_service_loop side: answers gettransport, echoes everything
+// else, and stops on an empty message.
+static void bench_app_service(app_transport *t) {
+  string in;
+  while (t->read_message(&in) > 0) {
+    app_request  req;
+    app_response rsp;
+    bool         switch_to_rings = false;
+    if (!req.ParseFromString(in))
+      return;
+    rsp.set_function(req.function());
+    if (req.function() == "gettransport") {
+      switch_to_rings = t->offer_rings(&rsp);
+      rsp.set_status(switch_to_rings ? "succeeded" : "failed");
+    } else {
+      rsp.set_status("succeeded");
+      if (req.args_size() > 0)
+        rsp.add_args(req.args(0));
+    }
+    string out;
+    rsp.SerializeToString(&out);
+    if (t->write_message(out.size(), (byte *)out.data()) < 0)
+      return;
+    if (switch_to_rings)
+      t->start_rings();
+  }
+}
+
+// Every iteration is one Seal-shaped request with range(0) bytes and
+// its echoed response, as application_enclave.cc sends them, so the
+// protobuf encoding is included.
+static void BM_app_transport(benchmark::State &state, const char *transport) {
+  int           size = state.range(0);
+  int           to_child[2];
+  int           to_parent[2];
+  app_transport parent;
+  app_transport child;
+
+  if (pipe(to_child) < 0 || pipe(to_parent) < 0) {
+    state.SkipWithError("Can't make pipes");
+    return;
+  }
+  parent.init_pipes(to_parent[0], to_child[1]);
+  child.init_pipes(to_child[0], to_parent[1]);
+  bool want_rings = strcmp(transport, "ring") == 0;
+  if (want_rings && !parent.create_rings(app_transport::default_ring_size)) {
+    state.SkipWithError("Can't create rings");
+    return;
+  }
+  std::thread server(bench_app_service, &parent);
+
+  bool failed = !child.request_rings() || child.use_ring_ != want_rings;
+  if (failed)
+    state.SkipWithError("Transport negotiation failed");
+
+  app_request req;
+  req.set_function("seal");
+  req.add_args(string(size, 's'));
+  string req_str;
+  req.SerializeToString(&req_str);
+  string rsp_str;
+  for (auto _ : state) {
+    if (failed)
+      break;
+    if (child.write_message(req_str.size(), (byte *)req_str.data()) < 0
+        || child.read_message(&rsp_str) < 0) {
+      state.SkipWithError("Round trip failed");
+      failed = true;
+      break;
+    }
+  }
+  child.write_message(0, nullptr);
+  server.join();
+
+#ifdef APPLICATION_SHARED_RING
+  // Both ends are in this process, so only the parent closes the fds.
+  for (int i = 0; i < app_transport::NUM_RING_FDS; i++)
+    child.ring_fds_[i] = -1;
+#endif
+  close(to_child[0]);
+  close(to_child[1]);
+  close(to_parent[0]);
+  close(to_parent[1]);
+  state.SetBytesProcessed(state.iterations() * (int64_t)size * 2);
+}
+
+// Startup
+// -----------------------------------------------------------------------
+
+static const char *bench_public_key_algs[] = {
+    Enc_method_rsa_2048,
+    Enc_method_rsa_3072,
+    Enc_method_rsa_4096,
+    Enc_method_ecc_384,
+};
+
+// Every iteration is one cold_init of a fresh authentication trust
+// manager: key generation plus saving the store.  With pregenerated the
+// key comes from the pool, which is refilled outside the timing.
+static void BM_cold_init(benchmark::State &state,
+                         const char      *alg,
+                         bool             pregenerated) {
+  static bench_channel_keys keys;
+  static bool               keys_ok = keys.init();
+  string                    enclave_type("simulated-enclave");
+  string                    purpose("authentication");
+  string                    store_file("/tmp/bench_cold_init_store.bin");
+  if (!keys_ok) {
+    state.SkipWithError("Can't make policy key");
+    return;
+  }
+  if (pregenerated && !start_key_pregeneration(alg, 1)) {
+    state.SkipWithError("Can't start key pregeneration");
+    return;
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    while (pregenerated && num_pregenerated_keys(alg) < 1)
+      usleep(1000);
+    cc_trust_manager *mgr =
+        new cc_trust_manager(enclave_type, purpose, store_file);
+    bool ok = mgr->init_policy_key((byte *)keys.policy_cert_.data(),
+                                   keys.policy_cert_.size());
+    state.ResumeTiming();
+
+    ok = ok
+         && mgr->cold_init(alg,
+                           Enc_method_aes_256_cbc_hmac_sha256,
+                           "bench-domain",
+                           "localhost",
+                           8123,
+                           "localhost",
+                           8124);
+
+    state.PauseTiming();
+    delete mgr;
+    state.ResumeTiming();
+    if (!ok) {
+      state.SkipWithError("cold_init failed");
+      break;
+    }
+  }
+  stop_key_pregeneration();
+  unlink(store_file.c_str());
+}
+
+// Every iteration is one warm_restart of a fresh trust manager from a
+// store holding the trust data and range(0) 16KB blobs.
+static void BM_warm_restart(benchmark::State &state) {
+  static bench_channel_keys keys;
+  static bool               keys_ok = keys.init();
+  string                    enclave_type("simulated-enclave");
+  string                    purpose("authentication");
+  string                    store_file("/tmp/bench_warm_restart_store.bin");
+  if (!keys_ok) {
+    state.SkipWithError("Can't make policy key");
+    return;
+  }
+
+  {
+    cc_trust_manager mgr(enclave_type, purpose, store_file);
+    bool ok = mgr.init_policy_key((byte *)keys.policy_cert_.data(),
+                                  keys.policy_cert_.size())
+              && mgr.cold_init(Enc_method_rsa_2048,
+                               Enc_method_aes_256_cbc_hmac_sha256,
+                               "bench-domain",
+                               "localhost",
+                               8123,
+                               "localhost",
+                               8124);
+    string type("binary-blob");
+    string blob(16 * 1024, 'b');
+    for (int i = 0; ok && i < state.range(0); i++)
+      ok = mgr.store_.update_or_insert("blob-" + std::to_string(i), type, blob);
+    if (!ok || !mgr.save_store()) {
+      state.SkipWithError("Can't make store");
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    cc_trust_manager mgr(enclave_type, purpose, store_file);
+    if (!mgr.warm_restart()) {
+      state.SkipWithError("warm_restart failed");
+      break;
+    }
+  }
+  unlink(store_file.c_str());
+  state.SetBytesProcessed(state.iterations() * state.range(0) * 16 * 1024);
+}
+
+// -----------------------------------------------------------------------
+
+static void register_benchmarks() {
+  for (const char *alg : bench_digest_algs) {
+    string name("BM_digest_message/");
+    name.append(alg);
+    benchmark::RegisterBenchmark(name.c_str(), BM_digest_message, alg)
+        ->RangeMultiplier(16)
+        ->Range(64, 1 << 20);
+  }
+
+  benchmark::RegisterBenchmark("BM_get_random/pool", BM_get_random, false)
+      ->RangeMultiplier(16)
+      ->Range(16, 1 << 16)
+      ->Threads(1)
+      ->Threads(4);
+  benchmark::RegisterBenchmark("BM_get_random/kernel", BM_get_random, true)
+      ->RangeMultiplier(16)
+      ->Range(16, 1 << 16)
+      ->Threads(1)
+      ->Threads(4);
+
+  for (const char *alg : bench_auth_enc_algs) {
+    string name("BM_authenticated_encrypt/");
+    name.append(alg);
+    benchmark::RegisterBenchmark(name.c_str(), BM_authenticated_encrypt, alg)
+        ->RangeMultiplier(16)
+        ->Range(64, 1 << 20);
+    name.assign("BM_authenticated_decrypt/");
+    name.append(alg);
+    benchmark::RegisterBenchmark(name.c_str(), BM_authenticated_decrypt, alg)
+        ->RangeMultiplier(16)
+        ->Range(64, 1 << 20);
+  }
+
+  for (const bench_sign_alg &a : bench_sign_algs) {
+    string name("BM_make_signed_claim/");
+    name.append(a.sign_alg_);
+    benchmark::RegisterBenchmark(name.c_str(), BM_make_signed_claim, a);
+    name.assign("BM_verify_signed_claim/");
+    name.append(a.sign_alg_);
+    benchmark::RegisterBenchmark(name.c_str(), BM_verify_signed_claim, a);
+    name.assign("BM_produce_artifact/");
+    name.append(a.sign_alg_);
+    benchmark::RegisterBenchmark(name.c_str(), BM_produce_artifact, a);
+    name.assign("BM_issue_admission_certs/");
+    name.append(a.sign_alg_);
+    benchmark::RegisterBenchmark(name.c_str(), BM_issue_admission_certs, a)
+        ->Arg(1)
+        ->Arg(64);
+    name.assign("BM_verify_artifact/");
+    name.append(a.sign_alg_);
+    benchmark::RegisterBenchmark(name.c_str(), BM_verify_artifact, a);
+    name.assign("BM_verify_cert_chain/");
+    name.append(a.sign_alg_);
+    benchmark::RegisterBenchmark((name + "/fresh").c_str(),
+                                 BM_verify_cert_chain,
+                                 a,
+                                 false);
+    benchmark::RegisterBenchmark((name + "/cached").c_str(),
+                                 BM_verify_cert_chain,
+                                 a,
+                                 true);
+  }
+
+  benchmark::RegisterBenchmark("BM_protect_blob", BM_protect_blob)
+      ->RangeMultiplier(16)
+      ->Range(64, 1 << 16);
+  benchmark::RegisterBenchmark("BM_unprotect_blob", BM_unprotect_blob)
+      ->RangeMultiplier(16)
+      ->Range(64, 1 << 16);
+
+  benchmark::RegisterBenchmark("BM_policy_store_update_or_insert",
+                               BM_policy_store_update_or_insert)
+      ->Arg(10)
+      ->Arg(policy_store::MAX_NUM_ENTRIES);
+  benchmark::RegisterBenchmark("BM_policy_store_find_entry",
+                               BM_policy_store_find_entry)
+      ->Arg(10)
+      ->Arg(policy_store::MAX_NUM_ENTRIES);
+  benchmark::RegisterBenchmark("BM_policy_store_serialize",
+                               BM_policy_store_serialize)
+      ->Arg(10)
+      ->Arg(policy_store::MAX_NUM_ENTRIES);
+  benchmark::RegisterBenchmark("BM_policy_store_deserialize",
+                               BM_policy_store_deserialize)
+      ->Arg(10)
+      ->Arg(policy_store::MAX_NUM_ENTRIES);
+
+  benchmark::RegisterBenchmark("BM_policy_index_build", BM_policy_index_build)
+      ->Arg(10000)
+      ->Arg(100000)
+      ->Unit(benchmark::kMillisecond);
+  benchmark::RegisterBenchmark("BM_policy_index_built_from",
+                               BM_policy_index_built_from)
+      ->Arg(10000)
+      ->Arg(100000)
+      ->Unit(benchmark::kMicrosecond);
+  benchmark::RegisterBenchmark("BM_policy_index_filter", BM_policy_index_filter)
+      ->Arg(10000)
+      ->Arg(100000);
+
+  benchmark::RegisterBenchmark("BM_validate_evidence/full-vse-support",
+                               BM_validate_evidence,
+                               "full-vse-support");
+  benchmark::RegisterBenchmark(
+      "BM_validate_evidence/platform-attestation-only",
+      BM_validate_evidence,
+      "platform-attestation-only");
+
+  benchmark::RegisterBenchmark("BM_trusted_key_lookup", BM_trusted_key_lookup)
+      ->Arg(1000)
+      ->Arg(10000)
+      ->Arg(100000)
+      ->Unit(benchmark::kMicrosecond);
+  benchmark::RegisterBenchmark("BM_same_key", BM_same_key);
+  benchmark::RegisterBenchmark("BM_key_fingerprint", BM_key_fingerprint);
+
+  benchmark::RegisterBenchmark("BM_check_date_range/time_point",
+                               BM_check_date_range,
+                               "time_point");
+  benchmark::RegisterBenchmark("BM_check_date_range/time_ns",
+                               BM_check_date_range,
+                               "time_ns");
+  benchmark::RegisterBenchmark("BM_check_date_range/request_clock",
+                               BM_check_date_range,
+                               "request_clock");
+
+  benchmark::RegisterBenchmark("BM_evidence_package/full-vse-support",
+                               BM_evidence_package,
+                               "full-vse-support")
+      ->ArgName("compact")
+      ->Arg(0)
+      ->Arg(1);
+  benchmark::RegisterBenchmark(
+      "BM_evidence_package/platform-attestation-only",
+      BM_evidence_package,
+      "platform-attestation-only")
+      ->ArgName("compact")
+      ->Arg(0)
+      ->Arg(1);
+
+  benchmark::RegisterBenchmark("BM_Seal/simulated-enclave",
+                               BM_Seal,
+                               "simulated-enclave")
+      ->RangeMultiplier(16)
+      ->Range(64, 1 << 12);
+  benchmark::RegisterBenchmark("BM_Attest/simulated-enclave",
+                               BM_Attest,
+                               "simulated-enclave");
+
+#ifdef SEV_SNP
+  benchmark::RegisterBenchmark("BM_Seal/sev-enclave", BM_Seal, "sev-enclave")
+      ->RangeMultiplier(16)
+      ->Range(64, 1 << 12);
+  benchmark::RegisterBenchmark("BM_Attest/sev-enclave",
+                               BM_Attest,
+                               "sev-enclave");
+  benchmark::RegisterBenchmark("BM_verify_sev_Attest", BM_verify_sev_Attest);
+#endif  // SEV_SNP
+
+  benchmark::RegisterBenchmark("BM_channel_echo", BM_channel_echo)
+      ->Arg(1000)
+      ->Arg(10000)
+      ->Iterations(20)
+      ->UseRealTime()
+      ->Unit(benchmark::kMillisecond);
+  benchmark::RegisterBenchmark("BM_channel_requests", BM_channel_requests)
+      ->ArgName("pooled")
+      ->Arg(0)
+      ->Arg(1)
+      ->UseRealTime()
+      ->Unit(benchmark::kMicrosecond);
+
+  for (const char *transport : bench_frame_transports) {
+    string name("BM_sized_frames/");
+    name.append(transport);
+    benchmark::RegisterBenchmark(name.c_str(), BM_sized_frames, transport)
+        ->RangeMultiplier(16)
+        ->Range(64, 1 << 20)
+        ->UseRealTime();
+  }
+
+  for (const char *transport : bench_app_transports) {
+    string name("BM_app_transport/");
+    name.append(transport);
+    benchmark::RegisterBenchmark(name.c_str(), BM_app_transport, transport)
+        ->RangeMultiplier(16)
+        ->Range(1 << 10, 1 << 24)
+        ->UseRealTime();
+  }
+
+  for (const char *alg : bench_public_key_algs) {
+    string name("BM_cold_init/");
+    name.append(alg);
+    benchmark::RegisterBenchmark((name + "/generated").c_str(),
+                                 BM_cold_init,
+                                 alg,
+                                 false)
+        ->Iterations(5)
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark((name + "/pregenerated").c_str(),
+                                 BM_cold_init,
+                                 alg,
+                                 true)
+        ->Iterations(5)
+        ->Unit(benchmark::kMillisecond);
+  }
+
+  benchmark::RegisterBenchmark("BM_warm_restart", BM_warm_restart)
+      ->Arg(0)
+      ->Arg(16)
+      ->Arg(128)
+      ->Arg(policy_store::MAX_NUM_ENTRIES - 8)
+      ->Unit(benchmark::kMicrosecond);
+}
+
+int main(int an, char **av) {
+  benchmark::Initialize(&an, av);
+  if (benchmark::ReportUnrecognizedArguments(an, av))
+    return 1;
+
+  extern bool simulator_init();
+  if (!simulator_init()) {
+    printf("%s() error, line %d, simulator_init failed\n", __func__, __LINE__);
+    return 1;
+  }
+
+  register_benchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -19,6 +19,8 @@
 #include "application_enclave.h"
 #include <sys/socket.h>
 #include <netdb.h>
+#include <algorithm>
+#include <mutex>
 #ifdef SEV_SNP
 #  include "attestation.h"
 #endif
@@ -28,6 +30,7 @@
 
 using namespace certifier::framework;
 using namespace certifier::utilities;
+using std::vector;
 
 // Proof support
 // -----------------------------------------------------------------------
@@ -328,35 +331,92 @@ bool get_signed_measurement_claim_from_trusted_list(
   return false;
 }
 
+// The clause a trusted platform list entry says is trusted:
+// "policy-key says key is-trusted[-for-attestation]".
+static const key_message *trusted_platform_key(const vse_clause &c) {
+  if (c.verb() != "says")
+    return nullptr;
+  if (!c.has_clause() || !c.clause().has_verb())
+    return nullptr;
+  if ((c.clause().verb() != "is-trusted"
+       && c.clause().verb() != "is-trusted-for-attestation")
+      || !c.clause().has_subject())
+    return nullptr;
+  if (c.clause().subject().entity_type() != "key")
+    return nullptr;
+  return &c.clause().subject().key();
+}
+
+trusted_key_index::trusted_key_index() : built_(false) {}
+
+bool trusted_key_index::build(const signed_claim_sequence &trusted) {
+  built_ = false;
+  signatures_.clear();
+  by_fingerprint_.clear();
+
+  for (int i = 0; i < trusted.claims_size(); i++) {
+    signatures_.push_back(trusted.claims(i).signature());
+    vse_clause c;
+    if (!get_vse_clause_from_signed_claim(trusted.claims(i), &c))
+      continue;
+    const key_message *k = trusted_platform_key(c);
+    string             fp;
+    if (k == nullptr || !key_fingerprint(*k, &fp))
+      continue;
+    // Only the first claim for a key is ever found.
+    by_fingerprint_.insert(std::make_pair(fp, i));
+  }
+
+  built_ = true;
+  return true;
+}
+
+bool trusted_key_index::built_from(const signed_claim_sequence &trusted) const {
+  if (!built_ || trusted.claims_size() != (int)signatures_.size())
+    return false;
+  for (int i = 0; i < trusted.claims_size(); i++) {
+    if (trusted.claims(i).signature() != signatures_[i])
+      return false;
+  }
+  return true;
+}
+
+int trusted_key_index::find(const signed_claim_sequence &trusted,
+                            const key_message           &k) const {
+  string fp;
+  if (!built_ || !key_fingerprint(k, &fp))
+    return -1;
+  std::unordered_map<string, int>::const_iterator it = by_fingerprint_.find(fp);
+  if (it == by_fingerprint_.end())
+    return -1;
+  int i = it->second;
+  if (i >= trusted.claims_size()
+      || trusted.claims(i).signature() != signatures_[i])
+    return -1;
+  return i;
+}
+
+// The trusted list is usually the same from one request to the next, so
+// the index is kept.  A hit is checked against the list itself; only a
+// miss compares the whole list and rebuilds the index if it changed.
 bool get_signed_platform_claim_from_trusted_list(
     const key_message     &expected_key,
     signed_claim_sequence &trusted_platforms,
     signed_claim_message  *claim) {
+  static std::mutex        index_lock;
+  static trusted_key_index index;
 
-  for (int i = 0; i < trusted_platforms.claims_size(); i++) {
-    vse_clause c;
-    if (!get_vse_clause_from_signed_claim(trusted_platforms.claims(i), &c)) {
-      continue;
-    }
-    string says_verb("says");
-    string it1_verb("is-trusted");
-    string it2_verb("is-trusted-for-attestation");
-    // policy-key says platform-key is-trusted-for-attestation
-    if (c.verb() != says_verb)
-      continue;
-    if (!c.has_clause() || !c.clause().has_verb())
-      continue;
-    if ((c.clause().verb() != it1_verb && c.clause().verb() != it2_verb)
-        || !c.clause().has_subject())
-      continue;
-    if (c.clause().subject().entity_type() != "key")
-      continue;
-    if (same_key(c.clause().subject().key(), expected_key)) {
-      claim->CopyFrom(trusted_platforms.claims(i));
-      return true;
-    }
+  std::lock_guard<std::mutex> l(index_lock);
+  int                         i = index.find(trusted_platforms, expected_key);
+  if (i < 0 && !index.built_from(trusted_platforms)) {
+    if (!index.build(trusted_platforms))
+      return false;
+    i = index.find(trusted_platforms, expected_key);
   }
-  return false;
+  if (i < 0)
+    return false;
+  claim->CopyFrom(trusted_platforms.claims(i));
+  return true;
 }
 
 // Statement construction support
@@ -2708,6 +2768,25 @@ bool validate_evidence(const string          &evidence_descriptor,
                        evidence_package      &evp,
                        key_message           &policy_pk) {
 
+  if (is_compact_evidence_package(evp)) {
+    evidence_package expanded;
+    if (!expand_evidence_package(evp, &expanded)) {
+      printf("%s() error, line %d, validate_evidence: can't expand evidence\n",
+             __func__,
+             __LINE__);
+      return false;
+    }
+    return validate_evidence(evidence_descriptor,
+                             trusted_platforms,
+                             trusted_measurements,
+                             purpose,
+                             expanded,
+                             policy_pk);
+  }
+
+  // Every claim and report in the package is checked against one now.
+  request_clock request_time;
+
   proved_statements   already_proved;
   vse_clause          to_prove;
   proof               pf;
@@ -3215,79 +3294,251 @@ bool right_platform(const vse_clause &cl, const platform &p) {
   return satisfying_platform(cl.subject().platform_ent(), p);
 }
 
-#ifdef SEV_SNP
-// Exactly one satisfying platform and one satisfying measurement should
-// be in the filtered policy.  It there are none or more than one each,
-// it's an error.  Also check the policy key is doing the saying.
-bool filter_sev_policy(const sev_attestation_message &sev_att,
-                       const key_message             &policy_pk,
-                       const signed_claim_sequence   &policy,
-                       signed_claim_sequence         *filtered_policy) {
-
-  entity_message m_ent;
-  if (!get_measurement_from_sev_attest(sev_att, &m_ent)) {
-    printf("filter_sev_policy: Can't get measurement from attestation\n");
-    return false;
-  }
-  entity_message p_ent;
-  if (!get_platform_from_sev_attest(sev_att, &p_ent)) {
-    printf("filter_sev_policy: Can't get platform from attestation\n");
-    return false;
+policy_index::policy_index() : built_(false) {}
+
+// The property names and comparators, sorted, identify a group.
+static string platform_shape(const platform &p, vector<string> *names) {
+  vector<string> shape;
+  names->clear();
+  for (int i = 0; i < p.props().props_size(); i++) {
+    const property &pp = p.props().props(i);
+    names->push_back(pp.property_name());
+    string s(pp.property_name());
+    s.append(1, '\0').append(pp.comparator());
+    shape.push_back(s);
+  }
+  std::sort(names->begin(), names->end());
+  std::sort(shape.begin(), shape.end());
+  string out;
+  for (const string &s : shape)
+    out.append(s).append(1, '\0');
+  return out;
+}
+
+static void append_property_value(const property &p, string *out) {
+  out->append(p.value_type()).append(1, '\0');
+  if (p.value_type() == "int")
+    out->append(std::to_string(p.int_value()));
+  else if (p.value_type() == "string")
+    out->append(std::to_string(p.string_value().size()))
+        .append(1, ':')
+        .append(p.string_value());
+  out->append(1, '\0');
+}
+
+// The values of a policy platform's "=" properties, ordered by name.
+static string policy_platform_values(const platform &p, vector<string> *names) {
+  vector<const property *> eq;
+  for (int i = 0; i < p.props().props_size(); i++) {
+    if (p.props().props(i).comparator() == "=")
+      eq.push_back(&p.props().props(i));
+  }
+  std::stable_sort(eq.begin(),
+                   eq.end(),
+                   [](const property *a, const property *b) {
+                     return a->property_name() < b->property_name();
+                   });
+  string out;
+  names->clear();
+  for (const property *pp : eq) {
+    names->push_back(pp->property_name());
+    append_property_value(*pp, &out);
+  }
+  return out;
+}
+
+// The same for an attested platform, which can only satisfy those
+// properties with its own "=" properties of the same names.
+static bool attested_platform_values(const vector<string> &eq_names,
+                                     const platform       &p,
+                                     string               *out) {
+  out->clear();
+  for (const string &name : eq_names) {
+    const property *pp = find_property(name, p.props());
+    if (pp == nullptr || pp->comparator() != "=")
+      return false;
+    append_property_value(*pp, out);
   }
+  return true;
+}
 
-  bool found_measurement = false;
-  bool found_platform = false;
+bool policy_index::build(const key_message           &policy_pk,
+                         const signed_claim_sequence &policy) {
+  built_ = false;
+  policy_pk_.CopyFrom(policy_pk);
+  policy_.CopyFrom(policy);
+  other_claims_.clear();
+  measurements_.clear();
+  platforms_.clear();
+  platform_claims_.clear();
+  platform_groups_.clear();
 
-  for (int i = 0; i < policy.claims_size(); i++) {
+  for (int i = 0; i < policy_.claims_size(); i++) {
     claim_message cm;
-    if (!cm.ParseFromString(policy.claims(i).serialized_claim_message())) {
-      printf("filter_sev_policy: Can't parse serialized claim in policy\n");
+    if (!cm.ParseFromString(policy_.claims(i).serialized_claim_message())) {
+      printf("%s() error, line %d, can't parse serialized claim in policy\n",
+             __func__,
+             __LINE__);
       return false;
     }
     if (cm.claim_format() != "vse-clause") {
-      printf("filter_sev_policy: policy must be a vse-clause\n");
+      printf("%s() error, line %d, policy must be a vse-clause\n",
+             __func__,
+             __LINE__);
       return false;
     }
     vse_clause cl;
     if (!cl.ParseFromString(cm.serialized_claim())) {
-      printf("filter_sev_policy: Can't parse serialized policy\n");
+      printf("%s() error, line %d, can't parse serialized policy\n",
+             __func__,
+             __LINE__);
       return false;
     }
-    if (!cl.has_subject()) {
-      printf("filter_sev_policy: policy rule misformatted (1)\n");
+    if (!cl.has_subject() || !cl.has_clause()) {
+      printf("%s() error, line %d, policy rule misformatted\n",
+             __func__,
+             __LINE__);
       return false;
     }
     const entity_message &em = cl.subject();
     if (em.entity_type() != "key" || !same_key(policy_pk, em.key())) {
-      printf("filter_sev_policy: the policy key does the saying\n");
-      return false;
-    }
-    // In cl, look for: policy_key says measurement is_trusted and
-    // policy-key says platform[] has trusted-platform-properties.
-    // If match, keep them.  If not, don't.
-    if (!cl.has_clause()) {
-      printf("filter_sev_policy: policy rule misformatted (2)\n");
+      printf("%s() error, line %d, the policy key does the saying\n",
+             __func__,
+             __LINE__);
       return false;
     }
+
     if (is_measurement(cl.clause())) {
-      if (found_measurement)
-        continue;
-      if (!right_measurement(cl.clause(), m_ent.measurement()))
-        continue;
-      found_measurement = true;
+      // Only the first claim for a measurement is ever kept.
+      measurements_.insert(
+          std::make_pair(cl.clause().subject().measurement(), i));
+    } else if (is_platform(cl.clause())) {
+      const platform &p = cl.clause().subject().platform_ent();
+      vector<string>  names;
+      string          shape = platform_shape(p, &names);
+      platform_group &g = platform_groups_[p.platform_type()][shape];
+      vector<string>  eq_names;
+      string          values = policy_platform_values(p, &eq_names);
+      if (g.names_.empty()) {
+        g.names_ = names;
+        g.eq_names_ = eq_names;
+      }
+      g.by_values_[values].push_back(platforms_.size());
+      platforms_.push_back(p);
+      platform_claims_.push_back(i);
+    } else {
+      other_claims_.push_back(i);
     }
-    if (is_platform(cl.clause())) {
-      if (found_platform)
+  }
+
+  built_ = true;
+  return true;
+}
+
+bool policy_index::built_from(const key_message           &policy_pk,
+                              const signed_claim_sequence &policy) const {
+  if (!built_ || policy.claims_size() != policy_.claims_size())
+    return false;
+  if (!same_key(policy_pk, policy_pk_))
+    return false;
+  for (int i = 0; i < policy.claims_size(); i++) {
+    if (policy.claims(i).signature() != policy_.claims(i).signature())
+      return false;
+  }
+  return true;
+}
+
+bool policy_index::filter(const string          &measurement,
+                          const platform        &plat,
+                          signed_claim_sequence *filtered_policy) const {
+  if (!built_)
+    return false;
+
+  int  m_claim = -1;
+  auto m = measurements_.find(measurement);
+  if (m != measurements_.end())
+    m_claim = m->second;
+
+  int  p_claim = -1;
+  auto groups = platform_groups_.find(plat.platform_type());
+  if (groups != platform_groups_.end()) {
+    for (const auto &shape_group : groups->second) {
+      const platform_group &g = shape_group.second;
+      bool                  have_names = true;
+      for (const string &name : g.names_) {
+        if (find_property(name, plat.props()) == nullptr) {
+          have_names = false;
+          break;
+        }
+      }
+      string values;
+      if (!have_names
+          || !attested_platform_values(g.eq_names_, plat, &values))
         continue;
-      if (!right_platform(cl.clause(), p_ent.platform_ent()))
+      auto candidates = g.by_values_.find(values);
+      if (candidates == g.by_values_.end())
         continue;
-      found_platform = true;
+      // Candidates are in policy order; a later group can only win
+      // with an earlier claim.
+      for (int j : candidates->second) {
+        if (p_claim >= 0 && platform_claims_[j] > p_claim)
+          break;
+        if (satisfying_platform(platforms_[j], plat)) {
+          p_claim = platform_claims_[j];
+          break;
+        }
+      }
     }
-    signed_claim_message *sc = filtered_policy->add_claims();
-    sc->CopyFrom(policy.claims(i));
   }
 
-  return found_measurement && found_platform;
+  vector<int> keep(other_claims_);
+  if (m_claim >= 0)
+    keep.insert(std::upper_bound(keep.begin(), keep.end(), m_claim), m_claim);
+  if (p_claim >= 0)
+    keep.insert(std::upper_bound(keep.begin(), keep.end(), p_claim), p_claim);
+  for (int i : keep)
+    filtered_policy->add_claims()->CopyFrom(policy_.claims(i));
+
+  return m_claim >= 0 && p_claim >= 0;
+}
+
+#ifdef SEV_SNP
+bool filter_sev_policy(const sev_attestation_message &sev_att,
+                       const policy_index            &index,
+                       signed_claim_sequence         *filtered_policy) {
+  entity_message m_ent;
+  if (!get_measurement_from_sev_attest(sev_att, &m_ent)) {
+    printf("filter_sev_policy: Can't get measurement from attestation\n");
+    return false;
+  }
+  entity_message p_ent;
+  if (!get_platform_from_sev_attest(sev_att, &p_ent)) {
+    printf("filter_sev_policy: Can't get platform from attestation\n");
+    return false;
+  }
+  return index.filter(m_ent.measurement(), p_ent.platform_ent(), filtered_policy);
+}
+
+// Exactly one satisfying platform and one satisfying measurement should
+// be in the filtered policy.  It there are none or more than one each,
+// it's an error.  Also check the policy key is doing the saying.
+//
+// The index of the last policy filtered is kept and only rebuilt when
+// a different policy comes in.
+static std::mutex   sev_policy_index_lock;
+static policy_index sev_policy_index;
+
+bool filter_sev_policy(const sev_attestation_message &sev_att,
+                       const key_message             &policy_pk,
+                       const signed_claim_sequence   &policy,
+                       signed_claim_sequence         *filtered_policy) {
+  std::lock_guard<std::mutex> l(sev_policy_index_lock);
+  if (!sev_policy_index.built_from(policy_pk, policy)
+      && !sev_policy_index.build(policy_pk, policy)) {
+    printf("filter_sev_policy: Can't index policy\n");
+    return false;
+  }
+  return filter_sev_policy(sev_att, sev_policy_index, filtered_policy);
 }
 
 // Use policy statements for init
@@ -3297,6 +3548,21 @@ bool validate_evidence_from_policy(const string          &evidence_descriptor,
                                    evidence_package      &evp,
                                    key_message           &policy_pk) {
 
+  if (is_compact_evidence_package(evp)) {
+    evidence_package expanded;
+    if (!expand_evidence_package(evp, &expanded)) {
+      printf("validate_evidence: can't expand evidence\n");
+      return false;
+    }
+    return validate_evidence_from_policy(evidence_descriptor,
+                                         policy,
+                                         purpose,
+                                         expanded,
+                                         policy_pk);
+  }
+
+  request_clock request_time;
+
   proved_statements   already_proved;
   vse_clause          to_prove;
   predicate_dominance predicate_dominance_root;
@@ -49,6 +49,10 @@ TEST(test_random, test_random) {
   EXPECT_TRUE(test_random(FLAGS_print_all));
 }
 
+TEST(test_random, test_random_fork) {
+  EXPECT_TRUE(test_random_fork(FLAGS_print_all));
+}
+
 TEST(test_digest, test_digest) {
   EXPECT_TRUE(test_digest(FLAGS_print_all));
 }
@@ -81,6 +85,50 @@ TEST(time, test_time) {
   EXPECT_TRUE(test_time(FLAGS_print_all));
 }
 
+TEST(time, test_time_ns) {
+  EXPECT_TRUE(test_time_ns(FLAGS_print_all));
+}
+
+TEST(metrics, test_metrics) {
+  EXPECT_TRUE(test_metrics(FLAGS_print_all));
+}
+
+TEST(async_channel, test_async_channel) {
+  EXPECT_TRUE(test_async_channel(FLAGS_print_all));
+}
+
+TEST(sized_frames, test_sized_frames) {
+  EXPECT_TRUE(test_sized_frames(FLAGS_print_all));
+}
+
+TEST(small_stacks, test_small_stacks) {
+  EXPECT_TRUE(test_small_stacks(FLAGS_print_all));
+}
+
+TEST(app_transport, test_app_transport) {
+  EXPECT_TRUE(test_app_transport(FLAGS_print_all));
+}
+
+TEST(app_batch, test_app_batch) {
+  EXPECT_TRUE(test_app_batch(FLAGS_print_all));
+}
+
+TEST(key_pregeneration, test_key_pregeneration) {
+  EXPECT_TRUE(test_key_pregeneration(FLAGS_print_all));
+}
+
+TEST(recertification, test_recertification) {
+  EXPECT_TRUE(test_recertification(FLAGS_print_all));
+}
+
+TEST(server_credential_rotation, test_server_credential_rotation) {
+  EXPECT_TRUE(test_server_credential_rotation(FLAGS_print_all));
+}
+
+TEST(channel_pool, test_channel_pool) {
+  EXPECT_TRUE(test_channel_pool(FLAGS_print_all));
+}
+
 // Basic Primitive tests
 TEST(seal, test_seal) {
   EXPECT_TRUE(test_seal(FLAGS_print_all));
@@ -109,6 +157,10 @@ TEST(init_and_recover_containers, test_init_and_recover_containers) {
   EXPECT_TRUE(test_init_and_recover_containers(FLAGS_print_all));
 }
 
+TEST(lazy_store, test_lazy_store) {
+  EXPECT_TRUE(test_lazy_store(FLAGS_print_all));
+}
+
 // policy tests
 TEST(test_claims_1, test_claims_1) {
   EXPECT_TRUE(test_claims_1(FLAGS_print_all));
@@ -147,6 +199,15 @@ TEST(local_certify, test_new_local_certify) {
                                       evidence_descriptor));
 }
 
+extern bool test__compact_evidence(string &, string &);
+TEST(compact_evidence, test_compact_evidence) {
+  string enclave_type("simulated-enclave");
+  string full("full-vse-support");
+  string partial("platform-attestation-only");
+  EXPECT_TRUE(test__compact_evidence(enclave_type, full));
+  EXPECT_TRUE(test__compact_evidence(enclave_type, partial));
+}
+
 TEST(certify, test_certify_steps) {
   EXPECT_TRUE(test_certify_steps(FLAGS_print_all));
 }
@@ -159,6 +220,14 @@ TEST(test_predicate_dominance, test_predicate_dominance) {
   EXPECT_TRUE(test_predicate_dominance(FLAGS_print_all));
 }
 
+TEST(policy_index, test_policy_index) {
+  EXPECT_TRUE(test_policy_index(FLAGS_print_all));
+}
+
+TEST(key_fingerprint, test_key_fingerprint) {
+  EXPECT_TRUE(test_key_fingerprint(FLAGS_print_all));
+}
+
 // The following tests will only work if there is initialized
 // policy data in test_data
 
@@ -170,6 +239,14 @@ TEST(test_x_509_sign, test_x_509_sign) {
   EXPECT_TRUE(test_x_509_sign(FLAGS_print_all));
 }
 
+TEST(cert_verifier, test_cert_verifier) {
+  EXPECT_TRUE(test_cert_verifier(FLAGS_print_all));
+}
+
+TEST(admission_cert_issuer, test_admission_cert_issuer) {
+  EXPECT_TRUE(test_admission_cert_issuer(FLAGS_print_all));
+}
+
 // sev tests
 #ifdef RUN_SEV_TESTS
 
@@ -116,7 +116,12 @@ channel_dobj = $(O)/test_channel.o $(common_objs) \
 
 pipe_read_dobj = $(O)/pipe_read_test.o $(common_objs)
 
-nvidia_tests_dobj = $(O)/nvidia_tests.o $(O)/nvidia_impl.o $(O)/nvidia_mock.o $(common_objs)
+nvidia_tests_dobj = $(O)/nvidia_tests.o $(O)/nvidia_impl.o $(O)/nvidia_mock.o \
+                    $(O)/nvidia_attestation.o $(common_objs) \
+                    $(O)/cc_helpers.o $(O)/cc_useful.o
+
+bench_dobj = $(O)/certifier_bench.o $(common_objs) \
+             $(O)/cc_helpers.o $(O)/cc_useful.o
 
 ifdef ENABLE_SEV
 sev_common_objs = $(O)/sev_support.o $(O)/sev_report.o $(O)/sev_cert_table.o
@@ -128,6 +133,8 @@ channel_dobj += $(sev_common_objs)
 pipe_read_dobj += $(sev_common_objs)
 
 nvidia_tests_dobj += $(sev_common_objs)
+
+bench_dobj += $(sev_common_objs)
 endif
 
 all:	certifier_tests.exe test_channel.exe pipe_read_test.exe nvidia_tests.exe
@@ -137,6 +144,10 @@ all:	certifier_tests.exe test_channel.exe pipe_read_test.exe nvidia_tests.exe
 # rebuilding all objects with CFLAGS_PIC = -fpic flag.
 sharedlib:	$(CL)/$(CERTIFIER_TESTS_SHARED_LIB)
 
+# NOTE: Default target 'all' does -not- include this target either.
+# The benchmarks need Google Benchmark (libbenchmark) installed.
+bench:	certifier_bench.exe
+
 clean:
 	@echo "removing generated files"
 	rm -rf $(S)/certifier.pb.h $(I)/certifier.pb.h $(S)/certifier.pb.cc $(S)/$(SWIG_CERT_TESTS_INTERFACE)_wrap.cc
@@ -146,6 +157,7 @@ clean:
 	rm -rf $(O)/*.o
 	@echo "removing executable files"
 	rm -rf $(EXE_DIR)/certifier_tests.exe $(EXE_DIR)/pipe_read_test.exe $(EXE_DIR)/test_channel.exe
+	rm -rf $(EXE_DIR)/certifier_bench.exe
 	@echo "removing shared libraries"
 	rm -rf $(CL)/$(CERTIFIER_TESTS_SHARED_LIB)
 
@@ -276,6 +288,18 @@ $(O)/nvidia_impl.o: $(S)/nvidia/nvidia_impl.cc
 	@echo "\ncompiling $<"
 	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
 
+$(O)/nvidia_attestation.o: $(S)/nvidia/nvidia_attestation.cc $(I)/nvidia_attestation.h
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
+
+certifier_bench.exe: $(bench_dobj)
+	@echo "\nlinking executable $@"
+	$(LINK) -o $(EXE_DIR)/certifier_bench.exe $(bench_dobj) $(LDFLAGS) -lbenchmark
+
+$(O)/certifier_bench.o: $(S)/certifier_bench.cc $(I)/certifier.pb.h $(I)/certifier.h $(I)/cc_helpers.h $(S)/test_support.cc
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
+
 pipe_read_test.exe: $(pipe_read_dobj) 
 	@echo "\nlinking executable $@"
 	$(LINK) -o $(EXE_DIR)/pipe_read_test.exe $(pipe_read_dobj) $(LDFLAGS)
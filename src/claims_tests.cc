@@ -451,3 +451,310 @@ bool test_predicate_dominance(bool print_all) {
 
   return true;
 }
+
+// Policy index ------------------------------------------
+
+static bool policy_says(const key_message     &policy_key,
+                        const entity_message  &subject,
+                        const string          &verb,
+                        signed_claim_sequence *policy) {
+  key_message    pk;
+  entity_message key_ent;
+  vse_clause     said, says;
+  string         says_verb("says"), v(verb);
+  if (!private_key_to_public_key(policy_key, &pk)
+      || !make_key_entity(pk, &key_ent)
+      || !make_unary_vse_clause(subject, v, &said)
+      || !make_indirect_vse_clause(key_ent, says_verb, said, &says))
+    return false;
+
+  string        serialized_cl;
+  string        format("vse-clause");
+  string        descriptor;
+  string        nb("2021-08-01T05:09:50.000000Z");
+  string        na("2036-08-01T05:09:50.000000Z");
+  claim_message cm;
+  says.SerializeToString(&serialized_cl);
+  if (!make_claim(serialized_cl.size(),
+                  (byte *)serialized_cl.data(),
+                  format,
+                  descriptor,
+                  nb,
+                  na,
+                  &cm))
+    return false;
+  return make_signed_claim(Enc_method_rsa_2048_sha256_pkcs_sign,
+                           cm,
+                           policy_key,
+                           policy->add_claims());
+}
+
+static bool test_platform(const string &type,
+                          const string &debug,
+                          const string &debug_cmp,
+                          uint64_t      api_major,
+                          const string &api_cmp,
+                          platform     *p) {
+  string debug_name("debug"), api_name("api-major");
+  string str_type("string"), int_type("int");
+  string d(debug), dc(debug_cmp), ac(api_cmp), unused;
+  p->set_platform_type(type);
+  p->set_has_key(false);
+  if (!debug.empty()
+      && !make_property(debug_name,
+                        str_type,
+                        dc,
+                        0,
+                        d,
+                        p->mutable_props()->add_props()))
+    return false;
+  return make_property(api_name,
+                       int_type,
+                       ac,
+                       api_major,
+                       unused,
+                       p->mutable_props()->add_props());
+}
+
+// The filter as it was before the index: one pass over every claim.
+static bool linear_filter(const signed_claim_sequence &policy,
+                          const string                &m,
+                          const platform              &plat,
+                          signed_claim_sequence       *out) {
+  bool found_m = false, found_p = false;
+  for (int i = 0; i < policy.claims_size(); i++) {
+    claim_message cm;
+    vse_clause    cl;
+    cm.ParseFromString(policy.claims(i).serialized_claim_message());
+    cl.ParseFromString(cm.serialized_claim());
+    const entity_message &e = cl.clause().subject();
+    if (e.entity_type() == "measurement") {
+      if (found_m || !same_measurement(m, e.measurement()))
+        continue;
+      found_m = true;
+    }
+    if (e.entity_type() == "platform") {
+      if (found_p || !satisfying_platform(e.platform_ent(), plat))
+        continue;
+      found_p = true;
+    }
+    out->add_claims()->CopyFrom(policy.claims(i));
+  }
+  return found_m && found_p;
+}
+
+static bool same_filter(const policy_index          &index,
+                        const signed_claim_sequence &policy,
+                        const string                &m,
+                        const platform              &plat,
+                        bool                         expected) {
+  signed_claim_sequence indexed, linear;
+  bool                  r1 = index.filter(m, plat, &indexed);
+  bool                  r2 = linear_filter(policy, m, plat, &linear);
+  if (r1 != expected || r2 != expected) {
+    printf("filter returned %d, linear %d, expected %d\n", r1, r2, expected);
+    return false;
+  }
+  if (indexed.claims_size() != linear.claims_size()) {
+    printf("filter kept %d claims, linear %d\n",
+           indexed.claims_size(),
+           linear.claims_size());
+    return false;
+  }
+  for (int i = 0; i < indexed.claims_size(); i++) {
+    if (indexed.claims(i).signature() != linear.claims(i).signature()) {
+      printf("filter kept a different claim %d\n", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool test_policy_index(bool print_all) {
+  key_message policy_key, other_key, policy_pk;
+  if (!make_certifier_rsa_key(2048, &policy_key)
+      || !make_certifier_rsa_key(2048, &other_key)
+      || !private_key_to_public_key(policy_key, &policy_pk))
+    return false;
+
+  signed_claim_sequence policy;
+  entity_message        ent;
+  key_message           other_pk;
+  if (!private_key_to_public_key(other_key, &other_pk)
+      || !make_key_entity(other_pk, &ent)
+      || !policy_says(policy_key, ent, "is-trusted-for-attestation", &policy))
+    return false;
+
+  const int num_measurements = 50;
+  for (int i = 0; i < num_measurements; i++) {
+    string m(32, (char)i);
+    if (!make_measurement_entity(m, &ent)
+        || !policy_says(policy_key, ent, "is-trusted", &policy))
+      return false;
+  }
+  // A second claim for a measurement already trusted.
+  string m5(32, (char)5);
+  if (!make_measurement_entity(m5, &ent)
+      || !policy_says(policy_key, ent, "is-trusted", &policy))
+    return false;
+
+  // Three shapes of amd-sev-snp platform and one other type.
+  platform p_debug, p_nodebug_api5, p_nodebug_only, p_other;
+  if (!test_platform("amd-sev-snp", "yes", "=", 0, ">=", &p_debug)
+      || !test_platform("amd-sev-snp", "no", "=", 5, ">=", &p_nodebug_api5)
+      || !test_platform("amd-sev-snp", "", "", 2, ">=", &p_nodebug_only)
+      || !test_platform("other-platform", "no", "=", 0, ">=", &p_other))
+    return false;
+  platform policy_platforms[] = {p_debug,
+                                 p_nodebug_api5,
+                                 p_nodebug_only,
+                                 p_other};
+  for (const platform &p : policy_platforms) {
+    platform pl(p);
+    string   verb("has-trusted-platform-property");
+    if (!make_platform_entity(pl, &ent)
+        || !policy_says(policy_key, ent, verb, &policy))
+      return false;
+  }
+
+  policy_index index;
+  if (!index.build(policy_pk, policy) || !index.built_from(policy_pk, policy)
+      || index.num_claims() != policy.claims_size()) {
+    printf("can't build index\n");
+    return false;
+  }
+
+  // Attested platforms have "=" for every property.
+  platform attested_nodebug_api6, attested_nodebug_api1, attested_debug;
+  if (!test_platform("amd-sev-snp", "no", "=", 6, "=", &attested_nodebug_api6)
+      || !test_platform("amd-sev-snp", "no", "=", 1, "=", &attested_nodebug_api1)
+      || !test_platform("amd-sev-snp", "yes", "=", 1, "=", &attested_debug))
+    return false;
+
+  string m7(32, (char)7), unknown(32, 'x');
+  if (!same_filter(index, policy, m5, attested_nodebug_api6, true)
+      || !same_filter(index, policy, m7, attested_nodebug_api1, false)
+      || !same_filter(index, policy, m7, attested_debug, true)
+      || !same_filter(index, policy, unknown, attested_debug, false))
+    return false;
+
+  // A changed policy needs a new index.
+  signed_claim_sequence changed(policy);
+  changed.mutable_claims()->SwapElements(1, 2);
+  if (index.built_from(policy_pk, changed)
+      || index.built_from(other_pk, policy)) {
+    printf("index not rebuilt for a new policy\n");
+    return false;
+  }
+  if (!index.build(policy_pk, changed)
+      || !same_filter(index, changed, m5, attested_nodebug_api6, true))
+    return false;
+
+  // Only the policy key may say things in the policy.
+  if (!make_measurement_entity(m7, &ent)
+      || !policy_says(other_key, ent, "is-trusted", &changed))
+    return false;
+  if (index.build(policy_pk, changed)) {
+    printf("index built for a claim the policy key didn't make\n");
+    return false;
+  }
+  return true;
+}
+
+// Key identity ------------------------------------------
+
+extern bool get_signed_platform_claim_from_trusted_list(
+    const key_message     &expected_key,
+    signed_claim_sequence &trusted_platforms,
+    signed_claim_message  *claim);
+
+bool test_key_fingerprint(bool print_all) {
+  key_message e1, e2, e1_pk, e1_copy;
+  if (!make_certifier_ecc_key(384, &e1) || !make_certifier_ecc_key(384, &e2)
+      || !private_key_to_public_key(e1, &e1_pk))
+    return false;
+  e1_copy.CopyFrom(e1);
+  e1_copy.set_key_name("another-name");
+
+  // Different ECC keys on the same curve used to compare equal.
+  string fp1, fp2, fp_copy, fp_pk;
+  if (same_key(e1, e2) || !same_key(e1, e1_copy) || same_key(e1, e1_pk)
+      || !key_fingerprint(e1, &fp1) || !key_fingerprint(e2, &fp2)
+      || !key_fingerprint(e1_copy, &fp_copy) || !key_fingerprint(e1_pk, &fp_pk)
+      || fp1 == fp2 || fp1 != fp_copy || fp1 == fp_pk
+      || fp1.size() != SHA256_DIGEST_LENGTH) {
+    printf("%s() error, line %d, ecc key identity wrong\n", __func__, __LINE__);
+    return false;
+  }
+
+  // Leading zeros don't make a different key.
+  key_message r1, r1_pk, padded;
+  if (!make_certifier_rsa_key(2048, &r1)
+      || !private_key_to_public_key(r1, &r1_pk))
+    return false;
+  padded.CopyFrom(r1_pk);
+  padded.mutable_rsa_key()->set_public_modulus(
+      string(1, '\0') + r1_pk.rsa_key().public_modulus());
+  string fp_r, fp_padded;
+  if (!same_key(r1_pk, padded) || !key_fingerprint(r1_pk, &fp_r)
+      || !key_fingerprint(padded, &fp_padded) || fp_r != fp_padded) {
+    printf("%s() error, line %d, padded rsa key differs\n", __func__, __LINE__);
+    return false;
+  }
+
+  // The trusted list is searched by fingerprint, first claim first.
+  key_message e2_pk;
+  if (!private_key_to_public_key(e2, &e2_pk))
+    return false;
+  entity_message        ent1, ent2, ent_r;
+  signed_claim_sequence trusted;
+  string                for_attestation("is-trusted-for-attestation");
+  if (!make_key_entity(e1_pk, &ent1) || !make_key_entity(e2_pk, &ent2)
+      || !make_key_entity(r1_pk, &ent_r)
+      || !policy_says(r1, ent2, for_attestation, &trusted)
+      || !policy_says(r1, ent1, for_attestation, &trusted)
+      || !policy_says(r1, ent1, for_attestation, &trusted))
+    return false;
+
+  trusted_key_index    index;
+  signed_claim_message found;
+  if (!index.build(trusted) || !index.built_from(trusted)
+      || index.find(trusted, e1_pk) != 1 || index.find(trusted, e2_pk) != 0
+      || index.find(trusted, r1_pk) != -1
+      || !get_signed_platform_claim_from_trusted_list(e1_pk,
+                                                      trusted,
+                                                      &found)
+      || found.signature() != trusted.claims(1).signature()
+      || get_signed_platform_claim_from_trusted_list(r1_pk, trusted, &found)) {
+    printf("%s() error, line %d, trusted key lookup wrong\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  if (!policy_says(r1, ent_r, for_attestation, &trusted)
+      || index.built_from(trusted)
+      || !get_signed_platform_claim_from_trusted_list(r1_pk, trusted, &found)
+      || found.signature() != trusted.claims(3).signature()) {
+    printf("%s() error, line %d, index not rebuilt\n", __func__, __LINE__);
+    return false;
+  }
+  // A stale index never returns a claim that isn't in the list.
+  signed_claim_sequence reordered;
+  reordered.add_claims()->CopyFrom(trusted.claims(1));
+  reordered.add_claims()->CopyFrom(trusted.claims(0));
+  if (index.find(reordered, e1_pk) != -1
+      || !get_signed_platform_claim_from_trusted_list(e1_pk,
+                                                      reordered,
+                                                      &found)
+      || found.signature() != reordered.claims(0).signature()) {
+    printf("%s() error, line %d, stale index used\n", __func__, __LINE__);
+    return false;
+  }
+
+  if (print_all) {
+    printf("Fingerprint: ");
+    print_bytes(fp1.size(), (byte *)fp1.data());
+    printf("\n");
+  }
+  return true;
+}
@@ -99,6 +99,7 @@ typedef struct GramineFunctions {
 bool    gramine_Init(const int cert_size, byte *cert);
 int     gramine_Getkey(byte *user_report_data, sgx_key_128bit_t *key);
 int     gramine_Sgx_Getkey(byte *user_report_data, sgx_key_128bit_t *key);
+void    gramine_clear_sealing_key();
 int     gramine_file_size(const char *file_name);
 ssize_t gramine_rw_file(const char *path,
                         uint8_t    *buf,
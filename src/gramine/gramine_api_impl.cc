@@ -13,10 +13,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <dlfcn.h>
-
 #include "gramine_api.h"
-#include "gramine_verify_dcap.h"
+#include "gramine_dcap_verifier.cc"
+#include "gramine_sealer.cc"
 
 #include "mbedtls/ssl.h"
 #include "mbedtls/x509.h"
@@ -25,6 +24,7 @@
 #include "mbedtls/gcm.h"
 #include "mbedtls/entropy.h"
 #include "mbedtls/ctr_drbg.h"
+#include "mbedtls/platform_util.h"
 
 #define KEY_SIZE       16
 #define SGX_MR_SIZE    32
@@ -182,46 +182,6 @@ int remote_verify_quote(size_t   quote_size,
                         uint8_t *quote,
                         size_t  *mr_size,
                         uint8_t *mr) {
-  int                ret = -1;
-  void              *sgx_verify_lib = NULL;
-  uint8_t           *supplemental_data = NULL;
-  uint32_t           supplemental_data_size = 0;
-  uint32_t           collateral_expiration_status = 1;
-  sgx_ql_qv_result_t verification_result = SGX_QL_QV_RESULT_UNSPECIFIED;
-
-  time_t current_time = time(NULL);
-  if (current_time == ((time_t)-1)) {
-    goto out;
-  }
-
-  sgx_verify_lib = dlopen("libsgx_dcap_quoteverify.so", RTLD_LAZY);
-  if (!sgx_verify_lib) {
-    printf("User requested SGX attestation but cannot find lib\n");
-    return false;
-  }
-
-  sgx_qv_get_quote_supplemental_data_size =
-      (int (*)(uint32_t *))dlsym(sgx_verify_lib,
-                                 "sgx_qv_get_quote_supplemental_data_size");
-
-#ifdef DEBUG
-  printf("Supplemental data size address to be called: %p\n",
-         sgx_qv_get_quote_supplemental_data_size);
-#endif
-
-  /* call into libsgx_dcap_quoteverify to get supplemental data size */
-  ret = sgx_qv_get_quote_supplemental_data_size(&supplemental_data_size);
-  if (ret) {
-    ret = -1;
-    goto out;
-  }
-
-  supplemental_data = (uint8_t *)malloc(supplemental_data_size);
-  if (!supplemental_data) {
-    ret = -1;
-    goto out;
-  }
-
 #ifdef DEBUG
   printf("%s: Quote Size: %ld Quote:\n", __FUNCTION__, quote_size);
   gramine_print_bytes(quote_size, (uint8_t *)quote);
@@ -230,67 +190,9 @@ int remote_verify_quote(size_t   quote_size,
          ((sgx_quote_t *)quote)->body.version);
 #endif
 
-  sgx_qv_verify_quote =
-      (int (*)(const uint8_t *,
-               uint32_t,
-               void *,
-               const time_t,
-               uint32_t *,
-               sgx_ql_qv_result_t *,
-               void *,
-               uint32_t,
-               uint8_t *))dlsym(sgx_verify_lib, "sgx_qv_verify_quote");
-#ifdef DEBUG
-  printf("Verify function address to be called: %p with size: %ld\n",
-         sgx_qv_verify_quote,
-         quote_size);
-#endif
-
-  /* call into libsgx_dcap_quoteverify to verify ECDSA-based SGX quote */
-  ret = sgx_qv_verify_quote((uint8_t *)quote,
-                            (uint32_t)quote_size,
-                            NULL,
-                            current_time,
-                            &collateral_expiration_status,
-                            &verification_result,
-                            NULL,
-                            supplemental_data_size,
-                            supplemental_data);
-  if (ret) {
-    printf("%s: Quote Failed: %d\n", __FUNCTION__, ret);
-    ret = -1;
-    goto out;
-  }
-
-#ifdef DEBUG
-  printf("%s: Supplemental size: %d data:\n",
-         __FUNCTION__,
-         supplemental_data_size);
-  gramine_print_bytes(supplemental_data_size, (uint8_t *)supplemental_data);
-  printf("%s: Quote verification done with result %d %s\n",
-         __FUNCTION__,
-         verification_result,
-         sgx_ql_qv_result_to_str(verification_result));
-#endif
-
-  if (ret != 0) {
-    printf("\nRemote verification failed: %d\n", ret);
-    goto out;
-  }
-
-  /*
-   * The out of date config and software hardening are acceptable for now. Users
-   * will be given an option to change this behavior in a later patch.
-   */
-  if (verification_result != SGX_QL_QV_RESULT_OK
-      && verification_result != SGX_QL_QV_RESULT_OUT_OF_DATE_CONFIG_NEEDED
-      && verification_result
-             != SGX_QL_QV_RESULT_CONFIG_AND_SW_HARDENING_NEEDED) {
-    printf("\nGramine acceptable verification failed: %d %s\n",
-           verification_result,
-           sgx_ql_qv_result_to_str(verification_result));
-    ret = -1;
-    goto out;
+  if (!gramine_dcap_verifier::get()->verify(quote_size, quote)) {
+    printf("\nRemote verification failed\n");
+    return -1;
   }
 
   *mr_size = SGX_MR_SIZE;
@@ -304,14 +206,7 @@ int remote_verify_quote(size_t   quote_size,
   printf("\n");
 #endif
 
-out:
-  free(supplemental_data);
-
-#ifdef DEBUG
-  printf("Verify done with result: %d\n", ret);
-#endif
-
-  return ret;
+  return 0;
 }
 
 bool gramine_local_verify_impl(const int what_to_say_size,
@@ -509,12 +404,24 @@ bool gramine_get_attributes_from_quote(byte                 *attestation,
   return true;
 }
 
+// The measurement can't change while the enclave runs, so the quote is
+// only read once.
+static std::mutex gramine_measurement_lock;
+static bool       gramine_measurement_valid = false;
+static uint8_t    gramine_measurement[SGX_MR_SIZE];
+
 bool gramine_get_measurement(byte *measurement) {
   bool status = true;
   byte attestation[MAX_ATTESTATION_SIZE];
   byte user_data[USER_DATA_SIZE];
   int  attestation_size;
 
+  std::lock_guard<std::mutex> l(gramine_measurement_lock);
+  if (gramine_measurement_valid) {
+    memcpy(measurement, gramine_measurement, SGX_MR_SIZE);
+    return true;
+  }
+
   for (int i = 0; i < USER_DATA_SIZE; i++) {
     user_data[i] = (byte)i;
   }
@@ -529,29 +436,17 @@ bool gramine_get_measurement(byte *measurement) {
   }
 
   sgx_quote_t *quote = (sgx_quote_t *)attestation;
-  memcpy(measurement, quote->body.report_body.mr_enclave.m, SGX_MR_SIZE);
+  memcpy(gramine_measurement,
+         quote->body.report_body.mr_enclave.m,
+         SGX_MR_SIZE);
+  gramine_measurement_valid = true;
+  memcpy(measurement, gramine_measurement, SGX_MR_SIZE);
 
   return status;
 }
 
-bool gramine_seal_impl(int in_size, byte *in, int *size_out, byte *out) {
-  int                       ret = 0;
-  bool                      status = true;
-  __sgx_mem_aligned uint8_t key[KEY_SIZE];
-  uint8_t                   tag[TAG_SIZE];
-  unsigned char             enc_buf[in_size];
-  mbedtls_gcm_context       gcm;
-  int                       tag_size = TAG_SIZE;
-  int                       i, j = 0;
-  uint8_t                   measurement[SGX_MR_SIZE];
-
-#ifdef DEBUG
-  printf("Seal: Input size: %d \n", in_size);
-  gramine_print_bytes(in_size, in);
-  printf("\n");
-#endif
-
-  memset(enc_buf, 0, sizeof(enc_buf));
+static bool gramine_sgx_sealing_key(uint8_t *key) {
+  uint8_t measurement[SGX_MR_SIZE];
 
   if (gramine_get_measurement(measurement) != true) {
     printf("get_Measurement during Seal failed\n");
@@ -559,62 +454,33 @@ bool gramine_seal_impl(int in_size, byte *in, int *size_out, byte *out) {
   }
 
   /* Get SGX Sealing Key */
-  if (gramine_Sgx_Getkey(measurement, (sgx_key_128bit_t *)key) == FAILURE) {
-    printf("getkey failed to retrieve SGX Sealing Key\n");
+  __sgx_mem_aligned sgx_key_128bit_t sgx_key;
+  if (gramine_Sgx_Getkey(measurement, &sgx_key) == FAILURE) {
+    mbedtls_platform_zeroize(sgx_key, sizeof(sgx_key));
     return false;
   }
+  memcpy(key, sgx_key, KEY_SIZE);
+  mbedtls_platform_zeroize(sgx_key, sizeof(sgx_key));
+  return true;
+}
 
-  /* Use GCM encrypt/decrypt */
-  mbedtls_gcm_init(&gcm);
-  ret = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, 128);
-
-  if (ret != 0) {
-    printf("mbedtls_gcm_setkey failed: %d\n", ret);
-    status = false;
-    goto done;
-  }
+// The sealing key is fetched on the first Seal or Unseal and kept for
+// the life of the enclave; it is zeroized at exit.
+static gramine_sealer gramine_sgx_sealer(gramine_sgx_sealing_key);
 
-  ret = mbedtls_gcm_crypt_and_tag(&gcm,
-                                  MBEDTLS_GCM_ENCRYPT,
-                                  in_size,
-                                  key,
-                                  KEY_SIZE,
-                                  NULL,
-                                  0,
-                                  in,
-                                  enc_buf,
-                                  TAG_SIZE,
-                                  tag);
-
-  if (ret != 0) {
-    printf("mbedtls_gcm_crypt_and_tag failed: %d\n", ret);
-    status = false;
-    goto done;
-  }
+void gramine_clear_sealing_key() {
+  gramine_sgx_sealer.clear();
+}
 
+bool gramine_seal_impl(int in_size, byte *in, int *size_out, byte *out) {
 #ifdef DEBUG
-  printf("Testing seal interface - input buf:\n");
+  printf("Seal: Input size: %d \n", in_size);
   gramine_print_bytes(in_size, in);
   printf("\n");
-  printf("Testing seal interface - encrypted buf:\n");
-  gramine_print_bytes(sizeof(enc_buf), enc_buf);
-  printf("\n");
-  printf("Testing seal interface - tag:\n");
-  gramine_print_bytes(TAG_SIZE, tag);
-  printf("\n");
 #endif
 
-  for (i = 0; i < sizeof(int); i++, j++) {
-    out[j] = ((byte *)&in_size)[i];
-  }
-  for (i = 0; i < TAG_SIZE; i++, j++) {
-    out[j] = tag[i];
-  }
-  for (i = 0; i < sizeof(enc_buf); i++, j++) {
-    out[j] = enc_buf[i];
-  }
-
-  *size_out = j;
+  if (!gramine_sgx_sealer.seal(in_size, in, size_out, out))
+    return false;
 
 #ifdef DEBUG
   printf("Testing seal interface - out:\n");
@@ -623,112 +489,27 @@ bool gramine_seal_impl(int in_size, byte *in, int *size_out, byte *out) {
   printf("Seal: Successfully sealed size: %d\n", *size_out);
 #endif
 
-done:
-  mbedtls_gcm_free(&gcm);
-  return status;
+  return true;
 }
 
 bool gramine_unseal_impl(int in_size, byte *in, int *size_out, byte *out) {
-  int                       ret = 0;
-  bool                      status = true;
-  __sgx_mem_aligned uint8_t key[KEY_SIZE];
-  uint8_t                   tag[TAG_SIZE];
-  mbedtls_gcm_context       gcm;
-  int                       tag_size = TAG_SIZE;
-  int                       enc_size = 0;
-  int                       i, j = 0;
-  uint8_t                   measurement[SGX_MR_SIZE];
-
 #ifdef DEBUG
   printf("Preparing Unseal size: %d \n", in_size);
   gramine_print_bytes(in_size, in);
   printf("\n");
 #endif
 
-  for (i = 0; i < sizeof(int); i++, j++) {
-    ((byte *)&enc_size)[i] = in[j];
-  }
-
-  for (i = 0; i < TAG_SIZE; i++, j++) {
-    tag[i] = in[j];
-  }
-
-  unsigned char enc_buf[enc_size];
-  unsigned char dec_buf[enc_size];
-
-  memset(enc_buf, 0, enc_size);
-  memset(dec_buf, 0, enc_size);
-
-  for (i = 0; i < enc_size; i++, j++) {
-    enc_buf[i] = in[j];
-  }
-
-#ifdef DEBUG
-  printf("Testing unseal interface - encrypted buf: size: %d\n", enc_size);
-  gramine_print_bytes(enc_size, enc_buf);
-  printf("\n");
-  printf("Testing unseal interface - tag:\n");
-  gramine_print_bytes(TAG_SIZE, tag);
-  printf("\n");
-#endif
-
-  if (gramine_get_measurement(measurement) != true) {
-    printf("get_Measurement during Seal failed\n");
-    return false;
-  }
-
-  /* Get SGX Sealing Key */
-  if (gramine_Sgx_Getkey(measurement, (sgx_key_128bit_t *)key) == FAILURE) {
-    printf("getkey failed to retrieve SGX Sealing Key\n");
+  if (!gramine_sgx_sealer.unseal(in_size, in, size_out, out))
     return false;
-  }
-
-  /* Use GCM encrypt/decrypt */
-  mbedtls_gcm_init(&gcm);
-  ret = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, 128);
-
-  if (ret != 0) {
-    printf("mbedtls_gcm_setkey failed: %d\n", ret);
-    status = false;
-    goto done;
-  }
-
-  /* Invoke unseal */
-  ret = mbedtls_gcm_auth_decrypt(&gcm,
-                                 enc_size,
-                                 key,
-                                 KEY_SIZE,
-                                 NULL,
-                                 0,
-                                 tag,
-                                 TAG_SIZE,
-                                 enc_buf,
-                                 dec_buf);
-  if (ret != 0) {
-    printf("mbedtls_gcm_auth_decrypt failed: %d\n", ret);
-    status = false;
-    goto done;
-  }
 
 #ifdef DEBUG
   printf("Testing seal interface - decrypted buf:\n");
-  gramine_print_bytes(enc_size, dec_buf);
+  gramine_print_bytes(*size_out, out);
   printf("\n");
-#endif
-
-  /* Set size */
-  *size_out = enc_size;
-  for (i = 0; i < enc_size; i++) {
-    out[i] = dec_buf[i];
-  }
-
-#ifdef DEBUG
   printf("Successfully unsealed size: %d\n", *size_out);
 #endif
 
-done:
-  mbedtls_gcm_free(&gcm);
-  return status;
+  return true;
 }
 
 void gramine_setup_functions(GramineFunctions *gramineFuncs) {
@@ -0,0 +1,286 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is included in gramine_api_impl.cc so the existing Gramine
+// makefiles pick it up.  It has no SGX header dependencies and can be
+// built on its own against a stub verification library for testing.
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gramine_dcap_verifier.h"
+
+// Version 3 ECDSA quote layout: the header, the enclave report body,
+// then the signature data.  The signature data holds the enclave report
+// signature, the attestation key, the QE report and its signature, the
+// QE authentication data and finally the certification data.
+const size_t dcap_quote_header_size = 48;
+const size_t dcap_report_body_size = 384;
+const size_t dcap_fixed_signature_size = 64 + 64 + 384 + 64;
+
+bool dcap_quote_platform_id(size_t         quote_size,
+                            const uint8_t *quote,
+                            std::string   *platform) {
+  size_t   off = 0;
+  uint16_t version = 0;
+  uint16_t auth_size = 0;
+  uint32_t sig_size = 0;
+  uint32_t cert_size = 0;
+
+  if (quote == nullptr || quote_size < dcap_quote_header_size)
+    return false;
+  memcpy(&version, quote, sizeof(version));
+  if (version != 3)
+    return false;
+
+  off = dcap_quote_header_size + dcap_report_body_size;
+  if (off + sizeof(sig_size) > quote_size)
+    return false;
+  memcpy(&sig_size, quote + off, sizeof(sig_size));
+  off += sizeof(sig_size);
+  if (sig_size > quote_size - off)
+    return false;
+  size_t sig_end = off + sig_size;
+
+  off += dcap_fixed_signature_size;
+  if (off + sizeof(auth_size) > sig_end)
+    return false;
+  memcpy(&auth_size, quote + off, sizeof(auth_size));
+  off += sizeof(auth_size) + auth_size;
+
+  // Certification data: a 2 byte type, a 4 byte size, then the chain.
+  off += sizeof(uint16_t);
+  if (off + sizeof(cert_size) > sig_end)
+    return false;
+  memcpy(&cert_size, quote + off, sizeof(cert_size));
+  off += sizeof(cert_size);
+  if (cert_size == 0 || cert_size > sig_end - off)
+    return false;
+
+  platform->assign((const char *)(quote + off), cert_size);
+  return true;
+}
+
+gramine_dcap_verifier::gramine_dcap_verifier(const char *lib_name)
+    : lib_(nullptr),
+      supplemental_data_size_fn_(nullptr),
+      verify_quote_(nullptr),
+      get_collateral_(nullptr),
+      free_collateral_(nullptr),
+      supplemental_data_size_(0),
+      collateral_lifetime_(default_dcap_collateral_lifetime) {
+  lib_ = dlopen(lib_name, RTLD_LAZY);
+  if (lib_ == nullptr) {
+    printf("User requested SGX attestation but cannot find lib\n");
+    return;
+  }
+
+  supplemental_data_size_fn_ =
+      (sgx_qv_get_quote_supplemental_data_size_t)dlsym(
+          lib_,
+          "sgx_qv_get_quote_supplemental_data_size");
+  sgx_qv_verify_quote_t verify_quote =
+      (sgx_qv_verify_quote_t)dlsym(lib_, "sgx_qv_verify_quote");
+  if (supplemental_data_size_fn_ == nullptr || verify_quote == nullptr) {
+    printf("%s: Can't find quote verification functions in %s\n",
+           __FUNCTION__,
+           lib_name);
+    return;
+  }
+
+  /* call into libsgx_dcap_quoteverify to get supplemental data size */
+  if (supplemental_data_size_fn_(&supplemental_data_size_) != 0) {
+    printf("%s: Can't get supplemental data size\n", __FUNCTION__);
+    return;
+  }
+
+  // Both or neither.
+  get_collateral_ =
+      (tee_qv_get_collateral_t)dlsym(lib_, "tee_qv_get_collateral");
+  free_collateral_ =
+      (tee_qv_free_collateral_t)dlsym(lib_, "tee_qv_free_collateral");
+  if (get_collateral_ == nullptr || free_collateral_ == nullptr) {
+    get_collateral_ = nullptr;
+    free_collateral_ = nullptr;
+  }
+
+  verify_quote_ = verify_quote;
+}
+
+gramine_dcap_verifier::~gramine_dcap_verifier() {
+  // Cached collateral is freed by the library, so drop it first.
+  clear_collateral_cache();
+  if (lib_ != nullptr)
+    dlclose(lib_);
+}
+
+gramine_dcap_verifier *gramine_dcap_verifier::get() {
+  // Never destroyed: verification may still be running at exit.
+  static gramine_dcap_verifier *the_verifier =
+      new gramine_dcap_verifier(DCAP_QUOTE_VERIFY_LIB);
+  return the_verifier;
+}
+
+void gramine_dcap_verifier::set_collateral_lifetime(int seconds) {
+  std::lock_guard<std::mutex> l(cache_lock_);
+  collateral_lifetime_ = seconds;
+}
+
+int gramine_dcap_verifier::num_cached_collateral() {
+  std::lock_guard<std::mutex> l(cache_lock_);
+  return (int)collateral_cache_.size();
+}
+
+void gramine_dcap_verifier::clear_collateral_cache() {
+  std::lock_guard<std::mutex> l(cache_lock_);
+  collateral_cache_.clear();
+}
+
+void gramine_dcap_verifier::drop_collateral(const std::string &platform) {
+  std::lock_guard<std::mutex> l(cache_lock_);
+  collateral_cache_.erase(platform);
+}
+
+// Returns nullptr if the collateral can't be fetched, in which case the
+// library fetches it during verification as it would without a cache.
+// Fetching happens outside the lock; two threads missing on the same
+// platform both fetch and the later one replaces the earlier entry.
+std::shared_ptr<uint8_t> gramine_dcap_verifier::collateral_for(
+    const std::string &platform,
+    size_t             quote_size,
+    const uint8_t     *quote,
+    time_t             now) {
+  {
+    std::lock_guard<std::mutex> l(cache_lock_);
+    auto                        it = collateral_cache_.find(platform);
+    if (it != collateral_cache_.end()) {
+      if (now - it->second.fetched_ < collateral_lifetime_)
+        return it->second.collateral_;
+      collateral_cache_.erase(it);
+    }
+  }
+
+  uint8_t *collateral = nullptr;
+  uint32_t collateral_size = 0;
+  int ret = get_collateral_(quote,
+                            (uint32_t)quote_size,
+                            &collateral,
+                            &collateral_size);
+  if (ret != 0 || collateral == nullptr) {
+    printf("%s: Can't get quote collateral\n", __FUNCTION__);
+    return nullptr;
+  }
+
+  tee_qv_free_collateral_t free_collateral = free_collateral_;
+  std::shared_ptr<uint8_t> p(collateral, [free_collateral](uint8_t *c) {
+    free_collateral(c);
+  });
+
+  std::lock_guard<std::mutex> l(cache_lock_);
+  cached_collateral          &entry = collateral_cache_[platform];
+  entry.collateral_ = p;
+  entry.fetched_ = now;
+  return p;
+}
+
+bool gramine_dcap_verifier::verify(size_t quote_size, const uint8_t *quote) {
+  if (!loaded()) {
+    printf("%s: No quote verification library\n", __FUNCTION__);
+    return false;
+  }
+  if (quote == nullptr || quote_size == 0 || quote_size > UINT32_MAX)
+    return false;
+
+  time_t now = time(NULL);
+  if (now == ((time_t)-1))
+    return false;
+
+  std::string platform;
+  bool        cache = get_collateral_ != nullptr
+               && dcap_quote_platform_id(quote_size, quote, &platform);
+
+  // Grows once per thread and is reused after that.
+  static thread_local std::vector<uint8_t> supplemental_data;
+  if (supplemental_data.size() < supplemental_data_size_)
+    supplemental_data.resize(supplemental_data_size_);
+
+  uint32_t           collateral_expiration_status = 1;
+  sgx_ql_qv_result_t verification_result = SGX_QL_QV_RESULT_UNSPECIFIED;
+  int                ret = -1;
+
+  // If the library says cached collateral has expired, refetch it and
+  // verify once more.
+  for (int attempt = 0; attempt < 2; attempt++) {
+    std::shared_ptr<uint8_t> collateral;
+    if (cache)
+      collateral = collateral_for(platform, quote_size, quote, now);
+
+    collateral_expiration_status = 1;
+    verification_result = SGX_QL_QV_RESULT_UNSPECIFIED;
+
+    /* call into libsgx_dcap_quoteverify to verify ECDSA-based SGX quote */
+    ret = verify_quote_(quote,
+                        (uint32_t)quote_size,
+                        collateral.get(),
+                        now,
+                        &collateral_expiration_status,
+                        &verification_result,
+                        NULL,
+                        supplemental_data_size_,
+                        supplemental_data_size_ > 0 ? supplemental_data.data()
+                                                    : NULL);
+    if (collateral == nullptr || ret != 0 || collateral_expiration_status == 0)
+      break;
+    drop_collateral(platform);
+  }
+
+  if (ret) {
+    printf("%s: Quote Failed: %d\n", __FUNCTION__, ret);
+    return false;
+  }
+
+  /*
+   * The out of date config and software hardening are acceptable for now. Users
+   * will be given an option to change this behavior in a later patch.
+   */
+  if (verification_result != SGX_QL_QV_RESULT_OK
+      && verification_result != SGX_QL_QV_RESULT_OUT_OF_DATE_CONFIG_NEEDED
+      && verification_result
+             != SGX_QL_QV_RESULT_CONFIG_AND_SW_HARDENING_NEEDED) {
+    printf("\nGramine acceptable verification failed: %d %s\n",
+           verification_result,
+           sgx_ql_qv_result_to_str(verification_result));
+    return false;
+  }
+
+  return true;
+}
+
+int gramine_dcap_verifier::verify_batch(int                   num_quotes,
+                                        const size_t         *quote_sizes,
+                                        const uint8_t *const *quotes,
+                                        bool                 *verified) {
+  int num_verified = 0;
+
+  for (int i = 0; i < num_quotes; i++) {
+    verified[i] = verify(quote_sizes[i], quotes[i]);
+    if (verified[i])
+      num_verified++;
+  }
+  return num_verified;
+}
@@ -0,0 +1,97 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <time.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "gramine_verify_dcap.h"
+
+#ifndef _GRAMINE_DCAP_VERIFIER_H_
+#  define _GRAMINE_DCAP_VERIFIER_H_
+
+#  define DCAP_QUOTE_VERIFY_LIB "libsgx_dcap_quoteverify.so"
+
+// Collateral (QE identity, TCB info, CRLs) fetched for a platform is
+// reused for this long unless the library reports it has expired.
+const int default_dcap_collateral_lifetime = 3600;
+
+// Process-wide DCAP quote verifier.  The quote verification library is
+// opened and its symbols resolved once, each thread keeps its own
+// supplemental data buffer and collateral is cached per platform, keyed
+// by the PCK certificate chain in the quote.  Libraries without the
+// collateral calls verify as before, fetching on every quote.
+class gramine_dcap_verifier {
+ public:
+  gramine_dcap_verifier(const char *lib_name);
+  ~gramine_dcap_verifier();
+
+  // The verifier for DCAP_QUOTE_VERIFY_LIB.
+  static gramine_dcap_verifier *get();
+
+  bool loaded() { return verify_quote_ != nullptr; }
+
+  // True if the quote verifies with an acceptable TCB status.
+  bool verify(size_t quote_size, const uint8_t *quote);
+
+  // Verifies num_quotes quotes, setting verified[i] for each.  Returns
+  // the number that verified.
+  int verify_batch(int                   num_quotes,
+                   const size_t         *quote_sizes,
+                   const uint8_t *const *quotes,
+                   bool                 *verified);
+
+  void set_collateral_lifetime(int seconds);
+  int  num_cached_collateral();
+  void clear_collateral_cache();
+
+ private:
+  struct cached_collateral {
+    std::shared_ptr<uint8_t> collateral_;
+    time_t                   fetched_;
+  };
+
+  void                                     *lib_;
+  sgx_qv_get_quote_supplemental_data_size_t supplemental_data_size_fn_;
+  sgx_qv_verify_quote_t                     verify_quote_;
+  tee_qv_get_collateral_t                   get_collateral_;
+  tee_qv_free_collateral_t                  free_collateral_;
+  uint32_t                                  supplemental_data_size_;
+
+  std::mutex                               cache_lock_;
+  int                                      collateral_lifetime_;
+  std::map<std::string, cached_collateral> collateral_cache_;
+
+  std::shared_ptr<uint8_t> collateral_for(const std::string &platform,
+                                          size_t             quote_size,
+                                          const uint8_t     *quote,
+                                          time_t             now);
+  void                     drop_collateral(const std::string &platform);
+
+  gramine_dcap_verifier(const gramine_dcap_verifier &);
+  gramine_dcap_verifier &operator=(const gramine_dcap_verifier &);
+};
+
+// The PCK certificate chain of a version 3 ECDSA quote, which identifies
+// the platform.  False if the quote is too short or malformed.
+bool dcap_quote_platform_id(size_t         quote_size,
+                            const uint8_t *quote,
+                            std::string   *platform);
+
+#endif  // #ifdef _GRAMINE_DCAP_VERIFIER_H_
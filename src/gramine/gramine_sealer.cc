@@ -0,0 +1,146 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is included in gramine_api_impl.cc so the existing Gramine
+// makefiles pick it up.  It has no SGX header dependencies and can be
+// built on its own with a mock key source.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mbedtls/platform_util.h"
+
+#include "gramine_sealer.h"
+
+gramine_sealer::gramine_sealer(gramine_sealing_key_source source)
+    : source_(source), keyed_(false) {
+  memset(key_, 0, sizeof(key_));
+  mbedtls_gcm_init(&gcm_);
+}
+
+gramine_sealer::~gramine_sealer() {
+  clear();
+}
+
+bool gramine_sealer::keyed() {
+  std::lock_guard<std::mutex> l(lock_);
+  return keyed_;
+}
+
+void gramine_sealer::clear() {
+  std::lock_guard<std::mutex> l(lock_);
+  mbedtls_platform_zeroize(key_, sizeof(key_));
+  mbedtls_gcm_free(&gcm_);
+  mbedtls_gcm_init(&gcm_);
+  keyed_ = false;
+}
+
+bool gramine_sealer::key_locked() {
+  if (keyed_)
+    return true;
+
+  if (source_ == nullptr || !source_(key_)) {
+    printf("getkey failed to retrieve SGX Sealing Key\n");
+    mbedtls_platform_zeroize(key_, sizeof(key_));
+    return false;
+  }
+
+  int ret = mbedtls_gcm_setkey(&gcm_,
+                               MBEDTLS_CIPHER_ID_AES,
+                               key_,
+                               8 * gramine_seal_key_size);
+  if (ret != 0) {
+    printf("mbedtls_gcm_setkey failed: %d\n", ret);
+    mbedtls_platform_zeroize(key_, sizeof(key_));
+    return false;
+  }
+  keyed_ = true;
+  return true;
+}
+
+// The sealed format is unchanged from earlier releases, including the
+// use of the key as the GCM IV, so existing sealed data still unseals.
+bool gramine_sealer::seal(int      in_size,
+                          uint8_t *in,
+                          int     *size_out,
+                          uint8_t *out) {
+  if (in_size < 0) {
+    printf("Seal: bad input size %d\n", in_size);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> l(lock_);
+  if (!key_locked())
+    return false;
+
+  /* Ciphertext goes straight into out, after the size and tag */
+  int ret = mbedtls_gcm_crypt_and_tag(&gcm_,
+                                      MBEDTLS_GCM_ENCRYPT,
+                                      in_size,
+                                      key_,
+                                      gramine_seal_key_size,
+                                      NULL,
+                                      0,
+                                      in,
+                                      out + gramine_seal_header_size,
+                                      gramine_seal_tag_size,
+                                      out + sizeof(int));
+  if (ret != 0) {
+    printf("mbedtls_gcm_crypt_and_tag failed: %d\n", ret);
+    return false;
+  }
+  memcpy(out, &in_size, sizeof(int));
+  *size_out = gramine_seal_header_size + in_size;
+  return true;
+}
+
+bool gramine_sealer::unseal(int      in_size,
+                            uint8_t *in,
+                            int     *size_out,
+                            uint8_t *out) {
+  int enc_size = 0;
+
+  if (in_size < gramine_seal_header_size) {
+    printf("Unseal: input too small %d\n", in_size);
+    return false;
+  }
+  memcpy(&enc_size, in, sizeof(int));
+  if (enc_size < 0 || enc_size > in_size - gramine_seal_header_size) {
+    printf("Unseal: bad sealed size %d\n", enc_size);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> l(lock_);
+  if (!key_locked())
+    return false;
+
+  /* Invoke unseal; out is zeroed if the tag doesn't match */
+  int ret = mbedtls_gcm_auth_decrypt(&gcm_,
+                                     enc_size,
+                                     key_,
+                                     gramine_seal_key_size,
+                                     NULL,
+                                     0,
+                                     in + sizeof(int),
+                                     gramine_seal_tag_size,
+                                     in + gramine_seal_header_size,
+                                     out);
+  if (ret != 0) {
+    printf("mbedtls_gcm_auth_decrypt failed: %d\n", ret);
+    return false;
+  }
+  *size_out = enc_size;
+  return true;
+}
@@ -0,0 +1,62 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+
+#include <mutex>
+
+#include "mbedtls/gcm.h"
+
+#ifndef _GRAMINE_SEALER_H_
+#  define _GRAMINE_SEALER_H_
+
+const int gramine_seal_key_size = 16;
+const int gramine_seal_tag_size = 16;
+
+// Sealed blobs are the plaintext size, the tag, then the ciphertext.
+const int gramine_seal_header_size = sizeof(int) + gramine_seal_tag_size;
+
+// Fills in the sealing key.  In an enclave this is EGETKEY.
+typedef bool (*gramine_sealing_key_source)(uint8_t *key);
+
+// Seals and unseals with a key fetched from source on first use and
+// kept, already expanded in a GCM context, until clear() is called or
+// the sealer is destroyed.  Both zeroize the key.  Calls are serialized
+// on the context.
+class gramine_sealer {
+ public:
+  gramine_sealer(gramine_sealing_key_source source);
+  ~gramine_sealer();
+
+  bool seal(int in_size, uint8_t *in, int *size_out, uint8_t *out);
+  bool unseal(int in_size, uint8_t *in, int *size_out, uint8_t *out);
+
+  bool keyed();
+  void clear();
+
+ private:
+  std::mutex                 lock_;
+  gramine_sealing_key_source source_;
+  bool                       keyed_;
+  uint8_t                    key_[gramine_seal_key_size];
+  mbedtls_gcm_context        gcm_;
+
+  bool key_locked();
+
+  gramine_sealer(const gramine_sealer &);
+  gramine_sealer &operator=(const gramine_sealer &);
+};
+
+#endif  // #ifdef _GRAMINE_SEALER_H_
@@ -0,0 +1,115 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Stand-in for libsgx_dcap_quoteverify.so used by dcap_verifier_tests.
+ * The first byte of the report body picks the outcome: 0 verifies, 1
+ * gives a bad signature and 2 makes the call itself fail.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+
+#define STUB_SUPPLEMENTAL_SIZE 128
+#define STUB_REPORT_OFFSET     48
+#define STUB_COLLATERAL_MAGIC  0x5a
+
+static std::atomic<int> num_verifies(0);
+static std::atomic<int> num_with_collateral(0);
+static std::atomic<int> num_fetches(0);
+static std::atomic<int> num_frees(0);
+static std::atomic<int> collateral_expired(0);
+
+extern "C" {
+
+int sgx_qv_get_quote_supplemental_data_size(uint32_t *p_data_size) {
+  *p_data_size = STUB_SUPPLEMENTAL_SIZE;
+  return 0;
+}
+
+int sgx_qv_verify_quote(const uint8_t *p_quote,
+                        uint32_t       quote_size,
+                        void          *p_quote_collateral,
+                        const time_t   expiration_check_date,
+                        uint32_t      *p_collateral_expiration_status,
+                        int           *p_quote_verification_result,
+                        void          *p_qve_report_info,
+                        uint32_t       supplemental_data_size,
+                        uint8_t       *p_supplemental_data) {
+  num_verifies++;
+  if (p_supplemental_data == nullptr
+      || supplemental_data_size != STUB_SUPPLEMENTAL_SIZE)
+    return 1;
+  memset(p_supplemental_data, 0, supplemental_data_size);
+  if (quote_size <= STUB_REPORT_OFFSET)
+    return 1;
+
+  *p_collateral_expiration_status = 0;
+  if (p_quote_collateral != nullptr) {
+    if (*(uint8_t *)p_quote_collateral != STUB_COLLATERAL_MAGIC)
+      return 1;
+    num_with_collateral++;
+    if (collateral_expired.load())
+      *p_collateral_expiration_status = 1;
+  }
+
+  switch (p_quote[STUB_REPORT_OFFSET]) {
+    case 0:
+      *p_quote_verification_result = 0;  // SGX_QL_QV_RESULT_OK
+      return 0;
+    case 1:
+      *p_quote_verification_result = 0xA004;  // INVALID_SIGNATURE
+      return 0;
+    default:
+      return 1;
+  }
+}
+
+int tee_qv_get_collateral(const uint8_t *p_quote,
+                          uint32_t       quote_size,
+                          uint8_t      **pp_quote_collateral,
+                          uint32_t      *p_collateral_size) {
+  num_fetches++;
+  *pp_quote_collateral = (uint8_t *)malloc(64);
+  memset(*pp_quote_collateral, STUB_COLLATERAL_MAGIC, 64);
+  *p_collateral_size = 64;
+  return 0;
+}
+
+int tee_qv_free_collateral(uint8_t *p_quote_collateral) {
+  num_frees++;
+  free(p_quote_collateral);
+  return 0;
+}
+
+// Test hooks.
+void stub_dcap_counts(int *verifies,
+                      int *with_collateral,
+                      int *fetches,
+                      int *frees) {
+  *verifies = num_verifies.load();
+  *with_collateral = num_with_collateral.load();
+  *fetches = num_fetches.load();
+  *frees = num_frees.load();
+}
+
+void stub_dcap_set_expired(int expired) {
+  collateral_expired.store(expired);
+}
+}
@@ -0,0 +1,240 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * DCAP verifier tests, run outside Gramine against dcap_stub.cc:
+ *   ./dcap_verifier_tests ./libdcap_stub.so
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gramine_dcap_verifier.h"
+
+#define QUOTE_SIZE   1200
+#define NUM_THREADS  4
+#define NUM_PER_THR  50
+
+typedef void (*stub_dcap_counts_t)(int *, int *, int *, int *);
+typedef void (*stub_dcap_set_expired_t)(int);
+
+stub_dcap_counts_t      stub_dcap_counts = nullptr;
+stub_dcap_set_expired_t stub_dcap_set_expired = nullptr;
+
+// A version 3 quote with an empty QE authentication block and the given
+// certification data.  outcome is read by the stub.
+void make_quote(uint8_t outcome, const char *cert, std::vector<uint8_t> *q) {
+  uint16_t version = 3;
+  uint16_t cert_type = 5;
+  uint32_t cert_size = (uint32_t)strlen(cert);
+
+  q->assign(QUOTE_SIZE, 0);
+  memcpy(q->data(), &version, sizeof(version));
+  (*q)[48] = outcome;
+
+  size_t   off = 48 + 384;
+  uint32_t sig_size = (uint32_t)(QUOTE_SIZE - off - sizeof(sig_size));
+  memcpy(q->data() + off, &sig_size, sizeof(sig_size));
+  off += sizeof(sig_size) + 576 + sizeof(uint16_t);
+  memcpy(q->data() + off, &cert_type, sizeof(cert_type));
+  off += sizeof(cert_type);
+  memcpy(q->data() + off, &cert_size, sizeof(cert_size));
+  off += sizeof(cert_size);
+  memcpy(q->data() + off, cert, cert_size);
+}
+
+bool test_platform_id() {
+  std::vector<uint8_t> q;
+  std::string          platform;
+
+  make_quote(0, "pck-chain-a", &q);
+  if (!dcap_quote_platform_id(q.size(), q.data(), &platform)
+      || platform != "pck-chain-a") {
+    printf("platform id not found\n");
+    return false;
+  }
+  if (dcap_quote_platform_id(600, q.data(), &platform)) {
+    printf("truncated quote accepted\n");
+    return false;
+  }
+  q[0] = 4;
+  if (dcap_quote_platform_id(q.size(), q.data(), &platform)) {
+    printf("wrong version accepted\n");
+    return false;
+  }
+  return true;
+}
+
+bool test_verify(gramine_dcap_verifier &v) {
+  std::vector<uint8_t> good, bad, broken, other, untagged;
+  int                  verifies, with_collateral, fetches, frees;
+
+  make_quote(0, "pck-chain-a", &good);
+  make_quote(1, "pck-chain-a", &bad);
+  make_quote(2, "pck-chain-a", &broken);
+  make_quote(0, "pck-chain-b", &other);
+  make_quote(0, "pck-chain-c", &untagged);
+  untagged[0] = 4;  // no platform id, so no cached collateral
+
+  for (int i = 0; i < 10; i++) {
+    if (!v.verify(good.size(), good.data())) {
+      printf("good quote failed\n");
+      return false;
+    }
+  }
+  if (v.verify(bad.size(), bad.data())
+      || v.verify(broken.size(), broken.data())) {
+    printf("bad quote verified\n");
+    return false;
+  }
+  if (!v.verify(other.size(), other.data())
+      || !v.verify(untagged.size(), untagged.data())) {
+    printf("other quotes failed\n");
+    return false;
+  }
+
+  stub_dcap_counts(&verifies, &with_collateral, &fetches, &frees);
+  // Bad quotes don't cause a refetch.
+  if (v.num_cached_collateral() != 2 || fetches != 2 || frees != 0) {
+    printf("collateral not cached: %d entries, %d fetches, %d frees\n",
+           v.num_cached_collateral(),
+           fetches,
+           frees);
+    return false;
+  }
+  if (with_collateral != verifies - 1) {
+    printf("collateral not passed\n");
+    return false;
+  }
+  return true;
+}
+
+bool test_expiry(gramine_dcap_verifier &v) {
+  std::vector<uint8_t> q;
+  int                  verifies, with_collateral, fetches, frees;
+  int                  fetches_before;
+
+  make_quote(0, "pck-chain-a", &q);
+  v.clear_collateral_cache();
+  stub_dcap_counts(&verifies, &with_collateral, &fetches_before, &frees);
+
+  // Expired collateral is refetched and the quote verified again.
+  stub_dcap_set_expired(1);
+  bool ok = v.verify(q.size(), q.data());
+  stub_dcap_set_expired(0);
+  stub_dcap_counts(&verifies, &with_collateral, &fetches, &frees);
+  if (!ok || fetches != fetches_before + 2) {
+    printf("expired collateral not refetched\n");
+    return false;
+  }
+
+  // A zero lifetime fetches every time.
+  v.set_collateral_lifetime(0);
+  v.verify(q.size(), q.data());
+  v.verify(q.size(), q.data());
+  v.set_collateral_lifetime(default_dcap_collateral_lifetime);
+  stub_dcap_counts(&verifies, &with_collateral, &fetches, &frees);
+  if (fetches != fetches_before + 4) {
+    printf("collateral lifetime ignored\n");
+    return false;
+  }
+  return true;
+}
+
+bool test_batch_and_threads(gramine_dcap_verifier &v) {
+  std::vector<uint8_t> good, bad;
+  make_quote(0, "pck-chain-a", &good);
+  make_quote(1, "pck-chain-a", &bad);
+
+  const uint8_t *quotes[3] = {good.data(), bad.data(), good.data()};
+  size_t         sizes[3] = {good.size(), bad.size(), good.size()};
+  bool           verified[3];
+  if (v.verify_batch(3, sizes, quotes, verified) != 2 || !verified[0]
+      || verified[1] || !verified[2]) {
+    printf("batch verify wrong\n");
+    return false;
+  }
+
+  std::atomic<int>         failures(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < NUM_THREADS; t++) {
+    threads.push_back(std::thread([&]() {
+      for (int i = 0; i < NUM_PER_THR; i++) {
+        if (!v.verify(good.size(), good.data()))
+          failures++;
+      }
+    }));
+  }
+  for (std::thread &t : threads)
+    t.join();
+  if (failures.load() != 0) {
+    printf("threaded verify failed\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *lib_name = argc > 1 ? argv[1] : "./libdcap_stub.so";
+
+  void *stub = dlopen(lib_name, RTLD_NOW);
+  if (stub == nullptr) {
+    printf("Can't open %s\n", lib_name);
+    return 1;
+  }
+  stub_dcap_counts = (stub_dcap_counts_t)dlsym(stub, "stub_dcap_counts");
+  stub_dcap_set_expired =
+      (stub_dcap_set_expired_t)dlsym(stub, "stub_dcap_set_expired");
+  if (stub_dcap_counts == nullptr || stub_dcap_set_expired == nullptr) {
+    printf("%s is not the stub library\n", lib_name);
+    return 1;
+  }
+
+  int  frees_before, n;
+  bool ok = test_platform_id();
+  {
+    gramine_dcap_verifier v(lib_name);
+    if (!v.loaded()) {
+      printf("verifier didn't load\n");
+      return 1;
+    }
+    ok = ok && test_verify(v) && test_expiry(v) && test_batch_and_threads(v);
+    stub_dcap_counts(&n, &n, &n, &frees_before);
+    frees_before += v.num_cached_collateral();
+  }
+
+  // Cached collateral goes back to the library with the verifier.
+  int fetches, frees;
+  stub_dcap_counts(&n, &n, &fetches, &frees);
+  if (ok && (frees != frees_before || frees != fetches)) {
+    printf("collateral leaked: %d fetches, %d frees\n", fetches, frees);
+    ok = false;
+  }
+
+  gramine_dcap_verifier missing("./no_such_dcap_lib.so");
+  if (missing.loaded() || missing.verify(10, (const uint8_t *)"0123456789")) {
+    printf("verifier without library verified\n");
+    ok = false;
+  }
+
+  dlclose(stub);
+  printf("DCAP verifier tests %s\n", ok ? "successful" : "failed");
+  return ok ? 0 : 1;
+}
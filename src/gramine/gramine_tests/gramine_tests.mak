@@ -52,6 +52,23 @@ LDFLAGS += -Wl,--enable-new-dtags $(shell pkg-config --libs mbedtls_gramine) -L/
 gramine_tests: gramine_tests.cc certifier
 	$(GPP) $< $(CFLAGS) $(LDFLAGS) -o $@
 
+######################### DCAP VERIFIER TESTS #################################
+# These run outside Gramine, with a stub in place of the DCAP library.
+
+libdcap_stub.so: dcap_stub.cc
+	$(GPP) -shared -fPIC -o $@ $<
+
+dcap_verifier_tests: dcap_verifier_tests.cc $(CERTIFIER_SRC_PATH)/gramine/gramine_dcap_verifier.cc libdcap_stub.so
+	$(GPP) -std=c++17 -I$(CERTIFIER_SRC_PATH)/gramine $(filter %.cc,$^) -o $@ -ldl -lpthread
+
+.PHONY: dcap_tests
+dcap_tests: dcap_verifier_tests
+	./dcap_verifier_tests ./libdcap_stub.so
+
+# Seal/Unseal with a mock sealing key, also outside Gramine.
+seal_bench: seal_bench.cc $(CERTIFIER_SRC_PATH)/gramine/gramine_sealer.cc
+	$(GPP) -std=c++17 -O2 -I$(CERTIFIER_SRC_PATH)/gramine -I./mbedtls/include $^ -o $@ $(shell pkg-config --libs mbedtls_gramine) -lpthread
+
 ########################### TEST APP MANIFEST #################################
 
 gramine_tests.manifest: gramine_tests.manifest.template
@@ -80,7 +97,7 @@ gramine_tests.token: gramine_tests.sig
 .PHONY: clean
 clean:
 	$(RM) -r \
-		*.token *.sig *.manifest.sgx *.manifest gramine_tests *.so *.o *.a *.so.* OUTPUT
+		*.token *.sig *.manifest.sgx *.manifest gramine_tests dcap_verifier_tests seal_bench *.so *.o *.a *.so.* OUTPUT
 
 .PHONY: distclean
 distclean: clean
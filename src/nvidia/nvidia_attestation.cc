@@ -0,0 +1,333 @@
+//  Copyright (c) 2023, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nvidia_attestation.h"
+#include "certifier_utilities.h"
+
+#include <string.h>
+#include <thread>
+
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+// GPU attestation reports are the SPDM GET_MEASUREMENTS request, which
+// carries the nonce, the response, then an ECDSA P-384 signature (r || s)
+// by the leaf certificate's key over everything before it.
+const int     spdm_request_code_offset = 1;
+const uint8_t spdm_get_measurements = 0xe0;
+const int     spdm_nonce_offset = 4;
+const int     spdm_request_size = spdm_nonce_offset + nvidia_gpu_nonce_size + 1;
+const int     gpu_report_signature_size = 96;
+
+// The cache is cleared rather than allowed to grow past this.
+const int max_cached_gpu_certs = 1024;
+
+NvidiaAttestationPipeline::NvidiaAttestationPipeline(
+    const std::string &trusted_root)
+    : root(nullptr), signature_checks(0) {
+  const unsigned char *p = (const unsigned char *)trusted_root.data();
+  root = d2i_X509(nullptr, &p, trusted_root.size());
+  if (root == nullptr) {
+    printf("%s() error, line %d, can't parse trusted root\n",
+           __func__,
+           __LINE__);
+  }
+}
+
+NvidiaAttestationPipeline::~NvidiaAttestationPipeline() {
+  if (root != nullptr)
+    X509_free(root);
+}
+
+static bool cert_hash(X509 *x, std::string *hash) {
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int  len = 0;
+  if (X509_digest(x, EVP_sha256(), md, &len) != 1)
+    return false;
+  hash->assign((char *)md, len);
+  return true;
+}
+
+bool NvidiaAttestationPipeline::cert_known(const std::string &hash) {
+  std::lock_guard<std::mutex> l(cache_lock);
+  return verified_certs.find(hash) != verified_certs.end();
+}
+
+void NvidiaAttestationPipeline::remember_cert(const std::string &hash) {
+  std::lock_guard<std::mutex> l(cache_lock);
+  if ((int)verified_certs.size() >= max_cached_gpu_certs)
+    verified_certs.clear();
+  verified_certs.insert(hash);
+}
+
+int NvidiaAttestationPipeline::num_cached_certs() {
+  std::lock_guard<std::mutex> l(cache_lock);
+  return (int)verified_certs.size();
+}
+
+// Checks the chain from the trusted root down and returns the leaf key,
+// or nullptr.  A certificate seen in an earlier chain is already known to
+// lead to the root, so its signature isn't checked again; its validity
+// period is.
+EVP_PKEY *NvidiaAttestationPipeline::verify_chain(
+    const std::vector<uint8_t> &pem) {
+  if (root == nullptr)
+    return nullptr;
+
+  std::vector<X509 *> certs;
+  BIO                *bio = BIO_new_mem_buf(pem.data(), (int)pem.size());
+  if (bio == nullptr)
+    return nullptr;
+  X509 *x = nullptr;
+  while ((x = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) != nullptr)
+    certs.push_back(x);
+  BIO_free(bio);
+  ERR_clear_error();
+
+  // The chain may end with a copy of the root.
+  if (!certs.empty() && X509_cmp(certs.back(), root) == 0) {
+    X509_free(certs.back());
+    certs.pop_back();
+  }
+  if (certs.empty()) {
+    printf("%s() error, line %d, empty certificate chain\n",
+           __func__,
+           __LINE__);
+    return nullptr;
+  }
+
+  bool ok = true;
+  for (int i = (int)certs.size() - 1; ok && i >= 0; i--) {
+    X509       *issuer = (i == (int)certs.size() - 1) ? root : certs[i + 1];
+    std::string hash;
+    if (!cert_hash(certs[i], &hash)) {
+      ok = false;
+      break;
+    }
+    // Checked even for a cached certificate, which may since have
+    // expired.
+    if (X509_cmp_current_time(X509_get0_notBefore(certs[i])) >= 0
+        || X509_cmp_current_time(X509_get0_notAfter(certs[i])) <= 0) {
+      printf("%s() error, line %d, certificate %d not valid now\n",
+             __func__,
+             __LINE__,
+             i);
+      ok = false;
+      break;
+    }
+    if (cert_known(hash))
+      continue;
+
+    if (X509_check_issued(issuer, certs[i]) != X509_V_OK
+        || X509_check_ca(issuer) < 1) {
+      printf("%s() error, line %d, certificate %d not issued by the next\n",
+             __func__,
+             __LINE__,
+             i);
+      ok = false;
+      break;
+    }
+    signature_checks++;
+    if (X509_verify(certs[i], X509_get0_pubkey(issuer)) != 1) {
+      printf("%s() error, line %d, bad signature on certificate %d\n",
+             __func__,
+             __LINE__,
+             i);
+      ok = false;
+      break;
+    }
+    remember_cert(hash);
+  }
+
+  EVP_PKEY *leaf_key = ok ? X509_get_pubkey(certs[0]) : nullptr;
+  for (X509 *c : certs)
+    X509_free(c);
+  return leaf_key;
+}
+
+static bool verify_report_signature(EVP_PKEY                   *key,
+                                    const std::vector<uint8_t> &report) {
+  int            signed_size = (int)report.size() - gpu_report_signature_size;
+  const uint8_t *rs = report.data() + signed_size;
+
+  ECDSA_SIG *sig = ECDSA_SIG_new();
+  BIGNUM    *r = BN_bin2bn(rs, gpu_report_signature_size / 2, nullptr);
+  BIGNUM    *s = BN_bin2bn(rs + gpu_report_signature_size / 2,
+                        gpu_report_signature_size / 2,
+                        nullptr);
+  if (sig == nullptr || r == nullptr || s == nullptr) {
+    ECDSA_SIG_free(sig);
+    BN_free(r);
+    BN_free(s);
+    return false;
+  }
+  ECDSA_SIG_set0(sig, r, s);
+
+  unsigned char *der = nullptr;
+  int            der_size = i2d_ECDSA_SIG(sig, &der);
+  ECDSA_SIG_free(sig);
+  if (der_size <= 0)
+    return false;
+
+  EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+  bool        ok = ctx != nullptr
+            && EVP_DigestVerifyInit(ctx, nullptr, EVP_sha384(), nullptr, key)
+                   == 1
+            && EVP_DigestVerify(ctx, der, der_size, report.data(), signed_size)
+                   == 1;
+  EVP_MD_CTX_free(ctx);
+  OPENSSL_free(der);
+  return ok;
+}
+
+bool NvidiaAttestationPipeline::verify_gpu(NvidiaGPUEvidence *ev) {
+  ev->verified = false;
+
+  if ((int)ev->nonce.size() != nvidia_gpu_nonce_size
+      || (int)ev->report.size()
+             < spdm_request_size + gpu_report_signature_size) {
+    printf("%s() error, line %d, GPU %d: bad nonce or report size\n",
+           __func__,
+           __LINE__,
+           ev->index);
+    return false;
+  }
+  if (ev->report[spdm_request_code_offset] != spdm_get_measurements
+      || memcmp(ev->report.data() + spdm_nonce_offset,
+                ev->nonce.data(),
+                nvidia_gpu_nonce_size)
+             != 0) {
+    printf("%s() error, line %d, GPU %d: report is not for our nonce\n",
+           __func__,
+           __LINE__,
+           ev->index);
+    return false;
+  }
+
+  EVP_PKEY *leaf_key = verify_chain(ev->cert_chain);
+  if (leaf_key == nullptr) {
+    printf("%s() error, line %d, GPU %d: bad certificate chain\n",
+           __func__,
+           __LINE__,
+           ev->index);
+    return false;
+  }
+  bool ok = verify_report_signature(leaf_key, ev->report);
+  EVP_PKEY_free(leaf_key);
+  if (!ok) {
+    printf("%s() error, line %d, GPU %d: bad report signature\n",
+           __func__,
+           __LINE__,
+           ev->index);
+    return false;
+  }
+
+  ev->verified = true;
+  return true;
+}
+
+// Nonces are drawn first; then every GPU is asked for its chain and
+// report at once.
+bool NvidiaAttestationPipeline::collect(NvidiaPlatform                 *platform,
+                                        std::vector<NvidiaGPUEvidence> *out) {
+  if (platform == nullptr || !platform->is_cc_enabled()) {
+    printf("%s() error, line %d, no confidential computing GPUs\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  int num_gpus = platform->get_num_gpus();
+  if (num_gpus <= 0) {
+    printf("%s() error, line %d, no GPUs\n", __func__, __LINE__);
+    return false;
+  }
+
+  out->assign(num_gpus, NvidiaGPUEvidence());
+  for (int i = 0; i < num_gpus; i++) {
+    (*out)[i].index = i;
+    (*out)[i].nonce.resize(nvidia_gpu_nonce_size);
+    if (!certifier::utilities::get_random(8 * nvidia_gpu_nonce_size,
+                                          (*out)[i].nonce.data())) {
+      printf("%s() error, line %d, can't get nonce\n", __func__, __LINE__);
+      return false;
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_gpus; i++) {
+    threads.push_back(std::thread([platform, out, i]() {
+      NvidiaGPUEvidence &ev = (*out)[i];
+      NvidiaGPU         *gpu = platform->get_gpu(i);
+      if (gpu == nullptr)
+        return;
+      ev.uuid = gpu->get_uuid();
+      ev.cert_chain = gpu->get_attestation_cert_chain();
+      ev.report = gpu->get_attestation_report(ev.nonce);
+    }));
+  }
+  for (std::thread &t : threads)
+    t.join();
+
+  bool ok = true;
+  for (int i = 0; i < num_gpus; i++) {
+    if ((*out)[i].report.empty() || (*out)[i].cert_chain.empty()) {
+      printf("%s() error, line %d, no evidence from GPU %d\n",
+             __func__,
+             __LINE__,
+             i);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+int NvidiaAttestationPipeline::verify(std::vector<NvidiaGPUEvidence> *evidence) {
+  std::vector<std::thread> threads;
+  for (NvidiaGPUEvidence &ev : *evidence) {
+    NvidiaGPUEvidence *p = &ev;
+    threads.push_back(std::thread([this, p]() { verify_gpu(p); }));
+  }
+  for (std::thread &t : threads)
+    t.join();
+
+  int num_verified = 0;
+  for (NvidiaGPUEvidence &ev : *evidence) {
+    if (ev.verified)
+      num_verified++;
+  }
+  return num_verified;
+}
+
+bool NvidiaAttestationPipeline::attach(
+    const std::vector<NvidiaGPUEvidence>  &evidence,
+    certifier::framework::cc_trust_manager *tm) {
+  for (const NvidiaGPUEvidence &ev : evidence) {
+    evidence_package ep;
+    ep.set_prover_type("vse-verifier");
+    ::evidence *chain = ep.add_fact_assertion();
+    chain->set_evidence_type("pem-cert-chain");
+    chain->set_serialized_evidence(
+        std::string(ev.cert_chain.begin(), ev.cert_chain.end()));
+    ::evidence *report = ep.add_fact_assertion();
+    report->set_evidence_type("nvidia-gpu-attestation-report");
+    report->set_serialized_evidence(
+        std::string(ev.report.begin(), ev.report.end()));
+    if (!tm->add_accelerator_evidence("nvidia-gpu", ev.uuid, ep, ev.verified))
+      return false;
+  }
+  return true;
+}
@@ -16,7 +16,28 @@
 #include "nvidia_mock.h"
 #include "certifier_utilities.h"
 
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+NvidiaGPUMock::~NvidiaGPUMock() {
+  if (signing_key != nullptr)
+    EVP_PKEY_free(signing_key);
+}
+
+std::string NvidiaGPUMock::get_uuid() {
+  char uuid[64];
+  snprintf(uuid,
+           sizeof(uuid),
+           "GPU-11111111-2222-3333-4444-%012llx",
+           0x555555555555ULL + (unsigned long long)index);
+  return std::string(uuid);
+}
+
 std::vector<uint8_t> NvidiaGPUMock::get_attestation_cert_chain() {
+  if (signing_key != nullptr)
+    return std::vector<uint8_t>(cert_chain.begin(), cert_chain.end());
+
   int                  chain_size = 10000;
   std::vector<uint8_t> cert_chain(chain_size, 0);
   std::string          cert_path = base_dir + "/gpuAkCertChain.txt";
@@ -32,8 +53,55 @@ std::vector<uint8_t> NvidiaGPUMock::get_attestation_cert_chain() {
   return cert_chain;
 }
 
+// A live report is the SPDM GET_MEASUREMENTS request carrying the nonce,
+// a response, then an ECDSA P-384 signature (r || s) over both.
+static std::vector<uint8_t> mock_signed_report(
+    int                         index,
+    const std::vector<uint8_t> &nonce,
+    EVP_PKEY                   *key) {
+  std::vector<uint8_t> report = {0x11, 0xe0, 0x01, 0xff};
+  report.insert(report.end(), nonce.begin(), nonce.end());
+  report.push_back(0x00);
+  std::vector<uint8_t> response = {0x11, 0x60, 0x00, 0x00};
+  for (int i = 0; i < 64; i++)
+    response.push_back((uint8_t)(index + i));
+  report.insert(report.end(), response.begin(), response.end());
+
+  size_t      der_size = 0;
+  EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+  bool        ok = ctx != nullptr
+            && EVP_DigestSignInit(ctx, nullptr, EVP_sha384(), nullptr, key) == 1
+            && EVP_DigestSign(ctx,
+                              nullptr,
+                              &der_size,
+                              report.data(),
+                              report.size())
+                   == 1;
+  std::vector<uint8_t> der(der_size);
+  ok = ok
+       && EVP_DigestSign(ctx, der.data(), &der_size, report.data(), report.size())
+              == 1;
+  EVP_MD_CTX_free(ctx);
+  if (!ok)
+    return {};
+
+  const uint8_t *p = der.data();
+  ECDSA_SIG     *sig = d2i_ECDSA_SIG(nullptr, &p, der_size);
+  if (sig == nullptr)
+    return {};
+  uint8_t rs[96];
+  BN_bn2binpad(ECDSA_SIG_get0_r(sig), rs, 48);
+  BN_bn2binpad(ECDSA_SIG_get0_s(sig), rs + 48, 48);
+  ECDSA_SIG_free(sig);
+  report.insert(report.end(), rs, rs + sizeof(rs));
+  return report;
+}
+
 std::vector<uint8_t> NvidiaGPUMock::get_attestation_report(
     const std::vector<uint8_t> &nonce) {
+  if (signing_key != nullptr)
+    return mock_signed_report(index, nonce, signing_key);
+
   int hex_report_size = 10000;
   // the attestation report as a hex string
   std::vector<uint8_t> hex_report(hex_report_size, 0);
@@ -56,3 +124,141 @@ std::vector<uint8_t> NvidiaGPUMock::get_attestation_report(
   }
   return report;
 }
+
+static EVP_PKEY *mock_p384_key() {
+  EC_KEY *ec = EC_KEY_new_by_curve_name(NID_secp384r1);
+  if (ec == nullptr || EC_KEY_generate_key(ec) != 1) {
+    EC_KEY_free(ec);
+    return nullptr;
+  }
+  EVP_PKEY *key = EVP_PKEY_new();
+  EVP_PKEY_assign_EC_KEY(key, ec);
+  return key;
+}
+
+// issuer == nullptr makes a self-signed root.
+static X509 *mock_cert(const char *name,
+                       X509       *issuer,
+                       EVP_PKEY   *subject_key,
+                       EVP_PKEY   *issuer_key,
+                       bool        ca,
+                       long        serial,
+                       long        lifetime = 365L * 86400L) {
+  X509 *x = X509_new();
+  X509_set_version(x, 2L);
+  ASN1_INTEGER_set(X509_get_serialNumber(x), serial);
+
+  X509_NAME *subject = X509_NAME_new();
+  X509_NAME_add_entry_by_txt(subject,
+                             "CN",
+                             MBSTRING_ASC,
+                             (const unsigned char *)name,
+                             -1,
+                             -1,
+                             0);
+  X509_NAME_add_entry_by_txt(subject,
+                             "O",
+                             MBSTRING_ASC,
+                             (const unsigned char *)"NVIDIA Mock",
+                             -1,
+                             -1,
+                             0);
+  X509_set_subject_name(x, subject);
+  X509_set_issuer_name(x,
+                       issuer != nullptr ? X509_get_subject_name(issuer)
+                                         : subject);
+  X509_NAME_free(subject);
+
+  X509_gmtime_adj(X509_getm_notBefore(x), -3600);
+  X509_gmtime_adj(X509_getm_notAfter(x), lifetime);
+  X509_set_pubkey(x, subject_key);
+
+  if (ca) {
+    X509V3_CTX ctx;
+    X509V3_set_ctx_nodb(&ctx);
+    X509V3_set_ctx(&ctx, issuer != nullptr ? issuer : x, x, nullptr, nullptr, 0);
+    X509_EXTENSION *ex =
+        X509V3_EXT_conf_nid(nullptr, &ctx, NID_basic_constraints, "critical,CA:TRUE");
+    X509_add_ext(x, ex, -1);
+    X509_EXTENSION_free(ex);
+  }
+
+  X509_sign(x, issuer_key, EVP_sha384());
+  return x;
+}
+
+static void append_pem(X509 *x, std::string *chain) {
+  BIO *bio = BIO_new(BIO_s_mem());
+  PEM_write_bio_X509(bio, x);
+  char *data = nullptr;
+  long  len = BIO_get_mem_data(bio, &data);
+  chain->append(data, len);
+  BIO_free(bio);
+}
+
+// Chains are leaf, device, intermediate, root like NVIDIA's; the last
+// two are the same for every GPU.  Leaf certificates expire after
+// leaf_lifetime seconds.
+std::unique_ptr<NvidiaPlatformMock> NvidiaPlatformMock::create(
+    int          num_gpus,
+    std::string *root_cert,
+    long         leaf_lifetime) {
+  std::unique_ptr<NvidiaPlatformMock> platform(new NvidiaPlatformMock());
+
+  EVP_PKEY *root_key = mock_p384_key();
+  EVP_PKEY *ica_key = mock_p384_key();
+  if (root_key == nullptr || ica_key == nullptr) {
+    EVP_PKEY_free(root_key);
+    EVP_PKEY_free(ica_key);
+    return nullptr;
+  }
+  X509 *root = mock_cert("Mock Device Identity CA",
+                         nullptr,
+                         root_key,
+                         root_key,
+                         true,
+                         1);
+  X509 *ica = mock_cert("Mock Provisioner ICA", root, ica_key, root_key, true, 2);
+
+  unsigned char *der = nullptr;
+  int            der_len = i2d_X509(root, &der);
+  root_cert->assign((char *)der, der_len);
+  OPENSSL_free(der);
+
+  for (int i = 0; i < num_gpus; i++) {
+    EVP_PKEY *device_key = mock_p384_key();
+    EVP_PKEY *leaf_key = mock_p384_key();
+    std::string device_name = "Mock GPU BROM " + std::to_string(i);
+    std::string leaf_name = "Mock GPU FMC LF " + std::to_string(i);
+    X509     *device = mock_cert(device_name.c_str(),
+                             ica,
+                             device_key,
+                             ica_key,
+                             true,
+                             100 + 2 * i);
+    X509     *leaf = mock_cert(leaf_name.c_str(),
+                           device,
+                           leaf_key,
+                           device_key,
+                           false,
+                           101 + 2 * i,
+                           leaf_lifetime);
+
+    std::string chain;
+    append_pem(leaf, &chain);
+    append_pem(device, &chain);
+    append_pem(ica, &chain);
+    append_pem(root, &chain);
+    platform->gpus.emplace_back(new NvidiaGPUMock(i, chain, leaf_key));
+
+    X509_free(leaf);
+    X509_free(device);
+    EVP_PKEY_free(device_key);
+  }
+
+  X509_free(ica);
+  X509_free(root);
+  EVP_PKEY_free(ica_key);
+  EVP_PKEY_free(root_key);
+  return platform;
+}
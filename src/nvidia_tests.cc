@@ -1,11 +1,16 @@
 #include <gtest/gtest.h>
 #include <gflags/gflags.h>
 #include <string>
+#include <unistd.h>
+#include <openssl/pem.h>
 #include "nvidia_impl.h"
+#include "nvidia_mock.h"
+#include "nvidia_attestation.h"
 
 DEFINE_string(nvml_lib_path,
               "/usr/lib/x86_64-linux-gnu/libnvidia-ml.so.535.113.01",
               "nvml lib path");
+DEFINE_string(data_dir, "./test_data", "directory for test data");
 
 bool test_load() {
   auto platform = NvidiaPlatformImpl::create(FLAGS_nvml_lib_path.c_str());
@@ -76,6 +81,153 @@ TEST(nvml, GPUTests) {
   EXPECT_EQ(test_get_gpu_uuid(), "GPU-e0735ed5-ade6-97d0-a903-79fcf4ce31a3");
 }
 
+// The recorded report and chain come from a real H100.  Its nonce is
+// whatever was used when it was recorded, so take it from the report.
+bool test_recorded_gpu_evidence() {
+  NvidiaPlatformMock platform(FLAGS_data_dir);
+  NvidiaGPU         *gpu = platform.get_gpu(0);
+  if (gpu == nullptr)
+    return false;
+
+  NvidiaGPUEvidence ev;
+  ev.index = 0;
+  ev.cert_chain = gpu->get_attestation_cert_chain();
+  ev.report = gpu->get_attestation_report({});
+  if (ev.report.size() < 4 + nvidia_gpu_nonce_size)
+    return false;
+  ev.nonce.assign(ev.report.begin() + 4,
+                  ev.report.begin() + 4 + nvidia_gpu_nonce_size);
+
+  // The root is the last certificate in the chain.
+  BIO *bio = BIO_new_mem_buf(ev.cert_chain.data(), ev.cert_chain.size());
+  X509 *x = nullptr;
+  X509 *last = nullptr;
+  while ((x = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) != nullptr) {
+    X509_free(last);
+    last = x;
+  }
+  BIO_free(bio);
+  if (last == nullptr)
+    return false;
+  unsigned char *der = nullptr;
+  int            der_len = i2d_X509(last, &der);
+  std::string    root((char *)der, der_len);
+  OPENSSL_free(der);
+  X509_free(last);
+
+  NvidiaAttestationPipeline pipeline(root);
+  if (!pipeline.verify_gpu(&ev))
+    return false;
+
+  // A different nonce or a changed report must fail.
+  ev.nonce[0] ^= 1;
+  if (pipeline.verify_gpu(&ev))
+    return false;
+  ev.nonce[0] ^= 1;
+  ev.report[ev.report.size() / 2] ^= 1;
+  if (pipeline.verify_gpu(&ev))
+    return false;
+  return true;
+}
+
+bool test_gpu_pipeline(int num_gpus) {
+  std::string                         root;
+  std::unique_ptr<NvidiaPlatformMock> platform =
+      NvidiaPlatformMock::create(num_gpus, &root);
+  if (platform == nullptr)
+    return false;
+
+  NvidiaAttestationPipeline      pipeline(root);
+  std::vector<NvidiaGPUEvidence> evidence;
+  if (!pipeline.collect(platform.get(), &evidence)
+      || (int)evidence.size() != num_gpus)
+    return false;
+
+  // Every GPU gets its own nonce.
+  for (int i = 0; i < num_gpus; i++) {
+    for (int j = i + 1; j < num_gpus; j++) {
+      if (evidence[i].nonce == evidence[j].nonce
+          || evidence[i].uuid == evidence[j].uuid)
+        return false;
+    }
+  }
+
+  if (pipeline.verify(&evidence) != num_gpus)
+    return false;
+  // Device and leaf certificates are per GPU; the intermediate is shared.
+  if (pipeline.num_cached_certs() != 2 * num_gpus + 1)
+    return false;
+
+  // Everything is cached now, so a second round checks no certificates.
+  int checks = pipeline.num_signature_checks();
+  if (!pipeline.collect(platform.get(), &evidence)
+      || pipeline.verify(&evidence) != num_gpus
+      || pipeline.num_signature_checks() != checks)
+    return false;
+
+  // One bad report doesn't affect the others.
+  evidence[num_gpus / 2].report.back() ^= 1;
+  if (pipeline.verify(&evidence) != num_gpus - 1
+      || evidence[num_gpus / 2].verified)
+    return false;
+
+  // Chains from another root are rejected.
+  std::string                         other_root;
+  std::unique_ptr<NvidiaPlatformMock> other =
+      NvidiaPlatformMock::create(1, &other_root);
+  std::vector<NvidiaGPUEvidence> other_evidence;
+  if (other == nullptr || !pipeline.collect(other.get(), &other_evidence)
+      || pipeline.verify(&other_evidence) != 0)
+    return false;
+
+  // A cached chain is still rejected once a certificate in it expires.
+  std::string                         short_root;
+  std::unique_ptr<NvidiaPlatformMock> short_lived =
+      NvidiaPlatformMock::create(1, &short_root, 2);
+  NvidiaAttestationPipeline      short_pipeline(short_root);
+  std::vector<NvidiaGPUEvidence> short_evidence;
+  if (short_lived == nullptr
+      || !short_pipeline.collect(short_lived.get(), &short_evidence)
+      || short_pipeline.verify(&short_evidence) != 1)
+    return false;
+  sleep(3);
+  if (!short_pipeline.collect(short_lived.get(), &short_evidence)
+      || short_pipeline.verify(&short_evidence) != 0)
+    return false;
+
+  // All of them go to the trust manager, however many there are, and
+  // the type only counts as verified if every one was.
+  certifier::framework::cc_trust_manager tm("simulated-enclave",
+                                            "authentication",
+                                            "gpu_test_store.bin");
+  if (!pipeline.attach(evidence, &tm) || tm.num_accelerators_ != num_gpus)
+    return false;
+  if (tm.accelerator_verified("nvidia-gpu"))
+    return false;
+  certifier::framework::cc_trust_manager tm2("simulated-enclave",
+                                             "authentication",
+                                             "gpu_test_store.bin");
+  evidence[num_gpus / 2].report.back() ^= 1;
+  if (pipeline.verify(&evidence) != num_gpus || !pipeline.attach(evidence, &tm2)
+      || !tm2.accelerator_verified("nvidia-gpu"))
+    return false;
+  for (int i = 0; i < num_gpus; i++) {
+    if (tm2.accelerators_[i]->accelerator_id_ != evidence[i].uuid
+        || tm2.accelerators_[i]->support_.fact_assertion_size() != 2)
+      return false;
+  }
+  return true;
+}
+
+TEST(nvidia_attestation, RecordedEvidence) {
+  EXPECT_TRUE(test_recorded_gpu_evidence());
+}
+
+TEST(nvidia_attestation, Pipeline) {
+  EXPECT_TRUE(test_gpu_pipeline(8));
+  EXPECT_TRUE(test_gpu_pipeline(16));
+}
+
 int main(int argc, char *argv[]) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
   ::testing::InitGoogleTest();
@@ -25,7 +25,7 @@ using namespace certifier::utilities;
 int main(int an, char **av) {
 
   int fd[2];
-  if (pipe2(fd, O_DIRECT) < 0) {
+  if (pipe(fd) < 0) {
     printf("Pipe failed\n");
     return 0;
   }
@@ -1223,72 +1223,21 @@ int sev_read_pem_into_x509(const char *file_name, X509 **x509_cert) {
   return EXIT_SUCCESS;
 }
 
+// parent is the trust root; its store is kept by cert_verifier rather
+// than built for every report.
 static bool x509_validate_signature(X509 *child_cert,
                                     X509 *intermediate_cert,
                                     X509 *parent_cert) {
-  bool            ret = false;
-  X509_STORE     *store = NULL;
-  X509_STORE_CTX *store_ctx = NULL;
-
-  do {
-    // Create the store
-    store = X509_STORE_new();
-    if (!store)
-      break;
-
-    // Add the parent cert to the store
-    if (X509_STORE_add_cert(store, parent_cert) != 1) {
-      printf("Error adding parent_cert to x509_store\n");
-      break;
-    }
-
-    // Add the intermediate cert to the store
-    if (intermediate_cert) {
-      if (X509_STORE_add_cert(store, intermediate_cert) != 1) {
-        printf("Error adding intermediate_cert to x509_store\n");
-        break;
-      }
-    }
-
-    // Create the store context
-    store_ctx = X509_STORE_CTX_new();
-    if (!store_ctx) {
-      printf("Error creating x509_store_context\n");
-      break;
-    }
-
-    // Pass the store (parent and intermediate cert) and child cert (that we
-    // want to verify) into the store context
-    if (X509_STORE_CTX_init(store_ctx, store, child_cert, NULL) != 1) {
-      printf("Error initializing 509_store_context\n");
-      break;
-    }
-
-    // Specify which cert to validate
-    X509_STORE_CTX_set_cert(store_ctx, child_cert);
-
-    // Verify the certificate
-    ret = X509_verify_cert(store_ctx);
-
-    // Print out error code
-    if (ret == 0)
-      printf(
-          "Error verifying cert: %s\n",
-          X509_verify_cert_error_string(X509_STORE_CTX_get_error(store_ctx)));
-
-    if (ret != 1)
-      break;
-
-    ret = true;
-  } while (0);
-
-  // Cleanup
-  if (store_ctx)
-    X509_STORE_CTX_free(store_ctx);
-  if (store)
-    X509_STORE_free(store);
-
-  return ret;
+  std::vector<X509 *> untrusted;
+  if (intermediate_cert)
+    untrusted.push_back(intermediate_cert);
+  if (!cert_verifier::instance().verify_chain(parent_cert,
+                                              child_cert,
+                                              untrusted)) {
+    printf("Error verifying cert\n");
+    return false;
+  }
+  return true;
 }
 
 int sev_validate_vcek_cert_chain(X509 *x509_vcek,
@@ -120,15 +120,18 @@ bool simulated_Seal(const string &enclave_type,
   const int iv_size = block_size;
   byte      iv[iv_size];
 
-  int  input_size = in_size + my_measurement.size();
-  byte input[input_size];
-
+  int input_size = in_size + my_measurement.size();
   int output_size = in_size + my_measurement.size() + iv_size + max_seal_pad;
   if (out == nullptr) {
     *size_out = output_size;
     return true;
   }
-  byte output[output_size];
+  scratch_buffer input_buf(input_size);
+  scratch_buffer output_buf(output_size);
+  byte          *input = input_buf.data();
+  byte          *output = output_buf.data();
+  if (input == nullptr || output == nullptr)
+    return false;
 
   memset(input, 0, input_size);
   memset(output, 0, output_size);
@@ -172,11 +175,14 @@ bool simulated_Unseal(const string &enclave_type,
   int  iv_size = block_size;
   byte iv[iv_size];
   int  output_size = in_size + max_seal_pad;
-  byte output[output_size];
   if (out == nullptr) {
     *size_out = output_size;
     return true;
   }
+  scratch_buffer output_buf(output_size);
+  byte          *output = output_buf.data();
+  if (output == nullptr)
+    return false;
 
   memset(output, 0, output_size);
   memcpy(iv, in, iv_size);
@@ -382,3 +382,90 @@ bool test_policy_store(bool print_all) {
 
   return true;
 }
+
+bool test_lazy_store(bool print_all) {
+  policy_store ps(policy_store::MAX_NUM_ENTRIES);
+  string       type("binary-blob");
+  for (int i = 0; i < 20; i++) {
+    string value(100 * i, (char)i);
+    if (!ps.update_or_insert("entry-" + std::to_string(i), type, value)) {
+      printf("Error: Can't add entry %d\n", i);
+      return false;
+    }
+  }
+  string saved;
+  if (!ps.Serialize(&saved)) {
+    printf("Error: can't serialize\n");
+    return false;
+  }
+
+  // A store sized for fewer entries than were saved grows.
+  policy_store small(5);
+  string       copy(saved);
+  if (!small.Deserialize_from(&copy) || !copy.empty()
+      || small.get_num_entries() != 20
+      || small.max_num_ents_ != policy_store::MAX_NUM_ENTRIES) {
+    printf("Error: Can't Deserialize into a small store\n");
+    return false;
+  }
+
+  // Nothing is copied out until it is read.
+  if (small.num_undecoded_ != 20 || small.entry_[5]->value_offset_ < 0
+      || !small.entry_[5]->value_.empty()) {
+    printf("Error: Deserialize copied values\n");
+    return false;
+  }
+
+  // Every accessor sees the values.
+  const string *v = small.value(3);
+  string        got;
+  if (v == nullptr || *v != string(300, (char)3) || !small.get(7, &got)
+      || got != string(700, (char)7)
+      || small.get_entry(0)->value_.size() != 0
+      || small.get_entry(19)->value_ != string(1900, (char)19)) {
+    printf("Error: deserialized values don't match\n");
+    return false;
+  }
+  if (small.num_undecoded_ != 16 || small.entry_[3]->value_offset_ != -1) {
+    printf("Error: read values weren't decoded\n");
+    return false;
+  }
+
+  // Reserializing keeps updated and untouched entries.
+  if (!small.put(7, "seven") || !small.delete_entry(19)) {
+    printf("Error: Can't update\n");
+    return false;
+  }
+  string resaved;
+  policy_store again;
+  if (!small.Serialize(&resaved) || !again.Deserialize(resaved)
+      || again.get_num_entries() != 19 || *again.value(7) != "seven"
+      || *again.value(12) != string(1200, (char)12)
+      || *again.tag(18) != "entry-18") {
+    printf("Error: Reserialized store doesn't match\n");
+    return false;
+  }
+
+  string junk("not a store");
+  if (again.Deserialize(junk) || again.get_num_entries() != 0) {
+    printf("Error: Deserialized junk\n");
+    return false;
+  }
+  string truncated(saved, 0, saved.size() - 10);
+  if (again.Deserialize(truncated) || again.get_num_entries() != 0) {
+    printf("Error: Deserialized a truncated store\n");
+    return false;
+  }
+
+  // A corrupt max_ents can't force a huge allocation.
+  policy_store_message psm;
+  string               huge;
+  psm.set_max_ents(0x7fffffff);
+  if (!psm.SerializeToString(&huge) || again.Deserialize(huge)) {
+    printf("Error: Deserialized a store claiming 2^31 entries\n");
+    return false;
+  }
+  if (print_all)
+    printf("lazy store succeeded\n");
+  return true;
+}
@@ -30,13 +30,33 @@
 #include "certifier.pb.h"
 #include "sev-snp/sev_vcek_ext.h"
 
+#include <errno.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <pthread.h>
+#include <algorithm>
+#include <atomic>
+#include <set>
 #include <string>
+#include <vector>
+#ifndef OE_CERTIFIER
+#include <thread>
+#endif
 
 #include "certifier_algorithms.cc"
+#include "cc_metrics.cc"
 
 using std::string;
+using std::vector;
+
+#if defined(__has_include)
+#  if __has_include(<sys/random.h>)
+#    include <sys/random.h>
+#    define HAVE_GETRANDOM
+#  endif
+#endif
 using namespace certifier::framework;
 using namespace certifier::utilities;
 
@@ -229,16 +249,16 @@ bool certifier::utilities::read_file_into_string(const string &file_name,
            file_name.c_str());
     return false;
   }
-  byte buf[size];
-  if (!read_file(file_name, &size, buf)) {
+  out->resize(size);
+  if (!read_file(file_name, &size, (byte *)&(*out)[0]) || size < 0) {
     printf("%s() error, line: %d, read_file_into_string: Can't read file %s\n",
            __func__,
            __LINE__,
            file_name.c_str());
+    out->clear();
     return false;
   }
-
-  out->assign((char *)buf, size);
+  out->resize(size);
   return true;
 }
 
@@ -401,6 +421,256 @@ int certifier::utilities::compare_time(time_point &t1, time_point &t2) {
   return 0;
 }
 
+// Numeric time
+// -----------------------------------------------------------------------
+
+// Days from 1970-01-01 to y-m-d, proleptic Gregorian.
+static int64_t days_from_civil(int64_t y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int64_t *y, int *m, int *d) {
+  z += 719468;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  int64_t doe = z - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  *d = (int)(doy - (153 * mp + 2) / 5 + 1);
+  *m = (int)(mp < 10 ? mp + 3 : mp - 9);
+  *y = yoe + era * 400 + (*m <= 2);
+}
+
+// Times past 2262 (or before 1677) saturate.
+static time_ns seconds_to_time_ns(int64_t secs, int64_t frac_ns) {
+  const int64_t max_secs = INT64_MAX / ns_per_second - 1;
+  if (secs > max_secs)
+    return INT64_MAX;
+  if (secs < -max_secs)
+    return INT64_MIN;
+  return secs * ns_per_second + frac_ns;
+}
+
+static bool read_digits(const char **p, const char *end, int n, int *out) {
+  int v = 0;
+  for (int i = 0; i < n; i++, (*p)++) {
+    if (*p >= end || **p < '0' || **p > '9')
+      return false;
+    v = v * 10 + (**p - '0');
+  }
+  *out = v;
+  return true;
+}
+
+static bool read_char(const char **p, const char *end, char c) {
+  if (*p >= end || **p != c)
+    return false;
+  (*p)++;
+  return true;
+}
+
+static int days_in_month(int y, int m) {
+  static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (m == 2 && (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)))
+    return 29;
+  return days[m - 1];
+}
+
+time_ns certifier::utilities::time_ns_now() {
+  struct timespec ts;
+#ifdef CLOCK_REALTIME_COARSE
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+  clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+  return seconds_to_time_ns(ts.tv_sec, ts.tv_nsec);
+}
+
+bool certifier::utilities::string_to_time_ns(const string &s, time_ns *t) {
+  const char *p = s.data();
+  const char *end = p + s.size();
+  int         y, mo, d, h, mi, sec;
+
+  if (!read_digits(&p, end, 4, &y) || !read_char(&p, end, '-')
+      || !read_digits(&p, end, 2, &mo) || !read_char(&p, end, '-')
+      || !read_digits(&p, end, 2, &d))
+    return false;
+  if (p >= end || (*p != 'T' && *p != 't' && *p != ' '))
+    return false;
+  p++;
+  if (!read_digits(&p, end, 2, &h) || !read_char(&p, end, ':')
+      || !read_digits(&p, end, 2, &mi) || !read_char(&p, end, ':'))
+    return false;
+
+  // time_to_string pads seconds with a space, not a 0.
+  while (p < end && *p == ' ')
+    p++;
+  if (!read_digits(&p, end, 1, &sec))
+    return false;
+  if (p < end && *p >= '0' && *p <= '9')
+    sec = sec * 10 + (*p++ - '0');
+
+  int64_t frac = 0;
+  if (p < end && *p == '.') {
+    p++;
+    int n = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (n < 9) {
+        frac = frac * 10 + (*p - '0');
+        n++;
+      }
+      p++;
+    }
+    if (n == 0)
+      return false;
+    for (; n < 9; n++)
+      frac *= 10;
+  }
+
+  int64_t offset = 0;
+  if (p < end && (*p == 'Z' || *p == 'z')) {
+    p++;
+  } else if (p < end && (*p == '+' || *p == '-')) {
+    int sign = *p++ == '-' ? -1 : 1;
+    int oh, om;
+    if (!read_digits(&p, end, 2, &oh) || !read_char(&p, end, ':')
+        || !read_digits(&p, end, 2, &om) || oh > 23 || om > 59)
+      return false;
+    offset = sign * (oh * 3600 + om * 60);
+  } else {
+    return false;
+  }
+  if (p != end)
+    return false;
+
+  if (mo < 1 || mo > 12 || d < 1 || d > days_in_month(y, mo) || h > 23
+      || mi > 59 || sec > 60)
+    return false;
+
+  int64_t secs = days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec
+                 - offset;
+  *t = seconds_to_time_ns(secs, frac);
+  return true;
+}
+
+static char *write_digits(char *p, int64_t v, int n) {
+  for (int i = n - 1; i >= 0; i--) {
+    p[i] = (char)('0' + v % 10);
+    v /= 10;
+  }
+  return p + n;
+}
+
+// YYYY-MM-DDTHH:mm:ss[.fffffffff]Z, without trailing zeros in the
+// fraction.
+bool certifier::utilities::time_ns_to_string(time_ns t, string *s) {
+  int64_t secs = t / ns_per_second;
+  int64_t frac = t % ns_per_second;
+  if (frac < 0) {
+    frac += ns_per_second;
+    secs--;
+  }
+  int64_t days = secs / 86400;
+  int64_t rem = secs % 86400;
+  if (rem < 0) {
+    rem += 86400;
+    days--;
+  }
+  int64_t y;
+  int     m, d;
+  civil_from_days(days, &y, &m, &d);
+  if (y < 0 || y > 9999)
+    return false;
+
+  char  buf[40];
+  char *p = buf;
+  p = write_digits(p, y, 4);
+  *p++ = '-';
+  p = write_digits(p, m, 2);
+  *p++ = '-';
+  p = write_digits(p, d, 2);
+  *p++ = 'T';
+  p = write_digits(p, rem / 3600, 2);
+  *p++ = ':';
+  p = write_digits(p, (rem / 60) % 60, 2);
+  *p++ = ':';
+  p = write_digits(p, rem % 60, 2);
+  if (frac != 0) {
+    *p++ = '.';
+    int n = 9;
+    while (frac % 10 == 0) {
+      frac /= 10;
+      n--;
+    }
+    p = write_digits(p, frac, n);
+  }
+  *p++ = 'Z';
+  s->assign(buf, p - buf);
+  return true;
+}
+
+bool certifier::utilities::time_point_to_time_ns(const time_point &tp,
+                                                 time_ns          *t) {
+  if (tp.month() < 1 || tp.month() > 12 || tp.seconds() < 0.0)
+    return false;
+  int64_t whole = (int64_t)tp.seconds();
+  int64_t frac = (int64_t)((tp.seconds() - (double)whole) * 1.0e9);
+  int64_t secs = days_from_civil(tp.year(), tp.month(), tp.day()) * 86400
+                 + tp.hour() * 3600 + tp.minute() * 60 + whole;
+  *t = seconds_to_time_ns(secs, frac);
+  return true;
+}
+
+#ifndef NO_REQUEST_CLOCK
+static thread_local request_clock *innermost_request_clock = nullptr;
+
+request_clock::request_clock()
+    : now_(time_ns_now()),
+      outer_(innermost_request_clock) {
+  innermost_request_clock = this;
+}
+
+request_clock::~request_clock() {
+  innermost_request_clock = outer_;
+}
+
+request_clock *request_clock::current() {
+  return innermost_request_clock;
+}
+#else
+request_clock::request_clock() : now_(time_ns_now()), outer_(nullptr) {}
+
+request_clock::~request_clock() {}
+
+request_clock *request_clock::current() {
+  return nullptr;
+}
+#endif  // NO_REQUEST_CLOCK
+
+bool request_clock::parse(const string &s, time_ns *t) {
+  std::unordered_map<string, time_ns>::const_iterator it = parsed_.find(s);
+  if (it != parsed_.end()) {
+    *t = it->second;
+    return true;
+  }
+  if (!string_to_time_ns(s, t))
+    return false;
+  parsed_[s] = *t;
+  return true;
+}
+
+bool request_clock::in_range(const string &nb, const string &na) {
+  time_ns t_nb, t_na;
+  if (!parse(nb, &t_nb) || !parse(na, &t_na))
+    return false;
+  return t_nb <= now_ && now_ <= t_na;
+}
+
 bool certifier::utilities::add_interval_to_time_point(time_point &t_in,
                                                       double      hours,
                                                       time_point *t_out) {
@@ -2333,68 +2603,227 @@ bool make_certifier_ecc_key(int n, key_message *k) {
 
 // -----------------------------------------------------------------------
 
-bool certifier::utilities::get_random(int num_bits, byte *out) {
-  bool ret = true;
-  int  k = 0;
-  int  n = ((num_bits + num_bits_in_byte - 1) / num_bits_in_byte);
-
-  int in = open("/dev/random", O_RDONLY, 0644);
+bool get_seed_bytes(int n, byte *out) {
+  int k = 0;
+#ifdef HAVE_GETRANDOM
   while (k < n) {
-    int m = read(in, out + k, n - k);
+    ssize_t m = getrandom(out + k, n - k, 0);
     if (m < 0) {
-      ret = false;
+      if (errno == EINTR)
+        continue;
       break;
     }
     k += m;
   }
+  if (k >= n)
+    return true;
+#endif
+
+  // No getrandom (ENOSYS, or an old libc)
+  int in = open("/dev/urandom", O_RDONLY);
+  if (in < 0) {
+    printf("%s() error, line: %d, can't open /dev/urandom\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  while (k < n) {
+    int m = read(in, out + k, n - k);
+    if (m < 0 && errno == EINTR)
+      continue;
+    if (m <= 0) {
+      printf("%s() error, line: %d, read failed\n", __func__, __LINE__);
+      close(in);
+      return false;
+    }
+    k += m;
+  }
   close(in);
-  return ret;
+  return true;
 }
 
-// may want to check leading 0's
-bool same_point(const point_message &pt1, const point_message &pt2) {
-  if (pt1.x().size() != pt2.x().size()) {
-    return false;
+#ifndef NO_RANDOM_POOL
+// Bumped in every forked child, so a child never hands out bytes its
+// parent, or another child, also has.
+static std::atomic<int> random_fork_generation(0);
+static pthread_once_t   random_atfork_once = PTHREAD_ONCE_INIT;
+
+static void random_after_fork() {
+  random_fork_generation++;
+}
+
+static void register_random_atfork() {
+  pthread_atfork(nullptr, nullptr, random_after_fork);
+}
+
+const int random_key_size = 32;
+
+class random_pool {
+ public:
+  EVP_CIPHER_CTX *ctx_;
+  byte            key_[random_key_size];
+  byte            buf_[random_pool_size];
+  int             used_;
+  int             since_seed_;
+  int             generation_;
+  int             seedings_;
+
+  random_pool()
+      : ctx_(nullptr),
+        used_(random_pool_size),
+        since_seed_(0),
+        generation_(0),
+        seedings_(0) {
+    memset(key_, 0, random_key_size);
+  }
+  ~random_pool() {
+    OPENSSL_cleanse(key_, random_key_size);
+    OPENSSL_cleanse(buf_, random_pool_size);
+    if (ctx_ != nullptr)
+      EVP_CIPHER_CTX_free(ctx_);
+  }
+
+  // The seed is xored into the key rather than replacing it, so a weak
+  // seed can't make the generator worse than it was.
+  bool seed() {
+    byte fresh[random_key_size];
+    if (!get_seed_bytes(random_key_size, fresh))
+      return false;
+    for (int i = 0; i < random_key_size; i++)
+      key_[i] ^= fresh[i];
+    OPENSSL_cleanse(fresh, random_key_size);
+    OPENSSL_cleanse(buf_, random_pool_size);
+    used_ = random_pool_size;
+    since_seed_ = 0;
+    generation_ = random_fork_generation.load();
+    seedings_++;
+    return true;
   }
-  if (pt1.y().size() != pt2.y().size()) {
-    return false;
+
+  // Runs the key in counter mode for a new key and a buffer of output;
+  // the old key is gone once this returns.
+  bool refill() {
+    if (ctx_ == nullptr && (ctx_ = EVP_CIPHER_CTX_new()) == nullptr)
+      return false;
+    byte iv[block_size];
+    byte next_key[random_key_size];
+    int  len = 0;
+    memset(iv, 0, block_size);
+    memset(next_key, 0, random_key_size);
+    memset(buf_, 0, random_pool_size);
+    if (EVP_EncryptInit_ex(ctx_, EVP_aes_256_ctr(), nullptr, key_, iv) != 1
+        || EVP_EncryptUpdate(ctx_, next_key, &len, next_key, random_key_size)
+               != 1
+        || EVP_EncryptUpdate(ctx_, buf_, &len, buf_, random_pool_size) != 1) {
+      printf("%s() error, line: %d, can't run generator\n",
+             __func__,
+             __LINE__);
+      return false;
+    }
+    memcpy(key_, next_key, random_key_size);
+    OPENSSL_cleanse(next_key, random_key_size);
+    used_ = 0;
+    return true;
   }
-  if (memcmp(pt1.x().data(), pt1.x().data(), pt1.x().size()) != 0) {
-    return false;
+
+  bool get(int n, byte *out) {
+    if (seedings_ == 0 || generation_ != random_fork_generation.load()
+        || since_seed_ >= random_reseed_interval) {
+      if (!seed())
+        return false;
+    }
+    while (n > 0) {
+      if (used_ >= random_pool_size && !refill())
+        return false;
+      int m = random_pool_size - used_;
+      if (m > n)
+        m = n;
+      memcpy(out, buf_ + used_, m);
+      // Bytes handed out aren't kept.
+      memset(buf_ + used_, 0, m);
+      used_ += m;
+      since_seed_ += m;
+      out += m;
+      n -= m;
+    }
+    return true;
   }
-  if (memcmp(pt1.y().data(), pt1.y().data(), pt1.y().size()) != 0) {
+};
+
+static thread_local random_pool the_random_pool;
+#endif
+
+bool certifier::utilities::get_random(int num_bits, byte *out) {
+  if (num_bits < 0)
     return false;
-  }
-  return true;
+  int n = ((num_bits + num_bits_in_byte - 1) / num_bits_in_byte);
+#ifndef NO_RANDOM_POOL
+  pthread_once(&random_atfork_once, register_random_atfork);
+  return the_random_pool.get(n, out);
+#else
+  return get_seed_bytes(n, out);
+#endif
+}
+
+int num_random_seedings() {
+#ifndef NO_RANDOM_POOL
+  return the_random_pool.seedings_;
+#else
+  return 0;
+#endif
 }
 
+// Big-endian values compare equal whatever their leading zeros.
+static bool same_value(const string &a, const string &b) {
+  size_t i = 0, j = 0;
+  while (i < a.size() && a[i] == 0)
+    i++;
+  while (j < b.size() && b[j] == 0)
+    j++;
+  return a.size() - i == b.size() - j
+         && memcmp(a.data() + i, b.data() + j, a.size() - i) == 0;
+}
+
+bool same_point(const point_message &pt1, const point_message &pt2) {
+  return same_value(pt1.x(), pt2.x()) && same_value(pt1.y(), pt2.y());
+}
+
+static bool is_rsa_key_type(const string &t) {
+  return t == Enc_method_rsa_2048_private || t == Enc_method_rsa_2048_public
+         || t == Enc_method_rsa_1024_private || t == Enc_method_rsa_1024_public
+         || t == Enc_method_rsa_3072_private || t == Enc_method_rsa_3072_public
+         || t == Enc_method_rsa_4096_private || t == Enc_method_rsa_4096_public;
+}
+
+static bool is_ecc_key_type(const string &t) {
+  return t == Enc_method_ecc_384_public || t == Enc_method_ecc_384_private
+         || t == Enc_method_ecc_256_public || t == Enc_method_ecc_256_private;
+}
+
+static bool is_symmetric_key_type(const string &t) {
+  return t == Enc_method_aes_256_cbc_hmac_sha256 || t == Enc_method_aes_256_cbc
+         || t == Enc_method_aes_256;
+}
+
+// Compares the canonical values directly, which is far cheaper than
+// fingerprinting either key (see BM_same_key and BM_key_fingerprint).
+// So one-off comparisons (same_entity, init_policy, the verify_rule_*
+// checks and policy_index::built_from) use this, and key_fingerprint is
+// kept for indexes that hash each key once and look it up many times.
 bool same_key(const key_message &k1, const key_message &k2) {
   if (k1.key_type() != k2.key_type()) {
     return false;
   }
 
-  if (k1.key_type() == Enc_method_rsa_2048_private
-      || k1.key_type() == Enc_method_rsa_2048_public
-      || k1.key_type() == Enc_method_rsa_1024_private
-      || k1.key_type() == Enc_method_rsa_1024_public
-      || k1.key_type() == Enc_method_rsa_3072_private
-      || k1.key_type() == Enc_method_rsa_3072_public
-      || k1.key_type() == Enc_method_rsa_4096_private
-      || k1.key_type() == Enc_method_rsa_4096_public) {
-    string b1, b2;
+  if (is_rsa_key_type(k1.key_type())) {
     if (!k1.has_rsa_key() || !k2.has_rsa_key()) {
       return false;
     }
-    if (k1.rsa_key().public_modulus() != k2.rsa_key().public_modulus()) {
-      return false;
-    }
-    if (k1.rsa_key().public_exponent() != k2.rsa_key().public_exponent()) {
-      return false;
-    }
-    return true;
-  } else if (k1.key_type() == Enc_method_aes_256_cbc_hmac_sha256
-             || k1.key_type() == Enc_method_aes_256_cbc
-             || k1.key_type() == Enc_method_aes_256) {
+    return same_value(k1.rsa_key().public_modulus(),
+                      k2.rsa_key().public_modulus())
+           && same_value(k1.rsa_key().public_exponent(),
+                         k2.rsa_key().public_exponent());
+  } else if (is_symmetric_key_type(k1.key_type())) {
     if (!k1.has_secret_key_bits()) {
       printf("%s() error, line: %d, no secret key bits\n", __func__, __LINE__);
       return false;
@@ -2409,77 +2838,84 @@ bool same_key(const key_message &k1, const key_message &k2) {
                    k2.secret_key_bits().data(),
                    k1.secret_key_bits().size())
             == 0);
-  } else if (k1.key_type() == Enc_method_ecc_384_public
-             || k1.key_type() == Enc_method_ecc_384_private) {
+  } else if (is_ecc_key_type(k1.key_type())) {
     const ecc_message &em1 = k1.ecc_key();
     const ecc_message &em2 = k2.ecc_key();
-    if (em1.curve_p().size() != em2.curve_p().size()
-        || memcmp(em1.curve_p().data(),
-                  em2.curve_p().data(),
-                  em1.curve_p().size())
-               != 0) {
-      return false;
-    }
-    if (em1.curve_a().size() != em2.curve_a().size()
-        || memcmp(em1.curve_a().data(),
-                  em1.curve_a().data(),
-                  em2.curve_a().size())
-               != 0) {
-      return false;
-    }
-    if (em1.curve_b().size() != em2.curve_b().size()
-        || memcmp(em1.curve_b().data(),
-                  em1.curve_b().data(),
-                  em2.curve_b().size())
-               != 0) {
-      return false;
-    }
-    if (!same_point(em1.base_point(), em2.base_point())) {
-      return false;
-    }
-    if (!same_point(em1.public_point(), em2.public_point())) {
-      return false;
-    }
-    return true;
-  } else if (k1.key_type() == Enc_method_ecc_256_public
-             || k1.key_type() == Enc_method_ecc_256_private) {
-    const ecc_message &em1 = k1.ecc_key();
-    const ecc_message &em2 = k2.ecc_key();
-    if (em1.curve_p().size() != em2.curve_p().size()
-        || memcmp(em1.curve_p().data(),
-                  em2.curve_p().data(),
-                  em1.curve_p().size())
-               != 0) {
-      return false;
-    }
-    if (em1.curve_a().size() != em2.curve_a().size()
-        || memcmp(em1.curve_a().data(),
-                  em1.curve_a().data(),
-                  em2.curve_a().size())
-               != 0) {
-      return false;
-    }
-    if (em1.curve_b().size() != em2.curve_b().size()
-        || memcmp(em1.curve_b().data(),
-                  em1.curve_b().data(),
-                  em2.curve_b().size())
-               != 0) {
-      return false;
-    }
-    if (!same_point(em1.base_point(), em2.base_point())) {
+    return same_value(em1.curve_p(), em2.curve_p())
+           && same_value(em1.curve_a(), em2.curve_a())
+           && same_value(em1.curve_b(), em2.curve_b())
+           && same_point(em1.base_point(), em2.base_point())
+           && same_point(em1.public_point(), em2.public_point());
+  } else {
+    printf("%s() error, line: %d, baad ecc type\n", __func__, __LINE__);
+    return false;
+  }
+  return true;
+}
+
+// Each value as a 4 byte length and the value without leading zeros.
+static void append_canonical_value(const string &v, bool strip, string *out) {
+  size_t i = 0;
+  while (strip && i < v.size() && v[i] == 0)
+    i++;
+  byte len[4];
+  encode_frame_size((int)(v.size() - i), len);
+  out->append((const char *)len, sizeof(len));
+  out->append(v, i, string::npos);
+}
+
+// The key type and the values same_key compares, so two keys have the
+// same fingerprint just when same_key says they're the same.
+static bool canonical_key(const key_message &k, string *out) {
+  out->clear();
+  append_canonical_value(k.key_type(), false, out);
+  if (is_rsa_key_type(k.key_type())) {
+    if (!k.has_rsa_key())
       return false;
-    }
-    if (!same_point(em1.public_point(), em2.public_point())) {
+    append_canonical_value(k.rsa_key().public_modulus(), true, out);
+    append_canonical_value(k.rsa_key().public_exponent(), true, out);
+  } else if (is_ecc_key_type(k.key_type())) {
+    const ecc_message &em = k.ecc_key();
+    append_canonical_value(em.curve_p(), true, out);
+    append_canonical_value(em.curve_a(), true, out);
+    append_canonical_value(em.curve_b(), true, out);
+    append_canonical_value(em.base_point().x(), true, out);
+    append_canonical_value(em.base_point().y(), true, out);
+    append_canonical_value(em.public_point().x(), true, out);
+    append_canonical_value(em.public_point().y(), true, out);
+  } else if (is_symmetric_key_type(k.key_type())) {
+    if (!k.has_secret_key_bits())
       return false;
-    }
-    return true;
+    append_canonical_value(k.secret_key_bits(), false, out);
   } else {
-    printf("%s() error, line: %d, baad ecc type\n", __func__, __LINE__);
     return false;
   }
   return true;
 }
 
+bool key_fingerprint(const key_message &k, string *fp) {
+  string       canonical;
+  byte         digest[SHA256_DIGEST_LENGTH];
+  unsigned int len = sizeof(digest);
+  if (!canonical_key(k, &canonical)) {
+    printf("%s() error, line: %d, unsupported key type %s\n",
+           __func__,
+           __LINE__,
+           k.key_type().c_str());
+    return false;
+  }
+  if (EVP_Digest(canonical.data(),
+                 canonical.size(),
+                 digest,
+                 &len,
+                 EVP_sha256(),
+                 nullptr)
+      != 1)
+    return false;
+  fp->assign((const char *)digest, len);
+  return true;
+}
+
 bool same_measurement(const string &m1, const string &m2) {
   if (m1.size() != m2.size())
     return false;
@@ -3079,12 +3515,20 @@ bool make_signed_claim(const char           *alg,
     }
 
     sig_size = RSA_size(r);
-    byte sig[sig_size];
+    scratch_buffer sig(sig_size);
+    if (sig.data() == nullptr) {
+      printf("%s() error, line: %d, make_signed_claim: can't allocate "
+             "signature buffer\n",
+             __func__,
+             __LINE__);
+      RSA_free(r);
+      return false;
+    }
     success = rsa_sha256_sign(r,
                               serialized_claim.size(),
                               (byte *)serialized_claim.data(),
                               &sig_size,
-                              sig);
+                              sig.data());
     RSA_free(r);
 
     // sign serialized claim
@@ -3098,7 +3542,7 @@ bool make_signed_claim(const char           *alg,
     }
     out->set_allocated_signing_key(psk);
     out->set_signing_algorithm(alg);
-    out->set_signature((void *)sig, sig_size);
+    out->set_signature((void *)sig.data(), sig_size);
   } else if (strcmp(alg, Enc_method_rsa_3072_sha384_pkcs_sign) == 0) {
     RSA *r = RSA_new();
     if (!key_to_RSA(key, r)) {
@@ -3109,13 +3553,21 @@ bool make_signed_claim(const char           *alg,
     }
 
     sig_size = RSA_size(r);
-    byte sig[sig_size];
+    scratch_buffer sig(sig_size);
+    if (sig.data() == nullptr) {
+      printf("%s() error, line: %d, make_signed_claim: can't allocate "
+             "signature buffer\n",
+             __func__,
+             __LINE__);
+      RSA_free(r);
+      return false;
+    }
     success = rsa_sign(Digest_method_sha_384,
                        r,
                        serialized_claim.size(),
                        (byte *)serialized_claim.data(),
                        &sig_size,
-                       sig);
+                       sig.data());
     if (!success) {
       printf("%s() error, line: %d, make_signed_claim: rsa_sign failed\n",
              __func__,
@@ -3132,7 +3584,7 @@ bool make_signed_claim(const char           *alg,
     }
     out->set_allocated_signing_key(psk);
     out->set_signing_algorithm(alg);
-    out->set_signature((void *)sig, sig_size);
+    out->set_signature((void *)sig.data(), sig_size);
   } else if (strcmp(alg, Enc_method_rsa_4096_sha384_pkcs_sign) == 0) {
     RSA *r = RSA_new();
     if (!key_to_RSA(key, r)) {
@@ -3143,13 +3595,21 @@ bool make_signed_claim(const char           *alg,
     }
 
     sig_size = RSA_size(r);
-    byte sig[sig_size];
+    scratch_buffer sig(sig_size);
+    if (sig.data() == nullptr) {
+      printf("%s() error, line: %d, make_signed_claim: can't allocate "
+             "signature buffer\n",
+             __func__,
+             __LINE__);
+      RSA_free(r);
+      return false;
+    }
     success = rsa_sign(Digest_method_sha_384,
                        r,
                        serialized_claim.size(),
                        (byte *)serialized_claim.data(),
                        &sig_size,
-                       sig);
+                       sig.data());
     if (!success) {
       printf("%s() error, line: %d, make_signed_claim: rsa_sign failed\n",
              __func__,
@@ -3168,7 +3628,7 @@ bool make_signed_claim(const char           *alg,
     }
     out->set_allocated_signing_key(psk);
     out->set_signing_algorithm(alg);
-    out->set_signature((void *)sig, sig_size);
+    out->set_signature((void *)sig.data(), sig_size);
   } else if (strcmp(alg, Enc_method_ecc_384_sha384_pkcs_sign) == 0) {
     EC_KEY *k = key_to_ECC(key);
     if (k == nullptr) {
@@ -3178,14 +3638,22 @@ bool make_signed_claim(const char           *alg,
       return false;
     }
     sig_size = 2 * ECDSA_size(k);
-    byte sig[sig_size];
+    scratch_buffer sig(sig_size);
+    if (sig.data() == nullptr) {
+      printf("%s() error, line: %d, make_signed_claim: can't allocate "
+             "signature buffer\n",
+             __func__,
+             __LINE__);
+      EC_KEY_free(k);
+      return false;
+    }
 
     success = ecc_sign(Digest_method_sha_384,
                        k,
                        serialized_claim.size(),
                        (byte *)serialized_claim.data(),
                        &sig_size,
-                       sig);
+                       sig.data());
     EC_KEY_free(k);
 
     // sign serialized claim
@@ -3198,7 +3666,7 @@ bool make_signed_claim(const char           *alg,
       return false;
     }
     out->set_allocated_signing_key(psk);
-    out->set_signature((void *)sig, sig_size);
+    out->set_signature((void *)sig.data(), sig_size);
   } else if (strcmp(alg, Enc_method_ecc_256_sha256_pkcs_sign) == 0) {
     EC_KEY *k = key_to_ECC(key);
     if (k == nullptr) {
@@ -3208,14 +3676,22 @@ bool make_signed_claim(const char           *alg,
       return false;
     }
     sig_size = 2 * ECDSA_size(k);
-    byte sig[sig_size];
+    scratch_buffer sig(sig_size);
+    if (sig.data() == nullptr) {
+      printf("%s() error, line: %d, make_signed_claim: can't allocate "
+             "signature buffer\n",
+             __func__,
+             __LINE__);
+      EC_KEY_free(k);
+      return false;
+    }
 
     success = ecc_sign(Digest_method_sha_256,
                        k,
                        serialized_claim.size(),
                        (byte *)serialized_claim.data(),
                        &sig_size,
-                       sig);
+                       sig.data());
     EC_KEY_free(k);
 
     // sign serialized claim
@@ -3223,7 +3699,7 @@ bool make_signed_claim(const char           *alg,
     if (!private_key_to_public_key(key, psk))
       return false;
     out->set_allocated_signing_key(psk);
-    out->set_signature((void *)sig, sig_size);
+    out->set_signature((void *)sig.data(), sig_size);
   } else {
     return false;
   }
@@ -3287,37 +3763,8 @@ bool verify_signed_claim(const signed_claim_message &signed_claim,
     return false;
   }
 
-  time_point t_now;
-  time_point t_nb;
-  time_point t_na;
-
-  if (!time_now(&t_now)) {
-    printf("%s() error, line: %d, verify_signed_claim: time_now failed\n",
-           __func__,
-           __LINE__);
-    return false;
-  }
-  if (!string_to_time(c.not_before(), &t_nb)) {
-    printf("%s() error, line: %d, verify_signed_claim: string_to_time failed\n",
-           __func__,
-           __LINE__);
-    return false;
-  }
-  if (!string_to_time(c.not_after(), &t_na)) {
-    printf("%s() error, line: %d, verify_signed_claim: string_to_time failed\n",
-           __func__,
-           __LINE__);
-    return false;
-  }
-
-  if (compare_time(t_now, t_nb) < 0) {
-    printf("%s() error, line: %d, verify_signed_claim: Bad time compare 1\n",
-           __func__,
-           __LINE__);
-    return false;
-  }
-  if (compare_time(t_na, t_now) < 0) {
-    printf("%s() error, line: %d, verify_signed_claim: Bad time compare 2\n",
+  if (!check_date_range(c.not_before(), c.not_after())) {
+    printf("%s() error, line: %d, verify_signed_claim: claim not valid now\n",
            __func__,
            __LINE__);
     return false;
@@ -3726,67 +4173,281 @@ bool certifier::utilities::produce_artifact(key_message &signing_key,
   return true;
 }
 
-bool certifier::utilities::verify_artifact(X509        &cert,
-                                           key_message &verify_key,
-                                           string      *issuer_name_str,
-                                           string      *issuer_description_str,
-                                           key_message *subject_key,
-                                           string      *subject_name_str,
-                                           string   *subject_organization_str,
-                                           uint64_t *sn) {
+certifier::utilities::admission_cert_issuer::admission_cert_issuer()
+    : signing_pkey_(nullptr),
+      digest_(nullptr),
+      issuer_name_(nullptr),
+      secs_duration_(0.0),
+      num_threads_(1) {}
+
+certifier::utilities::admission_cert_issuer::~admission_cert_issuer() {
+  EVP_PKEY_free(signing_pkey_);
+  X509_NAME_free(issuer_name_);
+  for (X509_EXTENSION *ex : extensions_)
+    X509_EXTENSION_free(ex);
+}
 
-  bool success = false;
-  if (verify_key.key_type() == Enc_method_rsa_1024_public
-      || verify_key.key_type() == Enc_method_rsa_1024_private
-      || verify_key.key_type() == Enc_method_rsa_2048_public
-      || verify_key.key_type() == Enc_method_rsa_2048_private
-      || verify_key.key_type() == Enc_method_rsa_3072_public
-      || verify_key.key_type() == Enc_method_rsa_3072_private
-      || verify_key.key_type() == Enc_method_rsa_4096_public
-      || verify_key.key_type() == Enc_method_rsa_4096_private) {
-    EVP_PKEY *verify_pkey = EVP_PKEY_new();
-    RSA      *verify_rsa_key = RSA_new();
-    if (!key_to_RSA(verify_key, verify_rsa_key))
-      return false;
-    EVP_PKEY_set1_RSA(verify_pkey, verify_rsa_key);
+// The digest, name and extensions are those produce_artifact uses with
+// is_root false.
+bool certifier::utilities::admission_cert_issuer::init(
+    const key_message &policy_key,
+    const string      &issuer_name,
+    const string      &issuer_organization,
+    double             secs_duration,
+    int                num_threads) {
+  const string &t = policy_key.key_type();
+  if (t == Enc_method_rsa_4096_private || t == Enc_method_ecc_384_private
+      || t == Enc_method_ecc_256_private) {
+    digest_ = EVP_sha384();
+  } else if (t == Enc_method_rsa_1024_private
+             || t == Enc_method_rsa_2048_private
+             || t == Enc_method_rsa_3072_private) {
+    digest_ = EVP_sha256();
+  } else {
+    printf("%s() error, line %d, unsupported policy key type %s\n",
+           __func__,
+           __LINE__,
+           t.c_str());
+    return false;
+  }
 
-    EVP_PKEY *subject_pkey = X509_get_pubkey(&cert);
-    RSA      *subject_rsa_key = EVP_PKEY_get1_RSA(subject_pkey);
-    if (!RSA_to_key(subject_rsa_key, subject_key)) {
-      return false;
-    }
-    success = (X509_verify(&cert, verify_pkey) == 1);
-    RSA_free(verify_rsa_key);
-    RSA_free(subject_rsa_key);
-    EVP_PKEY_free(verify_pkey);
-    EVP_PKEY_free(subject_pkey);
-    // Todo: Make this work
-  } else if (verify_key.key_type() == Enc_method_ecc_384_public
-             || verify_key.key_type() == Enc_method_ecc_384_private
-             || verify_key.key_type() == Enc_method_ecc_256_public
-             || verify_key.key_type() == Enc_method_ecc_256_private) {
-    EVP_PKEY *verify_pkey = EVP_PKEY_new();
-    EC_KEY   *verify_ecc_key = key_to_ECC(verify_key);
-    if (verify_ecc_key == nullptr) {
-      return false;
-    }
-    EVP_PKEY_set1_EC_KEY(verify_pkey, verify_ecc_key);
+  EVP_PKEY_free(signing_pkey_);
+  signing_pkey_ = pkey_from_key(policy_key);
+  if (signing_pkey_ == nullptr) {
+    printf("%s() error, line %d, can't convert policy key\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
 
-    EVP_PKEY *subject_pkey = X509_get_pubkey(&cert);
-    EC_KEY   *subject_ecc_key = EVP_PKEY_get1_EC_KEY(subject_pkey);
-    if (!ECC_to_key(subject_ecc_key, subject_key)) {
-      return false;
-    }
-    success = (X509_verify(&cert, verify_pkey) == 1);
-    EC_KEY_free(verify_ecc_key);
-    EC_KEY_free(subject_ecc_key);
-    EVP_PKEY_free(verify_pkey);
-    EVP_PKEY_free(subject_pkey);
-  } else {
-    printf("%s() error, line: %d, Unsupported key type\n", __func__, __LINE__);
+  X509_NAME_free(issuer_name_);
+  issuer_name_ = X509_NAME_new();
+  if (issuer_name_ == nullptr
+      || !X509_NAME_add_entry_by_txt(issuer_name_,
+                                     "CN",
+                                     MBSTRING_ASC,
+                                     (const byte *)issuer_name.c_str(),
+                                     -1,
+                                     -1,
+                                     0)
+      || !X509_NAME_add_entry_by_txt(issuer_name_,
+                                     "O",
+                                     MBSTRING_ASC,
+                                     (const byte *)issuer_organization.c_str(),
+                                     -1,
+                                     -1,
+                                     0)) {
+    printf("%s() error, line %d, can't make issuer name\n", __func__, __LINE__);
     return false;
   }
 
+  for (X509_EXTENSION *ex : extensions_)
+    X509_EXTENSION_free(ex);
+  extensions_.clear();
+  X509V3_CTX ctx;
+  X509V3_set_ctx_nodb(&ctx);
+  X509V3_set_ctx(&ctx, nullptr, nullptr, nullptr, nullptr, 0);
+  X509_EXTENSION *key_usage = X509V3_EXT_nconf_nid(
+      nullptr,
+      &ctx,
+      NID_key_usage,
+      "critical,keyCertSign,digitalSignature,cRLSign");
+  X509_EXTENSION *ext_key_usage = X509V3_EXT_nconf_nid(nullptr,
+                                                       &ctx,
+                                                       NID_ext_key_usage,
+                                                       "clientAuth,serverAuth");
+  if (key_usage != nullptr)
+    extensions_.push_back(key_usage);
+  if (ext_key_usage != nullptr)
+    extensions_.push_back(ext_key_usage);
+  if (key_usage == nullptr || ext_key_usage == nullptr) {
+    printf("%s() error, line %d, can't make extensions\n", __func__, __LINE__);
+    return false;
+  }
+
+  secs_duration_ = secs_duration;
+#ifdef OE_CERTIFIER
+  num_threads = 1;
+#else
+  if (num_threads <= 0)
+    num_threads = (int)std::thread::hardware_concurrency();
+#endif
+  num_threads_ = num_threads > 0 ? num_threads : 1;
+  return true;
+}
+
+// ctx is set from sign_ctx, which has been initialized with the signing
+// key, so the key and digest are only looked up once per thread.
+bool certifier::utilities::admission_cert_issuer::issue(
+    const admission_request &req,
+    const ASN1_TIME         *not_before,
+    const ASN1_TIME         *not_after,
+    EVP_MD_CTX              *sign_ctx,
+    EVP_MD_CTX              *ctx,
+    string                  *der) {
+  bool       ret = false;
+  X509      *x = X509_new();
+  X509_NAME *subject_name = X509_NAME_new();
+  EVP_PKEY  *subject_pkey = pkey_from_key(req.subject_key);
+  if (x == nullptr || subject_name == nullptr || subject_pkey == nullptr) {
+    printf("%s() error, line %d, can't make certificate for %s\n",
+           __func__,
+           __LINE__,
+           req.subject_name.c_str());
+    goto done;
+  }
+
+  if (!X509_set_version(x, 2L)
+      || !ASN1_INTEGER_set_uint64(X509_get_serialNumber(x), req.sn)
+      || !X509_NAME_add_entry_by_txt(subject_name,
+                                     "CN",
+                                     MBSTRING_ASC,
+                                     (const byte *)req.subject_name.c_str(),
+                                     -1,
+                                     -1,
+                                     0)
+      || !X509_NAME_add_entry_by_txt(
+          subject_name,
+          "O",
+          MBSTRING_ASC,
+          (const byte *)req.subject_organization.c_str(),
+          -1,
+          -1,
+          0)
+      || !X509_set_subject_name(x, subject_name)
+      || !X509_set_issuer_name(x, issuer_name_)
+      || !X509_set1_notBefore(x, not_before)
+      || !X509_set1_notAfter(x, not_after)
+      || !X509_set_pubkey(x, subject_pkey)) {
+    printf("%s() error, line %d, can't fill in certificate\n",
+           __func__,
+           __LINE__);
+    goto done;
+  }
+  for (X509_EXTENSION *ex : extensions_) {
+    if (!X509_add_ext(x, ex, -1)) {
+      printf("%s() error, line %d, can't add extension\n", __func__, __LINE__);
+      goto done;
+    }
+  }
+
+  if (!EVP_MD_CTX_copy_ex(ctx, sign_ctx) || X509_sign_ctx(x, ctx) <= 0) {
+    printf("%s() error, line %d, can't sign certificate\n", __func__, __LINE__);
+    goto done;
+  }
+  ret = x509_to_asn1(x, der);
+
+done:
+  EVP_PKEY_free(subject_pkey);
+  X509_NAME_free(subject_name);
+  X509_free(x);
+  return ret;
+}
+
+bool certifier::utilities::admission_cert_issuer::issue_admission_certs(
+    const std::vector<admission_request> &batch,
+    std::vector<string>                  *certs) {
+  if (signing_pkey_ == nullptr) {
+    printf("%s() error, line %d, issuer not initialized\n", __func__, __LINE__);
+    return false;
+  }
+  certs->assign(batch.size(), string());
+  if (batch.empty())
+    return true;
+
+  time_t     t_start = time(NULL);
+  int        offset_day = (int)(secs_duration_ / 86400.0);
+  long       offset_sec = ((long)secs_duration_) - ((long)offset_day * 86400);
+  ASN1_TIME *not_before = ASN1_TIME_set(nullptr, t_start);
+  ASN1_TIME *not_after =
+      ASN1_TIME_adj(nullptr, t_start, offset_day, offset_sec);
+  if (not_before == nullptr || not_after == nullptr) {
+    printf("%s() error, line %d, can't make validity period\n",
+           __func__,
+           __LINE__);
+    ASN1_TIME_free(not_before);
+    ASN1_TIME_free(not_after);
+    return false;
+  }
+
+  int num_threads = num_threads_;
+  if (num_threads > (int)batch.size())
+    num_threads = (int)batch.size();
+
+  std::atomic<int>  next(0);
+  std::atomic<bool> ok(true);
+  auto              worker = [&]() {
+    EVP_MD_CTX *sign_ctx = EVP_MD_CTX_new();
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (sign_ctx == nullptr || ctx == nullptr
+        || EVP_DigestSignInit(sign_ctx,
+                              nullptr,
+                              digest_,
+                              nullptr,
+                              signing_pkey_)
+               <= 0) {
+      printf("%s() error, line %d, can't set up signing\n", __func__, __LINE__);
+      ok = false;
+    }
+    for (int i = next++; ok && i < (int)batch.size(); i = next++) {
+      if (!issue(batch[i], not_before, not_after, sign_ctx, ctx, &(*certs)[i]))
+        ok = false;
+    }
+    EVP_MD_CTX_free(ctx);
+    EVP_MD_CTX_free(sign_ctx);
+  };
+
+#ifndef OE_CERTIFIER
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; i++)
+    threads.push_back(std::thread(worker));
+#endif
+  worker();
+#ifndef OE_CERTIFIER
+  for (std::thread &t : threads)
+    t.join();
+#endif
+
+  ASN1_TIME_free(not_before);
+  ASN1_TIME_free(not_after);
+  return ok;
+}
+
+bool certifier::utilities::verify_artifact(X509        &cert,
+                                           key_message &verify_key,
+                                           string      *issuer_name_str,
+                                           string      *issuer_description_str,
+                                           key_message *subject_key,
+                                           string      *subject_name_str,
+                                           string   *subject_organization_str,
+                                           uint64_t *sn) {
+
+  // The signature check goes through cert_verifier, which keeps the
+  // converted verify key and remembers signatures it has checked.
+  bool      success = false;
+  EVP_PKEY *subject_pkey = X509_get_pubkey(&cert);
+  if (subject_pkey == nullptr)
+    return false;
+  if (is_rsa_key_type(verify_key.key_type())) {
+    RSA *subject_rsa_key = EVP_PKEY_get1_RSA(subject_pkey);
+    success = subject_rsa_key != nullptr
+              && RSA_to_key(subject_rsa_key, subject_key);
+    RSA_free(subject_rsa_key);
+  } else if (is_ecc_key_type(verify_key.key_type())) {
+    EC_KEY *subject_ecc_key = EVP_PKEY_get1_EC_KEY(subject_pkey);
+    success = subject_ecc_key != nullptr
+              && ECC_to_key(subject_ecc_key, subject_key);
+    EC_KEY_free(subject_ecc_key);
+  } else {
+    EVP_PKEY_free(subject_pkey);
+    printf("%s() error, line: %d, Unsupported key type\n", __func__, __LINE__);
+    return false;
+  }
+  EVP_PKEY_free(subject_pkey);
+  if (!success)
+    return false;
+  success = cert_verifier::instance().verify_signature(&cert, verify_key);
+
   // Todo: report other cert values
   X509_NAME *subject_name = X509_get_subject_name(&cert);
   const int  max_buf = 2048;
@@ -3828,128 +4489,505 @@ bool certifier::utilities::x509_to_asn1(X509 *x, string *out) {
 
 // -----------------------------------------------------------------------
 
-//  Blocking read of pipe, socket, SSL connection with
-//  size prefix
+certifier::utilities::cert_verifier::cert_verifier()
+    : num_decodes_(0), num_signature_checks_(0) {}
 
-// little endian only
-const int max_pipe_size = 65536;
-int       sized_pipe_write(int fd, int size, byte *buf) {
-  if (size > max_pipe_size)
-    return -1;
-  if (write(fd, (byte *)&size, sizeof(int)) < (int)sizeof(int))
-    return -1;
-  if (write(fd, buf, size) < size)
-    return -1;
-  return size;
+certifier::utilities::cert_verifier::~cert_verifier() {
+  clear();
 }
 
-// little endian only
-int sized_pipe_read(int fd, string *out) {
-  int size = 0;
-  if (read(fd, (byte *)&size, sizeof(int)) < (int)sizeof(int)) {
-    printf("sized_pipe_read: bad read size \n");
-    return -1;
+// Never destroyed, so it outlives any static that verifies on exit.
+certifier::utilities::cert_verifier &
+certifier::utilities::cert_verifier::instance() {
+  static cert_verifier *verifier = new cert_verifier();
+  return *verifier;
+}
+
+static bool der_digest(const byte *der, int size, string *digest) {
+  byte         md[SHA256_DIGEST_LENGTH];
+  unsigned int len = sizeof(md);
+  if (EVP_Digest(der, size, md, &len, EVP_sha256(), nullptr) != 1)
+    return false;
+  digest->assign((const char *)md, len);
+  return true;
+}
+
+static bool cert_digest(X509 *cert, string *digest) {
+  byte         md[EVP_MAX_MD_SIZE];
+  unsigned int len = 0;
+  if (X509_digest(cert, EVP_sha256(), md, &len) != 1)
+    return false;
+  digest->assign((const char *)md, len);
+  return true;
+}
+
+void certifier::utilities::cert_verifier::clear() {
+  std::lock_guard<std::mutex> l(lock_);
+  for (auto &c : certs_)
+    X509_free(c.second);
+  certs_.clear();
+  for (auto &s : stores_)
+    X509_STORE_free(s.second);
+  stores_.clear();
+  for (auto &k : keys_)
+    EVP_PKEY_free(k.second);
+  keys_.clear();
+  verified_.clear();
+}
+
+X509 *certifier::utilities::cert_verifier::decode(const string &der) {
+  string digest;
+  if (!der_digest((const byte *)der.data(), der.size(), &digest))
+    return nullptr;
+
+  std::lock_guard<std::mutex> l(lock_);
+  std::unordered_map<string, X509 *>::iterator it = certs_.find(digest);
+  if (it != certs_.end()) {
+    X509_up_ref(it->second);
+    return it->second;
   }
-  if (size > max_pipe_size) {
-    printf("%s() error, line: %d, sized_pipe_read: larger than pipe buffer\n",
-           __func__,
-           __LINE__);
-    return -1;
+
+  const byte *p = (const byte *)der.data();
+  X509       *x = d2i_X509(nullptr, &p, der.size());
+  num_decodes_++;
+  if (x == nullptr) {
+    printf("%s() error, line: %d, can't decode cert\n", __func__, __LINE__);
+    return nullptr;
+  }
+  if ((int)certs_.size() >= max_cached) {
+    for (auto &c : certs_)
+      X509_free(c.second);
+    certs_.clear();
   }
+  certs_[digest] = x;
+  X509_up_ref(x);
+  return x;
+}
 
-  byte buf[size];
-  int  cur_size = 0;
-  int  n = 0;
-  while (cur_size < size) {
-    n = read(fd, &buf[cur_size], size - cur_size);
-    if (n < 0) {
-      printf("%s() error, line: %d, sized_pipe_read: read failed\n",
+X509_STORE *certifier::utilities::cert_verifier::store(X509 *root) {
+  string digest;
+  if (root == nullptr || !cert_digest(root, &digest))
+    return nullptr;
+
+  std::lock_guard<std::mutex> l(lock_);
+  std::unordered_map<string, X509_STORE *>::iterator it = stores_.find(digest);
+  if (it != stores_.end()) {
+    X509_STORE_up_ref(it->second);
+    return it->second;
+  }
+
+  X509_STORE *st = X509_STORE_new();
+  if (st == nullptr || X509_STORE_add_cert(st, root) != 1) {
+    printf("%s() error, line: %d, can't make store\n", __func__, __LINE__);
+    X509_STORE_free(st);
+    return nullptr;
+  }
+  if ((int)stores_.size() >= max_cached) {
+    for (auto &s : stores_)
+      X509_STORE_free(s.second);
+    stores_.clear();
+  }
+  stores_[digest] = st;
+  X509_STORE_up_ref(st);
+  return st;
+}
+
+bool certifier::utilities::cert_verifier::verify_chain(
+    X509                      *root,
+    X509                      *leaf,
+    const std::vector<X509 *> &untrusted) {
+  X509_STORE *st = store(root);
+  if (st == nullptr || leaf == nullptr) {
+    X509_STORE_free(st);
+    return false;
+  }
+
+  bool ret = false;
+  STACK_OF(X509) *chain = sk_X509_new_null();
+  X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+  for (X509 *x : untrusted) {
+    if (chain != nullptr && x != nullptr)
+      sk_X509_push(chain, x);
+  }
+  if (chain != nullptr && ctx != nullptr
+      && X509_STORE_CTX_init(ctx, st, leaf, chain) == 1) {
+    ret = X509_verify_cert(ctx) == 1;
+    if (!ret) {
+      printf("%s() error, line: %d, %s\n",
              __func__,
-             __LINE__);
-      return -1;
+             __LINE__,
+             X509_verify_cert_error_string(X509_STORE_CTX_get_error(ctx)));
     }
-    cur_size += n;
   }
 
-  out->clear();
-  out->assign((char *)buf, size);
-  return n;
+  X509_STORE_CTX_free(ctx);
+  sk_X509_free(chain);  // the certs aren't ours
+  X509_STORE_free(st);
+  return ret;
 }
 
-// little endian only
-int sized_ssl_write(SSL *ssl, int size, byte *buf) {
-  if (SSL_write(ssl, (byte *)&size, sizeof(int)) < (int)sizeof(int))
-    return -1;
-  if (SSL_write(ssl, buf, size) < size)
-    return -1;
-  return size;
+// Called with lock_ held; returns a new reference.
+EVP_PKEY *certifier::utilities::cert_verifier::public_key(
+    const key_message &key,
+    const string      &fp) {
+  std::unordered_map<string, EVP_PKEY *>::iterator it = keys_.find(fp);
+  if (it != keys_.end()) {
+    EVP_PKEY_up_ref(it->second);
+    return it->second;
+  }
+
+  EVP_PKEY *pkey = nullptr;
+  if (is_rsa_key_type(key.key_type())) {
+    RSA *r = RSA_new();
+    if (r != nullptr && key_to_RSA(key, r)) {
+      pkey = EVP_PKEY_new();
+      if (pkey != nullptr)
+        EVP_PKEY_set1_RSA(pkey, r);
+    }
+    RSA_free(r);
+  } else if (is_ecc_key_type(key.key_type())) {
+    EC_KEY *ecc = key_to_ECC(key);
+    if (ecc != nullptr) {
+      pkey = EVP_PKEY_new();
+      if (pkey != nullptr)
+        EVP_PKEY_set1_EC_KEY(pkey, ecc);
+    }
+    EC_KEY_free(ecc);
+  }
+  if (pkey == nullptr)
+    return nullptr;
+
+  if ((int)keys_.size() >= max_cached) {
+    for (auto &k : keys_)
+      EVP_PKEY_free(k.second);
+    keys_.clear();
+  }
+  keys_[fp] = pkey;
+  EVP_PKEY_up_ref(pkey);
+  return pkey;
 }
 
-// little endian only
-int sized_ssl_read(SSL *ssl, string *out) {
-  out->clear();
-  int size = 0;
-  int n = SSL_read(ssl, (byte *)&size, sizeof(int));
-  if (n < 0)
-    return n;
+// A signature that verified once always will, so the pair (certificate
+// digest, key fingerprint) is remembered.
+bool certifier::utilities::cert_verifier::verify_signature(
+    X509              *cert,
+    const key_message &key) {
+  string fp, digest;
+  if (cert == nullptr || !key_fingerprint(key, &fp)
+      || !cert_digest(cert, &digest))
+    return false;
+  string id = digest + fp;
+
+  EVP_PKEY *pkey = nullptr;
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    if (verified_.find(id) != verified_.end())
+      return true;
+    pkey = public_key(key, fp);
+    num_signature_checks_++;
+  }
+  if (pkey == nullptr) {
+    printf("%s() error, line: %d, unsupported key type %s\n",
+           __func__,
+           __LINE__,
+           key.key_type().c_str());
+    return false;
+  }
+  bool ok = X509_verify(cert, pkey) == 1;
+  EVP_PKEY_free(pkey);
+  if (!ok)
+    return false;
+
+  std::lock_guard<std::mutex> l(lock_);
+  if ((int)verified_.size() >= max_cached)
+    verified_.clear();
+  verified_.insert(id);
+  return true;
+}
 
-  int       total = 0;
-  const int read_stride = 8192;
-  byte      buf[read_stride];
+// -----------------------------------------------------------------------
+
+//  Blocking read of pipe, socket, SSL connection with
+//  size prefix.  A frame is a 4 byte little-endian size followed
+//  by that many bytes; frames larger than get_max_frame_size() are
+//  rejected by readers and writers alike.
+
+static int max_frame_size = default_max_frame_size;
+
+void set_max_frame_size(int size) {
+  if (size > 0)
+    max_frame_size = size;
+}
+
+int get_max_frame_size() {
+  return max_frame_size;
+}
+
+void encode_frame_size(int size, byte *hdr) {
+  uint32_t n = (uint32_t)size;
+  hdr[0] = (byte)(n & 0xff);
+  hdr[1] = (byte)((n >> 8) & 0xff);
+  hdr[2] = (byte)((n >> 16) & 0xff);
+  hdr[3] = (byte)((n >> 24) & 0xff);
+}
+
+int decode_frame_size(const byte *hdr) {
+  uint32_t n = ((uint32_t)hdr[0]) | (((uint32_t)hdr[1]) << 8)
+               | (((uint32_t)hdr[2]) << 16) | (((uint32_t)hdr[3]) << 24);
+  return (int)n;
+}
 
+static bool frame_size_ok(int size) {
+  return size >= 0 && size <= max_frame_size;
+}
+
+// Short reads and EINTR are retried; end of file is an error.
+static bool read_full(int fd, byte *buf, int size) {
+  int total = 0;
   while (total < size) {
-    if ((size - total) > read_stride)
-      n = SSL_read(ssl, buf, read_stride);
-    else
-      n = SSL_read(ssl, buf, size - total);
-    if (n < 0) {
-      return n;
-    } else {
-      out->append((char *)buf, n);
-      total += n;
-    }
+    ssize_t n = read(fd, buf + total, size - total);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    total += n;
   }
-  return total;
+  return true;
 }
 
-// little endian only
-int certifier::utilities::sized_socket_read(int fd, string *out) {
-  out->clear();
-  int       n = 0;
-  int       size = 0;
-  int       total = 0;
-  const int read_stride = 8192;
-  byte      buf[read_stride];
-
-  if (read(fd, (byte *)&size, sizeof(int)) < (int)sizeof(int))
+// Header and body go out in one writev; short writes are resumed.
+static int write_frame(int fd, int size, byte *buf) {
+  if (!frame_size_ok(size) || (size > 0 && buf == nullptr))
     return -1;
 
-  while (total < size) {
-    if ((size - total) > read_stride)
-      n = read(fd, buf, read_stride);
-    else
-      n = read(fd, buf, size - total);
-    if (n <= 0) {
+  byte hdr[frame_header_size];
+  encode_frame_size(size, hdr);
+
+  struct iovec  iov[2];
+  struct iovec *v = iov;
+  int           num_iov = 2;
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = frame_header_size;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = size;
+
+  while (num_iov > 0) {
+    ssize_t n = writev(fd, v, num_iov);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
       return -1;
-    } else {
-      out->append((char *)buf, n);
-      total += n;
+    while (num_iov > 0 && (size_t)n >= v->iov_len) {
+      n -= v->iov_len;
+      v++;
+      num_iov--;
+    }
+    if (num_iov > 0) {
+      v->iov_base = (byte *)v->iov_base + n;
+      v->iov_len -= n;
     }
   }
-  return total;
+  return size;
+}
+
+// The body is read straight into out, no intermediate buffer.
+static int read_frame(int fd, string *out) {
+  out->clear();
+  byte hdr[frame_header_size];
+  if (!read_full(fd, hdr, frame_header_size))
+    return -1;
+  int size = decode_frame_size(hdr);
+  if (!frame_size_ok(size)) {
+    printf("%s() error, line: %d, bad frame size %d\n",
+           __func__,
+           __LINE__,
+           size);
+    return -1;
+  }
+  out->resize(size);
+  if (size > 0 && !read_full(fd, (byte *)&(*out)[0], size)) {
+    out->clear();
+    return -1;
+  }
+  return size;
+}
+
+// Pipes must be byte streams: in packet mode (O_DIRECT) the 4 byte
+// header read would discard the rest of the first packet.
+int sized_pipe_write(int fd, int size, byte *buf) {
+  return write_frame(fd, size, buf);
+}
+
+int sized_pipe_read(int fd, string *out) {
+  return read_frame(fd, out);
 }
 
-// little endian only
 int certifier::utilities::sized_socket_write(int fd, int size, byte *buf) {
-  if (write(fd, (byte *)&size, sizeof(int)) < (int)sizeof(int))
+  return write_frame(fd, size, buf);
+}
+
+int certifier::utilities::sized_socket_read(int fd, string *out) {
+  return read_frame(fd, out);
+}
+
+// SSL_read returns at most one record, so a header can arrive short.
+static bool ssl_read_full(SSL *ssl, byte *buf, int size) {
+  int total = 0;
+  while (total < size) {
+    int n = SSL_read(ssl, buf + total, size - total);
+    if (n <= 0)
+      return false;
+    total += n;
+  }
+  return true;
+}
+
+// The header shares a record with the start of the body, so small
+// frames are a single SSL_write and a single record on the wire.
+// Larger frames deliberately take a second SSL_write for the rest of
+// the body rather than copying it; at that size the extra record is
+// cheap next to the copy.
+const int ssl_coalesce_size = 4096;
+
+int sized_ssl_write(SSL *ssl, int size, byte *buf) {
+  if (!frame_size_ok(size) || (size > 0 && buf == nullptr))
+    return -1;
+
+  byte first[ssl_coalesce_size];
+  int  first_body = size;
+  if (first_body > ssl_coalesce_size - frame_header_size)
+    first_body = ssl_coalesce_size - frame_header_size;
+  encode_frame_size(size, first);
+  if (first_body > 0)
+    memcpy(&first[frame_header_size], buf, first_body);
+  int n = frame_header_size + first_body;
+  if (SSL_write(ssl, first, n) < n)
+    return -1;
+
+  int rest = size - first_body;
+  if (rest > 0 && SSL_write(ssl, buf + first_body, rest) < rest)
+    return -1;
+  return size;
+}
+
+int sized_ssl_read(SSL *ssl, string *out) {
+  out->clear();
+  byte hdr[frame_header_size];
+  if (!ssl_read_full(ssl, hdr, frame_header_size))
+    return -1;
+  int size = decode_frame_size(hdr);
+  if (!frame_size_ok(size)) {
+    printf("%s() error, line: %d, bad frame size %d\n",
+           __func__,
+           __LINE__,
+           size);
     return -1;
-  if (write(fd, buf, size) < size)
+  }
+  out->resize(size);
+  if (size > 0 && !ssl_read_full(ssl, (byte *)&(*out)[0], size)) {
+    out->clear();
     return -1;
+  }
   return size;
 }
 
 // -----------------------------------------------------------------------
 
+//  Scratch buffers
+
+static int scratch_capacity(int size) {
+  int c = 256;
+  while (c < size && c < max_pooled_scratch_size)
+    c *= 2;
+  return c < size ? size : c;
+}
+
+#ifndef NO_SCRATCH_POOL
+class scratch_pool {
+ public:
+  int   num_;
+  byte *blocks_[max_pooled_scratch_blocks];
+  int   capacities_[max_pooled_scratch_blocks];
+
+  scratch_pool() : num_(0) {}
+  ~scratch_pool() {
+    for (int i = 0; i < num_; i++)
+      free(blocks_[i]);
+    num_ = 0;
+  }
+
+  // Smallest pooled block that fits.
+  byte *take(int size, int *capacity) {
+    int best = -1;
+    for (int i = 0; i < num_; i++) {
+      if (capacities_[i] >= size
+          && (best < 0 || capacities_[i] < capacities_[best]))
+        best = i;
+    }
+    if (best < 0)
+      return nullptr;
+    byte *b = blocks_[best];
+    *capacity = capacities_[best];
+    num_--;
+    blocks_[best] = blocks_[num_];
+    capacities_[best] = capacities_[num_];
+    return b;
+  }
+
+  // False if the block should be freed instead.
+  bool give_back(byte *b, int capacity) {
+    if (num_ >= max_pooled_scratch_blocks
+        || capacity > max_pooled_scratch_size)
+      return false;
+    blocks_[num_] = b;
+    capacities_[num_] = capacity;
+    num_++;
+    return true;
+  }
+};
+
+static thread_local scratch_pool the_scratch_pool;
+#endif
+
+scratch_buffer::scratch_buffer(int size)
+    : buf_(nullptr), size_(size < 0 ? 0 : size), capacity_(0) {
+#ifndef NO_SCRATCH_POOL
+  buf_ = the_scratch_pool.take(size_, &capacity_);
+  if (buf_ != nullptr)
+    return;
+#endif
+  capacity_ = scratch_capacity(size_);
+  buf_ = (byte *)malloc(capacity_);
+  if (buf_ == nullptr) {
+    printf("%s() error, line %d, can't allocate %d bytes\n",
+           __func__,
+           __LINE__,
+           capacity_);
+    capacity_ = 0;
+  }
+}
+
+scratch_buffer::~scratch_buffer() {
+  if (buf_ == nullptr)
+    return;
+  OPENSSL_cleanse(buf_, size_);
+#ifndef NO_SCRATCH_POOL
+  if (the_scratch_pool.give_back(buf_, capacity_))
+    return;
+#endif
+  free(buf_);
+}
+
+int num_pooled_scratch_blocks() {
+#ifndef NO_SCRATCH_POOL
+  return the_scratch_pool.num_;
+#else
+  return 0;
+#endif
+}
+
+// -----------------------------------------------------------------------
+
 bool key_from_pkey(EVP_PKEY *pkey, const string &name, key_message *k) {
 
   if (pkey == nullptr)
@@ -4328,3 +5366,266 @@ bool construct_vse_attestation_from_cert(const key_message &subj,
 }
 
 // -----------------------------------------------------------------------
+
+// Compact evidence packages
+// -----------------------------------------------------------------------
+
+// Shorter keys and certs aren't worth an index.
+const int min_interned_size = 32;
+
+static void add_key_candidates(const key_message &k, std::set<string> *c) {
+  string s;
+  if (k.SerializeToString(&s))
+    c->insert(s);
+  if (k.has_certificate())
+    c->insert(k.certificate());
+}
+
+static void add_clause_candidates(const vse_clause &cl, std::set<string> *c) {
+  if (cl.has_subject() && cl.subject().has_key())
+    add_key_candidates(cl.subject().key(), c);
+  if (cl.has_object() && cl.object().has_key())
+    add_key_candidates(cl.object().key(), c);
+  if (cl.has_clause())
+    add_clause_candidates(cl.clause(), c);
+}
+
+static void add_user_data_candidates(const string     &serialized,
+                                     std::set<string> *c) {
+  attestation_user_data ud;
+  if (!ud.ParseFromString(serialized))
+    return;
+  if (ud.has_enclave_key())
+    add_key_candidates(ud.enclave_key(), c);
+  if (ud.has_policy_key())
+    add_key_candidates(ud.policy_key(), c);
+}
+
+// Serialized keys and certs an assertion may carry.  They are only
+// candidates: an assertion that doesn't parse, or whose embedded keys
+// don't reserialize to the same bytes, just isn't shortened.
+static void add_evidence_candidates(const evidence &ev, std::set<string> *c) {
+  const string &type = ev.evidence_type();
+  const string &se = ev.serialized_evidence();
+
+  if (type == "signed-claim") {
+    signed_claim_message sc;
+    if (!sc.ParseFromString(se))
+      return;
+    if (sc.has_signing_key())
+      add_key_candidates(sc.signing_key(), c);
+    claim_message cm;
+    vse_clause    vc;
+    if (cm.ParseFromString(sc.serialized_claim_message())
+        && vc.ParseFromString(cm.serialized_claim()))
+      add_clause_candidates(vc, c);
+  } else if (type == "signed-vse-attestation-report") {
+    signed_report sr;
+    if (!sr.ParseFromString(se))
+      return;
+    if (sr.has_signing_key())
+      add_key_candidates(sr.signing_key(), c);
+    vse_attestation_report_info info;
+    if (info.ParseFromString(sr.report()))
+      add_user_data_candidates(info.user_data(), c);
+  } else if (type == "sev-attestation" || type == "gramine-attestation") {
+    // gramine_attestation_message has the same layout.
+    sev_attestation_message sa;
+    if (sa.ParseFromString(se))
+      add_user_data_candidates(sa.what_was_said(), c);
+  } else if (type == "cert") {
+    c->insert(se);
+  }
+}
+
+static int count_occurrences(const string &s, const string &in) {
+  int    n = 0;
+  size_t pos = in.find(s);
+  while (pos != string::npos) {
+    n++;
+    pos = in.find(s, pos + s.size());
+  }
+  return n;
+}
+
+static bool longer_first(const string &a, const string &b) {
+  if (a.size() != b.size())
+    return a.size() > b.size();
+  return a < b;
+}
+
+bool is_compact_evidence_package(const evidence_package &evp) {
+  return evp.compact_assertion_size() > 0 || evp.interned_size() > 0;
+}
+
+bool compact_evidence_package(const evidence_package &in,
+                              evidence_package       *out) {
+  if (is_compact_evidence_package(in)) {
+    printf("%s() error, line %d, package is already compact\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+
+  std::set<string> candidates;
+  for (int i = 0; i < in.fact_assertion_size(); i++)
+    add_evidence_candidates(in.fact_assertion(i), &candidates);
+
+  // Keep what occurs at least twice, longest first so a cert wins over
+  // the key inside it.
+  vector<string> table;
+  for (const string &c : candidates) {
+    if ((int)c.size() < min_interned_size)
+      continue;
+    int n = 0;
+    for (int i = 0; n < 2 && i < in.fact_assertion_size(); i++)
+      n += count_occurrences(c, in.fact_assertion(i).serialized_evidence());
+    if (n >= 2)
+      table.push_back(c);
+  }
+  std::sort(table.begin(), table.end(), longer_first);
+
+  out->Clear();
+  if (in.has_prover_type())
+    out->set_prover_type(in.prover_type());
+  if (in.has_enclave_type())
+    out->set_enclave_type(in.enclave_type());
+
+  vector<int> uses(table.size(), 0);
+  for (int i = 0; i < in.fact_assertion_size(); i++) {
+    const evidence &ev = in.fact_assertion(i);
+    const string   &se = ev.serialized_evidence();
+
+    // (start, table index) of each non-overlapping match
+    vector<std::pair<size_t, int>> spans;
+    vector<bool>                   covered(se.size(), false);
+    for (int t = 0; t < (int)table.size(); t++) {
+      const string &entry = table[t];
+      size_t        pos = se.find(entry);
+      while (pos != string::npos) {
+        bool available = true;
+        for (size_t j = pos; available && j < pos + entry.size(); j++)
+          available = !covered[j];
+        if (available) {
+          for (size_t j = pos; j < pos + entry.size(); j++)
+            covered[j] = true;
+          spans.push_back(std::make_pair(pos, t));
+          pos = se.find(entry, pos + entry.size());
+        } else {
+          pos = se.find(entry, pos + 1);
+        }
+      }
+    }
+    std::sort(spans.begin(), spans.end());
+
+    compact_evidence *ce = out->add_compact_assertion();
+    if (ev.has_evidence_type())
+      ce->set_evidence_type(ev.evidence_type());
+    string *body = ce->mutable_body();
+    body->reserve(se.size());
+    size_t next = 0;
+    for (const std::pair<size_t, int> &sp : spans) {
+      body->append(se, next, sp.first - next);
+      ce->add_offsets((int)body->size());
+      ce->add_refs(sp.second);
+      uses[sp.second]++;
+      next = sp.first + table[sp.second].size();
+    }
+    body->append(se, next, string::npos);
+  }
+
+  // Drop entries every match of which was inside a longer one.
+  vector<int> new_index(table.size(), -1);
+  for (int t = 0; t < (int)table.size(); t++) {
+    if (uses[t] == 0)
+      continue;
+    new_index[t] = out->interned_size();
+    out->add_interned(table[t]);
+  }
+  for (int i = 0; i < out->compact_assertion_size(); i++) {
+    compact_evidence *ce = out->mutable_compact_assertion(i);
+    for (int j = 0; j < ce->refs_size(); j++)
+      ce->set_refs(j, new_index[ce->refs(j)]);
+  }
+  return true;
+}
+
+bool expand_evidence_package(const evidence_package &in,
+                             evidence_package       *out) {
+  if (in.fact_assertion_size() > 0) {
+    printf("%s() error, line %d, compact package has full assertions\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+
+  out->Clear();
+  if (in.has_prover_type())
+    out->set_prover_type(in.prover_type());
+  if (in.has_enclave_type())
+    out->set_enclave_type(in.enclave_type());
+
+  // Everything is checked first, so each assertion is then built with
+  // one allocation and one copy of each piece.  An expanded package
+  // can't be bigger than a frame.
+  int64_t total = 0;
+  for (int i = 0; i < in.compact_assertion_size(); i++) {
+    const compact_evidence &ce = in.compact_assertion(i);
+    if (ce.offsets_size() != ce.refs_size()) {
+      printf("%s() error, line %d, assertion %d: %d offsets, %d refs\n",
+             __func__,
+             __LINE__,
+             i,
+             ce.offsets_size(),
+             ce.refs_size());
+      return false;
+    }
+    total += ce.body().size();
+    int prev = 0;
+    for (int j = 0; j < ce.refs_size(); j++) {
+      int off = ce.offsets(j);
+      int r = ce.refs(j);
+      if (off < prev || off > (int)ce.body().size() || r < 0
+          || r >= in.interned_size()) {
+        printf("%s() error, line %d, assertion %d: bad ref %d at %d\n",
+               __func__,
+               __LINE__,
+               i,
+               r,
+               off);
+        return false;
+      }
+      prev = off;
+      total += in.interned(r).size();
+    }
+    if (total > get_max_frame_size()) {
+      printf("%s() error, line %d, expanded package too large\n",
+             __func__,
+             __LINE__);
+      return false;
+    }
+  }
+
+  out->mutable_fact_assertion()->Reserve(in.compact_assertion_size());
+  for (int i = 0; i < in.compact_assertion_size(); i++) {
+    const compact_evidence &ce = in.compact_assertion(i);
+    const string           &body = ce.body();
+    size_t                  size = body.size();
+    for (int j = 0; j < ce.refs_size(); j++)
+      size += in.interned(ce.refs(j)).size();
+
+    evidence *ev = out->add_fact_assertion();
+    if (ce.has_evidence_type())
+      ev->set_evidence_type(ce.evidence_type());
+    string *se = ev->mutable_serialized_evidence();
+    se->reserve(size);
+    size_t next = 0;
+    for (int j = 0; j < ce.refs_size(); j++) {
+      se->append(body, next, ce.offsets(j) - next);
+      se->append(in.interned(ce.refs(j)));
+      next = ce.offsets(j);
+    }
+    se->append(body, next, string::npos);
+  }
+  return true;
+}
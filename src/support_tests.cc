@@ -13,9 +13,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sys/wait.h>
+#include <chrono>
+#include <thread>
+
 #include "certifier.h"
 #include "support.h"
+#include "cc_helpers.h"
+#include "application_enclave.h"
 
+using namespace certifier::framework;
 using namespace certifier::utilities;
 
 bool test_random(bool print_all) {
@@ -36,6 +43,85 @@ bool test_random(bool print_all) {
   return true;
 }
 
+// A forked child must not hand out what its parent does, even when the
+// parent's buffer was part used before the fork.  Drawing past the
+// reseed interval must reseed.
+bool test_random_fork(bool print_all) {
+  const int n = 32;
+  byte      before[n];
+  byte      parent[n];
+  byte      child[n];
+
+  if (!get_random(8 * n, before))
+    return false;
+
+  int fds[2];
+  if (pipe(fds) != 0)
+    return false;
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    byte b[n];
+    int  ok = get_random(8 * n, b) && write(fds[1], b, n) == n;
+    close(fds[1]);
+    _exit(ok ? 0 : 1);
+  }
+  close(fds[1]);
+  int got = 0;
+  while (got < n) {
+    int m = read(fds[0], child + got, n - got);
+    if (m <= 0)
+      break;
+    got += m;
+  }
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (got != n || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("%s() error, line: %d, child failed\n", __func__, __LINE__);
+    return false;
+  }
+  if (!get_random(8 * n, parent))
+    return false;
+  if (memcmp(parent, child, n) == 0 || memcmp(parent, before, n) == 0) {
+    printf("%s() error, line: %d, repeated output after fork\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+
+  int   seedings = num_random_seedings();
+  int   big = random_reseed_interval + random_pool_size;
+  byte *b = new byte[big];
+  bool  ret = get_random(8 * big, b) && get_random(8 * n, parent);
+  delete[] b;
+  if (!ret || num_random_seedings() <= seedings) {
+    printf("%s() error, line: %d, no reseed\n", __func__, __LINE__);
+    return false;
+  }
+
+  // Threads have their own generators.
+  byte other[n];
+  std::thread t([&other]() { get_random(8 * n, other); });
+  t.join();
+  if (!get_random(8 * n, parent) || memcmp(parent, other, n) == 0)
+    return false;
+
+  if (print_all) {
+    printf("Child bytes:  ");
+    print_bytes(n, child);
+    printf("\nParent bytes: ");
+    print_bytes(n, parent);
+    printf("\n");
+  }
+  return true;
+}
+
 bool test_encrypt(bool print_all) {
   const int   in_size = 2 * block_size;
   const int   out_size = in_size + 128;
@@ -570,9 +656,8 @@ bool test_public_keys(bool print_all) {
     printf("\n");
   }
 #if 1
-  // TODO: sometimes this faults
   if (!ecc_verify(Digest_method_sha_256,
-                  ecc_key,
+                  ecc_key2,
                   size_data,
                   data,
                   size_out,
@@ -1054,3 +1139,1552 @@ bool test_time(bool print_all) {
   }
   return true;
 }
+
+class time_ns_case {
+ public:
+  const char *in_;
+  time_ns     t_;
+  const char *out_;
+};
+
+static const time_ns_case time_ns_cases[] = {
+    {"1970-01-01T00:00:00Z", 0, "1970-01-01T00:00:00Z"},
+    {"2000-02-29T12:30:15.5Z", 951827415500000000, "2000-02-29T12:30:15.5Z"},
+    {"2023-10-18T09:05: 7.00000Z", 1697619907000000000, "2023-10-18T09:05:07Z"},
+    {"2023-10-18T11:05:07.000000001+02:00",
+     1697619907000000001,
+     "2023-10-18T09:05:07.000000001Z"},
+    {"1969-12-31T23:59:59.25Z", -750000000, "1969-12-31T23:59:59.25Z"},
+};
+
+static const char *bad_times[] = {
+    "",
+    "2023-10-18",
+    "2023-13-01T00:00:00Z",
+    "2023-02-29T00:00:00Z",
+    "2023-10-18T24:00:00Z",
+    "2023-10-18T00:00:00",
+    "2023-10-18T00:00:00.Z",
+    "2023-10-18T00:00:00Zjunk",
+};
+
+bool test_time_ns(bool print_all) {
+  for (const time_ns_case &c : time_ns_cases) {
+    time_ns t = 0;
+    string  s;
+    if (!string_to_time_ns(c.in_, &t) || t != c.t_ || !time_ns_to_string(t, &s)
+        || s != c.out_) {
+      printf("%s() error, line: %d, %s: %lld %s\n",
+             __func__,
+             __LINE__,
+             c.in_,
+             (long long)t,
+             s.c_str());
+      return false;
+    }
+  }
+  for (const char *b : bad_times) {
+    time_ns t;
+    if (string_to_time_ns(b, &t)) {
+      printf("%s() error, line: %d, parsed %s\n", __func__, __LINE__, b);
+      return false;
+    }
+  }
+
+  // Agrees with the time_point functions, and saturates far out.
+  time_point tp;
+  string     s;
+  time_ns    t1, t2, t3;
+  if (!time_now(&tp) || !time_to_string(tp, &s) || !string_to_time_ns(s, &t1)
+      || !time_point_to_time_ns(tp, &t2)
+      || !string_to_time_ns("9999-12-31T23:59:59Z", &t3)) {
+    printf("%s() error, line: %d, conversion failed\n", __func__, __LINE__);
+    return false;
+  }
+  if (t1 != t2 || t1 > time_ns_now() + ns_per_second || t3 != INT64_MAX) {
+    printf("%s() error, line: %d, %s gave %lld and %lld\n",
+           __func__,
+           __LINE__,
+           s.c_str(),
+           (long long)t1,
+           (long long)t2);
+    return false;
+  }
+
+  // check_date_range, with and without a request_clock.
+  string nb("2000-01-01T00:00:00Z");
+  string na("9000-01-01T00:00:00Z");
+  string past("2001-01-01T00:00:00Z");
+  if (!check_date_range(nb, na) || check_date_range(nb, past))
+    return false;
+#ifndef NO_REQUEST_CLOCK
+  {
+    request_clock clock;
+    if (request_clock::current() != &clock || !check_date_range(nb, na)
+        || !check_date_range(nb, na) || check_date_range(nb, past))
+      return false;
+    {
+      request_clock inner;
+      if (request_clock::current() != &inner || inner.now() < clock.now())
+        return false;
+    }
+    if (request_clock::current() != &clock)
+      return false;
+  }
+#endif
+  if (request_clock::current() != nullptr)
+    return false;
+
+  // The Go certifier's TimePointToString form.
+  time_ns go_time;
+  if (string_to_time_ns("2024:01:02T03:04:05Z", &go_time))
+    return false;
+
+  if (print_all)
+    printf("%s = %lld\n", s.c_str(), (long long)t1);
+  return true;
+}
+
+bool test_metrics(bool print_all) {
+#ifndef NO_CERTIFIER_METRICS
+  metrics_registry *r = metrics_registry::get();
+
+  metric_counter *c = r->counter("test_metrics_total", "Test counter");
+  if (c != r->counter("test_metrics_total", "Test counter")) {
+    printf("%s() error, line: %d, duplicate registration\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  uint64_t old_value = c->value();
+  CC_METRICS_COUNT("test_metrics_total", "Test counter", 3);
+  if (c->value() != old_value + 3) {
+    printf("%s() error, line: %d, bad counter value\n", __func__, __LINE__);
+    return false;
+  }
+
+  metric_histogram *h = r->histogram("test_metrics_seconds", "Test span");
+  uint64_t          old_count = h->count();
+  {
+    CC_METRICS_SPAN(span, "test_metrics_seconds", "Test span");
+    CC_METRICS_SPAN_END(span);
+    // Ending twice records once.
+    CC_METRICS_SPAN_END(span);
+  }
+  { CC_METRICS_SPAN(span, "test_metrics_seconds", "Test span"); }
+  if (h->count() != old_count + 2) {
+    printf("%s() error, line: %d, bad histogram count\n", __func__, __LINE__);
+    return false;
+  }
+
+  // Seal is instrumented.
+  byte   secret[32];
+  byte   sealed[512];
+  int    sealed_size = sizeof(sealed);
+  string enclave_type("simulated-enclave");
+  string enclave_id("test-enclave");
+  memset(secret, 0x5a, sizeof(secret));
+  metric_histogram *seal_h =
+      r->histogram("certifier_seal_seconds", "Time spent in Seal");
+  uint64_t old_seal_count = seal_h->count();
+  if (certifier::framework::Seal(enclave_type,
+                                 enclave_id,
+                                 sizeof(secret),
+                                 secret,
+                                 &sealed_size,
+                                 sealed)
+      && seal_h->count() != old_seal_count + 1) {
+    printf("%s() error, line: %d, Seal not recorded\n", __func__, __LINE__);
+    return false;
+  }
+
+  string text;
+  if (!r->prometheus_text(&text)) {
+    printf("%s() error, line: %d, prometheus_text failed\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  if (text.find("# TYPE test_metrics_total counter") == string::npos
+      || text.find("test_metrics_seconds_bucket{le=\"+Inf\"}") == string::npos
+      || text.find("test_metrics_seconds_count") == string::npos) {
+    printf("%s() error, line: %d, bad exposition text\n", __func__, __LINE__);
+    return false;
+  }
+  if (print_all)
+    printf("%s\n", text.c_str());
+
+  string                   file_name("./test_metrics.prom");
+  prometheus_file_exporter exporter(file_name);
+  if (!export_metrics(&exporter)) {
+    printf("%s() error, line: %d, export failed\n", __func__, __LINE__);
+    return false;
+  }
+  string exported;
+  if (!read_file_into_string(file_name, &exported) || exported != text) {
+    printf("%s() error, line: %d, exported text differs\n", __func__, __LINE__);
+    return false;
+  }
+  unlink(file_name.c_str());
+#endif  // NO_CERTIFIER_METRICS
+  return true;
+}
+
+// Non-blocking channels
+// -------------------------------------------------------------------
+
+static bool make_channel_cert(key_message &policy_key,
+                              key_message &auth_key,
+                              const char  *role,
+                              string      *out) {
+  string issuer_name("policyAuthority");
+  string issuer_organization("root");
+  string subject_name(role);
+  string subject_organization("1234567890");
+
+  X509 *x509_cert = X509_new();
+  bool  ret = produce_artifact(policy_key,
+                              issuer_name,
+                              issuer_organization,
+                              auth_key,
+                              subject_name,
+                              subject_organization,
+                              23,
+                              86400.0,
+                              x509_cert,
+                              false)
+             && x509_to_asn1(x509_cert, out);
+  X509_free(x509_cert);
+  if (ret)
+    auth_key.set_certificate(*out);
+  return ret;
+}
+
+static void async_echo_read(secure_authenticated_channel &channel,
+                            bool                          ok,
+                            const string                 &msg,
+                            void                         *arg) {
+  if (!ok)
+    return;
+  channel.async_write_message(msg, nullptr, nullptr);
+  channel.async_read_message(async_echo_read, arg);
+}
+
+static void async_echo_ready(secure_authenticated_channel &channel,
+                             bool                          ok,
+                             void                         *arg) {
+  if (ok)
+    channel.async_read_message(async_echo_read, arg);
+}
+
+class async_test_client {
+ public:
+  bool   ready_;
+  bool   done_;
+  bool   ok_;
+  string msg_;
+};
+
+static void async_client_ready(secure_authenticated_channel &channel,
+                               bool                          ok,
+                               void                         *arg) {
+  async_test_client *c = (async_test_client *)arg;
+  c->ready_ = true;
+  c->ok_ = ok;
+}
+
+static void async_client_read(secure_authenticated_channel &channel,
+                              bool                          ok,
+                              const string                 &msg,
+                              void                         *arg) {
+  async_test_client *c = (async_test_client *)arg;
+  c->done_ = true;
+  c->ok_ = ok;
+  c->msg_ = msg;
+}
+
+class async_held_channel {
+ public:
+  secure_authenticated_channel *channel_;
+  int                           num_read_;
+};
+
+static void async_held_ready(secure_authenticated_channel &channel,
+                             bool                          ok,
+                             void                         *arg) {
+  if (ok)
+    ((async_held_channel *)arg)->channel_ = &channel;
+}
+
+static void async_held_read(secure_authenticated_channel &channel,
+                            bool                          ok,
+                            const string                 &msg,
+                            void                         *arg) {
+  if (!ok)
+    return;
+  ((async_held_channel *)arg)->num_read_++;
+  channel.async_read_message(async_held_read, arg);
+}
+
+// A server channel nobody reads from stops reading once it holds a
+// maximum size frame, and starts again when its reader catches up.
+static bool check_rx_limit(const string &policy_cert,
+                           key_message  &server_key,
+                           const string &server_cert,
+                           key_message  &client_key,
+                           const string &client_cert) {
+  const int          num_msgs = 16;
+  const int          msg_size = 4000;
+  string             host("localhost");
+  int                port = 8134;
+  channel_reactor    server;
+  async_held_channel h;
+  h.channel_ = nullptr;
+  h.num_read_ = 0;
+  set_max_frame_size(msg_size);
+  if (!server.init()
+      || !async_server_listen(host,
+                              port,
+                              policy_cert,
+                              policy_cert,
+                              0,
+                              nullptr,
+                              server_key,
+                              server_cert,
+                              &server,
+                              async_held_ready,
+                              &h)) {
+    printf("%s() error, line: %d, Can't start server\n", __func__, __LINE__);
+    set_max_frame_size(default_max_frame_size);
+    return false;
+  }
+
+  std::atomic<bool> finished(false);
+  std::thread       writer([&]() {
+    string                       role("client");
+    secure_authenticated_channel c(role);
+    string                       msg(msg_size, 'h');
+    if (c.init_client_ssl(host, port, policy_cert, client_key, client_cert)) {
+      for (int i = 0; i < num_msgs; i++)
+        c.write(msg.size(), (byte *)msg.data());
+    }
+    while (!finished)
+      usleep(10000);
+    c.close();
+  });
+
+  bool ret = true;
+  for (int i = 0; i < 500 && (h.channel_ == nullptr || h.channel_->epoll_in_);
+       i++)
+    server.run_once(10);
+  if (h.channel_ == nullptr || h.channel_->epoll_in_
+      || h.channel_->rx_buf_.size() - h.channel_->rx_off_
+             > (size_t)(frame_header_size + msg_size)) {
+    printf("%s() error, line: %d, reading didn't stop\n", __func__, __LINE__);
+    ret = false;
+  }
+  if (ret) {
+    h.channel_->async_read_message(async_held_read, &h);
+    for (int i = 0; i < 500 && h.num_read_ < num_msgs; i++)
+      server.run_once(10);
+    if (h.num_read_ != num_msgs) {
+      printf("%s() error, line: %d, read %d of %d messages\n",
+             __func__,
+             __LINE__,
+             h.num_read_,
+             num_msgs);
+      ret = false;
+    }
+  }
+
+  finished = true;
+  writer.join();
+  set_max_frame_size(default_max_frame_size);
+  return ret;
+}
+
+// An async echo server talks to a blocking client and to an async
+// client sharing its SSL_CTX.
+bool test_async_channel(bool print_all) {
+  key_message policy_key;
+  key_message server_key;
+  key_message client_key;
+  string      server_cert;
+  string      client_cert;
+  string      type(Enc_method_rsa_2048_private);
+  string      name("policyKey");
+  string      issuer("policyAuthority");
+  if (!make_root_key_with_cert(type, name, issuer, &policy_key)
+      || !make_certifier_rsa_key(2048, &server_key)
+      || !make_certifier_rsa_key(2048, &client_key)
+      || !make_channel_cert(policy_key, server_key, "server", &server_cert)
+      || !make_channel_cert(policy_key, client_key, "client", &client_cert)) {
+    printf("%s() error, line: %d, Can't make keys\n", __func__, __LINE__);
+    return false;
+  }
+  string policy_cert(policy_key.certificate());
+
+  string          host("localhost");
+  int             port = 8133;
+  channel_reactor server;
+  if (!server.init()
+      || !async_server_listen(host,
+                              port,
+                              policy_cert,
+                              policy_cert,
+                              0,
+                              nullptr,
+                              server_key,
+                              server_cert,
+                              &server,
+                              async_echo_ready,
+                              nullptr)) {
+    printf("%s() error, line: %d, Can't start server\n", __func__, __LINE__);
+    return false;
+  }
+  std::thread server_thread([&server]() { server.run(); });
+
+  bool                         ret = true;
+  string                       role("client");
+  secure_authenticated_channel blocking(role);
+  secure_authenticated_channel async(role);
+  channel_reactor              client;
+  async_test_client            c;
+  c.ready_ = false;
+  c.done_ = false;
+  c.ok_ = false;
+
+  // Large enough to need several records and partial reads.
+  string big(200000, 'b');
+  string out;
+  string hello("hello");
+  int    sock = -1;
+
+  if (!blocking.init_client_ssl(host,
+                                port,
+                                policy_cert,
+                                client_key,
+                                client_cert)) {
+    printf("%s() error, line: %d, Can't connect\n", __func__, __LINE__);
+    ret = false;
+    goto done;
+  }
+  if (blocking.write(hello.size(), (byte *)hello.data()) < 0
+      || blocking.read(&out) < 0 || out != hello) {
+    printf("%s() error, line: %d, blocking echo failed\n", __func__, __LINE__);
+    ret = false;
+    goto done;
+  }
+  if (blocking.write(big.size(), (byte *)big.data()) < 0
+      || blocking.read(&out) < 0 || out != big) {
+    printf("%s() error, line: %d, large echo failed\n", __func__, __LINE__);
+    ret = false;
+    goto done;
+  }
+
+  if (!client.init() || !open_client_socket(host, port, &sock)
+      || !async.async_connect(&client,
+                              blocking.ssl_ctx_,
+                              sock,
+                              async_client_ready,
+                              &c)) {
+    printf("%s() error, line: %d, async connect failed\n", __func__, __LINE__);
+    ret = false;
+    goto done;
+  }
+  while (!c.ready_)
+    client.run_once(1000);
+  if (!c.ok_) {
+    printf("%s() error, line: %d, async handshake failed\n",
+           __func__,
+           __LINE__);
+    ret = false;
+    goto done;
+  }
+  if (!async.async_write_message(big, nullptr, nullptr)
+      || !async.async_read_message(async_client_read, &c)) {
+    printf("%s() error, line: %d, async calls failed\n", __func__, __LINE__);
+    ret = false;
+    goto done;
+  }
+  while (!c.done_)
+    client.run_once(1000);
+  if (!c.ok_ || c.msg_ != big) {
+    printf("%s() error, line: %d, async echo failed\n", __func__, __LINE__);
+    ret = false;
+    goto done;
+  }
+  if (print_all)
+    printf("async echo of %d bytes succeeded\n", (int)c.msg_.size());
+
+  if (!check_rx_limit(policy_cert,
+                      server_key,
+                      server_cert,
+                      client_key,
+                      client_cert)) {
+    ret = false;
+    goto done;
+  }
+
+done:
+  async.close();
+  blocking.close();
+  server.stop();
+  server_thread.join();
+  return ret;
+}
+
+bool test_sized_frames(bool print_all) {
+  byte hdr[frame_header_size];
+  encode_frame_size(0x01020304, hdr);
+  if (hdr[0] != 0x04 || hdr[1] != 0x03 || hdr[2] != 0x02 || hdr[3] != 0x01
+      || decode_frame_size(hdr) != 0x01020304) {
+    printf("%s() error, line: %d, bad header encoding\n", __func__, __LINE__);
+    return false;
+  }
+
+  int fd[2];
+  if (pipe(fd) < 0) {
+    printf("%s() error, line: %d, pipe failed\n", __func__, __LINE__);
+    return false;
+  }
+
+  // Bigger than the pipe buffer, so the reader sees short reads.
+  bool   ret = true;
+  string big(300000, 'f');
+  string small("small");
+  string out;
+  std::thread writer([&]() {
+    sized_pipe_write(fd[1], small.size(), (byte *)small.data());
+    sized_pipe_write(fd[1], 0, nullptr);
+    sized_pipe_write(fd[1], big.size(), (byte *)big.data());
+
+    // A header split across writes.
+    encode_frame_size(small.size(), hdr);
+    for (int i = 0; i < frame_header_size; i++) {
+      if (write(fd[1], &hdr[i], 1) != 1)
+        return;
+    }
+    if (write(fd[1], small.data(), small.size()) != (int)small.size())
+      return;
+  });
+  if (sized_pipe_read(fd[0], &out) != (int)small.size() || out != small
+      || sized_pipe_read(fd[0], &out) != 0 || !out.empty()
+      || sized_pipe_read(fd[0], &out) != (int)big.size() || out != big
+      || sized_pipe_read(fd[0], &out) != (int)small.size() || out != small) {
+    printf("%s() error, line: %d, pipe frames wrong\n", __func__, __LINE__);
+    ret = false;
+  }
+  writer.join();
+
+  // Oversized frames are refused by both ends.
+  set_max_frame_size(1000);
+  if (sized_pipe_write(fd[1], 2000, (byte *)big.data()) >= 0) {
+    printf("%s() error, line: %d, oversize write accepted\n",
+           __func__,
+           __LINE__);
+    ret = false;
+  }
+  encode_frame_size(2000, hdr);
+  if (write(fd[1], hdr, frame_header_size) != frame_header_size
+      || sized_pipe_read(fd[0], &out) >= 0) {
+    printf("%s() error, line: %d, oversize read accepted\n",
+           __func__,
+           __LINE__);
+    ret = false;
+  }
+  set_max_frame_size(default_max_frame_size);
+
+  // End of file in the middle of a frame is an error.
+  encode_frame_size(10, hdr);
+  if (write(fd[1], hdr, frame_header_size) != frame_header_size) {
+    ret = false;
+  }
+  close(fd[1]);
+  if (sized_pipe_read(fd[0], &out) >= 0) {
+    printf("%s() error, line: %d, truncated frame accepted\n",
+           __func__,
+           __LINE__);
+    ret = false;
+  }
+  close(fd[0]);
+
+  if (ret && print_all)
+    printf("sized frames succeeded\n");
+  return ret;
+}
+
+// Runs the paths that used to keep input-sized arrays on the stack.
+static bool small_stack_work() {
+  key_message rsa_key;
+  key_message ecc_key;
+  if (!make_certifier_rsa_key(2048, &rsa_key)
+      || !make_certifier_ecc_key(384, &ecc_key)) {
+    printf("%s() error, line: %d, can't make keys\n", __func__, __LINE__);
+    return false;
+  }
+  key_message rsa_public;
+  key_message ecc_public;
+  if (!private_key_to_public_key(rsa_key, &rsa_public)
+      || !private_key_to_public_key(ecc_key, &ecc_public))
+    return false;
+
+  time_point t_nb;
+  time_point t_na;
+  string     nb;
+  string     na;
+  if (!time_now(&t_nb) || !add_interval_to_time_point(t_nb, 1.0, &t_na)
+      || !time_to_string(t_nb, &nb) || !time_to_string(t_na, &na))
+    return false;
+
+  claim_message claim;
+  claim.set_claim_format("vse-clause");
+  claim.set_claim_descriptor("small stack");
+  claim.set_not_before(nb);
+  claim.set_not_after(na);
+  claim.set_serialized_claim(string(2000, 'c'));
+  signed_claim_message rsa_claim;
+  signed_claim_message ecc_claim;
+  if (!make_signed_claim(Enc_method_rsa_2048_sha256_pkcs_sign,
+                         claim,
+                         rsa_key,
+                         &rsa_claim)
+      || !verify_signed_claim(rsa_claim, rsa_public)
+      || !make_signed_claim(Enc_method_ecc_384_sha384_pkcs_sign,
+                            claim,
+                            ecc_key,
+                            &ecc_claim)
+      || !verify_signed_claim(ecc_claim, ecc_public)) {
+    printf("%s() error, line: %d, signed claims failed\n", __func__, __LINE__);
+    return false;
+  }
+
+  // Larger than the whole stack.
+  string enclave_type("simulated-enclave");
+  string enclave_id("local-machine");
+  string secret(100000, 's');
+  int    sealed_size = 0;
+  if (!Seal(enclave_type,
+            enclave_id,
+            secret.size(),
+            (byte *)secret.data(),
+            &sealed_size,
+            nullptr))
+    return false;
+  string sealed(sealed_size, 0);
+  if (!Seal(enclave_type,
+            enclave_id,
+            secret.size(),
+            (byte *)secret.data(),
+            &sealed_size,
+            (byte *)&sealed[0]))
+    return false;
+  int    unsealed_size = sealed_size;
+  string unsealed(unsealed_size, 0);
+  if (!Unseal(enclave_type,
+              enclave_id,
+              sealed_size,
+              (byte *)sealed.data(),
+              &unsealed_size,
+              (byte *)&unsealed[0])
+      || unsealed.substr(0, unsealed_size) != secret) {
+    printf("%s() error, line: %d, seal round trip failed\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+
+  string           store_file("/tmp/small_stack_store.bin");
+  string           purpose("authentication");
+  cc_trust_manager saver(enclave_type, purpose, store_file);
+  cc_trust_manager fetcher(enclave_type, purpose, store_file);
+  saver.symmetric_key_algorithm_ = Enc_method_aes_256_cbc_hmac_sha256;
+  string tag("small-stack");
+  string type("binary-blob");
+  string value(100000, 'v');
+  int    ent = -1;
+  string fetched;
+  if (!saver.store_.update_or_insert(tag, type, value) || !saver.save_store()
+      || !fetcher.fetch_store()
+      || (ent = fetcher.store_.find_entry(tag, type)) < 0
+      || !fetcher.store_.get(ent, &fetched) || fetched != value) {
+    printf("%s() error, line: %d, store round trip failed\n",
+           __func__,
+           __LINE__);
+    unlink(store_file.c_str());
+    return false;
+  }
+  unlink(store_file.c_str());
+
+  // The scratch blocks went back to this thread's pool.
+  if (num_pooled_scratch_blocks() == 0) {
+    printf("%s() error, line: %d, nothing pooled\n", __func__, __LINE__);
+    return false;
+  }
+  return true;
+}
+
+static void *small_stack_thread(void *arg) {
+  *(bool *)arg = small_stack_work();
+  return nullptr;
+}
+
+bool test_small_stacks(bool print_all) {
+  const int      stack_size = 64 * 1024;
+  const int      num_threads = 2;
+  pthread_t      threads[num_threads];
+  bool           results[num_threads];
+  pthread_attr_t attr;
+
+  pthread_attr_init(&attr);
+  if (pthread_attr_setstacksize(&attr, stack_size) != 0) {
+    printf("%s() error, line: %d, can't set stack size\n", __func__, __LINE__);
+    pthread_attr_destroy(&attr);
+    return false;
+  }
+
+  bool ret = true;
+  int  started = 0;
+  for (int i = 0; i < num_threads; i++) {
+    results[i] = false;
+    if (pthread_create(&threads[i], &attr, small_stack_thread, &results[i])
+        != 0) {
+      ret = false;
+      break;
+    }
+    // The store file is shared, so the threads take turns.
+    pthread_join(threads[i], nullptr);
+    ret = ret && results[i];
+    started++;
+  }
+  pthread_attr_destroy(&attr);
+
+  if (ret && print_all)
+    printf("%d threads on %d byte stacks succeeded\n", started, stack_size);
+  return ret;
+}
+
+// Stands in for app_service_loop: echoes the first argument back and
+// "seals" batches by tagging each item.
+static int num_batch_requests = 0;
+
+static void transport_echo_loop(app_transport *t) {
+  for (;;) {
+    string      in;
+    app_request req;
+    if (t->read_message(&in) < 0 || !req.ParseFromString(in)
+        || req.function() == "quit")
+      return;
+
+    app_response rsp;
+    bool         switch_to_rings = false;
+    rsp.set_function(req.function());
+    rsp.set_request_id(req.request_id());
+    if (req.function() == "gettransport") {
+      switch_to_rings = t->offer_rings(&rsp);
+      rsp.set_status(switch_to_rings ? "succeeded" : "failed");
+    } else if (req.function() == "seal_batch") {
+      num_batch_requests++;
+      rsp.set_status("succeeded");
+      for (int i = 0; i < req.args_size(); i++)
+        rsp.add_args("sealed:" + req.args(i));
+    } else if (req.function() == "unseal_batch") {
+      num_batch_requests++;
+      rsp.set_status("succeeded");
+      for (int i = 0; i < req.args_size(); i++)
+        rsp.add_args(req.args(i).substr(7));
+    } else {
+      rsp.set_status("succeeded");
+      if (req.args_size() > 0)
+        rsp.add_args(req.args(0));
+    }
+    string out;
+    rsp.SerializeToString(&out);
+    if (t->write_message(out.size(), (byte *)out.data()) < 0)
+      return;
+    if (switch_to_rings)
+      t->start_rings();
+  }
+}
+
+static bool transport_round_trips(bool with_rings) {
+  int to_child[2];
+  int to_parent[2];
+  if (pipe(to_child) < 0 || pipe(to_parent) < 0)
+    return false;
+
+  app_transport parent;
+  app_transport child;
+  parent.init_pipes(to_parent[0], to_child[1]);
+  child.init_pipes(to_child[0], to_parent[1]);
+  if (with_rings && !parent.create_rings(64 * 1024)) {
+    printf("%s() error, line: %d, can't create rings\n", __func__, __LINE__);
+    return false;
+  }
+  std::thread server(transport_echo_loop, &parent);
+
+  // Frames from empty to many times the ring size.
+  bool ret = child.request_rings() && child.use_ring_ == with_rings;
+  int  sizes[] = {0, 1000, 64 * 1024, 100000, 4 * 1024 * 1024};
+  for (int i = 0; ret && i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+    string payload(sizes[i], 0);
+    for (int j = 0; j < sizes[i]; j++)
+      payload[j] = (char)(j * 7);
+
+    app_request req;
+    req.set_function("seal");
+    req.add_args(payload);
+    string       req_str;
+    string       rsp_str;
+    app_response rsp;
+    req.SerializeToString(&req_str);
+    if (child.write_message(req_str.size(), (byte *)req_str.data()) < 0
+        || child.read_message(&rsp_str) < 0 || !rsp.ParseFromString(rsp_str)
+        || rsp.args_size() != 1 || rsp.args(0) != payload) {
+      printf("%s() error, line: %d, %d byte round trip failed\n",
+             __func__,
+             __LINE__,
+             sizes[i]);
+      ret = false;
+    }
+  }
+
+  app_request quit;
+  string      quit_str;
+  quit.set_function("quit");
+  quit.SerializeToString(&quit_str);
+  child.write_message(quit_str.size(), (byte *)quit_str.data());
+  server.join();
+
+#ifdef APPLICATION_SHARED_RING
+  // In one process both ends have the same fds, the parent closes them.
+  for (int i = 0; i < app_transport::NUM_RING_FDS; i++)
+    child.ring_fds_[i] = -1;
+#endif
+  close(to_child[0]);
+  close(to_child[1]);
+  close(to_parent[0]);
+  close(to_parent[1]);
+  return ret;
+}
+
+#ifdef APPLICATION_SHARED_RING
+// The other process can write the ring indices.  Ones claiming more
+// than the ring holds (or, for the writer, a tail past the head) must
+// fail the call and close the ring rather than copy out of bounds.
+static bool corrupt_ring_fails(bool reader) {
+  const int             ring_size = 4096;
+  std::vector<uint64_t> mem((shared_ring::header_size + ring_size) / 8);
+  int                   bell[2];
+  if (pipe(bell) < 0)
+    return false;
+
+  shared_ring ring;
+  bool        ret = false;
+  string      out;
+  byte        msg[16] = {0};
+  if (ring.attach((byte *)mem.data(), ring_size, bell[1], bell[1], -1, true)) {
+    if (reader) {
+      ring.hdr_->head_.store(3 * ring_size);
+      ret = ring.read_message(&out) < 0;
+    } else {
+      ring.hdr_->tail_.store(100);
+      ret = ring.write_message(sizeof(msg), msg) < 0;
+    }
+    ret = ret && ring.hdr_ == nullptr;
+  }
+  close(bell[0]);
+  close(bell[1]);
+  return ret;
+}
+#endif
+
+bool test_app_transport(bool print_all) {
+  if (!transport_round_trips(false)) {
+    printf("%s() error, line: %d, pipes failed\n", __func__, __LINE__);
+    return false;
+  }
+#ifdef APPLICATION_SHARED_RING
+  if (!transport_round_trips(true)) {
+    printf("%s() error, line: %d, rings failed\n", __func__, __LINE__);
+    return false;
+  }
+  if (!corrupt_ring_fails(true) || !corrupt_ring_fails(false)) {
+    printf("%s() error, line: %d, corrupt ring used\n", __func__, __LINE__);
+    return false;
+  }
+#endif
+  if (print_all)
+    printf("app transport succeeded\n");
+  return true;
+}
+
+bool test_app_batch(bool print_all) {
+  int to_child[2];
+  int to_parent[2];
+  if (pipe(to_child) < 0 || pipe(to_parent) < 0)
+    return false;
+
+  app_transport parent;
+  parent.init_pipes(to_parent[0], to_child[1]);
+  if (!parent.create_rings(64 * 1024)) {
+    printf("%s() error, line: %d, can't create rings\n", __func__, __LINE__);
+    return false;
+  }
+  std::thread server(transport_echo_loop, &parent);
+  string      enclave_type("application-enclave");
+  string      enclave_id("enclave-id");
+  bool        ret = application_Init("simulated-enclave",
+                                     to_child[0],
+                                     to_parent[1]);
+
+  // A small frame limit splits 1000 items over several requests.
+  std::vector<string> items;
+  std::vector<string> sealed;
+  std::vector<string> unsealed;
+  for (int i = 0; i < 1000; i++)
+    items.push_back("record " + std::to_string(i));
+  set_max_frame_size(64 * 1024);
+  num_batch_requests = 0;
+  if (ret
+      && (!Seal_batch(enclave_type, enclave_id, items, &sealed)
+          || sealed.size() != items.size() || sealed[999] != "sealed:record 999"
+          || !Unseal_batch(enclave_type, enclave_id, sealed, &unsealed)
+          || unsealed != items)) {
+    printf("%s() error, line: %d, batch round trip failed\n",
+           __func__,
+           __LINE__);
+    ret = false;
+  }
+  if (ret && (num_batch_requests < 4 || num_batch_requests > 20)) {
+    printf("%s() error, line: %d, %d requests for two batches\n",
+           __func__,
+           __LINE__,
+           num_batch_requests);
+    ret = false;
+  }
+  set_max_frame_size(default_max_frame_size);
+
+  // Single calls still work, and are numbered after the batches.
+  byte secret[32];
+  byte out[64];
+  int  out_size = sizeof(out);
+  memset(secret, 3, sizeof(secret));
+  if (ret
+      && (!Seal(enclave_type, enclave_id, 32, secret, &out_size, out)
+          || out_size != 32 || memcmp(out, secret, 32) != 0)) {
+    printf("%s() error, line: %d, Seal failed\n", __func__, __LINE__);
+    ret = false;
+  }
+
+  app_request quit;
+  string      quit_str;
+  quit.set_function("quit");
+  quit.SerializeToString(&quit_str);
+  extern app_transport parent_transport;
+  parent_transport.write_message(quit_str.size(), (byte *)quit_str.data());
+  server.join();
+
+  // The parent owns the ring fds.
+#ifdef APPLICATION_SHARED_RING
+  for (int i = 0; i < app_transport::NUM_RING_FDS; i++)
+    parent_transport.ring_fds_[i] = -1;
+#endif
+  parent_transport.close_rings();
+  close(to_child[0]);
+  close(to_child[1]);
+  close(to_parent[0]);
+  close(to_parent[1]);
+  if (ret && print_all)
+    printf("app batch succeeded\n");
+  return ret;
+}
+
+bool test_key_pregeneration(bool print_all) {
+  string alg(Enc_method_ecc_384);
+  if (start_key_pregeneration("rsa-1000", 2)
+      || start_key_pregeneration(alg, 0)) {
+    printf("%s() error, line: %d, bad pool accepted\n", __func__, __LINE__);
+    return false;
+  }
+  if (!start_key_pregeneration(alg, 2)) {
+    printf("%s() error, line: %d, can't start pool\n", __func__, __LINE__);
+    return false;
+  }
+  for (int i = 0; i < 1000 && num_pregenerated_keys(alg) < 2; i++)
+    usleep(10000);
+  if (num_pregenerated_keys(alg) != 2) {
+    printf("%s() error, line: %d, pool not filled\n", __func__, __LINE__);
+    stop_key_pregeneration();
+    return false;
+  }
+
+  key_message k1;
+  key_message k2;
+  key_message pub;
+  if (!new_private_key(alg, &k1) || !new_private_key(alg, &k2)
+      || k1.key_type() != Enc_method_ecc_384_private
+      || !private_key_to_public_key(k1, &pub)
+      || k1.ecc_key().public_point().x() == k2.ecc_key().public_point().x()) {
+    printf("%s() error, line: %d, bad pooled keys\n", __func__, __LINE__);
+    stop_key_pregeneration();
+    return false;
+  }
+
+  // cold_init draws from the pool too.
+  string           enclave_type("simulated-enclave");
+  string           purpose("authentication");
+  string           store_file("/tmp/key_pool_store.bin");
+  cc_trust_manager mgr(enclave_type, purpose, store_file);
+  key_message      policy_key;
+  string           key_type(Enc_method_ecc_384_private);
+  string           key_name("policyKey");
+  string           issuer("policyAuthority");
+  bool             ret =
+      make_root_key_with_cert(key_type, key_name, issuer, &policy_key)
+      && mgr.init_policy_key((byte *)policy_key.certificate().data(),
+                             policy_key.certificate().size())
+      && mgr.cold_init(alg,
+                       Enc_method_aes_256_cbc_hmac_sha256,
+                       "pool-domain",
+                       "localhost",
+                       8123,
+                       "localhost",
+                       8124)
+      && mgr.cc_auth_key_initialized_
+      && mgr.private_auth_key_.key_type() == Enc_method_ecc_384_private;
+  unlink(store_file.c_str());
+  stop_key_pregeneration();
+  if (!ret) {
+    printf("%s() error, line: %d, cold_init failed\n", __func__, __LINE__);
+    return false;
+  }
+  if (num_pregenerated_keys(alg) != 0) {
+    printf("%s() error, line: %d, keys left after stop\n", __func__, __LINE__);
+    return false;
+  }
+  if (print_all)
+    printf("key pregeneration succeeded\n");
+  return true;
+}
+
+// A stand-in Certifier Service: every request gets a new admissions cert
+// for auth_key_, good for lifetime seconds, after delay_usecs_.
+class stand_in_certifier {
+ public:
+  int                   listen_fd_;
+  std::atomic<int>      num_issued_;
+  std::atomic<int>      delay_usecs_;
+  key_message           auth_key_;
+  admission_cert_issuer issuer_;
+
+  bool init(const key_message &policy_key,
+            const key_message &auth_key,
+            double             lifetime,
+            int                port);
+  void run();
+};
+
+bool stand_in_certifier::init(const key_message &policy_key,
+                              const key_message &auth_key,
+                              double             lifetime,
+                              int                port) {
+  num_issued_ = 0;
+  delay_usecs_ = 0;
+  auth_key_.CopyFrom(auth_key);
+  return issuer_.init(policy_key, "policyAuthority", "root", lifetime, 1)
+         && open_server_socket("localhost", port, &listen_fd_);
+}
+
+void stand_in_certifier::run() {
+  for (;;) {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0)
+      return;
+    string                         serialized;
+    trust_request_message          request;
+    trust_response_message         response;
+    std::vector<admission_request> batch(1);
+    std::vector<string>            certs;
+    batch[0].subject_key.CopyFrom(auth_key_);
+    batch[0].subject_name = "recertified";
+    batch[0].subject_organization = "1234567890";
+    batch[0].sn = ++num_issued_;
+    if (sized_socket_read(fd, &serialized) >= 0
+        && request.ParseFromString(serialized)
+        && request.purpose() == "authentication"
+        && issuer_.issue_admission_certs(batch, &certs)) {
+      response.set_status("succeeded");
+      response.set_artifact(certs[0]);
+    } else {
+      response.set_status("failed");
+    }
+    response.SerializeToString(&serialized);
+    if (delay_usecs_ > 0)
+      usleep(delay_usecs_);
+    sized_socket_write(fd, serialized.size(), (byte *)serialized.data());
+    close(fd);
+  }
+}
+
+static void count_recertified(cc_trust_manager &mgr,
+                              const string     &domain_name,
+                              const string     &admissions_cert,
+                              void             *arg) {
+  string current;
+  if (mgr.get_admissions_cert(domain_name, &current)
+      && current == admissions_cert)
+    (*(std::atomic<int> *)arg)++;
+}
+
+extern key_message my_attestation_key;
+
+// Admissions certs that last two seconds are renewed in the background,
+// and a warm restart finds the latest.
+bool test_recertification(bool print_all) {
+  // The simulated enclave keeps the attest key simulator_init made, but
+  // certify_domain needs an attest claim too.
+  byte                 m[256];
+  int                  m_size = sizeof(m);
+  string               serialized_attest_key;
+  string               serialized_claim;
+  signed_claim_message claim;
+  if (!simulated_Getmeasurement(&m_size, m)
+      || !my_attestation_key.SerializeToString(&serialized_attest_key)
+      || !claim.SerializeToString(&serialized_claim)
+      || !simulated_Init(serialized_attest_key,
+                         string((char *)m, m_size),
+                         serialized_claim)) {
+    printf("%s() error, line: %d, Can't init enclave\n", __func__, __LINE__);
+    return false;
+  }
+
+  string             enclave_type("simulated-enclave");
+  string             purpose("authentication");
+  string             store_file("/tmp/recertification_store.bin");
+  string             domain("recert-domain");
+  int                port = 8135;
+  key_message        policy_key;
+  string             key_type(Enc_method_rsa_2048_private);
+  string             key_name("policyKey");
+  string             issuer("policyAuthority");
+  stand_in_certifier certifier;
+  cc_trust_manager  *mgr =
+      new cc_trust_manager(enclave_type, purpose, store_file);
+  if (!make_root_key_with_cert(key_type, key_name, issuer, &policy_key)
+      || !mgr->init_policy_key((byte *)policy_key.certificate().data(),
+                               policy_key.certificate().size())
+      || !mgr->cold_init(Enc_method_rsa_2048,
+                         Enc_method_aes_256_cbc_hmac_sha256,
+                         domain,
+                         "localhost",
+                         port,
+                         "localhost",
+                         port + 1)
+      || !certifier.init(policy_key, mgr->public_auth_key_, 2.0, port)) {
+    printf("%s() error, line: %d, Can't set up\n", __func__, __LINE__);
+    delete mgr;
+    return false;
+  }
+  std::thread certifier_thread([&certifier]() { certifier.run(); });
+
+  bool             ret = false;
+  std::atomic<int> num_callbacks(0);
+  string           first_cert;
+  string           cert;
+  string           restarted_cert;
+  if (!mgr->certify_me() || !mgr->get_admissions_cert(domain, &first_cert)) {
+    printf("%s() error, line: %d, Can't certify\n", __func__, __LINE__);
+    goto done;
+  }
+  if (mgr->start_recertification(0.8, 0.5, 1)
+      || !mgr->add_recertified_callback(count_recertified, &num_callbacks)
+      || !mgr->start_recertification(0.5, 0.75, 1)) {
+    printf("%s() error, line: %d, Can't start recertification\n",
+           __func__,
+           __LINE__);
+    goto done;
+  }
+  for (int i = 0; i < 100 && mgr->num_recertifications() < 2; i++)
+    usleep(100000);
+
+  // Certs can be read while a renewal waits on the Certifier Service.
+  {
+    certifier.delay_usecs_ = 1000000;
+    int issued = certifier.num_issued_;
+    for (int i = 0; i < 300 && certifier.num_issued_ == issued; i++)
+      usleep(10000);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    bool read = mgr->get_admissions_cert(domain, &cert)
+                && mgr->num_recertifications() >= 2;
+    std::chrono::duration<double> waited =
+        std::chrono::steady_clock::now() - start;
+    certifier.delay_usecs_ = 0;
+    if (certifier.num_issued_ == issued || !read || waited.count() > 0.5) {
+      printf("%s() error, line: %d, readers waited %.3f s for a renewal\n",
+             __func__,
+             __LINE__,
+             waited.count());
+      goto done;
+    }
+  }
+  mgr->stop_recertification();
+  if (mgr->num_recertifications() < 2 || num_callbacks < 2
+      || certifier.num_issued_ != 1 + mgr->num_recertifications()
+      || !mgr->get_admissions_cert(domain, &cert) || cert == first_cert) {
+    printf("%s() error, line: %d, not recertified: %d renewals\n",
+           __func__,
+           __LINE__,
+           mgr->num_recertifications());
+    goto done;
+  }
+
+  // The store has the last cert.
+  delete mgr;
+  mgr = new cc_trust_manager(enclave_type, purpose, store_file);
+  if (!mgr->init_policy_key((byte *)policy_key.certificate().data(),
+                            policy_key.certificate().size())
+      || !mgr->warm_restart()
+      || !mgr->get_admissions_cert(domain, &restarted_cert)
+      || restarted_cert != cert) {
+    printf("%s() error, line: %d, renewed cert not saved\n",
+           __func__,
+           __LINE__);
+    goto done;
+  }
+  if (print_all)
+    printf("%d renewals\n", (int)num_callbacks);
+  ret = true;
+
+done:
+  delete mgr;
+  shutdown(certifier.listen_fd_, SHUT_RDWR);
+  close(certifier.listen_fd_);
+  certifier_thread.join();
+  unlink(store_file.c_str());
+  return ret;
+}
+
+// Server credential rotation
+// -------------------------------------------------------------------
+
+static void echo_once(secure_authenticated_channel &channel) {
+  string msg;
+  if (channel.read(&msg) > 0)
+    channel.write(msg.size(), (byte *)msg.data());
+  channel.close();
+}
+
+// Connects, optionally waits, and checks an echo.  *der is the server's
+// cert.
+static bool rotation_round_trip(const string &policy_cert,
+                                key_message  &client_key,
+                                const string &client_cert,
+                                int           port,
+                                int           wait_usecs,
+                                string       *der) {
+  string                       role("client");
+  string                       host("localhost");
+  secure_authenticated_channel channel(role);
+  string                       hello("hello");
+  string                       out;
+  if (!channel.init_client_ssl(host,
+                               port,
+                               policy_cert,
+                               client_key,
+                               client_cert)
+      || channel.peer_cert_ == nullptr
+      || !x509_to_asn1(channel.peer_cert_, der)) {
+    channel.close();
+    return false;
+  }
+  if (wait_usecs > 0)
+    usleep(wait_usecs);
+  bool ok = channel.write(hello.size(), (byte *)hello.data()) > 0
+            && channel.read(&out) > 0 && out == hello;
+  channel.close();
+  return ok;
+}
+
+// The server's key and cert change every 50ms while clients connect.
+// Every handshake succeeds, both certs are seen, and a channel opened
+// before a change still works after it.
+bool test_server_credential_rotation(bool print_all) {
+  key_message policy_key;
+  key_message server_keys[2];
+  string      server_certs[2];
+  key_message client_key;
+  string      client_cert;
+  string      type(Enc_method_rsa_2048_private);
+  string      name("policyKey");
+  string      issuer("policyAuthority");
+  if (!make_root_key_with_cert(type, name, issuer, &policy_key)
+      || !make_certifier_rsa_key(2048, &server_keys[0])
+      || !make_certifier_rsa_key(2048, &server_keys[1])
+      || !make_certifier_rsa_key(2048, &client_key)
+      || !make_channel_cert(policy_key,
+                            server_keys[0],
+                            "server",
+                            &server_certs[0])
+      || !make_channel_cert(policy_key,
+                            server_keys[1],
+                            "server",
+                            &server_certs[1])
+      || !make_channel_cert(policy_key, client_key, "client", &client_cert)) {
+    printf("%s() error, line: %d, Can't make keys\n", __func__, __LINE__);
+    return false;
+  }
+  string             policy_cert(policy_key.certificate());
+  int                port = 8137;
+  server_credentials creds;
+  if (!creds.update(policy_cert, server_keys[0], server_certs[0])) {
+    printf("%s() error, line: %d, Can't load credentials\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    printf("%s() error, line: %d, fork failed\n", __func__, __LINE__);
+    return false;
+  }
+  if (pid == 0) {
+    std::thread rotate([&]() {
+      for (int i = 1;; i++) {
+        usleep(50000);
+        creds.update(policy_cert, server_keys[i % 2], server_certs[i % 2]);
+      }
+    });
+    string host("localhost");
+    server_dispatch(host, port, creds, echo_once);
+    _exit(1);
+  }
+
+  bool   ret = false;
+  bool   seen[2] = {false, false};
+  string der;
+  int    num_connections = 0;
+  // Wait for the server.
+  for (int i = 0; i < 100; i++) {
+    if (rotation_round_trip(policy_cert,
+                            client_key,
+                            client_cert,
+                            port,
+                            0,
+                            &der))
+      break;
+    usleep(50000);
+  }
+  for (; num_connections < 40; num_connections++) {
+    if (!rotation_round_trip(policy_cert,
+                             client_key,
+                             client_cert,
+                             port,
+                             0,
+                             &der)) {
+      printf("%s() error, line: %d, connection %d failed\n",
+             __func__,
+             __LINE__,
+             num_connections);
+      goto done;
+    }
+    for (int j = 0; j < 2; j++) {
+      if (der == server_certs[j])
+        seen[j] = true;
+    }
+    usleep(10000);
+  }
+  if (!seen[0] || !seen[1]) {
+    printf("%s() error, line: %d, credentials not rotated\n",
+           __func__,
+           __LINE__);
+    goto done;
+  }
+  if (!rotation_round_trip(policy_cert,
+                           client_key,
+                           client_cert,
+                           port,
+                           150000,
+                           &der)) {
+    printf("%s() error, line: %d, open channel broken by rotation\n",
+           __func__,
+           __LINE__);
+    goto done;
+  }
+  if (print_all)
+    printf("%d connections across rotations\n", num_connections);
+  ret = true;
+
+done:
+  kill(pid, SIGKILL);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return ret;
+}
+
+// Client channel pool
+// -------------------------------------------------------------------
+
+static void pool_echo_read(secure_authenticated_channel &channel,
+                           bool                          ok,
+                           const string                 &msg,
+                           void                         *arg) {
+  if (!ok)
+    return;
+  if (msg == "close") {
+    channel.close();
+    return;
+  }
+  channel.async_write_message(msg, nullptr, nullptr);
+  channel.async_read_message(pool_echo_read, arg);
+}
+
+static void pool_echo_ready(secure_authenticated_channel &channel,
+                            bool                          ok,
+                            void                         *arg) {
+  if (ok)
+    channel.async_read_message(pool_echo_read, arg);
+}
+
+static bool pool_round_trip(channel_pool *pool,
+                            const string &policy_cert,
+                            key_message  &client_key,
+                            const string &client_cert,
+                            int           port) {
+  string                        host("localhost");
+  string                        hello("hello");
+  string                        out;
+  secure_authenticated_channel *c =
+      pool->borrow(host, port, policy_cert, client_key, client_cert);
+  if (c == nullptr)
+    return false;
+  bool ok = c->write(hello.size(), (byte *)hello.data()) > 0
+            && c->read(&out) > 0 && out == hello;
+  pool->give_back(c, ok);
+  return ok;
+}
+
+// Requests reuse pooled channels, from one thread and several; the
+// per-host limit holds, and channels the server closed or that sat idle
+// too long are replaced.
+bool test_channel_pool(bool print_all) {
+  key_message policy_key;
+  key_message server_key;
+  key_message client_key;
+  string      server_cert;
+  string      client_cert;
+  string      type(Enc_method_rsa_2048_private);
+  string      name("policyKey");
+  string      issuer("policyAuthority");
+  if (!make_root_key_with_cert(type, name, issuer, &policy_key)
+      || !make_certifier_rsa_key(2048, &server_key)
+      || !make_certifier_rsa_key(2048, &client_key)
+      || !make_channel_cert(policy_key, server_key, "server", &server_cert)
+      || !make_channel_cert(policy_key, client_key, "client", &client_cert)) {
+    printf("%s() error, line: %d, Can't make keys\n", __func__, __LINE__);
+    return false;
+  }
+  string policy_cert(policy_key.certificate());
+
+  string          host("localhost");
+  int             port = 8139;
+  channel_reactor server;
+  if (!server.init()
+      || !async_server_listen(host,
+                              port,
+                              policy_cert,
+                              policy_cert,
+                              0,
+                              nullptr,
+                              server_key,
+                              server_cert,
+                              &server,
+                              pool_echo_ready,
+                              nullptr)) {
+    printf("%s() error, line: %d, Can't start server\n", __func__, __LINE__);
+    return false;
+  }
+  std::thread server_thread([&server]() { server.run(); });
+
+  bool                          ret = false;
+  channel_pool                 *pool = new channel_pool(2, 1, 200);
+  secure_authenticated_channel *a = nullptr;
+  secure_authenticated_channel *b = nullptr;
+  string                        bye("close");
+  std::atomic<int>              num_failed(0);
+  std::vector<std::thread>      clients;
+
+  for (int i = 0; i < 10; i++) {
+    if (!pool_round_trip(pool, policy_cert, client_key, client_cert, port)) {
+      printf("%s() error, line: %d, request failed\n", __func__, __LINE__);
+      goto done;
+    }
+  }
+  if (pool->num_connects() != 1 || pool->num_idle() != 1) {
+    printf("%s() error, line: %d, channel not reused\n", __func__, __LINE__);
+    goto done;
+  }
+
+  a = pool->borrow(host, port, policy_cert, client_key, client_cert);
+  b = pool->borrow(host, port, policy_cert, client_key, client_cert);
+  if (a == nullptr || b == nullptr || a == b
+      || pool->borrow(host, port, policy_cert, client_key, client_cert)
+             != nullptr) {
+    printf("%s() error, line: %d, per-host limit not kept\n",
+           __func__,
+           __LINE__);
+    goto done;
+  }
+  pool->give_back(a);
+  pool->give_back(b);
+
+  for (int t = 0; t < 4; t++) {
+    clients.push_back(std::thread([&]() {
+      for (int i = 0; i < 25; i++) {
+        if (!pool_round_trip(pool, policy_cert, client_key, client_cert, port))
+          num_failed++;
+      }
+    }));
+  }
+  for (size_t t = 0; t < clients.size(); t++)
+    clients[t].join();
+  if (num_failed != 0 || pool->num_connects() != 2 || pool->num_open() != 2) {
+    printf("%s() error, line: %d, %d threaded requests failed\n",
+           __func__,
+           __LINE__,
+           (int)num_failed);
+    goto done;
+  }
+
+  // Once the server has closed it, a channel isn't handed out again.
+  a = pool->borrow(host, port, policy_cert, client_key, client_cert);
+  if (a == nullptr || a->write(bye.size(), (byte *)bye.data()) <= 0) {
+    printf("%s() error, line: %d, Can't close\n", __func__, __LINE__);
+    goto done;
+  }
+  usleep(100000);
+  pool->give_back(a);
+  if (pool->num_open() != 1) {
+    printf("%s() error, line: %d, closed channel kept\n", __func__, __LINE__);
+    goto done;
+  }
+
+  // Nor is one idle longer than the timeout.
+  usleep(1100000);
+  if (!pool_round_trip(pool, policy_cert, client_key, client_cert, port)
+      || pool->num_connects() != 3 || pool->num_open() != 1) {
+    printf("%s() error, line: %d, idle channel reused\n", __func__, __LINE__);
+    goto done;
+  }
+  if (print_all)
+    printf("%d connections for 111 requests\n", pool->num_connects());
+  ret = true;
+
+done:
+  delete pool;
+  server.stop();
+  server_thread.join();
+  return ret;
+}
@@ -620,6 +620,101 @@ bool test__local_certify(string &enclave_type,
   return true;
 }
 
+// The compact form of a package must expand to the same bytes, be
+// smaller when keys repeat, and validate as the full one does.
+bool test__compact_evidence(string &enclave_type, string &evidence_descriptor) {
+  evidence_package      evp;
+  signed_claim_sequence trusted_measurements;
+  signed_claim_sequence trusted_platforms;
+  key_message           policy_key;
+  key_message           policy_pk;
+  string                unused("unused-file-name");
+  if (!construct_standard_evidence_package(enclave_type,
+                                           false,
+                                           unused,
+                                           evidence_descriptor,
+                                           &trusted_platforms,
+                                           &trusted_measurements,
+                                           &policy_key,
+                                           &policy_pk,
+                                           &evp))
+    return false;
+
+  evidence_package compact;
+  evidence_package expanded;
+  if (!compact_evidence_package(evp, &compact)
+      || !is_compact_evidence_package(compact)
+      || !expand_evidence_package(compact, &expanded)) {
+    printf("%s() error, line %d, can't compact or expand\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  string s_evp, s_compact, s_expanded;
+  if (!evp.SerializeToString(&s_evp) || !compact.SerializeToString(&s_compact)
+      || !expanded.SerializeToString(&s_expanded))
+    return false;
+  if (s_evp != s_expanded) {
+    printf("%s() error, line %d, expanded package differs\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  if (compact.interned_size() < 1 || s_compact.size() >= s_evp.size()) {
+    printf("%s() error, line %d, nothing interned: %d entries, %d >= %d\n",
+           __func__,
+           __LINE__,
+           compact.interned_size(),
+           (int)s_compact.size(),
+           (int)s_evp.size());
+    return false;
+  }
+  if (debug_print) {
+    printf("%s: %d bytes, compact %d bytes, %d interned\n",
+           evidence_descriptor.c_str(),
+           (int)s_evp.size(),
+           (int)s_compact.size(),
+           compact.interned_size());
+  }
+
+  string purpose("authentication");
+  if (!validate_evidence(evidence_descriptor,
+                         trusted_platforms,
+                         trusted_measurements,
+                         purpose,
+                         compact,
+                         policy_pk)) {
+    printf("%s() error, line %d, compact package doesn't validate\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+
+  // A bad reference is refused, not read past the table.
+  evidence_package bad;
+  bad.CopyFrom(compact);
+  compact_evidence *ce = bad.mutable_compact_assertion(0);
+  if (ce->refs_size() > 0) {
+    ce->set_refs(0, bad.interned_size());
+    if (expand_evidence_package(bad, &expanded))
+      return false;
+  }
+  bad.CopyFrom(compact);
+  bad.mutable_compact_assertion(0)->add_offsets(0);
+  if (expand_evidence_package(bad, &expanded))
+    return false;
+  // So is an offset past the end of the body.
+  bad.CopyFrom(compact);
+  ce = bad.mutable_compact_assertion(0);
+  if (ce->refs_size() > 0) {
+    ce->set_offsets(0, (int)ce->body().size() + 1);
+    if (expand_evidence_package(bad, &expanded))
+      return false;
+  }
+
+  return true;
+}
+
 // test_local_certify(), test_partial_local_certify()
 // Exist so that we can exercise these tests from the Python bindings to
 // certifier_tests.so, for the default behaviour of these test cases.
@@ -312,6 +312,183 @@ bool test_x_509_sign(bool print_all) {
   return success;
 }
 
+// A root and a certificate it issued, both RSA-2048.
+static bool make_cert_pair(const char  *name,
+                           key_message *root_key,
+                           X509        *root,
+                           X509        *leaf) {
+  key_message pub_root, leaf_key, pub_leaf;
+  string      root_name(name), root_desc("root");
+  string      leaf_name("leaf"), leaf_desc("leaf");
+  if (!make_certifier_rsa_key(2048, root_key)
+      || !private_key_to_public_key(*root_key, &pub_root)
+      || !make_certifier_rsa_key(2048, &leaf_key)
+      || !private_key_to_public_key(leaf_key, &pub_leaf))
+    return false;
+  return produce_artifact(*root_key,
+                          root_name,
+                          root_desc,
+                          pub_root,
+                          root_name,
+                          root_desc,
+                          1L,
+                          86400.0,
+                          root,
+                          true)
+         && produce_artifact(*root_key,
+                             root_name,
+                             root_desc,
+                             pub_leaf,
+                             leaf_name,
+                             leaf_desc,
+                             2L,
+                             86400.0,
+                             leaf,
+                             false);
+}
+
+bool test_cert_verifier(bool print_all) {
+  cert_verifier &v = cert_verifier::instance();
+  key_message    root_key, other_key, pub_root;
+  X509          *root = X509_new(), *leaf = X509_new();
+  X509          *other_root = X509_new(), *other_leaf = X509_new();
+  string         root_der, leaf_der;
+  bool           ret = false;
+
+  if (!make_cert_pair("root-1", &root_key, root, leaf)
+      || !make_cert_pair("root-2", &other_key, other_root, other_leaf)
+      || !private_key_to_public_key(root_key, &pub_root)
+      || !x509_to_asn1(root, &root_der) || !x509_to_asn1(leaf, &leaf_der))
+    goto done;
+
+  {
+    // Each DER is decoded once; stores are kept per root.
+    int         decodes = v.num_decodes();
+    X509       *d1 = v.decode(leaf_der), *d2 = v.decode(leaf_der);
+    X509       *r1 = v.decode(root_der);
+    X509_STORE *s1 = v.store(r1), *s2 = v.store(root);
+    bool        same = d1 != nullptr && d1 == d2 && s1 != nullptr && s1 == s2
+                && v.num_decodes() == decodes + 2;
+    bool        chain_ok = v.verify_chain(r1, d1, std::vector<X509 *>())
+                    && !v.verify_chain(other_root, d1, std::vector<X509 *>());
+    X509_free(d1);
+    X509_free(d2);
+    X509_free(r1);
+    X509_STORE_free(s1);
+    X509_STORE_free(s2);
+    if (!same) {
+      printf("%s() error, line %d, decode not memoized\n", __func__, __LINE__);
+      goto done;
+    }
+    if (!chain_ok) {
+      printf("%s() error, line %d, chain check wrong\n", __func__, __LINE__);
+      goto done;
+    }
+  }
+
+  {
+    // A verified signature isn't checked again; a bad one always is.
+    int  checks = v.num_signature_checks();
+    bool sig_ok = v.verify_signature(leaf, pub_root)
+                  && v.verify_signature(leaf, root_key)
+                  && v.verify_signature(leaf, pub_root)
+                  && !v.verify_signature(leaf, other_key)
+                  && !v.verify_signature(leaf, other_key);
+    if (!sig_ok || v.num_signature_checks() != checks + 4) {
+      printf("%s() error, line %d, signature checks wrong\n",
+             __func__,
+             __LINE__);
+      goto done;
+    }
+  }
+  ret = true;
+
+done:
+  if (print_all) {
+    printf("cert_verifier: %d decodes, %d signature checks\n",
+           v.num_decodes(),
+           v.num_signature_checks());
+  }
+  X509_free(root);
+  X509_free(leaf);
+  X509_free(other_root);
+  X509_free(other_leaf);
+  return ret;
+}
+
+// Certificates from a batch verify under the policy key and carry what
+// was asked for, whichever thread signed them.
+bool test_admission_cert_issuer(bool print_all) {
+  admission_cert_issuer          issuer;
+  key_message                    policy_key, policy_pk;
+  std::vector<admission_request> batch(6);
+  std::vector<string>            certs;
+  string issuer_name("policyAuthority"), issuer_organization("root");
+
+  if (issuer.issue_admission_certs(batch, &certs)) {
+    printf("%s() error, line %d, uninitialized issuer issued\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  if (!make_certifier_rsa_key(2048, &policy_key)
+      || !private_key_to_public_key(policy_key, &policy_pk)
+      || !issuer.init(policy_key, issuer_name, issuer_organization, 86400.0, 2))
+    return false;
+  for (int i = 0; i < (int)batch.size(); i++) {
+    key_message k;
+    if (i % 2 == 0 ? !make_certifier_rsa_key(2048, &k)
+                   : !make_certifier_ecc_key(384, &k))
+      return false;
+    if (!private_key_to_public_key(k, &batch[i].subject_key))
+      return false;
+    batch[i].subject_name = "node-" + std::to_string(i);
+    batch[i].subject_organization = "1234567890";
+    batch[i].sn = 100 + i;
+  }
+  if (!issuer.issue_admission_certs(batch, &certs)
+      || certs.size() != batch.size()) {
+    printf("%s() error, line %d, can't issue\n", __func__, __LINE__);
+    return false;
+  }
+
+  for (int i = 0; i < (int)batch.size(); i++) {
+    X509       *x = X509_new();
+    char        cn[256], issuer_cn[256];
+    uint64_t    sn = 0;
+    key_message subject_key_out;
+    bool        ok = asn1_to_x509(certs[i], x)
+              && cert_verifier::instance().verify_signature(x, policy_pk)
+              && X509_NAME_get_text_by_NID(X509_get_subject_name(x),
+                                           NID_commonName,
+                                           cn,
+                                           sizeof(cn))
+                     > 0
+              && X509_NAME_get_text_by_NID(X509_get_issuer_name(x),
+                                           NID_commonName,
+                                           issuer_cn,
+                                           sizeof(issuer_cn))
+                     > 0
+              && ASN1_INTEGER_get_uint64(&sn, X509_get_serialNumber(x))
+              && x509_to_public_key(x, &subject_key_out)
+              && issuer_name == issuer_cn && batch[i].subject_name == cn
+              && sn == batch[i].sn
+              && same_key(subject_key_out, batch[i].subject_key)
+              && X509_get_ext_count(x) == 2;
+    if (print_all && ok && i == 0)
+      X509_print_fp(stdout, x);
+    X509_free(x);
+    if (!ok) {
+      printf("%s() error, line %d, certificate %d wrong\n",
+             __func__,
+             __LINE__,
+             i);
+      return false;
+    }
+  }
+  return true;
+}
+
 bool test_sev_certs(bool print_all) {
   string ark_file_str("./test_data/milan_ark_cert.der");
   string ask_file_str("./test_data/milan_ask_cert.der");
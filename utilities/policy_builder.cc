@@ -0,0 +1,463 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <map>
+#include <thread>
+
+#include "certifier.h"
+#include "support.h"
+#include "policy_builder.h"
+
+using std::map;
+using std::vector;
+using namespace certifier::utilities;
+
+namespace {
+
+// A clause to sign and the private key to sign it with.
+typedef struct unsigned_claim {
+  vse_clause         cl;
+  const key_message *signing_key;
+} unsigned_claim;
+
+class policy_build {
+ public:
+  policy_build(const policy_spec::policy &pol) : pol_(pol) {}
+
+  bool make_platforms();
+  bool add_claim(const policy_spec::claim &c);
+  bool add_measurement(const string &hex);
+  bool add_platform(const policy_spec::platform &p);
+  bool sign(double          duration_hours,
+            const string   &signing_alg,
+            int             num_threads,
+            vector<string> *serialized_claims);
+
+  const key_message *private_key(const string &file);
+
+ private:
+  const policy_spec::policy &pol_;
+  map<string, key_message>   private_keys_;
+  map<string, key_message>   public_keys_;
+  map<string, key_message>   cert_keys_;
+  map<string, ::platform>    platforms_;
+  vector<unsigned_claim>     claims_;
+
+  bool public_key(const string &file, key_message *k);
+  bool measurement(const string &hex, string *m);
+  bool file_entity(const string &kind, const string &file, entity_message *e);
+  bool subject_entity(policy_spec::subject_type t,
+                      const string             &sub,
+                      entity_message           *e);
+  bool object_entity(policy_spec::object_type t,
+                     const string            &obj,
+                     entity_message          *e);
+  bool says(const string &signing_key, vse_clause &said);
+};
+
+const key_message *policy_build::private_key(const string &file) {
+  auto it = private_keys_.find(file);
+  if (it != private_keys_.end())
+    return &it->second;
+
+  string      serialized;
+  key_message k;
+  if (!read_file_into_string(file, &serialized)
+      || !k.ParseFromString(serialized)) {
+    printf("%s() error, line %d, can't read key %s\n",
+           __func__,
+           __LINE__,
+           file.c_str());
+    return nullptr;
+  }
+  return &(private_keys_[file] = k);
+}
+
+bool policy_build::public_key(const string &file, key_message *k) {
+  auto it = public_keys_.find(file);
+  if (it != public_keys_.end()) {
+    k->CopyFrom(it->second);
+    return true;
+  }
+  const key_message *pk = private_key(file);
+  if (pk == nullptr || !private_key_to_public_key(*pk, k))
+    return false;
+  public_keys_[file] = *k;
+  return true;
+}
+
+// As measurement_init.exe --mrenclave: an odd length gets a leading 0 and
+// at most 64 bytes are used.
+bool policy_build::measurement(const string &hex, string *m) {
+  const int max_measurement_size = 64;
+  string    h = (hex.size() % 2) ? "0" + hex : hex;
+
+  m->clear();
+  for (size_t i = 0; i + 1 < h.size() && (int)m->size() < max_measurement_size;
+       i += 2) {
+    char *end = nullptr;
+    char  digits[3] = {h[i], h[i + 1], 0};
+    long  b = strtol(digits, &end, 16);
+    if (end != digits + 2) {
+      printf("%s() error, line %d, bad measurement %s\n",
+             __func__,
+             __LINE__,
+             hex.c_str());
+      return false;
+    }
+    m->push_back((char)b);
+  }
+  return true;
+}
+
+// Keys, measurements, platforms and environments read from files, as
+// the make_*_vse_clause utilities do.
+bool policy_build::file_entity(const string   &kind,
+                               const string   &file,
+                               entity_message *e) {
+  if (kind == "key") {
+    key_message k;
+    return public_key(file, &k) && make_key_entity(k, e);
+  }
+
+  string serialized;
+  if (!read_file_into_string(file, &serialized)) {
+    printf("%s() error, line %d, can't read %s\n",
+           __func__,
+           __LINE__,
+           file.c_str());
+    return false;
+  }
+  if (kind == "measurement")
+    return make_measurement_entity(serialized, e);
+  if (kind == "platform") {
+    ::platform pl;
+    return pl.ParseFromString(serialized) && make_platform_entity(pl, e);
+  }
+  if (kind == "environment") {
+    environment env;
+    return env.ParseFromString(serialized) && make_environment_entity(env, e);
+  }
+  return false;
+}
+
+bool policy_build::subject_entity(policy_spec::subject_type t,
+                                  const string             &sub,
+                                  entity_message           *e) {
+  switch (t) {
+    case policy_spec::KEY_SUBJECT:
+      return file_entity("key", sub, e);
+    case policy_spec::CERT_SUBJECT: {
+      auto it = cert_keys_.find(sub);
+      if (it == cert_keys_.end()) {
+        string      cert;
+        key_message k;
+        if (!read_file_into_string(sub, &cert) || !PublicKeyFromCert(cert, &k)) {
+          printf("%s() error, line %d, can't get key from cert %s\n",
+                 __func__,
+                 __LINE__,
+                 sub.c_str());
+          return false;
+        }
+        it = cert_keys_.insert(make_pair(sub, k)).first;
+      }
+      return make_key_entity(it->second, e);
+    }
+    case policy_spec::MEASUREMENT_SUBJECT: {
+      string m;
+      return measurement(sub, &m) && make_measurement_entity(m, e);
+    }
+    case policy_spec::PLATFORM_SUBJECT: {
+      auto it = platforms_.find(sub);
+      if (it == platforms_.end()) {
+        printf("%s() error, line %d, no platform %s in the policy\n",
+               __func__,
+               __LINE__,
+               sub.c_str());
+        return false;
+      }
+      return make_platform_entity(it->second, e);
+    }
+    case policy_spec::ENVIRONMENT_SUBJECT:
+      return file_entity("environment", sub, e);
+    default:
+      return false;
+  }
+}
+
+bool policy_build::object_entity(policy_spec::object_type t,
+                                 const string            &obj,
+                                 entity_message          *e) {
+  switch (t) {
+    case policy_spec::KEY_OBJECT:
+      return file_entity("key", obj, e);
+    case policy_spec::MEASUREMENT_OBJECT:
+      return file_entity("measurement", obj, e);
+    case policy_spec::PLATFORM_OBJECT:
+      return file_entity("platform", obj, e);
+    case policy_spec::ENVIRONMENT_OBJECT:
+      return file_entity("environment", obj, e);
+    default:
+      return false;
+  }
+}
+
+bool policy_build::make_platforms() {
+  for (const policy_spec::platform &p : pol_.platforms) {
+    ::platform pl;
+    pl.set_has_key(false);
+    pl.set_platform_type(p.type);
+    for (const policy_spec::property &pp : p.props) {
+      string   name = pp.name, type = pp.type, cmp = pp.comparator;
+      string   string_value = pp.value;
+      uint64_t int_value = 0;
+      if (type == "int")
+        int_value = strtoull(pp.value.c_str(), nullptr, 10);
+      if (!make_property(name,
+                         type,
+                         cmp,
+                         int_value,
+                         string_value,
+                         pl.mutable_props()->add_props())) {
+        printf("%s() error, line %d, bad property %s on %s\n",
+               __func__,
+               __LINE__,
+               pp.name.c_str(),
+               p.type.c_str());
+        return false;
+      }
+    }
+    platforms_[p.type] = pl;
+  }
+  return true;
+}
+
+// Queues "signing_key says said" for signing.
+bool policy_build::says(const string &signing_key, vse_clause &said) {
+  entity_message key_ent;
+  string         verb("says");
+  unsigned_claim uc;
+  if (!file_entity("key", signing_key, &key_ent)
+      || !make_indirect_vse_clause(key_ent, verb, said, &uc.cl)) {
+    return false;
+  }
+  uc.signing_key = private_key(signing_key);
+  if (uc.signing_key == nullptr)
+    return false;
+  claims_.push_back(uc);
+  return true;
+}
+
+bool policy_build::add_claim(const policy_spec::claim &c) {
+  const policy_spec::clause &cl = c.cl;
+  entity_message             sub;
+  vse_clause                 inner;
+  string                     verb = cl.verb;
+
+  if (!subject_entity(cl.stype, cl.sub, &sub))
+    return false;
+  if (c.ctype == policy_spec::UNARY_CLAUSE) {
+    if (!make_unary_vse_clause(sub, verb, &inner))
+      return false;
+  } else if (c.ctype == policy_spec::SIMPLE_CLAUSE) {
+    entity_message obj;
+    if (!object_entity(cl.otype, cl.obj, &obj)
+        || !make_simple_vse_clause(sub, verb, obj, &inner))
+      return false;
+  } else if (c.ctype == policy_spec::INDIRECT_CLAUSE) {
+    entity_message ssub;
+    vse_clause     sub_clause;
+    string         sverb = cl.sverb;
+    if (!subject_entity(cl.sstype, cl.ssub, &ssub))
+      return false;
+    if (cl.ctype == policy_spec::UNARY_CLAUSE) {
+      if (!make_unary_vse_clause(ssub, sverb, &sub_clause))
+        return false;
+    } else if (cl.ctype == policy_spec::SIMPLE_CLAUSE) {
+      entity_message sobj;
+      if (!object_entity(cl.sotype, cl.sobj, &sobj)
+          || !make_simple_vse_clause(ssub, sverb, sobj, &sub_clause))
+        return false;
+    } else {
+      return false;
+    }
+    if (!make_indirect_vse_clause(sub, verb, sub_clause, &inner))
+      return false;
+  } else {
+    return false;
+  }
+
+  // The claim's own subject and verb wrap the clause.
+  entity_message claim_sub;
+  string         claim_verb = c.verb;
+  unsigned_claim uc;
+  if (!subject_entity(c.stype, c.sub, &claim_sub)
+      || !make_indirect_vse_clause(claim_sub, claim_verb, inner, &uc.cl))
+    return false;
+  uc.signing_key = private_key(c.skey == "" ? pol_.policy_key : c.skey);
+  if (uc.signing_key == nullptr)
+    return false;
+  claims_.push_back(uc);
+  return true;
+}
+
+bool policy_build::add_measurement(const string &hex) {
+  entity_message m_ent;
+  vse_clause     trusted;
+  string         m, verb("is-trusted");
+  if (!measurement(hex, &m) || !make_measurement_entity(m, &m_ent)
+      || !make_unary_vse_clause(m_ent, verb, &trusted))
+    return false;
+  return says(pol_.policy_key, trusted);
+}
+
+bool policy_build::add_platform(const policy_spec::platform &p) {
+  entity_message p_ent;
+  vse_clause     trusted;
+  string         verb("has-trusted-platform-property");
+  if (!subject_entity(policy_spec::PLATFORM_SUBJECT, p.type, &p_ent)
+      || !make_unary_vse_clause(p_ent, verb, &trusted))
+    return false;
+  return says(pol_.policy_key, trusted);
+}
+
+// Every claim gets the same validity period.  Keys are only read here,
+// so the workers share them.
+bool policy_build::sign(double          duration_hours,
+                        const string   &signing_alg,
+                        int             num_threads,
+                        vector<string> *serialized_claims) {
+  time_point t_not_before, t_not_after;
+  string     not_before, not_after;
+  if (!time_now(&t_not_before) || !time_to_string(t_not_before, &not_before)
+      || !add_interval_to_time_point(t_not_before,
+                                     duration_hours,
+                                     &t_not_after)
+      || !time_to_string(t_not_after, &not_after)) {
+    printf("%s() error, line %d, can't make validity period\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+
+  if (num_threads <= 0)
+    num_threads = (int)std::thread::hardware_concurrency();
+  if (num_threads <= 0)
+    num_threads = 1;
+  if (num_threads > (int)claims_.size())
+    num_threads = (int)claims_.size();
+
+  serialized_claims->assign(claims_.size(), string());
+  std::atomic<int>  next(0);
+  std::atomic<bool> ok(true);
+  auto              worker = [&]() {
+    string format("vse-clause");
+    string descriptor;
+    for (int i = next++; ok && i < (int)claims_.size(); i = next++) {
+      string               serialized_cl;
+      claim_message        cm;
+      signed_claim_message sc;
+      if (!claims_[i].cl.SerializeToString(&serialized_cl)
+          || !make_claim(serialized_cl.size(),
+                         (byte *)serialized_cl.data(),
+                         format,
+                         descriptor,
+                         not_before,
+                         not_after,
+                         &cm)
+          || !make_signed_claim(signing_alg.c_str(),
+                                cm,
+                                *claims_[i].signing_key,
+                                &sc)
+          || !sc.SerializeToString(&(*serialized_claims)[i])) {
+        printf("%s() error, line %d, can't sign claim %d\n",
+               __func__,
+               __LINE__,
+               i);
+        ok = false;
+      }
+    }
+  };
+
+  vector<std::thread> threads;
+  for (int i = 1; i < num_threads; i++)
+    threads.push_back(std::thread(worker));
+  worker();
+  for (std::thread &t : threads)
+    t.join();
+  return ok;
+}
+
+}  // namespace
+
+bool build_policy_package(const policy_spec::policy &pol,
+                          double                     duration_hours,
+                          const string              &signing_alg,
+                          int                        num_threads,
+                          string                    *serialized_package) {
+  policy_build b(pol);
+
+  if (b.private_key(pol.policy_key) == nullptr)
+    return false;
+  if (!b.make_platforms())
+    return false;
+
+  // Same order as the utility pipeline: claims, measurements, platforms.
+  for (const policy_spec::claim &c : pol.claims) {
+    if (!b.add_claim(c)) {
+      printf("%s() error, line %d, can't make claim about %s\n",
+             __func__,
+             __LINE__,
+             c.cl.sub.c_str());
+      return false;
+    }
+  }
+  for (const string &m : pol.measurements) {
+    if (!b.add_measurement(m)) {
+      printf("%s() error, line %d, can't make measurement claim %s\n",
+             __func__,
+             __LINE__,
+             m.c_str());
+      return false;
+    }
+  }
+  for (const policy_spec::platform &p : pol.platforms) {
+    if (!b.add_platform(p)) {
+      printf("%s() error, line %d, can't make platform claim %s\n",
+             __func__,
+             __LINE__,
+             p.type.c_str());
+      return false;
+    }
+  }
+
+  vector<string> signed_claims;
+  if (!b.sign(duration_hours, signing_alg, num_threads, &signed_claims))
+    return false;
+
+  buffer_sequence bufs;
+  for (string &sc : signed_claims)
+    bufs.add_block()->swap(sc);
+  if (!bufs.SerializeToString(serialized_package)) {
+    printf("%s() error, line %d, can't serialize package\n",
+           __func__,
+           __LINE__);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,112 @@
+//  Copyright (c) 2021-23, VMware Inc, and the Certifier Authors.  All rights
+//  reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _POLICY_BUILDER_H__
+#define _POLICY_BUILDER_H__
+
+#include <string>
+#include <vector>
+
+// The policy as read from the policy JSON.  These are kept apart from the
+// protobuf types of the same name so policy_generator.cc needn't see them.
+namespace policy_spec {
+
+typedef struct property {
+  std::string comparator;
+  std::string type;
+  std::string name;
+  std::string value;
+} property;
+
+typedef enum subject_type {
+  KEY_SUBJECT,
+  CERT_SUBJECT,
+  MEASUREMENT_SUBJECT,
+  ENVIRONMENT_SUBJECT,
+  PLATFORM_SUBJECT,
+  NONE_SUBJECT,
+} subject_type;
+
+typedef enum object_type {
+  KEY_OBJECT,
+  MEASUREMENT_OBJECT,
+  ENVIRONMENT_OBJECT,
+  PLATFORM_OBJECT,
+  NONE_OBJECT,
+} object_type;
+
+typedef enum clause_type {
+  SIMPLE_CLAUSE,
+  UNARY_CLAUSE,
+  INDIRECT_CLAUSE,
+  NONE_CLAUSE,
+} clause_type;
+
+typedef struct clause {
+  std::string  sub;
+  subject_type stype;
+  std::string  verb;
+  std::string  obj;
+  object_type  otype;
+  clause_type  ctype;
+  /* For indirect clause only */
+  std::string  ssub;
+  subject_type sstype;
+  std::string  sobj;
+  object_type  sotype;
+  std::string  sverb;
+} clause;
+
+typedef struct claim {
+  std::string  sub;
+  subject_type stype;
+  std::string  verb;
+  clause_type  ctype;
+  clause       cl;
+  std::string  skey;
+} claim;
+
+typedef struct platform {
+  std::string           type;
+  std::vector<property> props;
+} platform;
+
+typedef struct policy {
+  std::string              policy_key;  // private policy key file
+  std::vector<platform>    platforms;
+  std::vector<std::string> measurements;  // hex
+  std::vector<claim>       claims;
+} policy;
+
+}  // namespace policy_spec
+
+/*
+ * Builds the signed policy package for pol in-process: the same claims,
+ * in the same order, as running the policy utilities one after another,
+ * packaged as package_claims.exe does.  Each key or certificate file is
+ * read once, and claims are signed on num_threads threads (0 means one
+ * per core).
+ *
+ * Subjects are key files, certificate files, hex measurements or the
+ * type of a platform in pol.  Objects, and environment subjects, are
+ * files as for the make_*_vse_clause utilities.
+ */
+bool build_policy_package(const policy_spec::policy &pol,
+                          double                     duration_hours,
+                          const std::string         &signing_alg,
+                          int                        num_threads,
+                          std::string               *serialized_package);
+
+#endif
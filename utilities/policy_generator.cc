@@ -23,12 +23,16 @@
 #include <nlohmann/json.hpp>
 #include <nlohmann/json-schema.hpp>
 
+#include "policy_builder.h"
+
 using namespace std;
 using nlohmann::json;
 using nlohmann::json_schema::json_validator;
+using namespace policy_spec;
 
 DEFINE_bool(debug, false, "verbose");
 DEFINE_bool(script, false, "Generate script instead of policy package");
+DEFINE_int32(num_threads, 0, "Threads signing claims, 0 for one per core");
 DEFINE_string(util_path, "", "Path to Certifier utilities");
 DEFINE_string(schema_input, "policy_schema.json", "Policy schema input file");
 DEFINE_string(policy_input, "policy.json", "Policy input file");
@@ -44,66 +48,6 @@ DEFINE_string(policy_output, "policy.bin", "Policy output file");
 #define MAKE_SIGNED_CLAIM_CMD    "make_signed_claim_from_vse_clause.exe"
 #define PACKAGE_CLAIM_CMD        "package_claims.exe"
 
-typedef struct property {
-  string comparator;
-  string type;
-  string name;
-  string value;
-} property;
-
-typedef enum subject_type {
-  KEY_SUBJECT,
-  CERT_SUBJECT,
-  MEASUREMENT_SUBJECT,
-  ENVIRONMENT_SUBJECT,
-  PLATFORM_SUBJECT,
-  NONE_SUBJECT,
-} subject_type;
-
-typedef enum object_type {
-  KEY_OBJECT,
-  MEASUREMENT_OBJECT,
-  ENVIRONMENT_OBJECT,
-  PLATFORM_OBJECT,
-  NONE_OBJECT,
-} object_type;
-
-typedef enum clause_type {
-  SIMPLE_CLAUSE,
-  UNARY_CLAUSE,
-  INDIRECT_CLAUSE,
-  NONE_CLAUSE,
-} clause_type;
-
-typedef struct clause {
-  string       sub;
-  subject_type stype;
-  string       verb;
-  string       obj;
-  object_type  otype;
-  clause_type  ctype;
-  /* For indirect clause only */
-  string       ssub;
-  subject_type sstype;
-  string       sobj;
-  object_type  sotype;
-  string       sverb;
-} clause;
-
-typedef struct claim {
-  string       sub;
-  subject_type stype;
-  string       verb;
-  clause_type  ctype;
-  clause       cl;
-  string       skey;
-} claim;
-
-typedef struct platform {
-  string           type;
-  vector<property> props;
-} platform;
-
 void print_claim(claim &c, const string prefix = "") {
   map<clause_type, string> cname = {
       {SIMPLE_CLAUSE, "simpleClause"},
@@ -148,6 +92,9 @@ void print_claim(claim &c, const string prefix = "") {
   }
 }
 
+// from_json must be found by argument-dependent lookup.
+namespace policy_spec {
+
 void from_json(const json &j, property &p) {
   map<string, string> cmap = {
       {"eq", "="},
@@ -270,6 +217,8 @@ void from_json(const json &j, claim &c) {
   }
 }
 
+}  // namespace policy_spec
+
 vector<platform> platforms;
 vector<string>   measurements;
 vector<claim>    claims;
@@ -323,7 +272,7 @@ static string make_property_cmd(string name,
                                 string value,
                                 string output) {
   return string_format("%s --property_name=%s --property_type=\'%s\' "
-                       "comparator=\"%s\" --%s_value=%s --output=%s",
+                       "--comparator=\"%s\" --%s_value=%s --output=%s",
                        (FLAGS_util_path + MAKE_PROPERTY_CMD).c_str(),
                        name.c_str(),
                        type.c_str(),
@@ -673,6 +622,39 @@ static bool generate_packaged_claims(vector<string> signed_claims,
   return true;
 }
 
+/*
+ * Builds the policy bundle in-process with the policy library calls the
+ * utilities use, writing only the output file.
+ */
+static bool build_policy(string           policyKey,
+                         vector<platform> platforms,
+                         vector<string>   measurements,
+                         vector<claim>    claims) {
+  policy_spec::policy pol;
+  string              package;
+
+  pol.policy_key = policyKey;
+  pol.platforms = platforms;
+  pol.measurements = measurements;
+  pol.claims = claims;
+  if (!build_policy_package(pol,
+                            9000,
+                            "rsa-2048-sha256-pkcs-sign",
+                            FLAGS_num_threads,
+                            &package)) {
+    return false;
+  }
+
+  ofstream out(FLAGS_policy_output, ios::binary | ios::trunc);
+  out.write(package.data(), package.size());
+  out.close();
+  if (!out.good()) {
+    cerr << "Can't write " << FLAGS_policy_output << endl;
+    return false;
+  }
+  return true;
+}
+
 /*
  * When script is set to true, a list of commands will be generated that can
  * be redirected to create a shell script which can be used later to generate
@@ -821,11 +803,12 @@ int main(int argc, char *argv[]) {
   }
 
   /* Policy generation */
-  if (!generate_policy(policyKey,
-                       platforms,
-                       measurements,
-                       claims,
-                       FLAGS_script)) {
+  if (FLAGS_script) {
+    if (!generate_policy(policyKey, platforms, measurements, claims, true)) {
+      cerr << "Policy generation failed!" << endl;
+      return EXIT_FAILURE;
+    }
+  } else if (!build_policy(policyKey, platforms, measurements, claims)) {
     cerr << "Policy generation failed!" << endl;
     return EXIT_FAILURE;
   }
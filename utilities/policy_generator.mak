@@ -19,11 +19,17 @@ endif
 
 S= $(SRC_DIR)
 CERT_SRC=$(CERTIFIER_ROOT)/src
+CP = $(CERTIFIER_ROOT)/certifier_service/certprotos
 O= $(OBJ_DIR)
 
+ifndef INC_DIR
+INC_DIR=$(CERTIFIER_ROOT)/include
+endif
+I= $(INC_DIR)
+
 JSON_VALIDATOR=/usr/local
 LOCAL_LIB=$(JSON_VALIDATOR)/lib
-INCLUDE= -I$(JSON_VALIDATOR)/include
+INCLUDE= -I$(JSON_VALIDATOR)/include -I$(INC_DIR) -I/usr/local/opt/openssl@1.1/include/ -I$(CERT_SRC)/sev-snp/
 
 
 # Newer versions of protobuf require C++17 and dependancies on additional libraries.
@@ -40,21 +46,63 @@ endif
 
 CC=g++
 LD=g++
+PROTO=protoc
 
 ifndef NEWPROTOBUF
-LDFLAGS= -L$(LOCAL_LIB) -lnlohmann_json_schema_validator -lgflags
+LDFLAGS= -L$(LOCAL_LIB) -lprotobuf -lnlohmann_json_schema_validator -lgflags -lpthread -L/usr/local/opt/openssl@1.1/lib/ -lcrypto -lssl
 else
-LDFLAGS= -L$(LOCAL_LIB) `pkg-config --cflags --libs protobuf` -lnlohmann_json_schema_validator -lgflags
+LDFLAGS= -L$(LOCAL_LIB) `pkg-config --cflags --libs protobuf` -lnlohmann_json_schema_validator -lgflags -lpthread -L/usr/local/opt/openssl@1.1/lib/ -lcrypto -lssl
 endif
 
+# The policy builder signs claims with the certifier library.
+common_objs = $(O)/support.o $(O)/certifier.o $(O)/certifier_proofs.o \
+              $(O)/certifier.pb.o $(O)/simulated_enclave.o \
+              $(O)/application_enclave.o
+
+policy_generator_obj = $(O)/policy_generator.o $(O)/policy_builder.o $(common_objs)
+
 all:	$(EXE_DIR)/policy_generator.exe
 
 clean:
-	rm -rf $(O)/policy_generator.o $(EXE_DIR)/policy_generator.exe
+	rm -rf $(policy_generator_obj) $(EXE_DIR)/policy_generator.exe
 
-$(EXE_DIR)/policy_generator.exe: $(EXE_DIR)/policy_generator.o
-	$(LD) -o $(EXE_DIR)/policy_generator.exe policy_generator.o $(LDFLAGS)
+$(EXE_DIR)/policy_generator.exe: $(policy_generator_obj)
+	$(LD) -o $(EXE_DIR)/policy_generator.exe $(policy_generator_obj) $(LDFLAGS)
+
+$(O)/policy_generator.o: $(S)/policy_generator.cc $(S)/policy_builder.h
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
+
+$(O)/policy_builder.o: $(S)/policy_builder.cc $(S)/policy_builder.h $(I)/certifier.pb.h $(I)/certifier.h
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
+
+# Generate certifier.pb.cc in src/ dir, using proto file from certprotos/
+$(I)/certifier.pb.h: $(CERT_SRC)/certifier.pb.cc
+$(CERT_SRC)/certifier.pb.cc: $(CP)/certifier.proto
+	$(PROTO) --proto_path=$(CP) --cpp_out=$(CERT_SRC) $<
+	mv $(CERT_SRC)/certifier.pb.h $(I)
+
+$(O)/certifier.pb.o: $(CERT_SRC)/certifier.pb.cc $(I)/certifier.pb.h
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -Wno-error -Warray-bounds -o $(@D)/$@ -c $<
+
+$(O)/support.o: $(CERT_SRC)/support.cc $(I)/support.h $(I)/certifier.pb.h
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
+
+$(O)/certifier.o: $(CERT_SRC)/certifier.cc $(I)/certifier.pb.h $(I)/certifier.h
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
+
+$(O)/certifier_proofs.o: $(CERT_SRC)/certifier_proofs.cc $(I)/certifier.pb.h $(I)/certifier.h
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
+
+$(O)/simulated_enclave.o: $(CERT_SRC)/simulated_enclave.cc $(I)/simulated_enclave.h
+	@echo "\ncompiling $<"
+	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<
 
-$(O)/policy_generator.o: $(S)/policy_generator.cc
+$(O)/application_enclave.o: $(CERT_SRC)/application_enclave.cc $(I)/application_enclave.h
 	@echo "\ncompiling $<"
 	$(CC) $(CFLAGS) -o $(@D)/$@ -c $<